@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Benchmarks run by the headless driver with --bench <name>. Each prints its
+// own table to stdout and returns the process exit code.
+struct BenchOptions {
+  uint32_t width;
+  uint32_t height;
+  uint32_t frames;
+  uint32_t warmup;
+  uint32_t draws;
+};
+
+// Resident and anonymous (heap) bytes of this process; mapped file pages are
+// resident but not anonymous, and the kernel can drop them under pressure
+std::pair<size_t, size_t> memory_usage();
+// Asks the kernel to drop the files from the page cache, so they are read from
+// disk again. Only a hint: dirty or locked pages stay.
+void evict_file_cache(const std::vector<std::string>& paths);
+// Calls to operator new since the process started, from any thread. Always 0
+// unless built with VRO_COUNT_ALLOCATIONS.
+uint64_t heap_allocations();
+
+struct SourceMesh;
+// A UV sphere with 'segments' slices and stacks, colored by position
+SourceMesh sphere_mesh(uint32_t segments);
+
+// Draw recording time against the number of recording threads
+int bench_record(const BenchOptions& options);
+// Job system dispatch overhead and parallel_for scaling
+int bench_jobs(const BenchOptions& options);
+// Input-to-GPU-completion latency against frames in flight and pacing mode
+int bench_latency(const BenchOptions& options);
+// CPU-recorded against GPU-culled indirect draws, 1k to 1M instances
+int bench_indirect(const BenchOptions& options);
+// Two-phase Hi-Z occlusion culling on and off, with and without occluders
+int bench_occlusion(const BenchOptions& options);
+// Render graph barriers, aliased transient memory and compile time against a hand-written frame
+int bench_graph(const BenchOptions& options);
+// Cost of a resize with dynamic rendering against render pass and framebuffer objects
+int bench_resize(const BenchOptions& options);
+// Time to the first frame and until every pipeline is compiled
+int bench_startup(const BenchOptions& options);
+// Load latency and peak memory of mapped files against heap copies, through to the GPU
+int bench_assets(const BenchOptions& options);
+// Loading a cooked mesh against parsing the OBJ it was cooked from
+int bench_mesh(const BenchOptions& options);
+// Triangles drawn and frame time with screen-space error LOD selection on and off
+int bench_lod(const BenchOptions& options);
+// Triangles, meshlets and frame time with meshlets culled in compute, in task shaders or not at all
+int bench_meshlets(const BenchOptions& options);
+// Resident texture memory, stream-in latency and budget pressure against the texture budget
+int bench_textures(const BenchOptions& options);
+// Heap allocations and arena use per frame in steady state, for each recording path
+int bench_frame_allocs(const BenchOptions& options);
+// Scene transform hierarchy update time, scalar against SIMD, across job thread counts
+int bench_transforms(const BenchOptions& options);
+// GPU allocator defragmentation plan over a fragmented pool, checked for disjoint ranges
+int bench_defrag(const BenchOptions& options);
+// Frame time with post-processing on the graphics queue against overlapped on an async compute queue
+int bench_async_compute(const BenchOptions& options);
+// Render thread frames and packet order while the main thread stalls its frame packets
+int bench_frame_packets(const BenchOptions& options);
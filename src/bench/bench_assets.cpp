@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+static constexpr uint32_t pack_files = 8;
+static constexpr size_t pack_file_size = 32 * 1024 * 1024;
+
+// What assets were loaded with before files were mapped: a heap copy of the whole file
+static std::optional<std::vector<uint8_t>> read_binary(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return std::nullopt;
+  }
+
+  fseek(file, 0, SEEK_END);
+  size_t len = ftell(file);
+  rewind(file);
+
+  std::vector<uint8_t> buf(len);
+  size_t read = fread(buf.data(), 1, len, file);
+
+  fclose(file);
+
+  if (read != len) {
+    return std::nullopt;
+  }
+
+  return buf;
+}
+
+// Loads a synthetic asset pack and streams it into a GPU buffer, holding every
+// file until its upload is done, as a level load would. Heap copies are read
+// and uploaded from a vector; mapped files are copied from the mapping into
+// staging. Eviction from the page cache is a hint, so cold runs may be warm.
+int bench_assets(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vro_asset_bench";
+  std::filesystem::create_directories(dir);
+
+  std::vector<std::string> paths;
+  std::vector<uint8_t> contents(pack_file_size);
+
+  for (auto i : Range<uint32_t>(pack_files)) {
+    for (auto j : Range<size_t>(contents.size())) {
+      contents[j] = (uint8_t)(i + j * 31);
+    }
+
+    paths.push_back((dir / std::format("pack{}.bin", i)).string());
+    if (!save_binary(paths.back().c_str(), contents.data(), contents.size())) {
+      printf("Failed to write '%s'\n", paths.back().c_str());
+      return 1;
+    }
+  }
+
+  contents = {};
+
+  VkDeviceSize total_size = (VkDeviceSize)pack_files * pack_file_size;
+  GpuBuffer target = r.gpu_allocator().create_buffer(total_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+
+  printf("%u files of %zu MB, loaded then uploaded; memory is the peak above the baseline\n", pack_files, pack_file_size / (1024 * 1024));
+  printf("%10s %6s %10s %12s %10s %10s\n", "method", "cache", "load ms", "uploaded ms", "RSS MB", "heap MB");
+
+  for (bool cold : { true, false }) {
+    for (bool mapped : { false, true }) {
+      if (cold) {
+        evict_file_cache(paths);
+      }
+
+      r.wait_idle();
+      auto [base_resident, base_anon] = memory_usage();
+      size_t peak_resident = 0, peak_anon = 0;
+
+      auto sample = [&]() {
+        auto [resident, anon] = memory_usage();
+        peak_resident = std::max(peak_resident, resident - std::min(resident, base_resident));
+        peak_anon = std::max(peak_anon, anon - std::min(anon, base_anon));
+      };
+
+      auto start = std::chrono::steady_clock::now();
+      UploadTicket last_ticket = 0;
+
+      {
+        std::vector<std::shared_ptr<const MappedFile>> files;
+        std::vector<std::vector<uint8_t>> copies;
+
+        for (auto& path : paths) {
+          if (mapped) {
+            std::optional<MappedFile> file = map_binary(path.c_str());
+            files.push_back(std::make_shared<const MappedFile>(std::move(*file)));
+          }
+          else {
+            copies.push_back(std::move(*read_binary(path.c_str())));
+          }
+        }
+
+        sample();
+        double load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        for (auto i : Range<uint32_t>(pack_files)) {
+          VkDeviceSize offset = (VkDeviceSize)i * pack_file_size;
+
+          if (mapped) {
+            last_ticket = r.uploader().upload_buffer(target.buffer, offset, files[i], 0, pack_file_size);
+          }
+          else {
+            last_ticket = r.uploader().upload_buffer(target.buffer, offset, std::move(copies[i]));
+          }
+        }
+
+        files.clear();
+        copies.clear();
+
+        while (!r.uploader().is_ready(last_ticket)) {
+          r.present();
+          sample();
+        }
+
+        double uploaded_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%10s %6s %10.1f %12.1f %10.1f %10.1f\n", mapped ? "mapped" : "heap copy", cold ? "cold" : "warm", load_ms, uploaded_ms,
+          peak_resident / (1024.0 * 1024.0), peak_anon / (1024.0 * 1024.0));
+      }
+    }
+  }
+
+  r.wait_idle();
+  r.gpu_allocator().destroy_buffer(target);
+  std::filesystem::remove_all(dir);
+
+  return 0;
+}
@@ -0,0 +1,79 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Frame time with bloom and tonemapping on the graphics queue after each
+// frame's scene, against on a compute queue alongside the next frame's. The
+// GPU-driven grid is drawn with occlusion culling, so graphics has work of its
+// own to overlap with. Draws sets the instance count.
+//
+// The queue family ownership transfers between graphics and compute are only
+// checked under validation: on Linux, where _DEBUG is never defined, run with
+// VK_INSTANCE_LAYERS=VK_LAYER_KHRONOS_validation and watch stderr.
+int bench_async_compute(const BenchOptions& options) {
+  uint32_t draws = options.draws ? options.draws : 100000;
+
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+
+  if (!r.set_gpu_driven(true)) {
+    printf("GPU-driven draws are not supported on this device\n");
+    return 1;
+  }
+
+  r.set_draw_count(draws);
+  r.set_occlusion_culling(true);
+
+  printf("%u instances at %ux%u, %u frames per run\n", draws, options.width, options.height, options.frames);
+  printf("%10s %12s %12s %10s\n", "post", "frame ms", "min ms", "fps");
+
+  double sync_ms = 0.0;
+
+  for (bool async : { false, true }) {
+    if (!r.set_async_compute(async)) {
+      printf("%10s %12s\n", "async", "unsupported");
+      continue;
+    }
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+      r.present();
+    }
+
+    r.wait_idle();
+
+    auto start = Clock::now();
+    auto last = start;
+    double min_ms = 1e30;
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+      r.present();
+
+      auto now = Clock::now();
+      min_ms = std::min(min_ms, std::chrono::duration<double, std::milli>(now - last).count());
+      last = now;
+    }
+
+    r.wait_idle();
+    double frame_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / options.frames;
+
+    printf("%10s %12.3f %12.3f %10.1f\n", async ? "async" : "graphics", frame_ms, min_ms, 1000.0 / frame_ms);
+
+    if (async) {
+      printf("overlap saves %.3f ms per frame (%.1f%%)\n", sync_ms - frame_ms, 100.0 * (sync_ms - frame_ms) / sync_ms);
+    }
+    else {
+      sync_ms = frame_ms;
+    }
+  }
+
+  r.set_async_compute(false);
+  r.wait_idle();
+
+  return 0;
+}
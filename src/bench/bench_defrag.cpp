@@ -0,0 +1,146 @@
+#include <chrono>
+#include <cstdio>
+#include <set>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+static bool overlaps(const GpuAllocation& a, const GpuAllocation& b) {
+  return a.memory == b.memory && a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+}
+
+static bool same_node(const GpuAllocation& a, const GpuAllocation& b) {
+  return a.pool == b.pool && a.block == b.block && a.node == b.node;
+}
+
+static uint32_t block_count(const std::vector<GpuAllocation>& allocations) {
+  std::set<VkDeviceMemory> blocks;
+  for (auto& a : allocations) {
+    blocks.insert(a.memory);
+  }
+
+  return (uint32_t)blocks.size();
+}
+
+// Fragments a pool by freeing three of every four allocations across several
+// blocks, then plans and applies a defragmentation. Only the allocator's
+// bookkeeping is exercised; no contents are copied. Fails if a destination
+// overlaps anything live, a move starts from a destination reserved earlier
+// in the same plan, or the ranges are not disjoint once applied.
+int bench_defrag(const BenchOptions&) {
+  constexpr uint32_t allocation_count = 256;
+  constexpr VkDeviceSize allocation_size = 1024 * 1024;
+
+  // An allocator of its own, so the renderer's resources are never planned into moves
+  Renderer r(64, 64);
+  GpuAllocator allocator(r.physical_device(), r.gpu_allocator().device(), false);
+
+  VkMemoryRequirements requirements = {
+    .size = allocation_size,
+    .alignment = 256,
+    .memoryTypeBits = ~0u,
+  };
+
+  std::vector<GpuAllocation> live;
+
+  for (auto i : Range<uint32_t>(allocation_count)) {
+    std::optional<GpuAllocation> allocation = allocator.allocate(requirements, GpuMemoryUsage::GpuOnly, GpuResourceKind::Buffer);
+    if (!allocation) {
+      fprintf(stderr, "Out of GPU memory after %u allocations\n", i);
+      return 1;
+    }
+
+    if (i % 4 == 0) {
+      live.push_back(*allocation);
+    }
+    else {
+      allocator.free(*allocation);
+    }
+  }
+
+  uint32_t blocks_before = block_count(live);
+
+  if (blocks_before < 2) {
+    fprintf(stderr, "The allocations fit in one block, so there is nothing to defragment\n");
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<GpuDefragMove> moves = allocator.plan_defragment(~0ull);
+  double plan_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  bool valid = true;
+  VkDeviceSize moved = 0;
+
+  for (auto i : Range<size_t>(moves.size())) {
+    const GpuDefragMove& move = moves[i];
+    moved += move.src.size;
+
+    if (move.dst.size < move.src.size) {
+      fprintf(stderr, "Move %zu: destination is smaller than its source\n", i);
+      valid = false;
+    }
+
+    for (auto& a : live) {
+      if (overlaps(move.dst, a)) {
+        fprintf(stderr, "Move %zu: destination overlaps a live allocation\n", i);
+        valid = false;
+      }
+    }
+
+    for (auto j : Range<size_t>(i)) {
+      if (overlaps(move.dst, moves[j].dst)) {
+        fprintf(stderr, "Moves %zu and %zu: destinations overlap\n", j, i);
+        valid = false;
+      }
+
+      if (same_node(move.src, moves[j].dst)) {
+        fprintf(stderr, "Move %zu: source is the destination of move %zu\n", i, j);
+        valid = false;
+      }
+    }
+  }
+
+  // What the caller does once the copies are done: rebind to the destination
+  for (auto& a : live) {
+    for (auto& move : moves) {
+      if (same_node(a, move.src)) {
+        a = move.dst;
+      }
+    }
+  }
+
+  allocator.finish_defragment(moves);
+
+  for (auto i : Range<size_t>(live.size())) {
+    for (auto j : Range<size_t>(i)) {
+      if (overlaps(live[i], live[j])) {
+        fprintf(stderr, "Allocations %zu and %zu overlap after defragmenting\n", j, i);
+        valid = false;
+      }
+    }
+  }
+
+  uint32_t blocks_after = block_count(live);
+
+  printf("%u live %llu KB allocations, 3 of every 4 freed\n", (uint32_t)live.size(), (unsigned long long)(allocation_size / 1024));
+  printf("%14s %8s %10s %14s %10s %10s\n", "blocks before", "moves", "moved MB", "blocks after", "plan ms", "disjoint");
+  printf("%14u %8zu %10.1f %14u %10.3f %10s\n", blocks_before, moves.size(), moved / (1024.0 * 1024.0), blocks_after, plan_ms, valid ? "yes" : "no");
+
+  for (auto& a : live) {
+    allocator.free(a);
+  }
+
+  if (!valid) {
+    return 1;
+  }
+
+  if (blocks_after >= blocks_before) {
+    fprintf(stderr, "Defragmenting left the allocations in as many blocks\n");
+    return 1;
+  }
+
+  return 0;
+}
@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+// Stands in for per-frame draw lists built on job threads: each piece sorts
+// its draws into a list in its thread's arena
+struct DrawEntry {
+  uint32_t draw;
+  uint32_t key;
+};
+
+static void build_draw_lists(Renderer& r, uint32_t draws) {
+  FrameArenas& arenas = r.frame_arenas();
+
+  r.jobs().parallel_for(Range<uint32_t>(draws), 1024u, [&](Range<uint32_t> range) {
+    ArenaVector<DrawEntry> list(arenas.local());
+    list.reserve(range.upper - range.lower);
+
+    for (auto i : range) {
+      list.push_back(DrawEntry { i, (i * 2654435761u) >> 16 });
+    }
+  });
+}
+
+// Counts operator new calls across steady-state frames, after warmup has
+// built the graph, pipelines and scene for each path, and fails if any path
+// makes one. Draws sets the draw count.
+//
+// Known exception: a frame that submits uploads allocates for its queued
+// requests and its batch's barrier lists. Nothing is uploaded once the scene
+// is resident, so the measured frames never reach that.
+#ifndef VRO_COUNT_ALLOCATIONS
+int bench_frame_allocs(const BenchOptions&) {
+  printf("Heap allocations are only counted when configured with -DVRO_COUNT_ALLOCATIONS=ON\n");
+  return 1;
+}
+#else
+int bench_frame_allocs(const BenchOptions& options) {
+  uint32_t draws = options.draws ? options.draws : 10000;
+
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+  r.set_draw_count(draws);
+
+  struct Path {
+    const char* name;
+    uint32_t record_slices;
+    bool gpu_driven;
+    bool occlusion;
+  };
+
+  std::vector<Path> paths = {
+    { "inline", 0, false, false },
+    { "parallel", r.jobs().thread_count(), false, false },
+    { "gpu driven", 0, true, false },
+    { "occlusion", 0, true, true },
+  };
+
+  printf("%u draws, %u frames per run, %u job threads\n", draws, options.frames, r.jobs().thread_count());
+  printf("%12s %12s %14s %14s %12s\n", "path", "heap allocs", "allocs/frame", "arena peak KB", "arena chunks");
+
+  bool valid = true;
+
+  for (auto& path : paths) {
+    r.set_record_slices(path.record_slices);
+
+    if (!r.set_gpu_driven(path.gpu_driven)) {
+      printf("%12s %12s\n", path.name, "unsupported");
+      continue;
+    }
+
+    r.set_occlusion_culling(path.occlusion);
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+      r.wait_for_frame();
+      build_draw_lists(r, draws);
+      r.present();
+    }
+
+    uint64_t chunks = r.frame_arenas().stats().chunk_allocations;
+    uint64_t allocations = heap_allocations();
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+      r.wait_for_frame();
+      build_draw_lists(r, draws);
+      r.present();
+    }
+
+    allocations = heap_allocations() - allocations;
+    ArenaStats arena = r.frame_arenas().stats();
+
+    printf("%12s %12llu %14.3f %14.1f %12llu\n", path.name, (unsigned long long)allocations, (double)allocations / options.frames,
+      arena.peak / 1024.0, (unsigned long long)(arena.chunk_allocations - chunks));
+
+    if (allocations) {
+      fprintf(stderr, "%s: %llu heap allocations in steady-state frames\n", path.name, (unsigned long long)allocations);
+      valid = false;
+    }
+  }
+
+  r.set_gpu_driven(false);
+  r.wait_idle();
+
+  return valid ? 0 : 1;
+}
+#endif
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+#include "bench.h"
+#include "engine/frame_packets.h"
+#include "engine/base.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ms(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+struct BenchPacket {
+  uint64_t sequence;
+};
+
+// The render thread against a main thread that stops publishing now and then,
+// as it does in the modal size loop. The consumer paces itself like a frame
+// loop and must keep making frames through each stall, taking packets in
+// order whenever there are some. CPU only; frames sets the consumer's frames.
+int bench_frame_packets(const BenchOptions& options) {
+  constexpr auto frame_time = std::chrono::milliseconds(4);
+  constexpr auto step_time = std::chrono::milliseconds(1);
+  constexpr auto stall_time = std::chrono::milliseconds(200);
+  constexpr uint64_t stall_interval = 250; // Packets between stalls
+
+  FramePackets<BenchPacket> packets;
+  std::atomic<bool> stalled = false;
+  std::atomic<uint32_t> stalls = 0;
+  std::atomic<bool> done = false;
+
+  std::thread producer([&] {
+    uint64_t sequence = 0;
+
+    while (!done.load(std::memory_order_relaxed)) {
+      BenchPacket* packet = packets.begin_write();
+      if (!packet) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      packet->sequence = sequence++;
+      packets.publish();
+      std::this_thread::sleep_for(step_time);
+
+      if (sequence % stall_interval == 0) {
+        stalled.store(true, std::memory_order_relaxed);
+        std::this_thread::sleep_for(stall_time);
+        stalled.store(false, std::memory_order_relaxed);
+        stalls.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  uint32_t with_packet = 0;
+  uint32_t during_stalls = 0;
+  bool in_order = true;
+  double max_gap_ms = 0.0;
+
+  auto start = Clock::now();
+  auto last = start;
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+    if (const BenchPacket* packet = packets.try_acquire()) {
+      in_order &= packet->sequence == expected++;
+      with_packet++;
+      packets.release();
+    }
+    else if (stalled.load(std::memory_order_relaxed)) {
+      during_stalls++;
+    }
+
+    std::this_thread::sleep_for(frame_time);
+
+    auto now = Clock::now();
+    max_gap_ms = std::max(max_gap_ms, elapsed_ms(last, now));
+    last = now;
+  }
+
+  double total_ms = elapsed_ms(start, Clock::now());
+
+  done.store(true, std::memory_order_relaxed);
+  producer.join();
+
+  printf("%u frames in %.1f ms, %u producer stalls of %lld ms every %llu packets\n", options.frames, total_ms,
+    stalls.load(), (long long)stall_time.count(), (unsigned long long)stall_interval);
+  printf("%14s %14s %14s %12s\n", "with packet", "during stalls", "max gap ms", "in order");
+  printf("%14u %14u %14.2f %12s\n", with_packet, during_stalls, max_gap_ms, in_order ? "yes" : "no");
+
+  if (!in_order) {
+    fprintf(stderr, "Packets were consumed out of order\n");
+    return 1;
+  }
+
+  if (stalls.load() && !during_stalls) {
+    fprintf(stderr, "No frames were made while the producer was stalled\n");
+    return 1;
+  }
+
+  return 0;
+}
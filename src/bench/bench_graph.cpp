@@ -0,0 +1,138 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/render_graph.h"
+#include "engine/base.h"
+
+static constexpr uint32_t bloom_levels = 4;
+// Images the surviving passes write: G-buffer, AO, HDR, the bloom chain and the backbuffer
+static constexpr uint32_t written_images = 7 + bloom_levels;
+
+// A deferred frame: G-buffer, SSAO, lighting, a bloom chain and tonemapping
+// into the backbuffer, plus a debug view nothing reads. Passes record nothing,
+// since only compilation is measured. Returns the number of image uses, which
+// is how many barriers a hand-written frame issuing one per use would record.
+static uint32_t declare_deferred_frame(RenderGraph& graph, uint32_t width, uint32_t height) {
+  auto target = [&](const char* name, VkFormat format, uint32_t divisor) {
+    VkImageUsageFlags usage = format == VK_FORMAT_D32_SFLOAT ? VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+
+    return graph.create_image(name, RgImageDesc {
+      .format = format,
+      .width = std::max(width / divisor, 1u),
+      .height = std::max(height / divisor, 1u),
+      .usage = usage | VK_IMAGE_USAGE_SAMPLED_BIT,
+    });
+  };
+
+  RgImage backbuffer = graph.import_image("backbuffer", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+    .final = RgState { VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+  });
+
+  RgImage albedo = target("albedo", VK_FORMAT_R8G8B8A8_UNORM, 1);
+  RgImage normal = target("normal", VK_FORMAT_R16G16B16A16_SFLOAT, 1);
+  RgImage depth = target("depth", VK_FORMAT_D32_SFLOAT, 1);
+  RgImage ao = target("ao", VK_FORMAT_R8_UNORM, 1);
+  RgImage hdr = target("hdr", VK_FORMAT_R16G16B16A16_SFLOAT, 1);
+  RgImage bloom_up = target("bloom up", VK_FORMAT_R16G16B16A16_SFLOAT, 2);
+  RgImage debug = target("debug", VK_FORMAT_R8G8B8A8_UNORM, 1);
+
+  RgImage bloom[bloom_levels];
+  for (auto i : Range<uint32_t>(bloom_levels)) {
+    bloom[i] = target("bloom", VK_FORMAT_R16G16B16A16_SFLOAT, 2u << i);
+  }
+
+  auto nothing = [](VkCommandBuffer) {};
+  uint32_t uses = 0;
+
+  auto pass = [&](const char* name, std::vector<RgUse> pass_uses) {
+    uses += (uint32_t)pass_uses.size();
+    graph.add_pass(name, std::move(pass_uses), nothing);
+  };
+
+  pass("gbuffer", { { albedo, RgUsage::ColorAttachment }, { normal, RgUsage::ColorAttachment }, { depth, RgUsage::DepthAttachment } });
+  pass("ssao", { { depth, RgUsage::FragmentRead }, { normal, RgUsage::FragmentRead }, { ao, RgUsage::ColorAttachment } });
+  pass("lighting", { { albedo, RgUsage::FragmentRead }, { normal, RgUsage::FragmentRead }, { depth, RgUsage::FragmentRead }, { ao, RgUsage::FragmentRead }, { hdr, RgUsage::ColorAttachment } });
+
+  for (auto i : Range<uint32_t>(bloom_levels)) {
+    pass("bloom down", { { i ? bloom[i - 1] : hdr, RgUsage::FragmentRead }, { bloom[i], RgUsage::ColorAttachment } });
+  }
+
+  std::vector<RgUse> up_uses = { { bloom_up, RgUsage::ColorAttachment } };
+  for (auto i : Range<uint32_t>(bloom_levels)) {
+    up_uses.push_back({ bloom[i], RgUsage::FragmentRead });
+  }
+
+  pass("bloom up", up_uses);
+  pass("tonemap", { { hdr, RgUsage::FragmentRead }, { bloom_up, RgUsage::FragmentRead }, { backbuffer, RgUsage::ColorAttachment } });
+  pass("debug view", { { normal, RgUsage::FragmentRead }, { debug, RgUsage::ColorAttachment } });
+
+  // The backbuffer's final transition
+  return uses + 1;
+}
+
+int bench_graph(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+
+  // Never executed, so barriers don't need to be recordable
+  RenderGraph graph(r.gpu_allocator().device(), r.gpu_allocator(), nullptr);
+
+  uint32_t iterations = std::max(options.frames / 10, 1u);
+
+  printf("Deferred frame with %u bloom levels and an unused debug view; compile time averaged over %u builds\n", bloom_levels, iterations);
+  printf("Hand-written: one barrier call per image use, every target in its own memory\n");
+  printf("%12s %14s %8s %8s %10s %10s %14s %12s\n", "resolution", "", "passes", "culled", "barriers", "calls", "transient MB", "compile ms");
+
+  std::vector<std::pair<uint32_t, uint32_t>> resolutions = { { 1280, 720 }, { 1920, 1080 }, { 3840, 2160 } };
+  bool valid = true;
+
+  for (auto [width, height] : resolutions) {
+    RenderGraphStats stats = {};
+    uint32_t uses = 0;
+    double compile_ms = 0.0;
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(iterations)) {
+      graph.destroy(graph.reset());
+      uses = declare_deferred_frame(graph, width, height);
+
+      auto start = std::chrono::steady_clock::now();
+      stats = graph.compile();
+      compile_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t declared = stats.passes + stats.culled_passes;
+    char resolution[32];
+    snprintf(resolution, sizeof(resolution), "%ux%u", width, height);
+
+    printf("%12s %14s %8u %8u %10u %10u %14.1f %12s\n", resolution, "hand-written", declared, 0u, uses, uses,
+      stats.transient_bytes_unaliased / (1024.0 * 1024.0), "-");
+    printf("%12s %14s %8u %8u %10u %10u %14.1f %12.3f\n", "", "graph", stats.passes, stats.culled_passes, stats.barriers, stats.barrier_batches,
+      stats.transient_bytes / (1024.0 * 1024.0), compile_ms / iterations);
+
+    // Only the debug view is culled. Every written image needs at least its
+    // first transition, plus the backbuffer's final one, and no use needs
+    // more than one barrier.
+    if (stats.culled_passes != 1) {
+      fprintf(stderr, "%s: expected only the debug view to be culled\n", resolution);
+      valid = false;
+    }
+
+    if (stats.barriers < written_images + 1 || stats.barriers > uses || stats.barrier_batches > stats.passes + 1) {
+      fprintf(stderr, "%s: %u barriers in %u calls, expected %u to %u in at most %u\n", resolution, stats.barriers, stats.barrier_batches,
+        written_images + 1, uses, stats.passes + 1);
+      valid = false;
+    }
+
+    if (stats.transient_bytes > stats.transient_bytes_unaliased) {
+      fprintf(stderr, "%s: aliased transients take more memory than unaliased\n", resolution);
+      valid = false;
+    }
+  }
+
+  graph.destroy(graph.reset());
+  return valid ? 0 : 1;
+}
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+// CPU-recorded draws past this count take too long per frame to be worth timing
+static constexpr uint32_t max_cpu_draws = 100000;
+
+int bench_indirect(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+
+  if (!r.set_gpu_driven(true)) {
+    printf("GPU-driven draws are not supported on this device\n");
+    return 1;
+  }
+
+  std::vector<uint32_t> instance_counts = { 1000, 10000, 100000, 1000000 };
+  if (options.draws) {
+    instance_counts = { options.draws };
+  }
+
+  printf("%u frames per run; zoom 4 leaves about 1/16 of the grid in view\n", options.frames);
+  printf("%10s %8s %6s %12s %12s %10s\n", "instances", "path", "zoom", "record ms", "frame ms", "visible");
+
+  for (uint32_t count : instance_counts) {
+    for (bool gpu_driven : { false, true }) {
+      if (!gpu_driven && count > max_cpu_draws) {
+        continue;
+      }
+
+      for (float zoom : { 1.0f, 4.0f }) {
+        r.set_gpu_driven(gpu_driven);
+        r.set_draw_count(count);
+        r.set_camera(0.0f, 0.0f, zoom);
+
+        // Warmup also covers the instance upload, which may take several frames
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+          r.present();
+        }
+
+        r.wait_idle();
+
+        double record_ms = 0.0;
+        auto start = std::chrono::steady_clock::now();
+
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+          r.present();
+          record_ms += r.record_time_ms();
+        }
+
+        r.wait_idle();
+        double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.frames;
+
+        printf("%10u %8s %6.0f %12.4f %12.3f %10s\n", count, gpu_driven ? "indirect" : "cpu", zoom, record_ms / options.frames, frame_ms,
+          gpu_driven ? std::to_string(r.visible_instances()).c_str() : "-");
+      }
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "engine/jobs.h"
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_ns(Clock::time_point start) {
+  return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static void empty_job(const Job&) {
+}
+
+int bench_jobs(const BenchOptions&) {
+  constexpr uint32_t round_trips = 100000;
+  constexpr uint32_t batch_size = 4096;
+  constexpr uint32_t batch_count = 256;
+  constexpr uint32_t element_count = 1 << 24;
+  constexpr uint32_t grain = 16384;
+
+  std::vector<uint32_t> thread_counts = { 1 };
+  uint32_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  for (uint32_t count = 2; count <= max_threads; count *= 2) {
+    thread_counts.push_back(count);
+  }
+
+  if (thread_counts.back() != max_threads) {
+    thread_counts.push_back(max_threads);
+  }
+
+  std::vector<float> values(element_count);
+  for (auto i : Range<uint32_t>(element_count)) {
+    values[i] = (float)i;
+  }
+
+  std::vector<double> partial_sums(element_count / grain);
+
+  auto sum_range = [&](Range<uint32_t> range) {
+    double sum = 0.0;
+    for (auto i : range) {
+      sum += std::sqrt(values[i]);
+    }
+    partial_sums[range.lower / grain] = sum;
+  };
+
+  auto total = [&] {
+    double sum = 0.0;
+    for (double partial : partial_sums) {
+      sum += partial;
+    }
+    return sum;
+  };
+
+  // Serial baseline runs the same chunks in order
+  auto serial_start = Clock::now();
+  for (auto i : Range<uint32_t>(element_count / grain)) {
+    sum_range(Range<uint32_t>(i * grain, (i + 1) * grain));
+  }
+  double serial_ms = elapsed_ns(serial_start) / 1e6;
+  double serial_sum = total();
+
+  printf("round trip: submit + wait of one empty job\n");
+  printf("batch: %u empty jobs per submit, ns per job\n", batch_size);
+  printf("parallel_for: sqrt sum over %u floats, serial %.3f ms\n", element_count, serial_ms);
+  printf("%8s %14s %12s %16s %10s\n", "threads", "round trip ns", "batch ns", "parallel_for ms", "speedup");
+
+  std::vector<Job> batch(batch_size);
+
+  for (uint32_t threads : thread_counts) {
+    JobSystem jobs(threads);
+
+    auto round_trip_start = Clock::now();
+    for ([[maybe_unused]] auto i : Range<uint32_t>(round_trips)) {
+      Job job = { .function = empty_job };
+      JobCounter counter;
+      jobs.submit(&job, 1, counter);
+      jobs.wait(counter);
+    }
+    double round_trip_ns = elapsed_ns(round_trip_start) / round_trips;
+
+    auto batch_start = Clock::now();
+    for ([[maybe_unused]] auto i : Range<uint32_t>(batch_count)) {
+      for (auto& job : batch) {
+        job = { .function = empty_job };
+      }
+
+      JobCounter counter;
+      jobs.submit(batch.data(), batch_size, counter);
+      jobs.wait(counter);
+    }
+    double batch_ns = elapsed_ns(batch_start) / ((double)batch_count * batch_size);
+
+    std::fill(partial_sums.begin(), partial_sums.end(), 0.0);
+
+    auto for_start = Clock::now();
+    jobs.parallel_for(Range<uint32_t>(element_count), grain, sum_range);
+    double for_ms = elapsed_ns(for_start) / 1e6;
+
+    double sum = total();
+
+    if (std::abs(sum - serial_sum) > serial_sum * 1e-9) {
+      fprintf(stderr, "parallel_for result mismatch: %f != %f\n", sum, serial_sum);
+      return 1;
+    }
+
+    printf("%8u %14.1f %12.1f %16.3f %9.2fx\n", threads, round_trip_ns, batch_ns, for_ms, serial_ms / for_ms);
+  }
+
+  return 0;
+}
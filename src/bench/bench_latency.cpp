@@ -0,0 +1,62 @@
+#include <chrono>
+#include <cstdio>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+// Headless there is no display, so latency runs from input sampling to GPU
+// completion and the present mode doesn't apply; windowed builds report
+// latency to the display through Renderer::latency_stats().
+int bench_latency(const BenchOptions& options) {
+  uint32_t draws = options.draws ? options.draws : 20000;
+
+  printf("%u draws, %u frames per run\n", draws, options.frames);
+  bool valid = true;
+  printf("%8s %12s %12s %12s %12s %12s\n", "frames", "pacing", "latency ms", "min ms", "max ms", "frames/s");
+
+  for (auto frames_in_flight : Range<uint32_t>(1, 4)) {
+    for (bool low_latency : { false, true }) {
+      FramePacing pacing = {
+        .frames_in_flight = frames_in_flight,
+        .low_latency = low_latency,
+      };
+
+      Renderer r(options.width, options.height, pacing);
+      r.wait_for_pipelines();
+      r.set_draw_count(draws);
+
+      for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+        r.wait_for_frame();
+        r.present();
+      }
+
+      r.wait_idle();
+      r.reset_latency_stats();
+
+      auto start = std::chrono::steady_clock::now();
+
+      for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+        r.wait_for_frame();
+        r.present();
+      }
+
+      r.wait_idle();
+      double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      // Picks up the frames that finished during wait_idle()
+      r.wait_for_frame();
+
+      LatencyStats stats = r.latency_stats();
+      printf("%8u %12s %12.3f %12.3f %12.3f %12.1f\n", frames_in_flight, low_latency ? "low latency" : "default", stats.avg_ms, stats.min_ms, stats.max_ms, options.frames * 1000.0 / total_ms);
+
+      // Every sample is from a frame presented in this run, and at least one completed
+      if (!stats.samples || stats.samples > options.frames || stats.min_ms <= 0.0 || stats.min_ms > stats.avg_ms || stats.avg_ms > stats.max_ms) {
+        fprintf(stderr, "%u frames in flight: inconsistent latency stats, %u samples\n", frames_in_flight, stats.samples);
+        valid = false;
+      }
+    }
+  }
+
+  return valid ? 0 : 1;
+}
@@ -0,0 +1,97 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+#include "tools/mesh_cooker/cook.h"
+
+// Runs with the finest LOD everywhere past this many triangles a frame take
+// too long to be worth timing
+static constexpr uint64_t max_full_detail_triangles = 500000000;
+
+// A grid of dense spheres, drawn through the GPU-driven path at the finest LOD
+// (threshold 0) and with each instance's LOD picked by the cull pass for at
+// most one pixel of error. Zooming in makes instances larger on screen, so
+// finer LODs are picked. Draws sets the instance count.
+int bench_lod(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+
+  if (!r.set_gpu_driven(true)) {
+    printf("GPU-driven draws are not supported on this device\n");
+    return 1;
+  }
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vro_lod_bench";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "sphere.vmesh").string();
+
+  CookedMesh cooked = cook_mesh(sphere_mesh(256));
+  if (!write_cooked_mesh(path.c_str(), cooked) || !r.set_mesh(path.c_str())) {
+    printf("Failed to cook '%s'\n", path.c_str());
+    return 1;
+  }
+
+  printf("%u triangle sphere in %u LODs:", cooked.lods[0].index_count / 3, cooked.header.lod_count);
+  for (auto& lod : cooked.lods) {
+    printf(" %u", lod.index_count / 3);
+  }
+
+  printf("\n%u frames per run\n", options.frames);
+  printf("%10s %6s %6s %12s %10s  %s\n", "instances", "zoom", "px", "triangles", "frame ms", "draws per LOD");
+
+  std::vector<uint32_t> instance_counts = { 1000, 10000, 100000 };
+  if (options.draws) {
+    instance_counts = { options.draws };
+  }
+
+  for (uint32_t count : instance_counts) {
+    for (float zoom : { 1.0f, 8.0f }) {
+      for (float threshold : { 0.0f, 1.0f }) {
+        if (!threshold && (uint64_t)count * (cooked.lods[0].index_count / 3) > max_full_detail_triangles) {
+          continue;
+        }
+
+        r.set_draw_count(count);
+        r.set_camera(0.0f, 0.0f, zoom);
+        r.set_lod_threshold(threshold);
+
+        // Warmup also covers the mesh and instance uploads
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+          r.present();
+        }
+
+        r.wait_idle();
+        auto start = std::chrono::steady_clock::now();
+
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+          r.present();
+        }
+
+        r.wait_idle();
+        double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.frames;
+
+        CullStats stats = r.cull_stats();
+        std::string lods;
+
+        for (auto i : Range<uint32_t>(cooked.header.lod_count)) {
+          if (stats.lod_draws[i]) {
+            lods += std::format(" {}:{}", i, stats.lod_draws[i]);
+          }
+        }
+
+        printf("%10u %6.0f %6.0f %12u %10.3f %s\n", count, zoom, threshold, stats.triangles, frame_ms, lods.c_str());
+      }
+    }
+  }
+
+  r.set_mesh(nullptr);
+  r.wait_idle();
+  std::filesystem::remove_all(dir);
+
+  return 0;
+}
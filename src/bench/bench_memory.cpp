@@ -0,0 +1,74 @@
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "bench.h"
+
+#ifdef VRO_COUNT_ALLOCATIONS
+static std::atomic<uint64_t> g_heap_allocations = 0;
+
+// Every operator new in the process comes through these, STL containers
+// included. C allocations (drivers, the arenas' own chunks) are not counted.
+static void* counted_allocate(size_t size, size_t alignment) {
+  g_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  size = size ? size : 1;
+  void* p = alignment > alignof(std::max_align_t) ? aligned_alloc(alignment, (size + alignment - 1) & ~(alignment - 1)) : malloc(size);
+
+  if (!p) {
+    throw std::bad_alloc();
+  }
+
+  return p;
+}
+
+void* operator new(size_t size) { return counted_allocate(size, 0); }
+void* operator new[](size_t size) { return counted_allocate(size, 0); }
+void* operator new(size_t size, std::align_val_t alignment) { return counted_allocate(size, (size_t)alignment); }
+void* operator new[](size_t size, std::align_val_t alignment) { return counted_allocate(size, (size_t)alignment); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { free(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { free(p); }
+
+uint64_t heap_allocations() {
+  return g_heap_allocations.load(std::memory_order_relaxed);
+}
+#else
+uint64_t heap_allocations() {
+  return 0;
+}
+#endif
+
+std::pair<size_t, size_t> memory_usage() {
+  size_t size = 0, resident = 0, shared = 0;
+
+  if (FILE* file = fopen("/proc/self/statm", "r")) {
+    if (fscanf(file, "%zu %zu %zu", &size, &resident, &shared) != 3) {
+      resident = shared = 0;
+    }
+
+    fclose(file);
+  }
+
+  size_t page = (size_t)sysconf(_SC_PAGESIZE);
+  return { resident * page, (resident - shared) * page };
+}
+
+void evict_file_cache(const std::vector<std::string>& paths) {
+  for (auto& path : paths) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+      close(fd);
+    }
+  }
+}
@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/mesh.h"
+#include "engine/base.h"
+#include "tools/mesh_cooker/cook.h"
+
+SourceMesh sphere_mesh(uint32_t segments) {
+  SourceMesh mesh;
+  const float pi = 3.14159265f;
+
+  for (auto stack : Range<uint32_t>(segments + 1)) {
+    float theta = pi * (float)stack / (float)segments;
+
+    for (auto slice : Range<uint32_t>(segments + 1)) {
+      float phi = 2.0f * pi * (float)slice / (float)segments;
+      float p[3] = { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+
+      mesh.positions.insert(mesh.positions.end(), p, p + 3);
+
+      auto unorm = [](float v) { return (uint32_t)std::lround((v * 0.5f + 0.5f) * 255.0f); };
+      mesh.colors.push_back(unorm(p[0]) | unorm(p[1]) << 8 | unorm(p[2]) << 16 | 255u << 24);
+    }
+  }
+
+  uint32_t row = segments + 1;
+
+  for (auto stack : Range<uint32_t>(segments)) {
+    for (auto slice : Range<uint32_t>(segments)) {
+      uint32_t a = stack * row + slice;
+      uint32_t b = a + row;
+      uint32_t quad[] = { a, b, a + 1, a + 1, b, b + 1 };
+      mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+    }
+  }
+
+  return mesh;
+}
+
+// As OBJ text, the way a DCC export would be
+static bool write_obj(const char* path, const SourceMesh& mesh) {
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+
+  for (auto v : Range<size_t>(mesh.positions.size() / 3)) {
+    const float* p = &mesh.positions[v * 3];
+    uint32_t color = mesh.colors[v];
+
+    fprintf(file, "v %f %f %f %f %f %f\n", p[0], p[1], p[2],
+      (color & 0xff) / 255.0f, (color >> 8 & 0xff) / 255.0f, (color >> 16 & 0xff) / 255.0f);
+  }
+
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    fprintf(file, "f %u %u %u\n", mesh.indices[i] + 1, mesh.indices[i + 1] + 1, mesh.indices[i + 2] + 1);
+  }
+
+  return fclose(file) == 0;
+}
+
+// Loads the same sphere from OBJ text and from its cooked file, through to the
+// GPU. The OBJ is parsed into float positions and 32-bit indices and uploaded
+// from the heap, as meshes were before cooking; the cooked file is mapped and
+// its chunks uploaded from the mapping. Draws sets the sphere's segments.
+int bench_mesh(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+
+  // About 1M triangles by default
+  uint32_t segments = options.draws ? std::max(options.draws, 16u) : 700;
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vro_mesh_bench";
+  std::filesystem::create_directories(dir);
+
+  std::string obj_path = (dir / "sphere.obj").string();
+  std::string cooked_path = (dir / "sphere.vmesh").string();
+
+  if (!write_obj(obj_path.c_str(), sphere_mesh(segments))) {
+    printf("Failed to write '%s'\n", obj_path.c_str());
+    return 1;
+  }
+
+  {
+    auto start = std::chrono::steady_clock::now();
+
+    std::optional<SourceMesh> source = load_obj(obj_path.c_str());
+    if (!source) {
+      printf("Failed to read '%s'\n", obj_path.c_str());
+      return 1;
+    }
+
+    CookedMesh cooked = cook_mesh(*source);
+    if (!write_cooked_mesh(cooked_path.c_str(), cooked)) {
+      printf("Failed to write '%s'\n", cooked_path.c_str());
+      return 1;
+    }
+
+    double cook_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("%u triangles cooked into %zu LODs and %zu meshlets in %.1f ms\n", cooked.header.index_count / 3,
+      cooked.lods.size(), cooked.meshlets.size(), cook_ms);
+  }
+
+  MeshLoader loader(r.gpu_allocator(), r.uploader(), r.bindless());
+
+  std::vector<std::string> paths = { obj_path, cooked_path };
+
+  printf("memory is the peak above the baseline\n");
+  printf("%8s %6s %8s %10s %12s %10s %10s\n", "format", "cache", "file MB", "load ms", "uploaded ms", "RSS MB", "heap MB");
+
+  for (bool cold : { true, false }) {
+    for (bool cooked : { false, true }) {
+      if (cold) {
+        evict_file_cache(paths);
+      }
+
+      r.wait_idle();
+      auto [base_resident, base_anon] = memory_usage();
+      size_t peak_resident = 0, peak_anon = 0;
+
+      auto sample = [&]() {
+        auto [resident, anon] = memory_usage();
+        peak_resident = std::max(peak_resident, resident - std::min(resident, base_resident));
+        peak_anon = std::max(peak_anon, anon - std::min(anon, base_anon));
+      };
+
+      const std::string& path = cooked ? cooked_path : obj_path;
+      double file_mb = std::filesystem::file_size(path) / (1024.0 * 1024.0);
+
+      auto start = std::chrono::steady_clock::now();
+      double load_ms = 0.0;
+
+      if (cooked) {
+        std::optional<GpuMesh> mesh = loader.load(path.c_str());
+        if (!mesh) {
+          return 1;
+        }
+
+        sample();
+        load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        while (!loader.is_ready(*mesh)) {
+          r.present();
+          sample();
+        }
+
+        r.wait_idle();
+        loader.destroy(*mesh);
+      }
+      else {
+        GpuBuffer buffers[3] = {};
+        UploadTicket last_ticket = 0;
+
+        {
+          std::optional<SourceMesh> source = load_obj(path.c_str());
+          if (!source) {
+            return 1;
+          }
+
+          sample();
+          load_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+          VkDeviceSize sizes[3] = {
+            source->positions.size() * sizeof(float),
+            source->colors.size() * sizeof(uint32_t),
+            source->indices.size() * sizeof(uint32_t),
+          };
+
+          for (auto i : Range<uint32_t>(3)) {
+            VkBufferUsageFlags usage = i == 2 ? VK_BUFFER_USAGE_INDEX_BUFFER_BIT : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+            buffers[i] = r.gpu_allocator().create_buffer(sizes[i], usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+          }
+
+          r.uploader().upload_buffer(buffers[0].buffer, 0, source->positions.data(), sizes[0]);
+          r.uploader().upload_buffer(buffers[1].buffer, 0, source->colors.data(), sizes[1]);
+          last_ticket = r.uploader().upload_buffer(buffers[2].buffer, 0, source->indices.data(), sizes[2]);
+
+          sample();
+        }
+
+        while (!r.uploader().is_ready(last_ticket)) {
+          r.present();
+          sample();
+        }
+
+        r.wait_idle();
+        for (auto& buffer : buffers) {
+          r.gpu_allocator().destroy_buffer(buffer);
+        }
+      }
+
+      double uploaded_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+      printf("%8s %6s %8.1f %10.1f %12.1f %10.1f %10.1f\n", cooked ? "cooked" : "obj", cold ? "cold" : "warm", file_mb, load_ms, uploaded_ms,
+        peak_resident / (1024.0 * 1024.0), peak_anon / (1024.0 * 1024.0));
+    }
+  }
+
+  std::filesystem::remove_all(dir);
+
+  return 0;
+}
@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+#include "tools/mesh_cooker/cook.h"
+
+static const char* path_name(MeshletPath path) {
+  switch (path) {
+    case MeshletPath::None:
+      return "none";
+    case MeshletPath::Compute:
+      return "compute";
+    case MeshletPath::MeshShader:
+      return "mesh";
+  }
+
+  return "";
+}
+
+// A grid of dense spheres behind a row of occluders, drawn with two-phase
+// occlusion culling and each meshlet path the device supports. Instance
+// culling alone draws every triangle of a visible sphere, back faces included;
+// meshlets facing away, outside the view or hidden are dropped before any of
+// their vertices are shaded. Draws sets the instance count.
+int bench_meshlets(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+
+  if (!r.set_gpu_driven(true)) {
+    printf("GPU-driven draws are not supported on this device\n");
+    return 1;
+  }
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vro_meshlet_bench";
+  std::filesystem::create_directories(dir);
+  std::string path = (dir / "sphere.vmesh").string();
+
+  CookedMesh cooked = cook_mesh(sphere_mesh(128));
+  if (!write_cooked_mesh(path.c_str(), cooked) || !r.set_mesh(path.c_str())) {
+    printf("Failed to cook '%s'\n", path.c_str());
+    return 1;
+  }
+
+  uint32_t cone_culled = 0;
+  for (auto& bounds : cooked.meshlet_bounds) {
+    cone_culled += bounds.cone_axis[2] > bounds.cone_cutoff;
+  }
+
+  printf("%u triangle sphere in %u meshlets at LOD 0, %zu in all; %u of those face away\n",
+    cooked.lods[0].index_count / 3, cooked.lods[0].meshlet_count, cooked.meshlets.size(), cone_culled);
+  printf("%u frames per run, LOD threshold 1 px\n", options.frames);
+  printf("%10s %6s %8s %12s %10s %10s %10s\n", "instances", "zoom", "path", "triangles", "meshlets", "culled", "frame ms");
+
+  std::vector<uint32_t> instance_counts = { 1000, 10000 };
+  if (options.draws) {
+    instance_counts = { options.draws };
+  }
+
+  r.set_occlusion_culling(true);
+  r.set_occluder_count(4);
+  r.set_lod_threshold(1.0f);
+
+  for (uint32_t count : instance_counts) {
+    for (float zoom : { 1.0f, 8.0f }) {
+      for (MeshletPath meshlet_path : { MeshletPath::None, MeshletPath::Compute, MeshletPath::MeshShader }) {
+        if (!r.set_meshlet_path(meshlet_path)) {
+          printf("%10u %6.0f %8s %12s\n", count, zoom, path_name(meshlet_path), "unsupported");
+          continue;
+        }
+
+        r.set_draw_count(count);
+        r.set_camera(0.0f, 0.0f, zoom);
+
+        // Warmup also covers the mesh and instance uploads, and lets the
+        // delayed statistics catch up with the path
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+          r.present();
+        }
+
+        r.wait_idle();
+        auto start = std::chrono::steady_clock::now();
+
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+          r.present();
+        }
+
+        r.wait_idle();
+        double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.frames;
+
+        CullStats stats = r.cull_stats();
+        uint32_t meshlets = stats.meshlet_draws[0] + stats.meshlet_draws[1];
+
+        printf("%10u %6.0f %8s %12u %10u %10u %10.3f\n", count, zoom, path_name(meshlet_path), stats.triangles, meshlets, stats.meshlets_culled, frame_ms);
+      }
+    }
+  }
+
+  r.set_mesh(nullptr);
+  r.wait_idle();
+  std::filesystem::remove_all(dir);
+
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+int bench_occlusion(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+
+  if (!r.set_gpu_driven(true)) {
+    printf("GPU-driven draws are not supported on this device\n");
+    return 1;
+  }
+
+  std::vector<uint32_t> instance_counts = { 10000, 100000, 1000000 };
+  if (options.draws) {
+    instance_counts = { options.draws };
+  }
+
+  printf("%u frames per run; occluders are drawn in front of the grid and counted as instances\n", options.frames);
+  printf("%10s %10s %10s %12s %10s %10s %10s %10s\n", "instances", "occluders", "occlusion", "frame ms", "early", "late", "occluded", "frustum");
+
+  for (uint32_t count : instance_counts) {
+    for (uint32_t occluders : { 0u, 4u, 16u }) {
+      for (bool occlusion : { false, true }) {
+        r.set_draw_count(count);
+        r.set_occluder_count(occluders);
+        r.set_occlusion_culling(occlusion);
+
+        // Warmup covers the instance upload and lets visibility settle
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+          r.present();
+        }
+
+        r.wait_idle();
+
+        auto start = std::chrono::steady_clock::now();
+
+        for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+          r.present();
+        }
+
+        r.wait_idle();
+        double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.frames;
+
+        CullStats stats = r.cull_stats();
+        printf("%10u %10u %10s %12.3f %10u %10u %10u %10u\n", count, occluders, occlusion ? "on" : "off", frame_ms,
+          stats.early_draws, stats.late_draws, stats.occluded, stats.frustum_culled);
+      }
+    }
+  }
+
+  return 0;
+}
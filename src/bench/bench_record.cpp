@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+int bench_record(const BenchOptions& options) {
+  uint32_t draws = options.draws ? options.draws : 20000;
+
+  Renderer r(options.width, options.height);
+  r.wait_for_pipelines();
+  r.set_draw_count(draws);
+
+  // 0 is the inline path on the main thread. Other counts split the draws into
+  // that many secondaries, so at most that many threads record at once.
+  std::vector<uint32_t> slice_counts = { 0, 1 };
+  uint32_t max_threads = r.jobs().thread_count();
+
+  for (uint32_t count = 2; count <= max_threads; count *= 2) {
+    slice_counts.push_back(count);
+  }
+
+  if (slice_counts.back() != max_threads && max_threads > 1) {
+    slice_counts.push_back(max_threads);
+  }
+
+  printf("%u draws, %u frames per run, %u job threads\n", draws, options.frames, max_threads);
+  printf("%8s %12s %12s %10s\n", "threads", "record ms", "min ms", "speedup");
+
+  double inline_ms = 0.0;
+  bool valid = true;
+
+  for (uint32_t threads : slice_counts) {
+    r.set_record_slices(threads);
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+      r.present();
+    }
+
+    double total_ms = 0.0;
+    double min_ms = 1e9;
+    uint32_t unrecorded = 0;
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.frames)) {
+      r.present();
+      total_ms += r.record_time_ms();
+      min_ms = std::min(min_ms, r.record_time_ms());
+      unrecorded += r.record_time_ms() > 0.0 ? 0 : 1;
+    }
+
+    double avg_ms = total_ms / options.frames;
+    if (!threads) {
+      inline_ms = avg_ms;
+    }
+
+    printf("%8s %12.3f %12.3f %9.2fx\n", threads ? std::to_string(threads).c_str() : "inline", avg_ms, min_ms, inline_ms / avg_ms);
+
+    // Pipelines are ready, so every frame records its draws
+    if (unrecorded) {
+      fprintf(stderr, "%u threads: %u frames recorded no draws\n", threads, unrecorded);
+      valid = false;
+    }
+  }
+
+  r.wait_idle();
+
+  return valid ? 0 : 1;
+}
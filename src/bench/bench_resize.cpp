@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+// Headless, a resize recreates offscreen images instead of a swapchain. Both
+// paths pay for that and the render graph rebuild; the render pass path also
+// recreates a framebuffer per image.
+int bench_resize(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+
+  if (options.draws) {
+    r.set_draw_count(options.draws);
+  }
+
+  printf("%u resizes per run, alternating between %ux%u and %ux%u\n", options.frames, options.width, options.height, options.width - 64, options.height - 64);
+  printf("%18s %12s %12s %12s %12s\n", "path", "rebuild ms", "min ms", "max ms", "frame ms");
+  bool valid = true;
+
+  for (bool dynamic : { true, false }) {
+    const char* path = dynamic ? "dynamic rendering" : "render passes";
+
+    if (!r.set_dynamic_rendering(dynamic)) {
+      printf("%18s %12s\n", path, "unsupported");
+      continue;
+    }
+
+    r.wait_for_pipelines();
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(options.warmup)) {
+      r.present();
+    }
+
+    r.wait_idle();
+
+    double total_ms = 0.0;
+    double min_ms = 0.0;
+    double max_ms = 0.0;
+    uint32_t skipped = 0;
+
+    auto start = std::chrono::steady_clock::now();
+
+    for (auto i : Range<uint32_t>(options.frames)) {
+      uint32_t shrink = i % 2 ? 0 : 64;
+      r.resize(options.width - shrink, options.height - shrink);
+      r.present();
+
+      double ms = r.rebuild_time_ms();
+      skipped += ms > 0.0 ? 0 : 1;
+      min_ms = i ? std::min(min_ms, ms) : ms;
+      max_ms = i ? std::max(max_ms, ms) : ms;
+      total_ms += ms;
+    }
+
+    r.wait_idle();
+    double frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / options.frames;
+
+    printf("%18s %12.3f %12.3f %12.3f %12.3f\n", path, total_ms / options.frames, min_ms, max_ms, frame_ms);
+
+    // Every size differs from the last, so each present must have rebuilt
+    if (skipped) {
+      fprintf(stderr, "%s: %u of %u resizes were not applied\n", path, skipped, options.frames);
+      valid = false;
+    }
+  }
+
+  return valid ? 0 : 1;
+}
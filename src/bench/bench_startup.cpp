@@ -0,0 +1,55 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+
+static constexpr uint32_t runs = 5;
+static constexpr double ready_timeout_ms = 60000.0;
+
+static double ms_since(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Pipelines compile while frames are presented, so the first frame no longer
+// waits for them. The first run may compile against a cold pipeline cache;
+// later runs load the one the previous run saved.
+int bench_startup(const BenchOptions& options) {
+  printf("Renderer startup over %u runs; draws are skipped until their pipeline has linked\n", runs);
+  printf("%6s %14s %16s %12s %14s\n", "run", "create ms", "first frame ms", "ready ms", "frames");
+
+  for (auto run : Range<uint32_t>(runs)) {
+    auto start = std::chrono::steady_clock::now();
+
+    Renderer r(options.width, options.height);
+    double create_ms = ms_since(start);
+
+    if (options.draws) {
+      r.set_draw_count(options.draws);
+    }
+
+    r.present();
+    r.wait_idle();
+    double first_frame_ms = ms_since(start);
+
+    uint32_t frames = 1;
+
+    while (!r.pipelines_ready()) {
+      if (ms_since(start) > ready_timeout_ms) {
+        fprintf(stderr, "Run %u: pipelines still compiling after %.0f ms\n", run, ready_timeout_ms);
+        return 1;
+      }
+
+      r.present();
+      frames++;
+    }
+
+    double ready_ms = ms_since(start);
+
+    printf("%6u %14.3f %16.3f %12.3f %14u\n", run, create_ms, first_frame_ms, ready_ms, frames);
+  }
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "engine/renderer.h"
+#include "engine/base.h"
+#include "engine/ktx2.h"
+
+static constexpr uint32_t texture_count = 64;
+static constexpr uint32_t texture_size = 2048;
+// Textures drawn large at once; the rest are drawn small enough for their tail
+static constexpr uint32_t visible_count = 8;
+// Frames before the visible window moves on to the next texture
+static constexpr uint32_t frames_per_step = 4;
+
+// A full mip chain of noise-free blocks, which upload as fast as any other
+static std::vector<uint8_t> make_texture(VkFormat format, uint32_t seed) {
+  FormatBlock block = format_block(format);
+  std::vector<std::vector<uint8_t>> levels;
+
+  for (uint32_t size = texture_size; size; size /= 2) {
+    uint32_t blocks = (size + block.width - 1) / block.width;
+    std::vector<uint8_t> level((size_t)blocks * blocks * block.bytes);
+
+    for (auto i : Range<size_t>(level.size())) {
+      level[i] = (uint8_t)(seed + i * 7);
+    }
+
+    levels.push_back(std::move(level));
+  }
+
+  return write_ktx2(format, texture_size, texture_size, levels);
+}
+
+// A set of textures too large for the smaller budgets, with a window of them
+// drawn large that moves along the set, as a camera would. Reports what stays
+// resident, how long finer mips take to arrive and how often the budget
+// forces textures coarser. BC1 where supported, else uncompressed.
+int bench_textures(const BenchOptions& options) {
+  Renderer r(options.width, options.height);
+  TextureStreamer& textures = r.textures();
+
+  std::filesystem::path dir = std::filesystem::temp_directory_path() / "vro_texture_bench";
+  std::filesystem::create_directories(dir);
+
+  std::vector<TextureId> ids;
+
+  for (VkFormat format : { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, VK_FORMAT_R8G8B8A8_UNORM }) {
+    for (auto i : Range<uint32_t>(texture_count)) {
+      // Named per format, as files of a failed attempt may still be mapped
+      std::string path = (dir / std::format("texture{}_{}.ktx2", i, (uint32_t)format)).string();
+      std::vector<uint8_t> contents = make_texture(format, i);
+
+      if (!save_binary(path.c_str(), contents.data(), contents.size())) {
+        printf("Failed to write '%s'\n", path.c_str());
+        return 1;
+      }
+
+      std::optional<TextureId> id = textures.load(path.c_str());
+      if (!id) {
+        break;
+      }
+
+      ids.push_back(*id);
+    }
+
+    if (ids.size() == texture_count) {
+      printf("%u %ux%u %s textures, %u drawn large at a time\n", texture_count, texture_size, texture_size, format == VK_FORMAT_R8G8B8A8_UNORM ? "RGBA8" : "BC1", visible_count);
+      break;
+    }
+
+    for (auto id : ids) {
+      textures.unload(id);
+    }
+
+    ids.clear();
+  }
+
+  if (ids.empty()) {
+    printf("Failed to load the textures\n");
+    return 1;
+  }
+
+  // Every tail, whatever the budget
+  while (textures.stats().streaming) {
+    r.present();
+  }
+
+  printf("%u frames per run\n", options.frames);
+  printf("%10s %6s %12s %12s %10s %10s %10s %10s %8s\n", "budget MB", "px", "resident MB", "wanted MB", "stream-ins", "avg ms", "max ms", "evictions", "denied");
+
+  for (VkDeviceSize budget_mb : { 32, 128, 512 }) {
+    for (float pixels : { 512.0f, 2048.0f }) {
+      textures.set_budget(budget_mb * 1024 * 1024);
+
+      auto run = [&](uint32_t frames, uint32_t first_frame) {
+        for (auto i : Range<uint32_t>(frames)) {
+          uint32_t first_visible = (first_frame + i) / frames_per_step;
+
+          for (auto j : Range<uint32_t>(texture_count)) {
+            bool visible = (j + texture_count - first_visible % texture_count) % texture_count < visible_count;
+            textures.request(ids[j], visible ? pixels : 16.0f);
+          }
+
+          r.present();
+        }
+      };
+
+      run(options.warmup, 0);
+      r.wait_idle();
+      textures.reset_stats();
+
+      run(options.frames, options.warmup);
+      r.wait_idle();
+
+      // Stats of the last update, which saw every request of the last frame
+      TextureStats stats = textures.stats();
+      printf("%10llu %6.0f %12.1f %12.1f %10llu %10.2f %10.2f %10llu %8llu\n", (unsigned long long)budget_mb, pixels,
+        stats.resident_bytes / (1024.0 * 1024.0), stats.wanted_bytes / (1024.0 * 1024.0), (unsigned long long)stats.stream_ins,
+        stats.average_stream_in_ms, stats.max_stream_in_ms, (unsigned long long)stats.evictions, (unsigned long long)stats.denied);
+    }
+  }
+
+  for (auto id : ids) {
+    textures.unload(id);
+  }
+
+  r.present();
+  r.wait_idle();
+  std::filesystem::remove_all(dir);
+
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "engine/transforms.h"
+#include "engine/jobs.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Updates a hierarchy of one root, 1000 groups and their leaves (Draws of
+// them, 1M by default) with the scalar and SIMD kernels across job thread
+// counts. Every group turns each frame, so all of the leaves move.
+int bench_transforms(const BenchOptions& options) {
+  constexpr double target_ms = 2.0;
+  constexpr uint32_t group_count = 1000;
+
+  uint32_t leaves = options.draws ? options.draws : 1000000;
+
+  std::vector<uint32_t> thread_counts = { 1 };
+  uint32_t max_threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+  for (uint32_t count = 2; count <= max_threads; count *= 2) {
+    thread_counts.push_back(count);
+  }
+
+  if (thread_counts.back() != max_threads) {
+    thread_counts.push_back(max_threads);
+  }
+
+  TransformStore transforms;
+  transforms.reserve(1 + group_count + leaves);
+
+  EntityId root = transforms.create(no_parent, Transform2D { .scale = 1.0f }, 0.0f, 0.0f);
+  std::vector<EntityId> groups;
+
+  for (auto i : Range<uint32_t>(group_count)) {
+    groups.push_back(transforms.create(root, Transform2D { .x = (float)i, .scale = 1.0f }, 0.0f, 0.0f));
+  }
+
+  // Group by group, so the store is sorted as it's built
+  for (auto i : Range<uint32_t>(leaves)) {
+    transforms.create(groups[(uint64_t)i * group_count / leaves], Transform2D { .x = 0.01f * (float)(i % 1000), .scale = 0.5f }, 0.71f, 0.5f);
+  }
+
+  uint32_t first_instance = transforms.level(2).lower;
+  std::vector<GpuInstance> scalar_instances(leaves);
+  std::vector<GpuInstance> simd_instances(leaves);
+
+  auto animate = [&](uint32_t frame) {
+    for (auto i : Range<uint32_t>(group_count)) {
+      transforms.set_local(groups[i], Transform2D { .x = (float)i, .rotation = 0.01f * (float)(frame + i), .scale = 1.0f });
+    }
+  };
+
+  printf("%u transforms in %u levels, %u-wide SIMD, %u frames, target %.1f ms\n", transforms.size(), transforms.level_count(), TransformStore::simd_width(), options.frames, target_ms);
+  printf("%8s %8s %10s %10s %12s %8s\n", "threads", "kernel", "avg ms", "min ms", "Mtransform/s", "target");
+
+  for (uint32_t threads : thread_counts) {
+    JobSystem jobs(threads);
+
+    for (bool simd : { false, true }) {
+      GpuInstance* instances = simd ? simd_instances.data() : scalar_instances.data();
+
+      for (auto frame : Range<uint32_t>(options.warmup)) {
+        animate(frame);
+        transforms.update(jobs, instances, first_instance, simd);
+      }
+
+      double total_ms = 0.0;
+      double min_ms = 1e30;
+
+      for (auto frame : Range<uint32_t>(options.frames)) {
+        animate(frame);
+
+        auto start = Clock::now();
+        transforms.update(jobs, instances, first_instance, simd);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        total_ms += ms;
+        min_ms = std::min(min_ms, ms);
+      }
+
+      double avg_ms = total_ms / std::max(options.frames, 1u);
+      printf("%8u %8s %10.3f %10.3f %12.1f %8s\n", threads, simd ? "simd" : "scalar", avg_ms, min_ms, transforms.size() / (avg_ms * 1000.0), avg_ms < target_ms ? "met" : "missed");
+    }
+  }
+
+  // Both kernels ended on the same frame, so should agree to rounding. Errors
+  // are relative to the larger magnitude, floored at 1 so values near zero
+  // compare absolutely.
+  constexpr float tolerance = 1e-5f;
+  float max_error = 0.0f;
+
+  auto relative_error = [](float a, float b) {
+    float error = std::abs(a - b) / std::max({ std::abs(a), std::abs(b), 1.0f });
+    return std::isnan(error) ? INFINITY : error;
+  };
+
+  for (auto i : Range<uint32_t>(leaves)) {
+    const GpuInstance& a = scalar_instances[i];
+    const GpuInstance& b = simd_instances[i];
+    max_error = std::max({ max_error, relative_error(a.offset[0], b.offset[0]), relative_error(a.offset[1], b.offset[1]),
+      relative_error(a.scale, b.scale), relative_error(a.radius, b.radius) });
+  }
+
+  printf("largest scalar/simd difference: %g relative\n", max_error);
+
+  if (max_error > tolerance) {
+    fprintf(stderr, "Scalar and SIMD kernels differ by more than %g relative\n", tolerance);
+    return 1;
+  }
+
+  return 0;
+}
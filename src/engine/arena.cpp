@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+
+#include "arena.h"
+#include "jobs.h"
+#include "base.h"
+
+Arena::Arena(size_t chunk_size) {
+  add_chunk(chunk_size);
+}
+
+Arena::~Arena() {
+  for (auto& chunk : m_chunks) {
+    free(chunk.data);
+  }
+}
+
+void* Arena::allocate(size_t size, size_t alignment) {
+  assert(alignment <= alignof(std::max_align_t) && "Arena chunks are only malloc aligned");
+
+  Chunk* chunk = &m_chunks.back();
+  size_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+
+  if (offset + size > chunk->size) {
+    m_retired += m_head;
+    add_chunk(std::max(chunk->size * 2, size + alignment));
+
+    chunk = &m_chunks.back();
+    offset = 0;
+  }
+
+  m_head = offset + size;
+  m_peak = std::max(m_peak, m_retired + m_head);
+
+  // Chunks come from malloc, aligned for anything, so offset 0 is always aligned
+  return chunk->data + offset;
+}
+
+void Arena::reset() {
+  if (m_chunks.size() > 1) {
+    size_t total = 0;
+
+    for (auto& chunk : m_chunks) {
+      total += chunk.size;
+      free(chunk.data);
+    }
+
+    m_chunks.clear();
+    add_chunk(total);
+  }
+
+  m_head = 0;
+  m_retired = 0;
+}
+
+ArenaStats Arena::stats() const {
+  ArenaStats stats = {
+    .used = m_retired + m_head,
+    .peak = m_peak,
+    .chunk_allocations = m_chunk_allocations,
+  };
+
+  for (auto& chunk : m_chunks) {
+    stats.capacity += chunk.size;
+  }
+
+  return stats;
+}
+
+void Arena::add_chunk(size_t min_size) {
+  Chunk chunk = {
+    .data = (uint8_t*)malloc(min_size),
+    .size = min_size,
+  };
+
+  if (!chunk.data) {
+    fatal_error("Out of memory for a {} byte arena chunk.", min_size);
+  }
+
+  m_chunks.push_back(chunk);
+  m_chunk_allocations++;
+  m_head = 0;
+}
+
+FrameArenas::FrameArenas(JobSystem& jobs, uint32_t frame_count, size_t chunk_size)
+  : m_jobs(jobs), m_thread_count(jobs.thread_count())
+{
+  for ([[maybe_unused]] auto i : Range<uint32_t>(frame_count * m_thread_count)) {
+    m_arenas.push_back(std::make_unique<Arena>(chunk_size));
+  }
+}
+
+void FrameArenas::begin_frame(uint32_t frame_index) {
+  m_frame_index = frame_index;
+
+  for (auto i : Range<uint32_t>(m_thread_count)) {
+    m_arenas[frame_index * m_thread_count + i]->reset();
+  }
+}
+
+Arena& FrameArenas::local() {
+  uint32_t thread = m_jobs.thread_index();
+  assert(thread < m_thread_count && "Frame arenas are only for job system threads");
+
+  return *m_arenas[m_frame_index * m_thread_count + thread];
+}
+
+ArenaStats FrameArenas::stats() const {
+  ArenaStats total = {};
+
+  for (auto& arena : m_arenas) {
+    ArenaStats stats = arena->stats();
+    total.used += stats.used;
+    total.peak = std::max(total.peak, stats.peak);
+    total.capacity += stats.capacity;
+    total.chunk_allocations += stats.chunk_allocations;
+  }
+
+  return total;
+}
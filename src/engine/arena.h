@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class JobSystem;
+
+struct ArenaStats {
+  size_t used;               // Bytes handed out since the last reset
+  size_t peak;               // Most bytes handed out between two resets
+  size_t capacity;           // Bytes held, whether handed out or not
+  uint64_t chunk_allocations; // Heap allocations made for chunks, ever
+};
+
+// Bump allocator over heap chunks, for data that lives until the next
+// reset(). Running out of a chunk allocates another twice the size; reset()
+// folds them into one chunk of their combined size, so once an arena has
+// seen its largest frame it never allocates again. Not thread safe.
+class Arena {
+public:
+  static constexpr size_t default_chunk_size = 64 * 1024;
+
+  explicit Arena(size_t chunk_size = default_chunk_size);
+  ~Arena();
+
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t size, size_t alignment);
+
+  template<typename T>
+  T* allocate(size_t count) {
+    return (T*)allocate(count * sizeof(T), alignof(T));
+  }
+
+  // Everything allocated since the last reset becomes invalid
+  void reset();
+
+  ArenaStats stats() const;
+
+private:
+  struct Chunk {
+    uint8_t* data;
+    size_t size;
+  };
+
+  void add_chunk(size_t min_size);
+
+private:
+  std::vector<Chunk> m_chunks;
+  size_t m_head = 0;    // Offset in the last chunk
+  size_t m_retired = 0; // Bytes used in chunks before the last
+  size_t m_peak = 0;
+  uint64_t m_chunk_allocations = 0;
+};
+
+// Adapter for std containers. Deallocation is a no-op, so containers that
+// grow leave their old storage behind until the arena resets; reserve() where
+// the size is known.
+template<typename T>
+class ArenaAllocator {
+public:
+  using value_type = T;
+
+  ArenaAllocator(Arena& arena) : m_arena(&arena) {}
+
+  template<typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : m_arena(other.arena()) {}
+
+  T* allocate(size_t count) { return m_arena->allocate<T>(count); }
+  void deallocate(T*, size_t) {}
+
+  Arena* arena() const { return m_arena; }
+
+  template<typename U>
+  bool operator==(const ArenaAllocator<U>& other) const { return m_arena == other.arena(); }
+
+private:
+  Arena* m_arena;
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// One arena per frame in flight and job system thread. A frame's arenas are
+// reset by begin_frame() once its fence has signalled, so CPU data built
+// while recording it (draw lists, barriers, submit infos) can be used until
+// the frame is submitted without being freed. Job threads each take their own
+// arena, so recording in parallel needs no locking.
+class FrameArenas {
+public:
+  FrameArenas(JobSystem& jobs, uint32_t frame_count, size_t chunk_size = Arena::default_chunk_size);
+
+  void begin_frame(uint32_t frame_index);
+
+  // The calling thread's arena for the current frame; must be a thread of the job system
+  Arena& local();
+
+  // Peak across every arena and frame, with the capacity and chunk allocations summed
+  ArenaStats stats() const;
+
+private:
+  JobSystem& m_jobs;
+  uint32_t m_thread_count;
+  uint32_t m_frame_index = 0;
+  std::vector<std::unique_ptr<Arena>> m_arenas; // Indexed by frame * thread_count + thread
+};
@@ -1,19 +1,50 @@
+#include <string>
+
 #include "base.h"
 
-std::optional<std::vector<uint8_t>> load_binary(const char* path) {
-  FILE* file;
-  if (fopen_s(&file, path, "rb")) {
+MappedFile::~MappedFile() {
+  platform::unmap_file(m_mapping);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    platform::unmap_file(m_mapping);
+    m_mapping = std::exchange(other.m_mapping, {});
+  }
+
+  return *this;
+}
+
+std::optional<MappedFile> map_binary(const char* path) {
+  std::optional<platform::FileMapping> mapping = platform::map_file(path);
+  if (!mapping) {
     return std::nullopt;
   }
 
-  fseek(file, 0, SEEK_END);
-  size_t len = ftell(file);
-  rewind(file);
+  return MappedFile(*mapping);
+}
 
-  std::vector<uint8_t> buf(len);
-  fread(buf.data(), len, 1, file);
+bool save_binary(const char* path, const void* data, size_t size) {
+  // Write to a temporary file first so a crash mid-write never leaves a truncated file behind
+  std::string temp_path = std::string(path) + ".tmp";
 
-  fclose(file);
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+
+  bool ok = fwrite(data, 1, size, file) == size;
+  ok = fclose(file) == 0 && ok;
+
+  if (!ok) {
+    remove(temp_path.c_str());
+    return false;
+  }
+
+  if (!platform::replace_file(temp_path.c_str(), path)) {
+    remove(temp_path.c_str());
+    return false;
+  }
 
-  return buf;
+  return true;
 }
\ No newline at end of file
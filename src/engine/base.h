@@ -1,9 +1,14 @@
 #pragma once
 
 #include <cstdio>
+#include <cstdint>
 #include <utility>
 #include <vector>
 #include <optional>
+#include <string>
+#include <format>
+
+#include "platform/platform.h"
 
 template<typename T>
 struct Range {
@@ -41,4 +46,43 @@ struct Range {
   Iterator end() const { return Iterator { upper }; }
 };
 
-std::optional<std::vector<uint8_t>> load_binary(const char* path);
\ No newline at end of file
+template<typename... Args>
+void fatal_error(const std::format_string<Args...>& fmt, Args&&... args) {
+  std::string s = std::format(fmt, std::forward<Args>(args)...);
+  platform::message_box("Error", s.c_str()); // Title first, then the message
+  platform::exit_program(1);
+}
+
+template<typename T, typename I, typename R>
+std::vector<T> vk_enumerate(I instance, R(*func)(I, uint32_t*, T*)) {
+  uint32_t count = 0;
+  func(instance, &count, nullptr);
+
+  std::vector<T> v(count);
+  func(instance, &count, v.data());
+
+  return v;
+}
+
+// Read-only memory mapping of a whole file, unmapped on destruction. The view
+// is page aligned, so it can go straight to vkCreateShaderModule, and pages
+// are only read from disk when first touched.
+class MappedFile {
+public:
+  explicit MappedFile(platform::FileMapping mapping) : m_mapping(mapping) {}
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other) noexcept : m_mapping(std::exchange(other.m_mapping, {})) {}
+  MappedFile& operator=(MappedFile&& other) noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const uint8_t* data() const { return (const uint8_t*)m_mapping.data; }
+  size_t size() const { return m_mapping.size; }
+
+private:
+  platform::FileMapping m_mapping;
+};
+
+std::optional<MappedFile> map_binary(const char* path);
+bool save_binary(const char* path, const void* data, size_t size);
\ No newline at end of file
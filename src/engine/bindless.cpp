@@ -0,0 +1,226 @@
+#include <cassert>
+
+#include "bindless.h"
+#include "base.h"
+
+static constexpr VkDescriptorType descriptor_types[] = {
+  VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+  VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+  VK_DESCRIPTOR_TYPE_SAMPLER,
+};
+
+HandleAllocator::HandleAllocator(uint32_t capacity)
+  : m_generations(capacity), m_live(capacity)
+{
+  // Popped from the back, so low indices are handed out first
+  m_free.reserve(capacity);
+  for (auto i : Range<uint32_t>(capacity)) {
+    m_free.push_back(capacity - 1 - i);
+  }
+}
+
+bool HandleAllocator::allocate(uint32_t* index, uint32_t* generation) {
+  if (m_free.empty()) {
+    return false;
+  }
+
+  *index = m_free.back();
+  *generation = m_generations[*index];
+  m_free.pop_back();
+
+  m_live[*index] = true;
+  m_live_count++;
+  return true;
+}
+
+void HandleAllocator::remove(uint32_t index) {
+  assert(m_live[index] && "slot removed twice");
+
+  m_live[index] = false;
+  m_generations[index]++;
+  m_live_count--;
+}
+
+void HandleAllocator::release(uint32_t index) {
+  assert(!m_live[index] && "slot released before it was removed");
+  m_free.push_back(index);
+}
+
+bool HandleAllocator::is_current(uint32_t index, uint32_t generation) const {
+  return index < m_generations.size() && m_live[index] && m_generations[index] == generation;
+}
+
+BindlessHeap::BindlessHeap(VkDevice device, bool descriptor_indexing)
+  : m_device(device), m_buffers(max_buffers), m_images(max_images), m_samplers(max_samplers)
+{
+  if (!descriptor_indexing) {
+    return;
+  }
+
+  uint32_t counts[] = { max_buffers, max_images, max_samplers };
+
+  VkDescriptorSetLayoutBinding bindings[3];
+  VkDescriptorBindingFlags binding_flags[3];
+  VkDescriptorPoolSize pool_sizes[3];
+
+  for (auto i : Range<uint32_t>(3)) {
+    bindings[i] = VkDescriptorSetLayoutBinding {
+      .binding = i,
+      .descriptorType = descriptor_types[i],
+      .descriptorCount = counts[i],
+      .stageFlags = VK_SHADER_STAGE_ALL,
+    };
+
+    // Unused slots may hold nothing at all, and live ones change while
+    // earlier frames that don't touch them are still executing
+    binding_flags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+
+    pool_sizes[i] = VkDescriptorPoolSize {
+      .type = descriptor_types[i],
+      .descriptorCount = counts[i],
+    };
+  }
+
+  VkDescriptorSetLayoutBindingFlagsCreateInfo binding_flags_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+    .bindingCount = 3,
+    .pBindingFlags = binding_flags,
+  };
+
+  VkDescriptorSetLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .pNext = &binding_flags_info,
+    .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+    .bindingCount = 3,
+    .pBindings = bindings,
+  };
+
+  if (vkCreateDescriptorSetLayout(m_device, &layout_info, nullptr, &m_set_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
+
+  VkDescriptorPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+    .maxSets = 1,
+    .poolSizeCount = 3,
+    .pPoolSizes = pool_sizes,
+  };
+
+  if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &m_pool) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor pool.");
+  }
+
+  VkDescriptorSetAllocateInfo set_alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = m_pool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = &m_set_layout,
+  };
+
+  if (vkAllocateDescriptorSets(m_device, &set_alloc_info, &m_set) != VK_SUCCESS) {
+    fatal_error("Failed to allocate Vulkan descriptor set.");
+  }
+}
+
+BindlessHeap::~BindlessHeap() {
+  vkDestroyDescriptorPool(m_device, m_pool, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_set_layout, nullptr);
+}
+
+HandleAllocator& BindlessHeap::allocator(BindlessType type) {
+  switch (type) {
+    case BindlessType::StorageBuffer: return m_buffers;
+    case BindlessType::SampledImage: return m_images;
+    case BindlessType::Sampler: return m_samplers;
+  }
+
+  return m_buffers;
+}
+
+const HandleAllocator& BindlessHeap::allocator(BindlessType type) const {
+  return const_cast<BindlessHeap*>(this)->allocator(type);
+}
+
+BindlessHandle BindlessHeap::allocate(BindlessType type) {
+  BindlessHandle handle = { .type = type };
+
+  if (!allocator(type).allocate(&handle.index, &handle.generation)) {
+    fatal_error("Bindless heap is out of slots (type {}).", (uint32_t)type);
+  }
+
+  return handle;
+}
+
+void BindlessHeap::write(BindlessHandle handle, const VkDescriptorBufferInfo* buffer_info, const VkDescriptorImageInfo* image_info) {
+  if (!m_set) {
+    return;
+  }
+
+  VkWriteDescriptorSet write = {
+    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet = m_set,
+    .dstBinding = (uint32_t)handle.type,
+    .dstArrayElement = handle.index,
+    .descriptorCount = 1,
+    .descriptorType = descriptor_types[(uint32_t)handle.type],
+    .pImageInfo = image_info,
+    .pBufferInfo = buffer_info,
+  };
+
+  vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+}
+
+BindlessHandle BindlessHeap::add_buffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize range) {
+  BindlessHandle handle = allocate(BindlessType::StorageBuffer);
+
+  VkDescriptorBufferInfo buffer_info = {
+    .buffer = buffer,
+    .offset = offset,
+    .range = range,
+  };
+
+  write(handle, &buffer_info, nullptr);
+  return handle;
+}
+
+BindlessHandle BindlessHeap::add_image(VkImageView view) {
+  BindlessHandle handle = allocate(BindlessType::SampledImage);
+  update_image(handle, view);
+  return handle;
+}
+
+BindlessHandle BindlessHeap::add_sampler(VkSampler sampler) {
+  BindlessHandle handle = allocate(BindlessType::Sampler);
+
+  VkDescriptorImageInfo image_info = {
+    .sampler = sampler,
+  };
+
+  write(handle, nullptr, &image_info);
+  return handle;
+}
+
+void BindlessHeap::update_image(BindlessHandle handle, VkImageView view) {
+  assert(handle.type == BindlessType::SampledImage && is_current(handle) && "stale or mistyped bindless handle");
+
+  VkDescriptorImageInfo image_info = {
+    .imageView = view,
+    .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+  };
+
+  write(handle, nullptr, &image_info);
+}
+
+void BindlessHeap::remove(BindlessHandle handle) {
+  assert(is_current(handle) && "stale bindless handle");
+  allocator(handle.type).remove(handle.index);
+}
+
+void BindlessHeap::release(BindlessHandle handle) {
+  allocator(handle.type).release(handle.index);
+}
+
+bool BindlessHeap::is_current(BindlessHandle handle) const {
+  return handle.valid() && allocator(handle.type).is_current(handle.index, handle.generation);
+}
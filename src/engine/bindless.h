@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+enum class BindlessType : uint32_t {
+  StorageBuffer, // binding 0
+  SampledImage,  // binding 1
+  Sampler,       // binding 2
+};
+
+// Slot in the heap plus the slot's generation when it was handed out. Shaders
+// only see the index; the generation catches use of a handle after remove().
+struct BindlessHandle {
+  uint32_t index = UINT32_MAX;
+  uint32_t generation = 0;
+  BindlessType type = BindlessType::StorageBuffer;
+
+  bool valid() const { return index != UINT32_MAX; }
+};
+
+// Free list of slot indices, each with a generation that changes whenever the
+// slot is removed
+class HandleAllocator {
+public:
+  explicit HandleAllocator(uint32_t capacity);
+
+  // Returns false when every slot is taken
+  bool allocate(uint32_t* index, uint32_t* generation);
+  // Invalidates outstanding handles to the slot; release() makes it reusable
+  void remove(uint32_t index);
+  void release(uint32_t index);
+
+  bool is_current(uint32_t index, uint32_t generation) const;
+  uint32_t capacity() const { return (uint32_t)m_generations.size(); }
+  uint32_t live_count() const { return m_live_count; }
+
+private:
+  std::vector<uint32_t> m_generations;
+  std::vector<bool> m_live;
+  std::vector<uint32_t> m_free;
+  uint32_t m_live_count = 0;
+};
+
+// One update-after-bind descriptor set holding every storage buffer, sampled
+// image and sampler, bound once per command buffer and indexed by shaders with
+// handles passed in push constants (or stored in other buffers). Descriptors
+// are written when resources are added, so nothing is allocated or bound per
+// draw.
+//
+// Descriptors in pending command buffers may be updated as long as those
+// command buffers don't use them (UPDATE_UNUSED_WHILE_PENDING), so a removed
+// slot must not be released until every frame that could have indexed it has
+// completed.
+//
+// Without descriptor indexing there is no set at all: handles are still handed
+// out, so owners work unchanged, but no descriptors are written and nothing
+// may bind the heap.
+class BindlessHeap {
+public:
+  // Capacities are within the limits descriptor indexing guarantees
+  static constexpr uint32_t max_buffers = 65536;
+  static constexpr uint32_t max_images = 65536;
+  static constexpr uint32_t max_samplers = 1024;
+
+  BindlessHeap(VkDevice device, bool descriptor_indexing);
+  ~BindlessHeap();
+
+  BindlessHandle add_buffer(VkBuffer buffer, VkDeviceSize offset = 0, VkDeviceSize range = VK_WHOLE_SIZE);
+  // 'view' must be in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL when sampled
+  BindlessHandle add_image(VkImageView view);
+  BindlessHandle add_sampler(VkSampler sampler);
+  // Points an existing slot at a different resource, keeping its index
+  void update_image(BindlessHandle handle, VkImageView view);
+
+  void remove(BindlessHandle handle);
+  void release(BindlessHandle handle);
+
+  bool is_current(BindlessHandle handle) const;
+
+  // Null without descriptor indexing
+  VkDescriptorSetLayout set_layout() const { return m_set_layout; }
+  VkDescriptorSet set() const { return m_set; }
+
+private:
+  HandleAllocator& allocator(BindlessType type);
+  const HandleAllocator& allocator(BindlessType type) const;
+  BindlessHandle allocate(BindlessType type);
+  void write(BindlessHandle handle, const VkDescriptorBufferInfo* buffer_info, const VkDescriptorImageInfo* image_info);
+
+private:
+  VkDevice m_device;
+  VkDescriptorSetLayout m_set_layout = nullptr;
+  VkDescriptorPool m_pool = nullptr;
+  VkDescriptorSet m_set = nullptr;
+  HandleAllocator m_buffers;
+  HandleAllocator m_images;
+  HandleAllocator m_samplers;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <optional>
+
+// Fixed size single-producer single-consumer ring. Neither side blocks or
+// allocates; push() fails when the ring is full.
+template<typename T, uint32_t Capacity>
+class SpscQueue {
+public:
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+  bool push(const T& value) {
+    uint32_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+      return false;
+    }
+
+    m_items[tail & (Capacity - 1)] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  std::optional<T> pop() {
+    uint32_t head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire)) {
+      return std::nullopt;
+    }
+
+    T value = m_items[head & (Capacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+private:
+  alignas(64) std::atomic<uint32_t> m_head = 0;
+  alignas(64) std::atomic<uint32_t> m_tail = 0;
+  T m_items[Capacity];
+};
+
+// Double-buffered hand-off of per-frame data from a producer (simulation and
+// input) to a consumer (rendering). The producer fills one packet while the
+// consumer renders the other, so it runs at most one frame ahead; every
+// published packet is consumed, in order. The consumer doesn't wait for the
+// producer, so frames keep coming while it stalls.
+template<typename T>
+class FramePackets {
+public:
+  // Producer: the packet to fill, or null while the consumer still has both
+  T* begin_write() {
+    uint64_t published = m_published.load(std::memory_order_relaxed);
+    if (published > m_released.load(std::memory_order_acquire) + 1) {
+      return nullptr;
+    }
+
+    return &m_packets[published & 1];
+  }
+
+  // Producer: hands over the packet from begin_write()
+  void publish() {
+    m_published.fetch_add(1, std::memory_order_release);
+  }
+
+  // Consumer: the next published packet, or null when there is none yet.
+  // Never blocks, so the consumer can keep going while the producer stalls.
+  const T* try_acquire() {
+    uint64_t released = m_released.load(std::memory_order_relaxed);
+    if (m_published.load(std::memory_order_acquire) == released) {
+      return nullptr;
+    }
+
+    return &m_packets[released & 1];
+  }
+
+  // Consumer: done with the packet from try_acquire(), which the producer may now refill
+  void release() {
+    m_released.fetch_add(1, std::memory_order_release);
+  }
+
+private:
+  T m_packets[2] = {};
+  alignas(64) std::atomic<uint64_t> m_published = 0;
+  alignas(64) std::atomic<uint64_t> m_released = 0;
+};
@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <iostream>
+
+#include "gpu_memory.h"
+#include "base.h"
+
+static constexpr VkDeviceSize LARGE_HEAP_BLOCK_SIZE = 64ull * 1024 * 1024;
+static constexpr VkDeviceSize MIN_BLOCK_SIZE = 1ull * 1024 * 1024;
+
+GpuAllocator::GpuAllocator(VkPhysicalDevice physical_device, VkDevice device, bool memory_budget_ext)
+  : m_physical_device(physical_device), m_device(device), m_memory_budget_ext(memory_budget_ext)
+{
+  vkGetPhysicalDeviceMemoryProperties(m_physical_device, &m_memory_props);
+
+  VkPhysicalDeviceProperties device_props;
+  vkGetPhysicalDeviceProperties(m_physical_device, &device_props);
+  m_max_allocation_count = device_props.limits.maxMemoryAllocationCount;
+
+  for (auto type : Range<uint32_t>(m_memory_props.memoryTypeCount)) {
+    VkDeviceSize heap_size = m_memory_props.memoryHeaps[m_memory_props.memoryTypes[type].heapIndex].size;
+
+    // Small heaps (e.g. the 256MB BAR window) get proportionally smaller blocks
+    VkDeviceSize block_size = LARGE_HEAP_BLOCK_SIZE;
+    if (heap_size < 1024ull * 1024 * 1024) {
+      block_size = std::max(std::bit_floor(heap_size / 8), MIN_BLOCK_SIZE);
+    }
+
+    for (auto kind : { GpuResourceKind::Buffer, GpuResourceKind::Image }) {
+      m_pools.push_back(Pool {
+        .memory_type = type,
+        .kind = kind,
+        .block_size = block_size,
+      });
+    }
+  }
+
+  update_budget();
+}
+
+GpuAllocator::~GpuAllocator() {
+  for (auto pool_index : Range<uint32_t>((uint32_t)m_pools.size())) {
+    for (auto block_index : Range<uint32_t>((uint32_t)m_pools[pool_index].blocks.size())) {
+      if (m_pools[pool_index].blocks[block_index]) {
+        free_block(pool_index, block_index);
+      }
+    }
+  }
+}
+
+std::vector<uint32_t> GpuAllocator::rank_memory_types(uint32_t type_bits, GpuMemoryUsage usage) {
+  VkMemoryPropertyFlags required = 0;
+  VkMemoryPropertyFlags preferred = 0;
+  VkMemoryPropertyFlags avoided = 0;
+
+  switch (usage) {
+    case GpuMemoryUsage::GpuOnly:
+      preferred = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+      avoided = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT; // Leave BAR memory for uploads
+      break;
+    case GpuMemoryUsage::Upload:
+      required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      avoided = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+      break;
+    case GpuMemoryUsage::Readback:
+      required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+      preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+      break;
+  }
+
+  std::vector<std::pair<int, uint32_t>> ranked;
+
+  for (auto type : Range<uint32_t>(m_memory_props.memoryTypeCount)) {
+    VkMemoryPropertyFlags flags = m_memory_props.memoryTypes[type].propertyFlags;
+
+    if (!(type_bits & (1u << type)) || (flags & required) != required) {
+      continue;
+    }
+
+    int score = std::popcount(flags & preferred) * 2 - std::popcount(flags & avoided);
+    ranked.push_back({ -score, type });
+  }
+
+  std::stable_sort(ranked.begin(), ranked.end());
+
+  std::vector<uint32_t> types;
+  for (auto [score, type] : ranked) {
+    types.push_back(type);
+  }
+
+  return types;
+}
+
+std::optional<GpuAllocation> GpuAllocator::allocate(const VkMemoryRequirements& requirements, GpuMemoryUsage usage, GpuResourceKind kind, bool dedicated) {
+  std::lock_guard lock(m_mutex);
+
+  // Falls through to less preferred memory types when a heap is over budget
+  for (uint32_t type : rank_memory_types(requirements.memoryTypeBits, usage)) {
+    uint32_t pool_index = type * 2 + (uint32_t)kind;
+
+    if (auto allocation = allocate_from_pool(pool_index, requirements.size, requirements.alignment, dedicated)) {
+      return allocation;
+    }
+  }
+
+  return std::nullopt;
+}
+
+std::optional<GpuAllocation> GpuAllocator::allocate_from_pool(uint32_t pool_index, VkDeviceSize size, VkDeviceSize alignment, bool dedicated) {
+  Pool& pool = m_pools[pool_index];
+  dedicated = dedicated || size > pool.block_size / 2;
+
+  auto make_allocation = [&](uint32_t block_index, const TlsfAllocator::Allocation& a) {
+    Block& block = *pool.blocks[block_index];
+
+    return GpuAllocation {
+      .memory = block.memory,
+      .offset = a.offset,
+      .size = a.size,
+      .mapped = block.mapped ? block.mapped + a.offset : nullptr,
+      .pool = pool_index,
+      .block = block_index,
+      .node = a.node
+    };
+  };
+
+  if (!dedicated) {
+    for (auto block_index : Range<uint32_t>((uint32_t)pool.blocks.size())) {
+      Block* block = pool.blocks[block_index].get();
+
+      if (!block || block->dedicated) {
+        continue;
+      }
+
+      if (auto a = block->tlsf.allocate(size, alignment)) {
+        return make_allocation(block_index, *a);
+      }
+    }
+  }
+
+  std::optional<uint32_t> block_index = create_block(pool_index, dedicated ? size : pool.block_size, dedicated);
+  if (!block_index) {
+    return std::nullopt;
+  }
+
+  auto a = pool.blocks[*block_index]->tlsf.allocate(size, alignment);
+  assert(a);
+
+  return make_allocation(*block_index, *a);
+}
+
+std::optional<uint32_t> GpuAllocator::create_block(uint32_t pool_index, VkDeviceSize size, bool dedicated) {
+  Pool& pool = m_pools[pool_index];
+  uint32_t heap = m_memory_props.memoryTypes[pool.memory_type].heapIndex;
+
+  if (m_device_allocation_count >= m_max_allocation_count) {
+    return std::nullopt;
+  }
+
+  if (m_heap_allocated[heap] + m_heap_external_usage[heap] + size > m_heap_budget[heap]) {
+    return std::nullopt;
+  }
+
+  VkMemoryAllocateInfo alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+    .allocationSize = size,
+    .memoryTypeIndex = pool.memory_type
+  };
+
+  VkDeviceMemory memory;
+  if (vkAllocateMemory(m_device, &alloc_info, nullptr, &memory) != VK_SUCCESS) {
+    return std::nullopt;
+  }
+
+  // Host visible blocks stay mapped for their whole lifetime
+  void* mapped = nullptr;
+  if (m_memory_props.memoryTypes[pool.memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    if (vkMapMemory(m_device, memory, 0, VK_WHOLE_SIZE, 0, &mapped) != VK_SUCCESS) {
+      vkFreeMemory(m_device, memory, nullptr);
+      return std::nullopt;
+    }
+  }
+
+  m_device_allocation_count++;
+  m_heap_allocated[heap] += size;
+
+  auto block = std::make_unique<Block>(Block {
+    .memory = memory,
+    .mapped = (uint8_t*)mapped,
+    .dedicated = dedicated,
+    .tlsf = TlsfAllocator(size)
+  });
+
+  for (auto block_index : Range<uint32_t>((uint32_t)pool.blocks.size())) {
+    if (!pool.blocks[block_index]) {
+      pool.blocks[block_index] = std::move(block);
+      return block_index;
+    }
+  }
+
+  pool.blocks.push_back(std::move(block));
+  return (uint32_t)pool.blocks.size() - 1;
+}
+
+void GpuAllocator::free_block(uint32_t pool_index, uint32_t block_index) {
+  Pool& pool = m_pools[pool_index];
+  Block& block = *pool.blocks[block_index];
+  uint32_t heap = m_memory_props.memoryTypes[pool.memory_type].heapIndex;
+
+  vkFreeMemory(m_device, block.memory, nullptr);
+
+  m_device_allocation_count--;
+  m_heap_allocated[heap] -= block.tlsf.capacity();
+
+  pool.blocks[block_index].reset();
+}
+
+void GpuAllocator::free(const GpuAllocation& allocation) {
+  std::lock_guard lock(m_mutex);
+  free_locked(allocation);
+}
+
+void GpuAllocator::free_locked(const GpuAllocation& allocation) {
+  assert(allocation.node != TlsfAllocator::INVALID_NODE && "linear pool allocations are not freed individually");
+
+  Pool& pool = m_pools[allocation.pool];
+  Block& block = *pool.blocks[allocation.block];
+
+  block.tlsf.free(allocation.node);
+
+  if (block.tlsf.allocation_count()) {
+    return;
+  }
+
+  // Keep one empty shared block per pool so a single alloc/free pair doesn't thrash vkAllocateMemory
+  bool keep = !block.dedicated;
+  for (auto& other : pool.blocks) {
+    if (other && other.get() != &block && !other->dedicated) {
+      keep = false;
+    }
+  }
+
+  if (!keep) {
+    free_block(allocation.pool, allocation.block);
+  }
+}
+
+GpuBuffer GpuAllocator::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, GpuMemoryUsage memory_usage) {
+  VkBufferCreateInfo buffer_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = size,
+    .usage = usage,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+
+  GpuBuffer buffer;
+  if (vkCreateBuffer(m_device, &buffer_info, nullptr, &buffer.buffer) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan buffer.");
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(m_device, buffer.buffer, &requirements);
+
+  std::optional<GpuAllocation> allocation = allocate(requirements, memory_usage, GpuResourceKind::Buffer);
+  if (!allocation) {
+    fatal_error("Out of GPU memory allocating a {} byte buffer.", size);
+  }
+
+  buffer.allocation = *allocation;
+  vkBindBufferMemory(m_device, buffer.buffer, allocation->memory, allocation->offset);
+
+  return buffer;
+}
+
+void GpuAllocator::destroy_buffer(const GpuBuffer& buffer) {
+  vkDestroyBuffer(m_device, buffer.buffer, nullptr);
+  free(buffer.allocation);
+}
+
+GpuImage GpuAllocator::create_image(const VkImageCreateInfo& image_info, GpuMemoryUsage memory_usage) {
+  GpuImage image;
+  if (vkCreateImage(m_device, &image_info, nullptr, &image.image) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan image.");
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(m_device, image.image, &requirements);
+
+  std::optional<GpuAllocation> allocation = allocate(requirements, memory_usage, GpuResourceKind::Image);
+  if (!allocation) {
+    fatal_error("Out of GPU memory allocating a {}x{} image.", image_info.extent.width, image_info.extent.height);
+  }
+
+  image.allocation = *allocation;
+  vkBindImageMemory(m_device, image.image, allocation->memory, allocation->offset);
+
+  return image;
+}
+
+void GpuAllocator::destroy_image(const GpuImage& image) {
+  vkDestroyImage(m_device, image.image, nullptr);
+  free(image.allocation);
+}
+
+std::vector<GpuDefragMove> GpuAllocator::plan_defragment(VkDeviceSize max_bytes) {
+  std::lock_guard lock(m_mutex);
+
+  std::vector<GpuDefragMove> moves;
+  VkDeviceSize moved = 0;
+
+  for (auto pool_index : Range<uint32_t>((uint32_t)m_pools.size())) {
+    Pool& pool = m_pools[pool_index];
+
+    std::vector<uint32_t> shared;
+    for (auto block_index : Range<uint32_t>((uint32_t)pool.blocks.size())) {
+      if (pool.blocks[block_index] && !pool.blocks[block_index]->dedicated) {
+        shared.push_back(block_index);
+      }
+    }
+
+    if (shared.size() < 2) {
+      continue;
+    }
+
+    // Evacuate the emptiest blocks into the fullest ones
+    std::sort(shared.begin(), shared.end(), [&](uint32_t a, uint32_t b) {
+      return pool.blocks[a]->tlsf.used() < pool.blocks[b]->tlsf.used();
+    });
+
+    // Destinations reserved by this plan hold no data yet; moving them again
+    // would chain moves whose source is still being written
+    std::vector<std::vector<uint32_t>> reserved(shared.size());
+
+    for (auto src : Range<size_t>(shared.size() - 1)) {
+      Block& src_block = *pool.blocks[shared[src]];
+
+      for (auto& a : src_block.tlsf.allocations()) {
+        if (std::find(reserved[src].begin(), reserved[src].end(), a.node) != reserved[src].end()) {
+          continue;
+        }
+
+        if (moved + a.size > max_bytes) {
+          return moves;
+        }
+
+        std::optional<GpuDefragMove> move;
+
+        for (size_t dst = shared.size() - 1; dst > src && !move; --dst) {
+          Block& dst_block = *pool.blocks[shared[dst]];
+
+          if (auto b = dst_block.tlsf.allocate(a.size, src_block.tlsf.alignment_of(a.node))) {
+            reserved[dst].push_back(b->node);
+            move = GpuDefragMove {
+              .src = { src_block.memory, a.offset, a.size, src_block.mapped ? src_block.mapped + a.offset : nullptr, pool_index, shared[src], a.node },
+              .dst = { dst_block.memory, b->offset, b->size, dst_block.mapped ? dst_block.mapped + b->offset : nullptr, pool_index, shared[dst], b->node },
+            };
+          }
+        }
+
+        if (!move) {
+          break;
+        }
+
+        moves.push_back(*move);
+        moved += a.size;
+      }
+    }
+  }
+
+  return moves;
+}
+
+void GpuAllocator::finish_defragment(const std::vector<GpuDefragMove>& moves) {
+  std::lock_guard lock(m_mutex);
+
+  for (auto& move : moves) {
+    free_locked(move.src);
+  }
+}
+
+void GpuAllocator::update_budget() {
+  std::lock_guard lock(m_mutex);
+
+  if (m_memory_budget_ext) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_props = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+    };
+
+    VkPhysicalDeviceMemoryProperties2 memory_props = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+      .pNext = &budget_props,
+    };
+
+    vkGetPhysicalDeviceMemoryProperties2(m_physical_device, &memory_props);
+
+    for (auto heap : Range<uint32_t>(m_memory_props.memoryHeapCount)) {
+      m_heap_budget[heap] = budget_props.heapBudget[heap];
+      m_heap_external_usage[heap] = budget_props.heapUsage[heap] > m_heap_allocated[heap] ? budget_props.heapUsage[heap] - m_heap_allocated[heap] : 0;
+    }
+  }
+  else {
+    // Without the extension, assume we may use most of each heap
+    for (auto heap : Range<uint32_t>(m_memory_props.memoryHeapCount)) {
+      m_heap_budget[heap] = m_memory_props.memoryHeaps[heap].size / 10 * 8;
+    }
+  }
+}
+
+GpuHeapBudget GpuAllocator::heap_budget(uint32_t heap) {
+  std::lock_guard lock(m_mutex);
+
+  return GpuHeapBudget {
+    .allocated = m_heap_allocated[heap],
+    .usage = m_heap_allocated[heap] + m_heap_external_usage[heap],
+    .budget = m_heap_budget[heap],
+  };
+}
+
+void GpuAllocator::print_stats() {
+  std::lock_guard lock(m_mutex);
+
+  constexpr double MB = 1024.0 * 1024.0;
+
+  std::cout << std::format("GPU memory: {} device allocations (limit {})", m_device_allocation_count, m_max_allocation_count) << std::endl;
+
+  for (auto heap : Range<uint32_t>(m_memory_props.memoryHeapCount)) {
+    uint32_t block_count = 0;
+    uint32_t allocation_count = 0;
+    VkDeviceSize used = 0;
+
+    for (auto& pool : m_pools) {
+      if (m_memory_props.memoryTypes[pool.memory_type].heapIndex != heap) {
+        continue;
+      }
+
+      for (auto& block : pool.blocks) {
+        if (block) {
+          block_count++;
+          allocation_count += block->tlsf.allocation_count();
+          used += block->tlsf.used();
+        }
+      }
+    }
+
+    std::cout << std::format("  heap {}: {:.1f}/{:.1f} MB used in {} blocks, {} allocations, usage {:.1f} MB of {:.1f} MB budget",
+      heap, used / MB, m_heap_allocated[heap] / MB, block_count, allocation_count,
+      (m_heap_allocated[heap] + m_heap_external_usage[heap]) / MB, m_heap_budget[heap] / MB) << std::endl;
+  }
+}
+
+GpuLinearPool::GpuLinearPool(GpuAllocator& allocator, VkDeviceSize size, uint32_t memory_type_bits, GpuMemoryUsage usage, GpuResourceKind kind)
+  : m_allocator(allocator)
+{
+  VkMemoryRequirements requirements = {
+    .size = (size + BASE_ALIGNMENT - 1) & ~(BASE_ALIGNMENT - 1),
+    .alignment = BASE_ALIGNMENT,
+    .memoryTypeBits = memory_type_bits
+  };
+
+  std::optional<GpuAllocation> block = allocator.allocate(requirements, usage, kind, true);
+  if (!block) {
+    fatal_error("Out of GPU memory allocating a {} byte linear pool.", size);
+  }
+
+  m_block = *block;
+}
+
+GpuLinearPool::~GpuLinearPool() {
+  m_allocator.free(m_block);
+}
+
+std::optional<GpuAllocation> GpuLinearPool::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+  assert(std::has_single_bit(alignment) && alignment <= BASE_ALIGNMENT);
+
+  uint64_t capacity = m_block.size;
+  uint64_t offset = (m_head + alignment - 1) & ~(alignment - 1);
+
+  // Never straddle the end of the block; skip to the start of the next lap instead
+  if (offset % capacity + size > capacity) {
+    offset = (offset / capacity + 1) * capacity;
+  }
+
+  if (offset + size - m_tail > capacity) {
+    return std::nullopt;
+  }
+
+  m_head = offset + size;
+
+  GpuAllocation allocation = m_block;
+  allocation.offset += offset % capacity;
+  allocation.size = size;
+  allocation.mapped = m_block.mapped ? m_block.mapped + offset % capacity : nullptr;
+  allocation.node = TlsfAllocator::INVALID_NODE;
+
+  return allocation;
+}
+
+void GpuLinearPool::reset() {
+  m_head = 0;
+  m_tail = 0;
+}
+
+void GpuLinearPool::release_until(uint64_t mark) {
+  assert(mark >= m_tail && mark <= m_head);
+  m_tail = mark;
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "tlsf.h"
+
+enum class GpuMemoryUsage {
+  GpuOnly,  // Device local, never mapped
+  Upload,   // Host visible and coherent, persistently mapped; CPU writes, GPU reads
+  Readback, // Host visible, cached where possible; GPU writes, CPU reads
+};
+
+// Buffers and optimal-tiling images live in separate blocks so that
+// bufferImageGranularity never has to be considered when packing.
+enum class GpuResourceKind {
+  Buffer,
+  Image,
+};
+
+struct GpuAllocation {
+  VkDeviceMemory memory = nullptr;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  uint8_t* mapped = nullptr; // Non-null for host visible memory
+  uint32_t pool = ~0u;
+  uint32_t block = ~0u;
+  uint32_t node = TlsfAllocator::INVALID_NODE; // Invalid for linear pool allocations
+};
+
+struct GpuBuffer {
+  VkBuffer buffer = nullptr;
+  GpuAllocation allocation;
+};
+
+struct GpuImage {
+  VkImage image = nullptr;
+  GpuAllocation allocation;
+};
+
+// 'dst' is already reserved. The caller copies the contents over, rebinds its
+// resource to 'dst' and then passes the move to finish_defragment().
+struct GpuDefragMove {
+  GpuAllocation src;
+  GpuAllocation dst;
+};
+
+struct GpuHeapBudget {
+  VkDeviceSize allocated; // Bytes of VkDeviceMemory owned by this allocator
+  VkDeviceSize usage;     // Process-wide usage as reported by VK_EXT_memory_budget
+  VkDeviceSize budget;
+};
+
+// Takes large VkDeviceMemory blocks per memory type and sub-allocates resources
+// out of them with a TLSF allocator, keeping the number of vkAllocateMemory
+// calls far below maxMemoryAllocationCount.
+class GpuAllocator {
+public:
+  GpuAllocator(VkPhysicalDevice physical_device, VkDevice device, bool memory_budget_ext);
+  ~GpuAllocator();
+
+  std::optional<GpuAllocation> allocate(const VkMemoryRequirements& requirements, GpuMemoryUsage usage, GpuResourceKind kind, bool dedicated = false);
+  void free(const GpuAllocation& allocation);
+
+  GpuBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, GpuMemoryUsage memory_usage);
+  void destroy_buffer(const GpuBuffer& buffer);
+  GpuImage create_image(const VkImageCreateInfo& image_info, GpuMemoryUsage memory_usage);
+  void destroy_image(const GpuImage& image);
+
+  // Plans moves that evacuate sparsely used blocks into fuller ones, up to max_bytes
+  std::vector<GpuDefragMove> plan_defragment(VkDeviceSize max_bytes);
+  void finish_defragment(const std::vector<GpuDefragMove>& moves);
+
+  // Refreshes heap budgets; cheap enough to call once per frame
+  void update_budget();
+  GpuHeapBudget heap_budget(uint32_t heap);
+  void print_stats();
+
+  VkDevice device() const { return m_device; }
+
+private:
+  struct Block {
+    VkDeviceMemory memory;
+    uint8_t* mapped;
+    bool dedicated;
+    TlsfAllocator tlsf;
+  };
+
+  struct Pool {
+    uint32_t memory_type;
+    GpuResourceKind kind;
+    VkDeviceSize block_size;
+    std::vector<std::unique_ptr<Block>> blocks; // Null entries are reusable slots
+  };
+
+  std::vector<uint32_t> rank_memory_types(uint32_t type_bits, GpuMemoryUsage usage);
+  std::optional<GpuAllocation> allocate_from_pool(uint32_t pool_index, VkDeviceSize size, VkDeviceSize alignment, bool dedicated);
+  std::optional<uint32_t> create_block(uint32_t pool_index, VkDeviceSize size, bool dedicated);
+  void free_block(uint32_t pool_index, uint32_t block_index);
+  void free_locked(const GpuAllocation& allocation);
+
+private:
+  VkPhysicalDevice m_physical_device;
+  VkDevice m_device;
+  bool m_memory_budget_ext;
+  VkPhysicalDeviceMemoryProperties m_memory_props;
+  uint32_t m_max_allocation_count;
+  uint32_t m_device_allocation_count = 0;
+  std::vector<Pool> m_pools; // Indexed by memory type * 2 + kind
+  VkDeviceSize m_heap_allocated[VK_MAX_MEMORY_HEAPS] = {};
+  VkDeviceSize m_heap_external_usage[VK_MAX_MEMORY_HEAPS] = {};
+  VkDeviceSize m_heap_budget[VK_MAX_MEMORY_HEAPS] = {};
+  std::mutex m_mutex;
+};
+
+// Bump allocator over a single dedicated block for transient data. It can be
+// used linearly (reset() once everything in it is dead) or as a ring, where
+// mark() is recorded at the end of a frame and release_until() is called once
+// that frame's fence has signalled.
+class GpuLinearPool {
+public:
+  GpuLinearPool(GpuAllocator& allocator, VkDeviceSize size, uint32_t memory_type_bits, GpuMemoryUsage usage, GpuResourceKind kind);
+  ~GpuLinearPool();
+
+  std::optional<GpuAllocation> allocate(VkDeviceSize size, VkDeviceSize alignment);
+  void reset();
+  uint64_t mark() const { return m_head; }
+  void release_until(uint64_t mark);
+
+  VkDeviceSize capacity() const { return m_block.size; }
+  VkDeviceSize used() const { return m_head - m_tail; }
+  const GpuAllocation& block() const { return m_block; }
+
+private:
+  static constexpr VkDeviceSize BASE_ALIGNMENT = 256;
+
+  GpuAllocator& m_allocator;
+  GpuAllocation m_block;
+  uint64_t m_head = 0; // Virtual offsets, physical offset is modulo capacity
+  uint64_t m_tail = 0;
+};
@@ -0,0 +1,580 @@
+#include <cstddef>
+#include <iterator>
+
+#include "gpu_scene.h"
+#include "base.h"
+
+static constexpr uint32_t cull_group_size = 64; // local_size_x in cull.comp and meshlet_cull.comp
+static constexpr uint32_t meshlet_draw_capacity = 1 << 18; // Per list, for the compute path
+static constexpr uint16_t triangle_indices[] = { 0, 1, 2 };
+
+// Matches the CullConstants push constant block in cull.comp
+struct CullConstants {
+  float camera[2];
+  float zoom;
+  float aspect;
+  uint32_t instance_count;
+  uint32_t compact;
+  uint32_t index_count;
+  uint32_t phase;
+  uint32_t hiz_size[2];
+  uint32_t hiz_levels;
+  uint32_t first_index;
+  uint32_t lod_buffer; // Heap index of the mesh's MeshLod table
+  uint32_t lod_count;  // 0 draws index_count indices from first_index
+  float lod_scale;     // Pixels per normalized unit of error at an instance scale of 1, over the threshold; 0 keeps the finest LOD
+  uint32_t meshlets;   // Nonzero lists each draw's instance and LOD for meshlet culling
+  uint32_t meshlet_buffer;
+  uint32_t meshlet_bounds_buffer;
+  uint32_t meshlet_capacity;
+  float time;
+};
+
+static VkDescriptorSetLayout create_storage_set_layout(VkDevice device, uint32_t binding_count, VkShaderStageFlags stages) {
+  std::vector<VkDescriptorSetLayoutBinding> bindings(binding_count);
+
+  for (auto i : Range<uint32_t>(binding_count)) {
+    bindings[i] = VkDescriptorSetLayoutBinding {
+      .binding = i,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .descriptorCount = 1,
+      .stageFlags = stages,
+    };
+  }
+
+  VkDescriptorSetLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = binding_count,
+    .pBindings = bindings.data(),
+  };
+
+  VkDescriptorSetLayout layout;
+  if (vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
+
+  return layout;
+}
+
+GpuScene::GpuScene(VkDevice device, GpuAllocator& allocator, Uploader& uploader, BindlessHeap& bindless, VkPipelineCache pipeline_cache, VkShaderModule cull_shader, VkShaderModule meshlet_cull_shader, VkDescriptorSetLayout hiz_set_layout, uint32_t frame_count, bool draw_indirect_count, bool multi_draw_indirect,
+  PFN_vkCmdDrawMeshTasksIndirectEXT draw_mesh_tasks_indirect, PFN_vkCmdDrawMeshTasksIndirectCountEXT draw_mesh_tasks_indirect_count)
+  : m_device(device), m_allocator(allocator), m_uploader(uploader), m_bindless(bindless), m_draw_indirect_count(draw_indirect_count), m_multi_draw_indirect(multi_draw_indirect),
+    m_draw_mesh_tasks_indirect(draw_mesh_tasks_indirect), m_draw_mesh_tasks_indirect_count(draw_mesh_tasks_indirect_count)
+{
+  // Instances, draw commands, counts, visibility, visible instances, task
+  // commands, meshlet draw commands
+  m_cull_set_layout = create_storage_set_layout(m_device, 7, VK_SHADER_STAGE_COMPUTE_BIT);
+
+  VkPushConstantRange cull_constants_range = {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0,
+    .size = sizeof(CullConstants),
+  };
+
+  // The mesh's LOD table and meshlets are read through the bindless heap
+  VkDescriptorSetLayout set_layouts[] = { m_cull_set_layout, hiz_set_layout, m_bindless.set_layout() };
+
+  VkPipelineLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 3,
+    .pSetLayouts = set_layouts,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &cull_constants_range,
+  };
+
+  if (vkCreatePipelineLayout(m_device, &layout_info, nullptr, &m_cull_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan pipeline layout.");
+  }
+
+  VkComputePipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = cull_shader,
+      .pName = "main",
+    },
+    .layout = m_cull_layout,
+  };
+
+  if (vkCreateComputePipelines(m_device, pipeline_cache, 1, &pipeline_info, nullptr, &m_cull_pipeline) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan compute pipeline.");
+  }
+
+  // Shares the layout, so the cull pass's bindings carry over
+  pipeline_info.stage.module = meshlet_cull_shader;
+
+  if (vkCreateComputePipelines(m_device, pipeline_cache, 1, &pipeline_info, nullptr, &m_meshlet_cull_pipeline) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan compute pipeline.");
+  }
+
+  m_index_buffer = m_allocator.create_buffer(sizeof(triangle_indices), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+  m_index_ticket = m_uploader.upload_buffer(m_index_buffer.buffer, 0, triangle_indices, sizeof(triangle_indices));
+
+  m_count_buffer = m_allocator.create_buffer(sizeof(CullStats), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+  m_meshlet_draw_buffer = m_allocator.create_buffer((VkDeviceSize)meshlet_draw_capacity * 2 * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+
+  // Task shaders add their meshlet counts through the heap
+  m_count_handle = m_bindless.add_buffer(m_count_buffer.buffer);
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(frame_count)) {
+    m_count_readback.push_back(m_allocator.create_buffer(sizeof(CullStats), VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::Readback));
+  }
+
+  m_readback_pending.resize(frame_count);
+  m_instance_staging.resize(frame_count);
+}
+
+GpuScene::~GpuScene() {
+  destroy(release());
+
+  for (auto& readback : m_count_readback) {
+    m_allocator.destroy_buffer(readback);
+  }
+
+  m_bindless.remove(m_count_handle);
+  m_bindless.release(m_count_handle);
+
+  m_allocator.destroy_buffer(m_meshlet_draw_buffer);
+  m_allocator.destroy_buffer(m_count_buffer);
+  m_allocator.destroy_buffer(m_index_buffer);
+
+  vkDestroyPipeline(m_device, m_meshlet_cull_pipeline, nullptr);
+  vkDestroyPipeline(m_device, m_cull_pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_cull_layout, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_cull_set_layout, nullptr);
+}
+
+GpuScene::Retired GpuScene::release() {
+  Retired retired = {
+    .descriptor_pool = m_descriptor_pool,
+    .instance_handle = m_instance_handle,
+    .visible_handle = m_visible_handle,
+  };
+
+  // Frames in flight may still index the slots; destroy() frees them for reuse
+  if (m_instance_handle.valid()) {
+    m_bindless.remove(m_instance_handle);
+    m_bindless.remove(m_visible_handle);
+  }
+
+  if (m_instance_buffer.buffer) {
+    retired.buffers.push_back(m_instance_buffer);
+    retired.buffers.push_back(m_draw_buffer);
+    retired.buffers.push_back(m_visibility_buffer);
+    retired.buffers.push_back(m_visible_buffer);
+    retired.buffers.push_back(m_task_buffer);
+  }
+
+  for (auto& staging : m_instance_staging) {
+    if (staging.buffer) {
+      retired.buffers.push_back(staging);
+      staging = {};
+    }
+  }
+
+  m_staging_pending.reset();
+  m_instance_buffer = {};
+  m_draw_buffer = {};
+  m_visibility_buffer = {};
+  m_visible_buffer = {};
+  m_task_buffer = {};
+  m_descriptor_pool = nullptr;
+  m_cull_set = nullptr;
+  m_instance_handle = {};
+  m_visible_handle = {};
+  m_instance_count = 0;
+  m_culled = false;
+
+  return retired;
+}
+
+void GpuScene::destroy(const Retired& retired) {
+  for (auto& buffer : retired.buffers) {
+    m_allocator.destroy_buffer(buffer);
+  }
+
+  if (retired.descriptor_pool) {
+    vkDestroyDescriptorPool(m_device, retired.descriptor_pool, nullptr);
+  }
+
+  if (retired.instance_handle.valid()) {
+    m_bindless.release(retired.instance_handle);
+    m_bindless.release(retired.visible_handle);
+  }
+}
+
+GpuInstance* GpuScene::write_instances(uint32_t frame_index) {
+  if (!m_instance_count) {
+    return nullptr;
+  }
+
+  GpuBuffer& staging = m_instance_staging[frame_index];
+
+  if (!staging.buffer) {
+    staging = m_allocator.create_buffer(m_instance_count * sizeof(GpuInstance), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, GpuMemoryUsage::Upload);
+  }
+
+  m_staging_pending = frame_index;
+  return (GpuInstance*)staging.allocation.mapped;
+}
+
+bool GpuScene::set_meshlet_path(MeshletPath path) {
+  if (path == MeshletPath::Compute && !m_draw_indirect_count) {
+    return false;
+  }
+
+  if (path == MeshletPath::MeshShader && !m_draw_mesh_tasks_indirect) {
+    return false;
+  }
+
+  m_meshlet_path = path;
+  return true;
+}
+
+// Descriptor sets of in-flight frames can't be updated, so every new set of
+// buffers gets a fresh cull set from its own pool. Vertex shaders reach the
+// instances through the bindless heap instead.
+GpuScene::Retired GpuScene::set_instances(const std::vector<GpuInstance>& instances) {
+  Retired retired = release();
+
+  if (instances.empty()) {
+    return retired;
+  }
+
+  m_instance_count = (uint32_t)instances.size();
+
+  VkDeviceSize instance_size = instances.size() * sizeof(GpuInstance);
+  VkDeviceSize draw_size = instances.size() * sizeof(VkDrawIndexedIndirectCommand) * 2;
+  VkDeviceSize visibility_size = instances.size() * sizeof(uint32_t);
+  VkDeviceSize visible_size = instances.size() * sizeof(uint32_t) * 2 * 2;
+  VkDeviceSize task_size = instances.size() * sizeof(VkDrawMeshTasksIndirectCommandEXT) * 2;
+
+  m_instance_buffer = m_allocator.create_buffer(instance_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+  m_draw_buffer = m_allocator.create_buffer(draw_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+  m_visibility_buffer = m_allocator.create_buffer(visibility_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+  m_visible_buffer = m_allocator.create_buffer(visible_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+  m_task_buffer = m_allocator.create_buffer(task_size, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+  m_instance_ticket = m_uploader.upload_buffer(m_instance_buffer.buffer, 0, instances.data(), instance_size);
+  m_instance_handle = m_bindless.add_buffer(m_instance_buffer.buffer);
+  m_visible_handle = m_bindless.add_buffer(m_visible_buffer.buffer);
+  m_visibility_reset = true;
+
+  VkDescriptorPoolSize pool_size = {
+    .type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    .descriptorCount = 7,
+  };
+
+  VkDescriptorPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .maxSets = 1,
+    .poolSizeCount = 1,
+    .pPoolSizes = &pool_size,
+  };
+
+  if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor pool.");
+  }
+
+  VkDescriptorSetAllocateInfo set_alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = m_descriptor_pool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = &m_cull_set_layout,
+  };
+
+  if (vkAllocateDescriptorSets(m_device, &set_alloc_info, &m_cull_set) != VK_SUCCESS) {
+    fatal_error("Failed to allocate Vulkan descriptor set.");
+  }
+
+  VkDescriptorBufferInfo buffer_infos[] = {
+    { .buffer = m_instance_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    { .buffer = m_draw_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    { .buffer = m_count_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    { .buffer = m_visibility_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    { .buffer = m_visible_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    { .buffer = m_task_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+    { .buffer = m_meshlet_draw_buffer.buffer, .offset = 0, .range = VK_WHOLE_SIZE },
+  };
+
+  VkWriteDescriptorSet writes[std::size(buffer_infos)];
+
+  for (auto i : Range<uint32_t>((uint32_t)std::size(buffer_infos))) {
+    writes[i] = VkWriteDescriptorSet {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = m_cull_set,
+      .dstBinding = i,
+      .descriptorCount = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+      .pBufferInfo = &buffer_infos[i],
+    };
+  }
+
+  vkUpdateDescriptorSets(m_device, (uint32_t)std::size(writes), writes, 0, nullptr);
+
+  return retired;
+}
+
+void GpuScene::cull(VkCommandBuffer cmd, uint32_t frame_index, const CullView& view, CullPhase phase) {
+  if (phase != CullPhase::Late) {
+    // The fence for this slot has signalled, so its count copy has landed
+    if (m_readback_pending[frame_index]) {
+      m_stats = *(CullStats*)m_count_readback[frame_index].allocation.mapped;
+      m_readback_pending[frame_index] = false;
+    }
+
+    m_culled = m_instance_count && m_uploader.is_ready(m_instance_ticket) && m_uploader.is_ready(m_index_ticket) && (!m_mesh || m_uploader.is_ready(m_mesh->ticket));
+  }
+
+  if (!m_culled) {
+    return;
+  }
+
+  MeshletPath path = active_meshlet_path();
+  VkPipelineStageFlags shader_stages = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+  if (m_draw_mesh_tasks_indirect) {
+    shader_stages |= VK_PIPELINE_STAGE_TASK_SHADER_BIT_EXT;
+  }
+
+  if (phase != CullPhase::Late) {
+    // The previous frame may still be drawing from the buffers about to be
+    // overwritten, its late phase wrote visibility and its task shaders and
+    // meshlet pass were the last to count
+    VkMemoryBarrier start_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(cmd,
+      VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | shader_stages,
+      VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+      0, 1, &start_barrier, 0, nullptr, 0, nullptr);
+
+    if (m_counted) {
+      VkBufferCopy count_copy = {
+        .size = sizeof(CullStats),
+      };
+
+      vkCmdCopyBuffer(cmd, m_count_buffer.buffer, m_count_readback[frame_index].buffer, 1, &count_copy);
+
+      VkMemoryBarrier readback_barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+      };
+
+      // Also keeps the clear below from overtaking the copy
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &readback_barrier, 0, nullptr, 0, nullptr);
+
+      m_readback_pending[frame_index] = true;
+    }
+
+    if (m_staging_pending) {
+      // Vertex, task and mesh shaders of the previous frame may still be
+      // reading the instances; the start barrier already covers the cull pass
+      VkPipelineStageFlags instance_stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | shader_stages;
+
+      if (m_draw_mesh_tasks_indirect) {
+        instance_stages |= VK_PIPELINE_STAGE_MESH_SHADER_BIT_EXT;
+      }
+
+      vkCmdPipelineBarrier(cmd, instance_stages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+      VkBufferCopy instance_copy = {
+        .size = m_instance_count * sizeof(GpuInstance),
+      };
+
+      vkCmdCopyBuffer(cmd, m_instance_staging[*m_staging_pending].buffer, m_instance_buffer.buffer, 1, &instance_copy);
+      m_staging_pending.reset();
+
+      VkMemoryBarrier instance_barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+      };
+
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | instance_stages, 0, 1, &instance_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    vkCmdFillBuffer(cmd, m_count_buffer.buffer, 0, sizeof(CullStats), 0);
+    m_counted = true;
+
+    // New instances count as visible, so the first frame draws them all early
+    if (m_visibility_reset) {
+      vkCmdFillBuffer(cmd, m_visibility_buffer.buffer, 0, VK_WHOLE_SIZE, 1);
+      m_visibility_reset = false;
+    }
+
+    VkMemoryBarrier clear_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &clear_barrier, 0, nullptr, 0, nullptr);
+  }
+  else {
+    // Counts and visibility carry over from the early phase, whose task
+    // shaders also counted
+    VkMemoryBarrier early_barrier = {
+      .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(cmd, shader_stages, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &early_barrier, 0, nullptr, 0, nullptr);
+  }
+
+  CullConstants constants = {
+    .camera = { view.camera[0], view.camera[1] },
+    .zoom = view.zoom,
+    .aspect = view.aspect,
+    .instance_count = m_instance_count,
+    .compact = m_draw_indirect_count,
+    .index_count = (uint32_t)std::size(triangle_indices),
+    .phase = (uint32_t)phase,
+    .hiz_size = { view.hiz_size[0], view.hiz_size[1] },
+    .hiz_levels = view.hiz_levels,
+    .first_index = 0,
+    .lod_buffer = m_mesh ? m_mesh->lod_handle.index : 0,
+    .lod_count = m_mesh ? (uint32_t)m_mesh->lods.size() : 0,
+    // Vertices are in the unit sphere, drawn at half the instance scale, and
+    // the view is 2 units tall at zoom 1
+    .lod_scale = view.lod_threshold > 0.0f ? 0.25f * view.zoom * view.viewport_height / view.lod_threshold : 0.0f,
+    .meshlets = path != MeshletPath::None,
+    .meshlet_buffer = m_mesh ? m_mesh->meshlet_handle.index : 0,
+    .meshlet_bounds_buffer = m_mesh ? m_mesh->meshlet_bounds_handle.index : 0,
+    .meshlet_capacity = meshlet_draw_capacity,
+    .time = view.time,
+  };
+
+  VkDescriptorSet sets[] = { m_cull_set, view.hiz_set };
+  uint32_t set_count = view.hiz_set ? 2 : 1;
+  VkDescriptorSet bindless_set = m_bindless.set();
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_layout, 0, set_count, sets, 0, nullptr);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_cull_layout, 2, 1, &bindless_set, 0, nullptr);
+  vkCmdPushConstants(cmd, m_cull_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+  vkCmdDispatch(cmd, (m_instance_count + cull_group_size - 1) / cull_group_size, 1, 1);
+
+  VkMemoryBarrier cull_barrier = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | shader_stages, 0, 1, &cull_barrier, 0, nullptr, 0, nullptr);
+
+  if (path != MeshletPath::Compute) {
+    return;
+  }
+
+  // Every drawn instance is compacted into the first draw_counts slots, at
+  // most all of them
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_meshlet_cull_pipeline);
+  vkCmdDispatch(cmd, (m_instance_count + cull_group_size - 1) / cull_group_size, 1, 1);
+
+  VkMemoryBarrier meshlet_barrier = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1, &meshlet_barrier, 0, nullptr, 0, nullptr);
+}
+
+void GpuScene::draw(VkCommandBuffer cmd, VkPipelineLayout layout, const CullView& view, CullPhase phase) {
+  if (!m_culled) {
+    return;
+  }
+
+  MeshletPath path = active_meshlet_path();
+  uint32_t list = phase == CullPhase::Late ? 1 : 0;
+  VkDeviceSize count_offset = list * sizeof(uint32_t);
+
+  if (path == MeshletPath::MeshShader) {
+    MeshletConstants constants = {
+      .instance_buffer = m_instance_handle.index,
+      .visible_buffer = m_visible_handle.index,
+      .count_buffer = m_count_handle.index,
+      .first_slot = list * m_instance_count,
+      .list = list,
+      .lod_buffer = m_mesh->lod_handle.index,
+      .meshlet_buffer = m_mesh->meshlet_handle.index,
+      .meshlet_bounds_buffer = m_mesh->meshlet_bounds_handle.index,
+      .vertex_buffer = m_mesh->vertex_handle.index,
+      .meshlet_vertex_buffer = m_mesh->meshlet_vertex_handle.index,
+      .meshlet_triangle_buffer = m_mesh->meshlet_triangle_handle.index,
+      .occlusion = phase == CullPhase::Late,
+      .hiz_size = { view.hiz_size[0], view.hiz_size[1] },
+      .hiz_levels = view.hiz_levels,
+    };
+
+    if (view.hiz_set) {
+      vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 2, 1, &view.hiz_set, 0, nullptr);
+    }
+
+    VkShaderStageFlags stages = VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT;
+    uint32_t stride = sizeof(VkDrawMeshTasksIndirectCommandEXT);
+    VkDeviceSize task_offset = (VkDeviceSize)list * m_instance_count * stride;
+
+    vkCmdPushConstants(cmd, layout, stages, 0, sizeof(constants), &constants);
+
+    if (m_draw_indirect_count) {
+      m_draw_mesh_tasks_indirect_count(cmd, m_task_buffer.buffer, task_offset, m_count_buffer.buffer, count_offset, m_instance_count, stride);
+    }
+    else if (m_multi_draw_indirect) {
+      m_draw_mesh_tasks_indirect(cmd, m_task_buffer.buffer, task_offset, m_instance_count, stride);
+    }
+    else {
+      // gl_DrawID restarts with every call
+      for (auto i : Range<uint32_t>(m_instance_count)) {
+        constants.first_slot = list * m_instance_count + i;
+        vkCmdPushConstants(cmd, layout, stages, 0, sizeof(constants), &constants);
+        m_draw_mesh_tasks_indirect(cmd, m_task_buffer.buffer, task_offset + (VkDeviceSize)i * stride, 1, stride);
+      }
+    }
+
+    return;
+  }
+
+  InstancedConstants constants = {
+    .instance_buffer = m_instance_handle.index,
+    .vertex_buffer = m_mesh ? m_mesh->vertex_handle.index : ~0u,
+  };
+
+  vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+
+  if (m_mesh) {
+    vkCmdBindIndexBuffer(cmd, m_mesh->index_buffer.buffer, 0, m_mesh->index_type);
+  }
+  else {
+    vkCmdBindIndexBuffer(cmd, m_index_buffer.buffer, 0, VK_INDEX_TYPE_UINT16);
+  }
+
+  uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+
+  if (path == MeshletPath::Compute) {
+    VkDeviceSize meshlet_offset = (VkDeviceSize)list * meshlet_draw_capacity * stride;
+    VkDeviceSize meshlet_count_offset = offsetof(CullStats, meshlet_draws) + list * sizeof(uint32_t);
+    vkCmdDrawIndexedIndirectCount(cmd, m_meshlet_draw_buffer.buffer, meshlet_offset, m_count_buffer.buffer, meshlet_count_offset, meshlet_draw_capacity, stride);
+    return;
+  }
+
+  VkDeviceSize draw_offset = (VkDeviceSize)list * m_instance_count * stride;
+
+  if (m_draw_indirect_count) {
+    vkCmdDrawIndexedIndirectCount(cmd, m_draw_buffer.buffer, draw_offset, m_count_buffer.buffer, count_offset, m_instance_count, stride);
+  }
+  else if (m_multi_draw_indirect) {
+    vkCmdDrawIndexedIndirect(cmd, m_draw_buffer.buffer, draw_offset, m_instance_count, stride);
+  }
+  else {
+    for (auto i : Range<uint32_t>(m_instance_count)) {
+      vkCmdDrawIndexedIndirect(cmd, m_draw_buffer.buffer, draw_offset + (VkDeviceSize)i * stride, 1, stride);
+    }
+  }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+#include "uploader.h"
+#include "bindless.h"
+#include "mesh.h"
+
+// Matches Instance in cull.comp and instanced.vert (std430)
+struct GpuInstance {
+  float offset[2];
+  float scale;
+  float radius; // Bounding circle, in the same units as offset
+  float depth;
+  float padding[3];
+};
+
+// Push constants of the instanced pipeline; matches instanced.vert
+struct InstancedConstants {
+  uint32_t instance_buffer; // Heap index
+  uint32_t vertex_buffer;   // Heap index of a GpuMesh's vertices, or ~0u for the built-in triangle
+};
+
+// Push constants of the meshlet pipeline's task and mesh shaders; matches
+// meshlet.task and meshlet.mesh. Heap indices, except where noted.
+struct MeshletConstants {
+  uint32_t instance_buffer;
+  uint32_t visible_buffer; // The cull pass's list of drawn instances and their LODs
+  uint32_t count_buffer;   // CullStats
+  uint32_t first_slot;     // Of this phase's list in the visible buffer
+  uint32_t list;
+  uint32_t lod_buffer;
+  uint32_t meshlet_buffer;
+  uint32_t meshlet_bounds_buffer;
+  uint32_t vertex_buffer;
+  uint32_t meshlet_vertex_buffer;
+  uint32_t meshlet_triangle_buffer;
+  uint32_t occlusion; // Test meshlets against the Hi-Z pyramid
+  uint32_t hiz_size[2];
+  uint32_t hiz_levels;
+};
+
+// View the instances are culled against; see FrameUniforms
+struct CullView {
+  float camera[2];
+  float zoom;
+  float aspect;
+  float time; // Instances spin with it, which moves their meshlets
+  VkDescriptorSet hiz_set; // HiZPyramid::cull_set; read by the late phase
+  uint32_t hiz_size[2];
+  uint32_t hiz_levels;
+  uint32_t viewport_height;
+  float lod_threshold; // Pixels a mesh's surface may move by drawing a coarser LOD; 0 keeps the finest
+};
+
+// Two-phase occlusion culling: the early phase draws what was visible last
+// frame, a Hi-Z pyramid is built from the resulting depth, and the late phase
+// tests everything in view against it, drawing what became visible and
+// recording visibility for the next frame.
+enum class CullPhase {
+  All,   // Frustum culling only
+  Early,
+  Late,
+};
+
+// How a mesh's instances are culled below the instance level. Meshlets are
+// tested against the view, their normal cone and, in the late phase, the
+// Hi-Z pyramid.
+enum class MeshletPath {
+  None,       // Each instance draws its whole LOD
+  Compute,    // A compute pass turns each instance's visible meshlets into indexed indirect draws
+  MeshShader, // Task shaders cull meshlets and mesh shaders draw the rest
+};
+
+struct CullStats {
+  uint32_t early_draws;    // Every draw when occlusion culling is off
+  uint32_t late_draws;
+  uint32_t occluded;       // Failed the Hi-Z test in the late phase
+  uint32_t frustum_culled;
+  uint32_t triangles; // Drawn, over both phases; of the meshlets left after culling them
+  uint32_t lod_draws[mesh_max_lods];
+  uint32_t meshlet_draws[2]; // Early (or all) and late; the compute path's draw counts
+  uint32_t meshlets_culled;
+};
+
+// Instances live in a storage buffer. A compute pass culls them against the
+// view and writes one VkDrawIndexedIndirectCommand per visible instance, which
+// the graphics queue draws with a single indirect call, so recording cost does
+// not grow with the instance count.
+//
+// With drawIndirectCount the commands are compacted and the GPU supplies the
+// draw count. Without it every instance keeps its slot and culled ones get an
+// index count of zero; without multiDrawIndirect those slots are drawn one
+// call at a time.
+//
+// A mesh's instances can also be culled per meshlet (see MeshletPath). The
+// cull pass then lists each drawn instance with its LOD, and either a second
+// compute pass or task shaders work through that list. Statistics are copied
+// back at the start of the next frame, once every stage that counts is done.
+class GpuScene {
+public:
+  // What set_instances() replaces; frames still in flight may use it
+  struct Retired {
+    std::vector<GpuBuffer> buffers;
+    VkDescriptorPool descriptor_pool;
+    BindlessHandle instance_handle;
+    BindlessHandle visible_handle;
+  };
+
+  // The mesh task draws are null without VK_EXT_mesh_shader
+  GpuScene(VkDevice device, GpuAllocator& allocator, Uploader& uploader, BindlessHeap& bindless, VkPipelineCache pipeline_cache, VkShaderModule cull_shader, VkShaderModule meshlet_cull_shader, VkDescriptorSetLayout hiz_set_layout, uint32_t frame_count, bool draw_indirect_count, bool multi_draw_indirect,
+    PFN_vkCmdDrawMeshTasksIndirectEXT draw_mesh_tasks_indirect, PFN_vkCmdDrawMeshTasksIndirectCountEXT draw_mesh_tasks_indirect_count);
+  ~GpuScene();
+
+  Retired set_instances(const std::vector<GpuInstance>& instances);
+  // Host visible memory for every instance, copied over the instance buffer
+  // at the start of this frame's cull. Once the frame's fence has been waited
+  // on; null without instances. Only the last frame written is copied.
+  GpuInstance* write_instances(uint32_t frame_index);
+  // Draws every instance as the coarsest of the mesh's LODs whose error
+  // stays under the view's threshold on screen; null goes back to the
+  // built-in triangle. The mesh must outlive its use by frames in flight.
+  void set_mesh(const GpuMesh* mesh) { m_mesh = mesh; }
+  // Returns false, keeping the current path, when the device can't: the
+  // compute path needs drawIndirectCount and the mesh shader path the extension
+  bool set_meshlet_path(MeshletPath path);
+  MeshletPath meshlet_path() const { return m_meshlet_path; }
+  // Whether draw() expects the meshlet pipeline, rather than the instanced one
+  bool uses_mesh_shaders() const { return m_mesh && m_meshlet_path == MeshletPath::MeshShader; }
+  void destroy(const Retired& retired);
+
+  // Outside a render pass, once the frame's fence has been waited on. A frame
+  // culls either All, or Early then Late.
+  void cull(VkCommandBuffer cmd, uint32_t frame_index, const CullView& view, CullPhase phase);
+  // Inside a render pass, with the frame set and bindless heap bound. The
+  // pipeline takes InstancedConstants as vertex push constants or, when
+  // uses_mesh_shaders(), MeshletConstants in task and mesh shaders with the
+  // Hi-Z set at set 2, which draw() binds.
+  void draw(VkCommandBuffer cmd, VkPipelineLayout layout, const CullView& view, CullPhase phase);
+
+  uint32_t instance_count() const { return m_instance_count; }
+  // Counts from a recently completed frame
+  const CullStats& stats() const { return m_stats; }
+
+private:
+  Retired release();
+  MeshletPath active_meshlet_path() const { return m_mesh ? m_meshlet_path : MeshletPath::None; }
+
+private:
+  VkDevice m_device;
+  GpuAllocator& m_allocator;
+  Uploader& m_uploader;
+  BindlessHeap& m_bindless;
+  bool m_draw_indirect_count;
+  bool m_multi_draw_indirect;
+
+  VkDescriptorSetLayout m_cull_set_layout;
+  VkPipelineLayout m_cull_layout;
+  VkPipeline m_cull_pipeline;
+  VkPipeline m_meshlet_cull_pipeline;
+  PFN_vkCmdDrawMeshTasksIndirectEXT m_draw_mesh_tasks_indirect;
+  PFN_vkCmdDrawMeshTasksIndirectCountEXT m_draw_mesh_tasks_indirect_count;
+  MeshletPath m_meshlet_path = MeshletPath::None;
+
+  GpuBuffer m_index_buffer;
+  GpuBuffer m_count_buffer; // CullStats, whose first two fields are the draw counts
+  BindlessHandle m_count_handle;
+  GpuBuffer m_meshlet_draw_buffer; // The compute path's early (or all) draws, then late ones
+  std::vector<GpuBuffer> m_count_readback; // One per frame in flight
+  std::vector<bool> m_readback_pending;
+  bool m_counted = false; // The count buffer holds a frame's statistics
+  UploadTicket m_index_ticket;
+  const GpuMesh* m_mesh = nullptr;
+
+  GpuBuffer m_instance_buffer = {};
+  std::vector<GpuBuffer> m_instance_staging; // Per frame in flight, made by write_instances()
+  std::optional<uint32_t> m_staging_pending;  // Frame whose staging cull() copies next
+  GpuBuffer m_draw_buffer = {};       // Early (or All) commands, then late ones
+  GpuBuffer m_visibility_buffer = {}; // One uint per instance, visible last frame
+  GpuBuffer m_visible_buffer = {};    // Instance and LOD of each draw, in the same slots
+  GpuBuffer m_task_buffer = {};       // VkDrawMeshTasksIndirectCommandEXT in the same slots
+  VkDescriptorPool m_descriptor_pool = nullptr;
+  VkDescriptorSet m_cull_set = nullptr;
+  BindlessHandle m_instance_handle = {};
+  BindlessHandle m_visible_handle = {};
+  uint32_t m_instance_count = 0;
+  UploadTicket m_instance_ticket = 0;
+  bool m_culled = false; // cull() recorded work this frame, so draw() has commands to use
+  bool m_visibility_reset = false;
+  CullStats m_stats = {};
+};
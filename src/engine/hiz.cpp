@@ -0,0 +1,316 @@
+#include <algorithm>
+
+#include "hiz.h"
+#include "base.h"
+
+static constexpr uint32_t hiz_group_size = 8; // local_size_x/y in hiz.comp
+
+// Matches the HiZConstants push constant block in hiz.comp
+struct HiZConstants {
+  uint32_t src_size[2];
+  uint32_t dst_size[2];
+};
+
+static uint32_t previous_power_of_two(uint32_t value) {
+  uint32_t result = 1;
+  while (result * 2 <= value) {
+    result *= 2;
+  }
+
+  return result;
+}
+
+HiZBuilder::HiZBuilder(VkDevice device, GpuAllocator& allocator, VkPipelineCache pipeline_cache, VkShaderModule downsample_shader, VkShaderStageFlags cull_stages)
+  : m_device(device), m_allocator(allocator)
+{
+  // Point sampled: a texel's max must not be blended with its neighbours
+  VkSamplerCreateInfo sampler_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter = VK_FILTER_NEAREST,
+    .minFilter = VK_FILTER_NEAREST,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .maxLod = VK_LOD_CLAMP_NONE,
+  };
+
+  if (vkCreateSampler(m_device, &sampler_info, nullptr, &m_sampler) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan sampler.");
+  }
+
+  VkDescriptorSetLayoutBinding build_bindings[] = {
+    {
+      .binding = 0,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+    {
+      .binding = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+  };
+
+  VkDescriptorSetLayoutCreateInfo build_set_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = 2,
+    .pBindings = build_bindings,
+  };
+
+  if (vkCreateDescriptorSetLayout(m_device, &build_set_layout_info, nullptr, &m_build_set_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
+
+  VkDescriptorSetLayoutBinding cull_binding = build_bindings[0];
+  cull_binding.stageFlags = cull_stages;
+
+  VkDescriptorSetLayoutCreateInfo cull_set_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = 1,
+    .pBindings = &cull_binding,
+  };
+
+  if (vkCreateDescriptorSetLayout(m_device, &cull_set_layout_info, nullptr, &m_cull_set_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
+
+  VkPushConstantRange constants_range = {
+    .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    .offset = 0,
+    .size = sizeof(HiZConstants),
+  };
+
+  VkPipelineLayoutCreateInfo layout_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &m_build_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &constants_range,
+  };
+
+  if (vkCreatePipelineLayout(m_device, &layout_info, nullptr, &m_build_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan pipeline layout.");
+  }
+
+  VkComputePipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+    .stage = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+      .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+      .module = downsample_shader,
+      .pName = "main",
+    },
+    .layout = m_build_layout,
+  };
+
+  if (vkCreateComputePipelines(m_device, pipeline_cache, 1, &pipeline_info, nullptr, &m_build_pipeline) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan compute pipeline.");
+  }
+}
+
+HiZBuilder::~HiZBuilder() {
+  vkDestroyPipeline(m_device, m_build_pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_build_layout, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_cull_set_layout, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_build_set_layout, nullptr);
+  vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+HiZPyramid HiZBuilder::create_pyramid(VkImageView depth_view, uint32_t width, uint32_t height) {
+  HiZPyramid pyramid = {
+    .width = previous_power_of_two(width),
+    .height = previous_power_of_two(height),
+    .depth_width = width,
+    .depth_height = height,
+  };
+
+  pyramid.levels = 1;
+  while ((std::max(pyramid.width, pyramid.height) >> pyramid.levels) > 0) {
+    pyramid.levels++;
+  }
+
+  VkImageCreateInfo image_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = VK_FORMAT_R32_SFLOAT,
+    .extent = { pyramid.width, pyramid.height, 1 },
+    .mipLevels = pyramid.levels,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+  };
+
+  pyramid.image = m_allocator.create_image(image_info, GpuMemoryUsage::GpuOnly);
+
+  auto create_view = [&](uint32_t base_level, uint32_t level_count) {
+    VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = pyramid.image.image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = VK_FORMAT_R32_SFLOAT,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = base_level,
+        .levelCount = level_count,
+        .layerCount = 1,
+      },
+    };
+
+    VkImageView view;
+    if (vkCreateImageView(m_device, &view_info, nullptr, &view) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan image view.");
+    }
+
+    return view;
+  };
+
+  pyramid.view = create_view(0, pyramid.levels);
+
+  for (auto i : Range<uint32_t>(pyramid.levels)) {
+    pyramid.level_views.push_back(create_view(i, 1));
+  }
+
+  VkDescriptorPoolSize pool_sizes[] = {
+    { .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = pyramid.levels + 1 },
+    { .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = pyramid.levels },
+  };
+
+  VkDescriptorPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .maxSets = pyramid.levels + 1,
+    .poolSizeCount = 2,
+    .pPoolSizes = pool_sizes,
+  };
+
+  if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &pyramid.descriptor_pool) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor pool.");
+  }
+
+  std::vector<VkDescriptorSetLayout> set_layouts(pyramid.levels, m_build_set_layout);
+  set_layouts.push_back(m_cull_set_layout);
+
+  std::vector<VkDescriptorSet> sets(set_layouts.size());
+
+  VkDescriptorSetAllocateInfo set_alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = pyramid.descriptor_pool,
+    .descriptorSetCount = (uint32_t)set_layouts.size(),
+    .pSetLayouts = set_layouts.data(),
+  };
+
+  if (vkAllocateDescriptorSets(m_device, &set_alloc_info, sets.data()) != VK_SUCCESS) {
+    fatal_error("Failed to allocate Vulkan descriptor set.");
+  }
+
+  pyramid.cull_set = sets.back();
+  sets.pop_back();
+  pyramid.build_sets = sets;
+
+  // Image infos are referenced by the writes, so reserve up front
+  std::vector<VkDescriptorImageInfo> image_infos;
+  image_infos.reserve(pyramid.levels * 2 + 1);
+
+  std::vector<VkWriteDescriptorSet> writes;
+
+  for (auto i : Range<uint32_t>(pyramid.levels)) {
+    image_infos.push_back(VkDescriptorImageInfo {
+      .sampler = m_sampler,
+      .imageView = i ? pyramid.level_views[i - 1] : depth_view,
+      .imageLayout = i ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+    });
+
+    writes.push_back(VkWriteDescriptorSet {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = pyramid.build_sets[i],
+      .dstBinding = 0,
+      .descriptorCount = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo = &image_infos.back(),
+    });
+
+    image_infos.push_back(VkDescriptorImageInfo {
+      .imageView = pyramid.level_views[i],
+      .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    });
+
+    writes.push_back(VkWriteDescriptorSet {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = pyramid.build_sets[i],
+      .dstBinding = 1,
+      .descriptorCount = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .pImageInfo = &image_infos.back(),
+    });
+  }
+
+  image_infos.push_back(VkDescriptorImageInfo {
+    .sampler = m_sampler,
+    .imageView = pyramid.view,
+    .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+  });
+
+  writes.push_back(VkWriteDescriptorSet {
+    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet = pyramid.cull_set,
+    .dstBinding = 0,
+    .descriptorCount = 1,
+    .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+    .pImageInfo = &image_infos.back(),
+  });
+
+  vkUpdateDescriptorSets(m_device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+  return pyramid;
+}
+
+void HiZBuilder::destroy_pyramid(const HiZPyramid& pyramid) {
+  vkDestroyDescriptorPool(m_device, pyramid.descriptor_pool, nullptr);
+
+  for (auto view : pyramid.level_views) {
+    vkDestroyImageView(m_device, view, nullptr);
+  }
+
+  vkDestroyImageView(m_device, pyramid.view, nullptr);
+  m_allocator.destroy_image(pyramid.image);
+}
+
+void HiZBuilder::build(VkCommandBuffer cmd, const HiZPyramid& pyramid) {
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_build_pipeline);
+
+  uint32_t src_width = pyramid.depth_width;
+  uint32_t src_height = pyramid.depth_height;
+
+  for (auto i : Range<uint32_t>(pyramid.levels)) {
+    uint32_t dst_width = std::max(pyramid.width >> i, 1u);
+    uint32_t dst_height = std::max(pyramid.height >> i, 1u);
+
+    // Each level reads the one before it
+    if (i) {
+      VkMemoryBarrier level_barrier = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+      };
+
+      vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &level_barrier, 0, nullptr, 0, nullptr);
+    }
+
+    HiZConstants constants = {
+      .src_size = { src_width, src_height },
+      .dst_size = { dst_width, dst_height },
+    };
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_build_layout, 0, 1, &pyramid.build_sets[i], 0, nullptr);
+    vkCmdPushConstants(cmd, m_build_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(cmd, (dst_width + hiz_group_size - 1) / hiz_group_size, (dst_height + hiz_group_size - 1) / hiz_group_size, 1);
+
+    src_width = dst_width;
+    src_height = dst_height;
+  }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+
+// Max-depth mip chain over a depth buffer. Level 0 is the largest power of two
+// that fits in the depth buffer, and every level halves it, so a texel at
+// level n bounds the depth of a 2^n square of level 0. Sized to the render
+// targets, so it is recreated and retired with them.
+struct HiZPyramid {
+  GpuImage image;
+  VkImageView view;                     // All levels, for culling
+  std::vector<VkImageView> level_views; // One per level, written by the build
+  VkDescriptorPool descriptor_pool;
+  std::vector<VkDescriptorSet> build_sets; // Level i reads level i - 1 (or the depth buffer)
+  VkDescriptorSet cull_set;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levels;
+  uint32_t depth_width;
+  uint32_t depth_height;
+};
+
+// Builds Hi-Z pyramids with a compute downsample. When build() is recorded the
+// depth buffer must be in VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL and
+// the pyramid in GENERAL, both ready for compute; the render graph sees to it.
+// Only the barriers between levels are recorded here.
+class HiZBuilder {
+public:
+  // 'cull_stages' are the shader stages that sample pyramids through cull_set
+  HiZBuilder(VkDevice device, GpuAllocator& allocator, VkPipelineCache pipeline_cache, VkShaderModule downsample_shader, VkShaderStageFlags cull_stages);
+  ~HiZBuilder();
+
+  HiZPyramid create_pyramid(VkImageView depth_view, uint32_t width, uint32_t height);
+  void destroy_pyramid(const HiZPyramid& pyramid);
+
+  void build(VkCommandBuffer cmd, const HiZPyramid& pyramid);
+
+  // Set layout of HiZPyramid::cull_set: one combined image sampler at binding 0
+  VkDescriptorSetLayout cull_set_layout() const { return m_cull_set_layout; }
+
+private:
+  VkDevice m_device;
+  GpuAllocator& m_allocator;
+  VkSampler m_sampler;
+  VkDescriptorSetLayout m_build_set_layout;
+  VkDescriptorSetLayout m_cull_set_layout;
+  VkPipelineLayout m_build_layout;
+  VkPipeline m_build_pipeline;
+};
@@ -0,0 +1,213 @@
+#include <cassert>
+
+#include "jobs.h"
+
+static thread_local const JobSystem* t_job_system = nullptr;
+static thread_local uint32_t t_thread_index = ~0u;
+static thread_local uint32_t t_random = 0x9e3779b9;
+
+static uint32_t next_random() {
+  // xorshift32, only used to spread steal attempts across victims
+  t_random ^= t_random << 13;
+  t_random ^= t_random >> 17;
+  t_random ^= t_random << 5;
+  return t_random;
+}
+
+bool JobDeque::push(Job* job) {
+  int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+  int64_t top = m_top.load(std::memory_order_acquire);
+
+  if (bottom - top >= CAPACITY) {
+    return false;
+  }
+
+  m_jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+  m_bottom.store(bottom + 1, std::memory_order_release);
+  return true;
+}
+
+Job* JobDeque::pop() {
+  int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+  m_bottom.store(bottom, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t top = m_top.load(std::memory_order_relaxed);
+
+  if (top > bottom) {
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+    return nullptr;
+  }
+
+  Job* job = m_jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+  if (top == bottom) {
+    // Last job: race any thief for it
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+      job = nullptr;
+    }
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  return job;
+}
+
+Job* JobDeque::steal() {
+  int64_t top = m_top.load(std::memory_order_acquire);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  int64_t bottom = m_bottom.load(std::memory_order_acquire);
+
+  if (top >= bottom) {
+    return nullptr;
+  }
+
+  Job* job = m_jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+
+  if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+    return nullptr;
+  }
+
+  return job;
+}
+
+JobSystem::JobSystem(uint32_t thread_count) {
+  if (!thread_count) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(thread_count)) {
+    m_deques.push_back(std::make_unique<JobDeque>());
+  }
+
+  t_job_system = this;
+  t_thread_index = 0;
+
+  for (auto i : Range<uint32_t>(1, thread_count)) {
+    m_workers.emplace_back(&JobSystem::worker_main, this, i);
+  }
+}
+
+JobSystem::~JobSystem() {
+  m_quit.store(true);
+  m_epoch.fetch_add(1);
+  m_epoch.notify_all();
+
+  for (auto& worker : m_workers) {
+    worker.join();
+  }
+
+  if (t_job_system == this) {
+    t_job_system = nullptr;
+    t_thread_index = ~0u;
+  }
+}
+
+uint32_t JobSystem::thread_index() const {
+  return t_job_system == this ? t_thread_index : ~0u;
+}
+
+void JobSystem::submit(Job* jobs, uint32_t count, JobCounter& counter) {
+  uint32_t index = thread_index();
+  assert(index != ~0u && "jobs must be submitted from a job system thread");
+
+  counter.pending.fetch_add(count, std::memory_order_relaxed);
+
+  for (auto i : Range<uint32_t>(count)) {
+    jobs[i].counter = &counter;
+
+    // A full deque means there is already plenty of parallel work queued
+    if (!m_deques[index]->push(&jobs[i])) {
+      execute(&jobs[i]);
+    }
+  }
+
+  m_epoch.fetch_add(1);
+  if (m_sleeping.load()) {
+    m_epoch.notify_all();
+  }
+}
+
+void JobSystem::wait(JobCounter& counter) {
+  uint32_t index = thread_index();
+  assert(index != ~0u && "jobs must be waited on from a job system thread");
+
+  while (counter.pending.load(std::memory_order_acquire)) {
+    if (Job* job = find_job(index)) {
+      execute(job);
+    }
+    else {
+      // Whatever is left is running on other threads
+      std::this_thread::yield();
+    }
+  }
+}
+
+Job* JobSystem::find_job(uint32_t thread_index) {
+  if (Job* job = m_deques[thread_index]->pop()) {
+    return job;
+  }
+
+  uint32_t count = thread_count();
+  uint32_t start = next_random();
+
+  for (auto i : Range<uint32_t>(count)) {
+    uint32_t victim = (start + i) % count;
+    if (victim == thread_index) {
+      continue;
+    }
+
+    if (Job* job = m_deques[victim]->steal()) {
+      return job;
+    }
+  }
+
+  return nullptr;
+}
+
+void JobSystem::execute(Job* job) {
+  // The counter may be freed the moment it hits zero, so read it first
+  JobCounter* counter = job->counter;
+  job->function(*job);
+  counter->pending.fetch_sub(1, std::memory_order_release);
+}
+
+void JobSystem::worker_main(uint32_t thread_index) {
+  t_job_system = this;
+  t_thread_index = thread_index;
+  t_random ^= thread_index * 0x85ebca6b;
+
+  constexpr uint32_t spin_count = 64;
+
+  while (!m_quit.load(std::memory_order_relaxed)) {
+    Job* job = nullptr;
+
+    for ([[maybe_unused]] auto i : Range<uint32_t>(spin_count)) {
+      job = find_job(thread_index);
+      if (job) {
+        break;
+      }
+      std::this_thread::yield();
+    }
+
+    if (job) {
+      execute(job);
+      continue;
+    }
+
+    // Sleep until the next submit. Registering as a sleeper before sampling the
+    // epoch means a submit either sees the sleeper and notifies, or bumps the
+    // epoch before we sample it and the recheck below finds its jobs.
+    m_sleeping.fetch_add(1);
+    uint32_t epoch = m_epoch.load();
+
+    job = find_job(thread_index);
+    if (!job && !m_quit.load()) {
+      m_epoch.wait(epoch);
+    }
+
+    m_sleeping.fetch_sub(1);
+
+    if (job) {
+      execute(job);
+    }
+  }
+}
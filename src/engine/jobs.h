@@ -0,0 +1,124 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base.h"
+
+// Number of jobs still to finish. Jobs submitted against a counter are waited on
+// with JobSystem::wait(), which is also how dependencies are expressed: a job
+// that needs other work done submits it (or is handed its counter) and waits.
+struct JobCounter {
+  std::atomic<uint32_t> pending = 0;
+};
+
+// Plain data so queues hold pointers and never allocate. The storage belongs to
+// the submitter and must outlive the job, which wait() guarantees.
+struct Job {
+  void (*function)(const Job& job);
+  void* data;
+  uint64_t begin;
+  uint64_t end;
+  JobCounter* counter;
+};
+
+// Fixed size Chase-Lev deque. The owning thread pushes and pops at the bottom,
+// other threads steal from the top.
+class JobDeque {
+public:
+  static constexpr int64_t CAPACITY = 4096;
+
+  bool push(Job* job);
+  Job* pop();
+  Job* steal();
+
+private:
+  alignas(64) std::atomic<int64_t> m_top = 0;
+  alignas(64) std::atomic<int64_t> m_bottom = 0;
+  std::atomic<Job*> m_jobs[CAPACITY] = {};
+};
+
+// Work-stealing scheduler with one deque per thread. The thread that creates the
+// system is thread 0 and takes part whenever it waits. Workers steal from random
+// victims when their own deque is empty and sleep when there is no work at all.
+class JobSystem {
+public:
+  // Total threads including the creating one; 0 uses every hardware thread
+  explicit JobSystem(uint32_t thread_count = 0);
+  ~JobSystem();
+
+  // Must be called from a thread of this system
+  void submit(Job* jobs, uint32_t count, JobCounter& counter);
+  // Runs queued jobs until 'counter' reaches zero
+  void wait(JobCounter& counter);
+
+  // Calls fn(Range<T>) on pieces of at most 'grain' items, splitting recursively
+  // so that idle threads steal large halves first
+  template<typename T, typename F>
+  void parallel_for(Range<T> range, T grain, const F& fn);
+
+  uint32_t thread_count() const { return (uint32_t)m_deques.size(); }
+  // Index of the calling thread within this system, or ~0u for outside threads
+  uint32_t thread_index() const;
+
+private:
+  void worker_main(uint32_t thread_index);
+  Job* find_job(uint32_t thread_index);
+  void execute(Job* job);
+
+  template<typename T, typename F>
+  struct ForContext {
+    JobSystem* system;
+    const F* fn;
+    T grain;
+  };
+
+  template<typename T, typename F>
+  static void split_for(ForContext<T, F>& context, T lower, T upper);
+
+private:
+  std::vector<std::unique_ptr<JobDeque>> m_deques;
+  std::vector<std::thread> m_workers;
+  std::atomic<uint32_t> m_epoch = 0;    // Bumped on every submit; sleepers wait on it
+  std::atomic<uint32_t> m_sleeping = 0;
+  std::atomic<bool> m_quit = false;
+};
+
+template<typename T, typename F>
+void JobSystem::parallel_for(Range<T> range, T grain, const F& fn) {
+  if (range.upper <= range.lower) {
+    return;
+  }
+
+  ForContext<T, F> context = { this, &fn, std::max<T>(grain, 1) };
+  split_for(context, range.lower, range.upper);
+}
+
+template<typename T, typename F>
+void JobSystem::split_for(ForContext<T, F>& context, T lower, T upper) {
+  if (upper - lower <= context.grain) {
+    (*context.fn)(Range<T>(lower, upper));
+    return;
+  }
+
+  // The upper half goes up for stealing while this thread carries on with the
+  // lower half; both live on this stack frame until the wait returns
+  T mid = lower + (upper - lower) / 2;
+
+  JobCounter counter;
+  Job job = {
+    .function = [](const Job& job) {
+      split_for(*(ForContext<T, F>*)job.data, (T)job.begin, (T)job.end);
+    },
+    .data = &context,
+    .begin = (uint64_t)mid,
+    .end = (uint64_t)upper,
+  };
+
+  context.system->submit(&job, 1, counter);
+  split_for(context, lower, mid);
+  context.system->wait(counter);
+}
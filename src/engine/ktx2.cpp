@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "ktx2.h"
+#include "base.h"
+
+static constexpr uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// The fixed part of a KTX2 file, up to the level index
+struct Ktx2Header {
+  uint8_t identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+};
+
+static_assert(sizeof(Ktx2Header) == 80);
+
+struct Ktx2LevelIndex {
+  uint64_t byte_offset;
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+};
+
+FormatBlock format_block(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+      return { 4, 1, 1 };
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+      return { 8, 4, 4 };
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+      return { 16, 4, 4 };
+    case VK_FORMAT_ASTC_4x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_4x4_SRGB_BLOCK:
+      return { 16, 4, 4 };
+    case VK_FORMAT_ASTC_5x4_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_5x4_SRGB_BLOCK:
+      return { 16, 5, 4 };
+    case VK_FORMAT_ASTC_5x5_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_5x5_SRGB_BLOCK:
+      return { 16, 5, 5 };
+    case VK_FORMAT_ASTC_6x5_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_6x5_SRGB_BLOCK:
+      return { 16, 6, 5 };
+    case VK_FORMAT_ASTC_6x6_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_6x6_SRGB_BLOCK:
+      return { 16, 6, 6 };
+    case VK_FORMAT_ASTC_8x5_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_8x5_SRGB_BLOCK:
+      return { 16, 8, 5 };
+    case VK_FORMAT_ASTC_8x6_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_8x6_SRGB_BLOCK:
+      return { 16, 8, 6 };
+    case VK_FORMAT_ASTC_8x8_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_8x8_SRGB_BLOCK:
+      return { 16, 8, 8 };
+    case VK_FORMAT_ASTC_10x5_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_10x5_SRGB_BLOCK:
+      return { 16, 10, 5 };
+    case VK_FORMAT_ASTC_10x6_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_10x6_SRGB_BLOCK:
+      return { 16, 10, 6 };
+    case VK_FORMAT_ASTC_10x8_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_10x8_SRGB_BLOCK:
+      return { 16, 10, 8 };
+    case VK_FORMAT_ASTC_10x10_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_10x10_SRGB_BLOCK:
+      return { 16, 10, 10 };
+    case VK_FORMAT_ASTC_12x10_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_12x10_SRGB_BLOCK:
+      return { 16, 12, 10 };
+    case VK_FORMAT_ASTC_12x12_UNORM_BLOCK:
+    case VK_FORMAT_ASTC_12x12_SRGB_BLOCK:
+      return { 16, 12, 12 };
+    default:
+      return {};
+  }
+}
+
+bool is_bc_format(VkFormat format) {
+  return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+bool is_astc_format(VkFormat format) {
+  return format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+}
+
+static size_t level_size(FormatBlock block, uint32_t width, uint32_t height) {
+  size_t blocks_x = (width + block.width - 1) / block.width;
+  size_t blocks_y = (height + block.height - 1) / block.height;
+  return blocks_x * blocks_y * block.bytes;
+}
+
+std::optional<Ktx2Texture> parse_ktx2(const uint8_t* data, size_t size, const char** error) {
+  auto invalid = [&](const char* reason) {
+    *error = reason;
+    return std::nullopt;
+  };
+
+  Ktx2Header header;
+  if (size < sizeof(header)) {
+    return invalid("truncated header");
+  }
+
+  memcpy(&header, data, sizeof(header));
+
+  if (memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier))) {
+    return invalid("not a KTX2 file");
+  }
+
+  // Basis Universal and zstd payloads would need a transcoder first
+  if (header.supercompression_scheme != 0) {
+    return invalid("supercompressed payloads are not supported");
+  }
+
+  if (header.pixel_depth > 1 || header.layer_count > 1 || header.face_count != 1) {
+    return invalid("only single 2D textures are supported");
+  }
+
+  VkFormat format = (VkFormat)header.vk_format;
+  FormatBlock block = format_block(format);
+
+  if (!block.bytes) {
+    return invalid("unsupported format");
+  }
+
+  if (!header.pixel_width || !header.pixel_height) {
+    return invalid("empty texture");
+  }
+
+  // Zero asks the loader to generate mips, which is left to the cooking tools
+  uint32_t level_count = std::max(header.level_count, 1u);
+  uint32_t max_levels = 32 - std::countl_zero(std::max(header.pixel_width, header.pixel_height));
+
+  if (level_count > max_levels) {
+    return invalid("more levels than the size allows");
+  }
+
+  if (sizeof(header) + (uint64_t)level_count * sizeof(Ktx2LevelIndex) > size) {
+    return invalid("truncated level index");
+  }
+
+  Ktx2Texture texture = {
+    .format = format,
+    .width = header.pixel_width,
+    .height = header.pixel_height,
+  };
+
+  const uint8_t* index = data + sizeof(header);
+
+  for (auto i : Range<uint32_t>(level_count)) {
+    Ktx2LevelIndex level;
+    memcpy(&level, index + i * sizeof(level), sizeof(level));
+
+    uint32_t width = std::max(header.pixel_width >> i, 1u);
+    uint32_t height = std::max(header.pixel_height >> i, 1u);
+
+    if (level.byte_offset > size || level.byte_length > size - level.byte_offset) {
+      return invalid("level past the end of the file");
+    }
+
+    if (level.byte_length != level_size(block, width, height)) {
+      return invalid("level size doesn't match its format");
+    }
+
+    texture.levels.push_back(Ktx2Level {
+      .offset = (size_t)level.byte_offset,
+      .size = (size_t)level.byte_length,
+      .width = width,
+      .height = height,
+    });
+  }
+
+  return texture;
+}
+
+std::vector<uint8_t> write_ktx2(VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels) {
+  Ktx2Header header = {
+    .vk_format = (uint32_t)format,
+    .type_size = 1,
+    .pixel_width = width,
+    .pixel_height = height,
+    .face_count = 1,
+    .level_count = (uint32_t)levels.size(),
+  };
+
+  memcpy(header.identifier, ktx2_identifier, sizeof(ktx2_identifier));
+
+  // Levels are stored coarsest first, each 16 byte aligned, which covers the
+  // block size of every format taken
+  size_t data_start = sizeof(header) + levels.size() * sizeof(Ktx2LevelIndex);
+  std::vector<Ktx2LevelIndex> index(levels.size());
+  size_t offset = data_start;
+
+  for (size_t i = levels.size(); i-- > 0;) {
+    offset = (offset + 15) & ~(size_t)15;
+    index[i] = Ktx2LevelIndex {
+      .byte_offset = offset,
+      .byte_length = levels[i].size(),
+      .uncompressed_byte_length = levels[i].size(),
+    };
+
+    offset += levels[i].size();
+  }
+
+  std::vector<uint8_t> file(offset);
+  memcpy(file.data(), &header, sizeof(header));
+  memcpy(file.data() + sizeof(header), index.data(), index.size() * sizeof(Ktx2LevelIndex));
+
+  for (auto i : Range<size_t>(levels.size())) {
+    memcpy(file.data() + index[i].byte_offset, levels[i].data(), levels[i].size());
+  }
+
+  return file;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Where a mip level's data lies in a KTX2 file, finest level first
+struct Ktx2Level {
+  size_t offset;
+  size_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+// A 2D KTX2 texture whose levels can be copied to an image as they are: one
+// face, no array layers and no supercompression. Block compressed payloads are
+// tightly packed blocks, so each level goes to the GPU untouched.
+struct Ktx2Texture {
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  std::vector<Ktx2Level> levels;
+};
+
+// Bytes per block and block size in texels; zero bytes for formats the
+// texture streamer doesn't take
+struct FormatBlock {
+  uint32_t bytes;
+  uint32_t width;
+  uint32_t height;
+};
+
+FormatBlock format_block(VkFormat format);
+bool is_bc_format(VkFormat format);
+bool is_astc_format(VkFormat format);
+
+// Checks the header and level index against the file size and the format's
+// block size. Returns nullopt with the reason in 'error'.
+std::optional<Ktx2Texture> parse_ktx2(const uint8_t* data, size_t size, const char** error);
+
+// A KTX2 file holding 'levels' (finest first), for tools and benchmarks that
+// make their own textures. There is no data format descriptor, which
+// parse_ktx2() doesn't read but stricter readers may want.
+std::vector<uint8_t> write_ktx2(VkFormat format, uint32_t width, uint32_t height, const std::vector<std::vector<uint8_t>>& levels);
@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "mesh.h"
+#include "base.h"
+
+MeshLoader::MeshLoader(GpuAllocator& allocator, Uploader& uploader, BindlessHeap& bindless)
+  : m_allocator(allocator), m_uploader(uploader), m_bindless(bindless)
+{
+}
+
+std::optional<GpuMesh> MeshLoader::load(const char* path) {
+  std::optional<MappedFile> mapped = map_binary(path);
+  if (!mapped) {
+    std::cerr << std::format("Missing mesh '{}'", path) << std::endl;
+    return std::nullopt;
+  }
+
+  auto file = std::make_shared<const MappedFile>(std::move(*mapped));
+
+  auto invalid = [&](const char* reason) {
+    std::cerr << std::format("Invalid mesh '{}': {}", path, reason) << std::endl;
+    return std::nullopt;
+  };
+
+  MeshFileHeader header;
+  if (file->size() < sizeof(header)) {
+    return invalid("truncated header");
+  }
+
+  memcpy(&header, file->data(), sizeof(header));
+
+  if (header.magic != mesh_file_magic) {
+    return invalid("not a cooked mesh");
+  }
+
+  if (header.version != mesh_file_version) {
+    return invalid("cooked by a different version of the cooker");
+  }
+
+  if (header.index_size != 2 && header.index_size != 4) {
+    return invalid("bad index size");
+  }
+
+  if (sizeof(header) + (uint64_t)header.chunk_count * sizeof(MeshChunk) > file->size()) {
+    return invalid("truncated chunk table");
+  }
+
+  // The table follows the 52 byte header, so it isn't aligned for MeshChunk's
+  // 64 bit fields; entries are copied out like the header
+  const uint8_t* chunk_table = file->data() + sizeof(header);
+  MeshChunk known_chunks[7];
+  const MeshChunk* chunks[7] = {};
+
+  for (auto i : Range<uint32_t>(header.chunk_count)) {
+    MeshChunk chunk;
+    memcpy(&chunk, chunk_table + (size_t)i * sizeof(MeshChunk), sizeof(chunk));
+
+    if (chunk.offset > file->size() || chunk.size > file->size() - chunk.offset) {
+      return invalid("chunk past the end of the file");
+    }
+
+    // Unknown chunks are left for newer loaders
+    if ((uint32_t)chunk.type < std::size(chunks)) {
+      known_chunks[(uint32_t)chunk.type] = chunk;
+      chunks[(uint32_t)chunk.type] = &known_chunks[(uint32_t)chunk.type];
+    }
+  }
+
+  auto chunk_matches = [&](MeshChunkType type, uint64_t size) {
+    const MeshChunk* chunk = chunks[(uint32_t)type];
+    return chunk && chunk->size == size;
+  };
+
+  if (!chunk_matches(MeshChunkType::Vertices, (uint64_t)header.vertex_count * sizeof(MeshVertex)) ||
+      !chunk_matches(MeshChunkType::Indices, (uint64_t)header.index_count * header.index_size) ||
+      !chunk_matches(MeshChunkType::Lods, (uint64_t)header.lod_count * sizeof(MeshLod)) ||
+      !chunk_matches(MeshChunkType::Meshlets, (uint64_t)header.meshlet_count * sizeof(MeshMeshlet)) ||
+      !chunk_matches(MeshChunkType::MeshletBounds, (uint64_t)header.meshlet_count * sizeof(MeshMeshletBounds)) ||
+      !chunk_matches(MeshChunkType::MeshletVertices, (uint64_t)header.meshlet_vertex_count * sizeof(uint32_t)) ||
+      !chunk_matches(MeshChunkType::MeshletTriangles, header.index_count)) {
+    return invalid("chunk sizes don't match the header");
+  }
+
+  if (!header.vertex_count || !header.index_count || !header.lod_count) {
+    return invalid("empty");
+  }
+
+  // Culling counts draws per LOD in fixed arrays of this size
+  if (header.lod_count > mesh_max_lods) {
+    return invalid("too many LODs");
+  }
+
+  GpuMesh mesh = {
+    .index_type = header.index_size == 2 ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32,
+    .lods = std::vector<MeshLod>(header.lod_count),
+    .meshlets = std::vector<MeshMeshlet>(header.meshlet_count),
+    .center = { header.center[0], header.center[1], header.center[2] },
+    .radius = header.radius,
+  };
+
+  // The tables are small and outlive the mapping
+  memcpy(mesh.lods.data(), file->data() + chunks[(uint32_t)MeshChunkType::Lods]->offset, mesh.lods.size() * sizeof(MeshLod));
+  memcpy(mesh.meshlets.data(), file->data() + chunks[(uint32_t)MeshChunkType::Meshlets]->offset, mesh.meshlets.size() * sizeof(MeshMeshlet));
+
+  for (auto& lod : mesh.lods) {
+    if ((uint64_t)lod.first_index + lod.index_count > header.index_count || (uint64_t)lod.first_meshlet + lod.meshlet_count > header.meshlet_count) {
+      return invalid("LOD out of range");
+    }
+  }
+
+  // Shaders index the meshlet chunks with these unchecked
+  for (auto& meshlet : mesh.meshlets) {
+    if ((uint64_t)meshlet.first_index + meshlet.triangle_count * 3 > header.index_count ||
+        (uint64_t)meshlet.first_vertex + meshlet.vertex_count > header.meshlet_vertex_count ||
+        meshlet.vertex_count > mesh_meshlet_max_vertices || meshlet.triangle_count > mesh_meshlet_max_triangles) {
+      return invalid("meshlet out of range");
+    }
+  }
+
+  // Vertex fetches are just as unchecked, through the index buffer, the
+  // meshlet vertex lists and the local indices into those lists
+  auto read_u32 = [&](MeshChunkType type, uint64_t index, uint32_t size) {
+    uint32_t value = 0;
+    memcpy(&value, file->data() + chunks[(uint32_t)type]->offset + index * size, size);
+    return value;
+  };
+
+  for (auto i : Range<uint32_t>(header.index_count)) {
+    if (read_u32(MeshChunkType::Indices, i, header.index_size) >= header.vertex_count) {
+      return invalid("index out of range");
+    }
+  }
+
+  for (auto i : Range<uint32_t>(header.meshlet_vertex_count)) {
+    if (read_u32(MeshChunkType::MeshletVertices, i, sizeof(uint32_t)) >= header.vertex_count) {
+      return invalid("meshlet vertex out of range");
+    }
+  }
+
+  for (auto& meshlet : mesh.meshlets) {
+    for (auto i : Range<uint32_t>(meshlet.first_index, meshlet.first_index + meshlet.triangle_count * 3)) {
+      if (read_u32(MeshChunkType::MeshletTriangles, i, 1) >= meshlet.vertex_count) {
+        return invalid("meshlet triangle out of range");
+      }
+    }
+  }
+
+  auto upload_chunk = [&](MeshChunkType type, VkBufferUsageFlags usage, GpuBuffer& buffer, BindlessHandle* handle) {
+    const MeshChunk& chunk = *chunks[(uint32_t)type];
+
+    // Shaders read the byte sized local indices a uint at a time
+    VkDeviceSize size = std::max<VkDeviceSize>((chunk.size + 3) & ~3ull, 4);
+
+    buffer = m_allocator.create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, GpuMemoryUsage::GpuOnly);
+    if (handle) {
+      *handle = m_bindless.add_buffer(buffer.buffer);
+    }
+
+    return chunk.size ? m_uploader.upload_buffer(buffer.buffer, 0, file, chunk.offset, chunk.size) : 0;
+  };
+
+  upload_chunk(MeshChunkType::Vertices, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.vertex_buffer, &mesh.vertex_handle);
+  upload_chunk(MeshChunkType::Lods, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.lod_buffer, &mesh.lod_handle);
+  upload_chunk(MeshChunkType::Meshlets, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.meshlet_buffer, &mesh.meshlet_handle);
+  upload_chunk(MeshChunkType::MeshletBounds, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.meshlet_bounds_buffer, &mesh.meshlet_bounds_handle);
+  upload_chunk(MeshChunkType::MeshletVertices, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.meshlet_vertex_buffer, &mesh.meshlet_vertex_handle);
+  upload_chunk(MeshChunkType::MeshletTriangles, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, mesh.meshlet_triangle_buffer, &mesh.meshlet_triangle_handle);
+
+  // Uploads complete in order, so the last one stands for all of them
+  mesh.ticket = upload_chunk(MeshChunkType::Indices, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, mesh.index_buffer, nullptr);
+
+  return mesh;
+}
+
+void MeshLoader::destroy(const GpuMesh& mesh) {
+  for (BindlessHandle handle : { mesh.vertex_handle, mesh.lod_handle, mesh.meshlet_handle, mesh.meshlet_bounds_handle, mesh.meshlet_vertex_handle, mesh.meshlet_triangle_handle }) {
+    m_bindless.remove(handle);
+    m_bindless.release(handle);
+  }
+
+  for (const GpuBuffer& buffer : { mesh.vertex_buffer, mesh.index_buffer, mesh.lod_buffer, mesh.meshlet_buffer, mesh.meshlet_bounds_buffer, mesh.meshlet_vertex_buffer, mesh.meshlet_triangle_buffer }) {
+    m_allocator.destroy_buffer(buffer);
+  }
+}
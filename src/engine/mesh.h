@@ -0,0 +1,57 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+#include "uploader.h"
+#include "bindless.h"
+#include "mesh_format.h"
+
+// A cooked mesh in GPU memory. Vertices are a storage buffer that vertex
+// shaders fetch through the bindless heap; every LOD's indices are in the one
+// index buffer, at the ranges in 'lods'. The LOD table and meshlet chunks are
+// storage buffers in the heap too, for culling and mesh shaders.
+struct GpuMesh {
+  GpuBuffer vertex_buffer;
+  GpuBuffer index_buffer;
+  GpuBuffer lod_buffer; // 'lods', for LOD selection on the GPU
+  GpuBuffer meshlet_buffer;
+  GpuBuffer meshlet_bounds_buffer;
+  GpuBuffer meshlet_vertex_buffer;
+  GpuBuffer meshlet_triangle_buffer;
+  BindlessHandle vertex_handle;
+  BindlessHandle lod_handle;
+  BindlessHandle meshlet_handle;
+  BindlessHandle meshlet_bounds_handle;
+  BindlessHandle meshlet_vertex_handle;
+  BindlessHandle meshlet_triangle_handle;
+  VkIndexType index_type;
+  std::vector<MeshLod> lods;
+  std::vector<MeshMeshlet> meshlets;
+  float center[3];
+  float radius;
+  UploadTicket ticket; // Of the last chunk; the mesh may be drawn once it is ready
+};
+
+// Loads cooked mesh files (see mesh_format.h). The file is mapped and its
+// chunks are queued on the uploader straight from the
+// mapping, so nothing is parsed and no copy is made on the heap; the file is
+// unmapped once the chunks have gone through staging.
+class MeshLoader {
+public:
+  MeshLoader(GpuAllocator& allocator, Uploader& uploader, BindlessHeap& bindless);
+
+  // Returns nullopt, after printing why, for missing or malformed files
+  std::optional<GpuMesh> load(const char* path);
+  // Once no frame in flight uses the mesh
+  void destroy(const GpuMesh& mesh);
+
+  bool is_ready(const GpuMesh& mesh) const { return m_uploader.is_ready(mesh.ticket); }
+
+private:
+  GpuAllocator& m_allocator;
+  Uploader& m_uploader;
+  BindlessHeap& m_bindless;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+
+// Cooked mesh files, written by the mesh_cooker tool and read by MeshLoader.
+//
+// A file is a MeshFileHeader, a table of 'chunk_count' MeshChunks, and the
+// chunk payloads, each 16 byte aligned so they can be copied from a mapping
+// straight into GPU buffers. Every LOD's triangles are in one index buffer
+// shared by the whole chain, and all of them index the same vertices.
+//
+// Positions are normalized into the unit sphere around 'center' and stored as
+// 16 bit snorm; colors are 8 bit unorm. Indices are ordered for the post
+// transform vertex cache, and then cut into meshlets, each a contiguous run of
+// at most mesh_meshlet_max_triangles triangles touching at most
+// mesh_meshlet_max_vertices vertices. Vertices are ordered by first use.
+//
+// Meshlets can be drawn two ways: as their run of the index buffer, or by a
+// mesh shader from their own vertex list and 8 bit local indices. The local
+// indices parallel the index buffer, one byte per index.
+
+static constexpr uint32_t mesh_file_magic = 0x48534d56; // "VMSH"
+static constexpr uint32_t mesh_file_version = 2;
+static constexpr uint32_t mesh_chunk_alignment = 16;
+static constexpr uint32_t mesh_max_lods = 8;
+static constexpr uint32_t mesh_meshlet_max_vertices = 64;
+static constexpr uint32_t mesh_meshlet_max_triangles = 124;
+
+enum class MeshChunkType : uint32_t {
+  Vertices, // MeshVertex[vertex_count]
+  Indices,  // uint16_t or uint32_t [index_count], see index_size
+  Lods,     // MeshLod[lod_count], finest first
+  Meshlets, // MeshMeshlet[meshlet_count], each LOD's in a contiguous range
+  MeshletBounds,    // MeshMeshletBounds[meshlet_count]
+  MeshletVertices,  // uint32_t, each meshlet's vertex_count vertices from first_vertex
+  MeshletTriangles, // uint8_t[index_count], indices into the meshlet's vertices
+};
+
+struct MeshFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t chunk_count;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  uint32_t index_size; // 2 or 4 bytes
+  uint32_t lod_count;
+  uint32_t meshlet_count;
+  uint32_t meshlet_vertex_count;
+  float center[3];     // Of the source positions, which are scaled by 1 / radius
+  float radius;
+};
+
+struct MeshChunk {
+  MeshChunkType type;
+  uint32_t padding;
+  uint64_t offset; // From the start of the file
+  uint64_t size;
+};
+
+// Matches Vertex in instanced.vert: unpackSnorm2x16(position_xy),
+// unpackSnorm2x16(position_z).x and unpackUnorm4x8(color)
+struct MeshVertex {
+  uint32_t position_xy;
+  uint32_t position_z;
+  uint32_t color;
+};
+
+// Matches MeshLod in cull.comp (std430), which reads the table to pick LODs
+struct MeshLod {
+  uint32_t first_index;
+  uint32_t index_count;
+  uint32_t first_meshlet;
+  uint32_t meshlet_count;
+  float error; // Distance the surface moved from the finest LOD, in normalized units; never less than a finer LOD's
+};
+
+// Matches Meshlet in the meshlet shaders (std430)
+struct MeshMeshlet {
+  uint32_t first_index;
+  uint32_t triangle_count;
+  uint32_t vertex_count; // Distinct vertices referenced
+  uint32_t first_vertex; // In the meshlet vertex chunk
+};
+
+// Matches MeshletBounds in the meshlet shaders (std430). In normalized units.
+// A viewer looking along a direction d sees only the backs of the meshlet's
+// triangles when dot(d, cone_axis) > cone_cutoff; the cutoff is 1 when their
+// normals are too spread for that to ever hold.
+struct MeshMeshletBounds {
+  float center[3];
+  float radius;
+  float cone_axis[3];
+  float cone_cutoff;
+};
@@ -0,0 +1,92 @@
+#include "parallel_recorder.h"
+
+ParallelRecorder::ParallelRecorder(VkDevice device, uint32_t queue_family, JobSystem& jobs, uint32_t slice_count, uint32_t frame_count)
+  : m_device(device), m_jobs(jobs), m_slice_count(slice_count), m_frame_count(frame_count)
+{
+  m_slice_frames.resize(slice_count * frame_count);
+  m_recorded.resize(slice_count);
+  m_slice_jobs.resize(slice_count);
+
+  for (auto& slice_frame : m_slice_frames) {
+    VkCommandPoolCreateInfo command_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+      .queueFamilyIndex = queue_family,
+    };
+
+    if (vkCreateCommandPool(m_device, &command_pool_info, nullptr, &slice_frame.pool) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan command pool.");
+    }
+
+    VkCommandBufferAllocateInfo cmd_buf_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = slice_frame.pool,
+      .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+      .commandBufferCount = 1
+    };
+
+    if (vkAllocateCommandBuffers(m_device, &cmd_buf_info, &slice_frame.cmd) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan secondary command buffer.");
+    }
+  }
+}
+
+ParallelRecorder::~ParallelRecorder() {
+  for (auto& slice_frame : m_slice_frames) {
+    vkDestroyCommandPool(m_device, slice_frame.pool, nullptr);
+  }
+}
+
+const std::vector<VkCommandBuffer>& ParallelRecorder::record(uint32_t frame_index, const VkCommandBufferInheritanceInfo& inheritance, uint32_t item_count, const RecordFn& fn) {
+  m_frame_index = frame_index;
+  m_inheritance = &inheritance;
+  m_item_count = item_count;
+  m_fn = &fn;
+
+  for (auto i : Range<uint32_t>(m_slice_count)) {
+    m_slice_jobs[i] = Job {
+      .function = [](const Job& job) {
+        ((ParallelRecorder*)job.data)->record_slice((uint32_t)job.begin);
+      },
+      .data = this,
+      .begin = i,
+    };
+  }
+
+  // The calling thread records slices too while it waits
+  JobCounter counter;
+  m_jobs.submit(m_slice_jobs.data(), m_slice_count, counter);
+  m_jobs.wait(counter);
+
+  for (auto i : Range<uint32_t>(m_slice_count)) {
+    m_recorded[i] = m_slice_frames[i * m_frame_count + frame_index].cmd;
+  }
+
+  return m_recorded;
+}
+
+void ParallelRecorder::record_slice(uint32_t slice) {
+  SliceFrame& slice_frame = m_slice_frames[slice * m_frame_count + m_frame_index];
+
+  // The frame's fence has been waited on, so everything from this pool is free
+  vkResetCommandPool(m_device, slice_frame.pool, 0);
+
+  VkCommandBufferBeginInfo cmd_begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+    .pInheritanceInfo = m_inheritance,
+  };
+
+  if (vkBeginCommandBuffer(slice_frame.cmd, &cmd_begin_info) != VK_SUCCESS) {
+    fatal_error("Failed to begin Vulkan secondary command buffer.");
+  }
+
+  uint32_t lower = (uint32_t)((uint64_t)m_item_count * slice / m_slice_count);
+  uint32_t upper = (uint32_t)((uint64_t)m_item_count * (slice + 1) / m_slice_count);
+
+  (*m_fn)(slice_frame.cmd, Range<uint32_t>(lower, upper));
+
+  if (vkEndCommandBuffer(slice_frame.cmd) != VK_SUCCESS) {
+    fatal_error("Failed to end Vulkan secondary command buffer.");
+  }
+}
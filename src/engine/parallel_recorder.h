@@ -0,0 +1,48 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "base.h"
+#include "jobs.h"
+
+// Records contiguous slices of a draw list into secondary command buffers, one
+// job per slice. Every (slice, frame) pair owns its command pool, so a pool is
+// only ever used by the one job recording that slice, and a frame's pools can
+// be reset as soon as that frame's fence has signalled.
+class ParallelRecorder {
+public:
+  using RecordFn = std::function<void(VkCommandBuffer cmd, Range<uint32_t> items)>;
+
+  ParallelRecorder(VkDevice device, uint32_t queue_family, JobSystem& jobs, uint32_t slice_count, uint32_t frame_count);
+  ~ParallelRecorder();
+
+  // Blocks until every slice is recorded; the buffers are returned in item order
+  const std::vector<VkCommandBuffer>& record(uint32_t frame_index, const VkCommandBufferInheritanceInfo& inheritance, uint32_t item_count, const RecordFn& fn);
+
+  uint32_t slice_count() const { return m_slice_count; }
+
+private:
+  struct SliceFrame {
+    VkCommandPool pool;
+    VkCommandBuffer cmd;
+  };
+
+  void record_slice(uint32_t slice);
+
+private:
+  VkDevice m_device;
+  JobSystem& m_jobs;
+  uint32_t m_slice_count;
+  uint32_t m_frame_count;
+  std::vector<SliceFrame> m_slice_frames; // Indexed by slice * frame_count + frame
+  std::vector<VkCommandBuffer> m_recorded;
+  std::vector<Job> m_slice_jobs;
+
+  // Current recording, valid inside record()
+  uint32_t m_frame_index = 0;
+  const VkCommandBufferInheritanceInfo* m_inheritance = nullptr;
+  uint32_t m_item_count = 0;
+  const RecordFn* m_fn = nullptr;
+};
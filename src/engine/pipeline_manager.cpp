@@ -0,0 +1,367 @@
+#include "pipeline_manager.h"
+#include "base.h"
+
+PipelineManager::PipelineManager(VkDevice device, VkPipelineCache cache, const PipelineTargets& targets, bool graphics_pipeline_library, uint32_t thread_count)
+  : m_device(device), m_cache(cache), m_targets(targets), m_graphics_pipeline_library(graphics_pipeline_library)
+{
+  m_dynamic_states[0] = VK_DYNAMIC_STATE_VIEWPORT;
+  m_dynamic_states[1] = VK_DYNAMIC_STATE_SCISSOR;
+
+  m_dynamic_state = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+    .dynamicStateCount = 2,
+    .pDynamicStates = m_dynamic_states
+  };
+
+  m_vertex_input = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+  };
+
+  m_input_assembly = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+  };
+
+  m_viewport_state = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+    .viewportCount = 1,
+    .scissorCount = 1
+  };
+
+  m_multisample = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+    .sampleShadingEnable = VK_FALSE,
+    .minSampleShading = 1.0f
+  };
+
+  m_blend_attachment = {
+    .blendEnable = VK_FALSE,
+    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+  };
+
+  m_blend_state = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+    .logicOpEnable = VK_FALSE,
+    .attachmentCount = 1,
+    .pAttachments = &m_blend_attachment,
+  };
+
+  m_rendering_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+    .colorAttachmentCount = 1,
+    .pColorAttachmentFormats = &m_targets.color_format,
+    .depthAttachmentFormat = m_targets.depth_format,
+  };
+
+  // The interface libraries hold no shaders and are cheap to build up front
+  if (m_graphics_pipeline_library) {
+    m_vertex_input_library = interface_library(VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT);
+    m_fragment_output_library = interface_library(VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_OUTPUT_INTERFACE_BIT_EXT);
+  }
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(std::max(thread_count, 1u))) {
+    m_threads.emplace_back(&PipelineManager::compile_thread, this);
+  }
+}
+
+PipelineManager::~PipelineManager() {
+  {
+    std::lock_guard lock(m_queue_mutex);
+    m_quit = true;
+  }
+
+  m_queue_cv.notify_all();
+
+  for (auto& thread : m_threads) {
+    thread.join();
+  }
+
+  for (auto& entry : m_entries) {
+    // The placeholder is already destroyed if update() replaced it
+    if (entry->linked && entry->current != entry->optimized) {
+      vkDestroyPipeline(m_device, entry->linked, nullptr);
+    }
+
+    vkDestroyPipeline(m_device, entry->optimized, nullptr);
+  }
+
+  for (auto& library : m_pre_rasterization_libraries) {
+    vkDestroyPipeline(m_device, library.pipeline, nullptr);
+  }
+
+  for (auto& library : m_fragment_shader_libraries) {
+    vkDestroyPipeline(m_device, library.pipeline, nullptr);
+  }
+
+  vkDestroyPipeline(m_device, m_vertex_input_library, nullptr);
+  vkDestroyPipeline(m_device, m_fragment_output_library, nullptr);
+}
+
+PipelineHandle PipelineManager::request(const GraphicsPipelineDesc& desc) {
+  auto entry = std::make_unique<Entry>();
+  entry->desc = desc;
+
+  {
+    std::lock_guard lock(m_queue_mutex);
+    m_queue.push_back(entry.get());
+  }
+
+  m_queue_cv.notify_one();
+
+  m_entries.push_back(std::move(entry));
+  m_pending++;
+
+  return (PipelineHandle)m_entries.size() - 1;
+}
+
+std::vector<VkPipeline> PipelineManager::update() {
+  std::vector<VkPipeline> replaced;
+
+  for (auto& entry : m_entries) {
+    if (entry->current && entry->current == entry->optimized.load(std::memory_order_relaxed)) {
+      continue;
+    }
+
+    if (VkPipeline optimized = entry->optimized.load(std::memory_order_acquire)) {
+      // The placeholder may have been skipped, but was still created
+      if (VkPipeline linked = entry->linked.load(std::memory_order_relaxed)) {
+        replaced.push_back(linked);
+      }
+
+      entry->current = optimized;
+      m_pending--;
+    }
+    else if (!entry->current) {
+      entry->current = entry->linked.load(std::memory_order_acquire);
+    }
+  }
+
+  return replaced;
+}
+
+void PipelineManager::wait() {
+  std::unique_lock lock(m_queue_mutex);
+  m_idle_cv.wait(lock, [&] { return m_queue.empty() && m_compiling == 0; });
+}
+
+void PipelineManager::compile_thread() {
+  while (true) {
+    Entry* entry;
+
+    {
+      std::unique_lock lock(m_queue_mutex);
+      m_queue_cv.wait(lock, [&] { return m_quit || !m_queue.empty(); });
+
+      if (m_quit) {
+        return;
+      }
+
+      entry = m_queue.front();
+      m_queue.pop_front();
+      m_compiling++;
+    }
+
+    compile(*entry);
+
+    {
+      std::lock_guard lock(m_queue_mutex);
+      m_compiling--;
+    }
+
+    m_idle_cv.notify_all();
+  }
+}
+
+void PipelineManager::compile(Entry& entry) {
+  const GraphicsPipelineDesc& desc = entry.desc;
+
+  // Pipeline libraries only split the vertex pipeline into parts
+  if (!m_graphics_pipeline_library || desc.mesh_shader) {
+    std::vector<VkPipelineShaderStageCreateInfo> stages;
+
+    if (desc.mesh_shader) {
+      if (desc.task_shader) {
+        stages.push_back(make_stage(VK_SHADER_STAGE_TASK_BIT_EXT, desc.task_shader));
+      }
+
+      stages.push_back(make_stage(VK_SHADER_STAGE_MESH_BIT_EXT, desc.mesh_shader));
+    }
+    else {
+      stages.push_back(make_stage(VK_SHADER_STAGE_VERTEX_BIT, desc.vertex_shader));
+    }
+
+    stages.push_back(make_stage(VK_SHADER_STAGE_FRAGMENT_BIT, desc.fragment_shader));
+
+    VkPipelineRasterizationStateCreateInfo rasterization = rasterization_state(desc);
+    VkPipelineDepthStencilStateCreateInfo depth_stencil = depth_stencil_state(desc);
+
+    VkGraphicsPipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+      .pNext = m_targets.render_pass ? nullptr : &m_rendering_info,
+      .stageCount = (uint32_t)stages.size(),
+      .pStages = stages.data(),
+      .pVertexInputState = desc.mesh_shader ? nullptr : &m_vertex_input,
+      .pInputAssemblyState = desc.mesh_shader ? nullptr : &m_input_assembly,
+      .pViewportState = &m_viewport_state,
+      .pRasterizationState = &rasterization,
+      .pMultisampleState = &m_multisample,
+      .pDepthStencilState = &depth_stencil,
+      .pColorBlendState = &m_blend_state,
+      .pDynamicState = &m_dynamic_state,
+      .layout = desc.layout,
+      .renderPass = m_targets.render_pass,
+      .subpass = 0
+    };
+
+    entry.optimized.store(create(pipeline_info), std::memory_order_release);
+    return;
+  }
+
+  VkPipeline libraries[] = {
+    m_vertex_input_library,
+    shader_library(m_pre_rasterization_libraries, VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT, desc),
+    shader_library(m_fragment_shader_libraries, VK_GRAPHICS_PIPELINE_LIBRARY_FRAGMENT_SHADER_BIT_EXT, desc),
+    m_fragment_output_library,
+  };
+
+  VkPipelineLibraryCreateInfoKHR library_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_LIBRARY_CREATE_INFO_KHR,
+    .libraryCount = 4,
+    .pLibraries = libraries,
+  };
+
+  VkGraphicsPipelineCreateInfo link_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+    .pNext = &library_info,
+    .layout = desc.layout,
+  };
+
+  // Linking without optimization only stitches the compiled stages together
+  entry.linked.store(create(link_info), std::memory_order_release);
+
+  link_info.flags = VK_PIPELINE_CREATE_LINK_TIME_OPTIMIZATION_BIT_EXT;
+  entry.optimized.store(create(link_info), std::memory_order_release);
+}
+
+VkPipeline PipelineManager::create(const VkGraphicsPipelineCreateInfo& info) {
+  VkPipeline pipeline;
+  if (vkCreateGraphicsPipelines(m_device, m_cache, 1, &info, nullptr, &pipeline) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan graphics pipeline.");
+  }
+
+  return pipeline;
+}
+
+VkPipeline PipelineManager::interface_library(VkGraphicsPipelineLibraryFlagsEXT part) {
+  VkGraphicsPipelineLibraryCreateInfoEXT library_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+    .pNext = m_targets.render_pass ? nullptr : &m_rendering_info,
+    .flags = part,
+  };
+
+  bool vertex_input = part == VK_GRAPHICS_PIPELINE_LIBRARY_VERTEX_INPUT_INTERFACE_BIT_EXT;
+
+  VkGraphicsPipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+    .pNext = &library_info,
+    .flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT,
+    .pVertexInputState = vertex_input ? &m_vertex_input : nullptr,
+    .pInputAssemblyState = vertex_input ? &m_input_assembly : nullptr,
+    .pMultisampleState = vertex_input ? nullptr : &m_multisample,
+    .pColorBlendState = vertex_input ? nullptr : &m_blend_state,
+    .renderPass = m_targets.render_pass,
+  };
+
+  return create(pipeline_info);
+}
+
+// Libraries are shared by every pipeline using the same shader, layout and
+// state, so each shader is compiled once. Two threads may race to build the
+// same one; the loser's copy is dropped.
+VkPipeline PipelineManager::shader_library(std::vector<Library>& cache, VkGraphicsPipelineLibraryFlagsEXT part, const GraphicsPipelineDesc& desc) {
+  bool pre_rasterization = part == VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT;
+  VkShaderModule shader = pre_rasterization ? desc.vertex_shader : desc.fragment_shader;
+  uint32_t state = pre_rasterization ? (uint32_t)desc.cull_mode : (uint32_t)desc.depth_compare << 1 | desc.depth_write;
+
+  auto find = [&]() -> VkPipeline {
+    for (auto& library : cache) {
+      if (library.shader == shader && library.layout == desc.layout && library.state == state) {
+        return library.pipeline;
+      }
+    }
+
+    return nullptr;
+  };
+
+  {
+    std::lock_guard lock(m_library_mutex);
+    if (VkPipeline pipeline = find()) {
+      return pipeline;
+    }
+  }
+
+  VkGraphicsPipelineLibraryCreateInfoEXT library_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_LIBRARY_CREATE_INFO_EXT,
+    .pNext = m_targets.render_pass ? nullptr : &m_rendering_info,
+    .flags = part,
+  };
+
+  VkPipelineShaderStageCreateInfo stage = make_stage(pre_rasterization ? VK_SHADER_STAGE_VERTEX_BIT : VK_SHADER_STAGE_FRAGMENT_BIT, shader);
+  VkPipelineRasterizationStateCreateInfo rasterization = rasterization_state(desc);
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = depth_stencil_state(desc);
+
+  VkGraphicsPipelineCreateInfo pipeline_info = {
+    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+    .pNext = &library_info,
+    .flags = VK_PIPELINE_CREATE_LIBRARY_BIT_KHR | VK_PIPELINE_CREATE_RETAIN_LINK_TIME_OPTIMIZATION_INFO_BIT_EXT,
+    .stageCount = 1,
+    .pStages = &stage,
+    .pViewportState = pre_rasterization ? &m_viewport_state : nullptr,
+    .pRasterizationState = pre_rasterization ? &rasterization : nullptr,
+    .pMultisampleState = pre_rasterization ? nullptr : &m_multisample,
+    .pDepthStencilState = pre_rasterization ? nullptr : &depth_stencil,
+    .pDynamicState = pre_rasterization ? &m_dynamic_state : nullptr,
+    .layout = desc.layout,
+    .renderPass = m_targets.render_pass,
+  };
+
+  VkPipeline pipeline = create(pipeline_info);
+
+  std::lock_guard lock(m_library_mutex);
+
+  if (VkPipeline existing = find()) {
+    vkDestroyPipeline(m_device, pipeline, nullptr);
+    return existing;
+  }
+
+  cache.push_back(Library { shader, desc.layout, state, pipeline });
+  return pipeline;
+}
+
+VkPipelineShaderStageCreateInfo PipelineManager::make_stage(VkShaderStageFlagBits stage, VkShaderModule module) {
+  return VkPipelineShaderStageCreateInfo {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+    .stage = stage,
+    .module = module,
+    .pName = "main"
+  };
+}
+
+VkPipelineRasterizationStateCreateInfo PipelineManager::rasterization_state(const GraphicsPipelineDesc& desc) {
+  return VkPipelineRasterizationStateCreateInfo {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+    .cullMode = desc.cull_mode,
+    .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+    .lineWidth = 1.0f,
+  };
+}
+
+VkPipelineDepthStencilStateCreateInfo PipelineManager::depth_stencil_state(const GraphicsPipelineDesc& desc) {
+  return VkPipelineDepthStencilStateCreateInfo {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+    .depthTestEnable = VK_TRUE,
+    .depthWriteEnable = desc.depth_write,
+    .depthCompareOp = desc.depth_compare,
+  };
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+// Index of a pipeline requested from a PipelineManager
+using PipelineHandle = uint32_t;
+
+// What varies between the renderer's graphics pipelines. Vertex input (none),
+// triangle lists, opaque blending and dynamic viewport and scissor are shared.
+struct GraphicsPipelineDesc {
+  VkShaderModule vertex_shader;
+  VkShaderModule fragment_shader;
+  VkPipelineLayout layout;
+  VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+  VkCompareOp depth_compare = VK_COMPARE_OP_LESS_OR_EQUAL;
+  bool depth_write = true;
+  // With a mesh shader (VK_EXT_mesh_shader) the vertex shader is unused and
+  // the task shader optional; these pipelines are always compiled whole
+  VkShaderModule task_shader = nullptr;
+  VkShaderModule mesh_shader = nullptr;
+};
+
+// A render pass, or the attachment formats of dynamic rendering when it is null
+struct PipelineTargets {
+  VkRenderPass render_pass;
+  VkFormat color_format;
+  VkFormat depth_format;
+};
+
+// Compiles graphics pipelines on background threads, so requesting one never
+// blocks; get() returns null until it is ready and the draw is skipped.
+//
+// With VK_EXT_graphics_pipeline_library each shader is compiled once into a
+// library, and a pipeline is first fast-linked from libraries as a placeholder,
+// then relinked with link time optimization and swapped in by update().
+// Without it each pipeline is compiled whole.
+//
+// The compile threads are separate from the JobSystem: its threads run their
+// own queued jobs first when they wait, so a frame's parallel recording could
+// end up stuck behind a compile.
+class PipelineManager {
+public:
+  // 'graphics_pipeline_library' needs the extension (and VK_KHR_pipeline_library) enabled
+  PipelineManager(VkDevice device, VkPipelineCache cache, const PipelineTargets& targets, bool graphics_pipeline_library, uint32_t thread_count);
+  // Waits for compiles in progress; ones not started yet are dropped
+  ~PipelineManager();
+
+  PipelineHandle request(const GraphicsPipelineDesc& desc);
+  VkPipeline get(PipelineHandle handle) const { return m_entries[handle]->current; }
+
+  // Publishes finished compiles; call once per frame. Returns placeholders
+  // that optimized pipelines replaced, which frames in flight may still use.
+  std::vector<VkPipeline> update();
+  // Blocks until every requested pipeline has compiled; update() still publishes them
+  void wait();
+  // Requested pipelines whose final version isn't published yet
+  uint32_t pending() const { return m_pending; }
+  bool graphics_pipeline_library() const { return m_graphics_pipeline_library; }
+
+private:
+  struct Entry {
+    GraphicsPipelineDesc desc;
+    std::atomic<VkPipeline> linked = nullptr;    // Fast-linked placeholder
+    std::atomic<VkPipeline> optimized = nullptr;
+    VkPipeline current = nullptr;                // What get() returns; render thread only
+  };
+
+  struct Library {
+    VkShaderModule shader;
+    VkPipelineLayout layout;
+    uint32_t state; // Cull mode, or depth compare and write
+    VkPipeline pipeline;
+  };
+
+  void compile_thread();
+  void compile(Entry& entry);
+  VkPipeline create(const VkGraphicsPipelineCreateInfo& info);
+  VkPipeline interface_library(VkGraphicsPipelineLibraryFlagsEXT part);
+  VkPipeline shader_library(std::vector<Library>& cache, VkGraphicsPipelineLibraryFlagsEXT part, const GraphicsPipelineDesc& desc);
+
+  static VkPipelineShaderStageCreateInfo make_stage(VkShaderStageFlagBits stage, VkShaderModule module);
+  static VkPipelineRasterizationStateCreateInfo rasterization_state(const GraphicsPipelineDesc& desc);
+  static VkPipelineDepthStencilStateCreateInfo depth_stencil_state(const GraphicsPipelineDesc& desc);
+
+private:
+  VkDevice m_device;
+  VkPipelineCache m_cache;
+  PipelineTargets m_targets;
+  bool m_graphics_pipeline_library;
+
+  // Shared fixed function state, read by every compile thread
+  VkDynamicState m_dynamic_states[2];
+  VkPipelineDynamicStateCreateInfo m_dynamic_state;
+  VkPipelineVertexInputStateCreateInfo m_vertex_input;
+  VkPipelineInputAssemblyStateCreateInfo m_input_assembly;
+  VkPipelineViewportStateCreateInfo m_viewport_state;
+  VkPipelineMultisampleStateCreateInfo m_multisample;
+  VkPipelineColorBlendAttachmentState m_blend_attachment;
+  VkPipelineColorBlendStateCreateInfo m_blend_state;
+  VkPipelineRenderingCreateInfo m_rendering_info;
+
+  VkPipeline m_vertex_input_library = nullptr;
+  VkPipeline m_fragment_output_library = nullptr;
+  std::mutex m_library_mutex;
+  std::vector<Library> m_pre_rasterization_libraries;
+  std::vector<Library> m_fragment_shader_libraries;
+
+  std::vector<std::unique_ptr<Entry>> m_entries;
+  uint32_t m_pending = 0;
+
+  std::mutex m_queue_mutex;
+  std::condition_variable m_queue_cv;
+  std::condition_variable m_idle_cv;
+  std::deque<Entry*> m_queue;
+  uint32_t m_compiling = 0;
+  bool m_quit = false;
+  std::vector<std::thread> m_threads;
+};
@@ -0,0 +1,395 @@
+#include <algorithm>
+
+#include "post.h"
+#include "base.h"
+
+static constexpr uint32_t post_group_size = 8; // local_size_x/y in the post shaders
+static constexpr uint32_t max_bloom_levels = 6;
+static constexpr float bloom_threshold = 0.7f;
+static constexpr float bloom_strength = 0.15f;
+static constexpr float exposure = 1.0f;
+
+// Matches the BloomConstants push constant block in bloom_down.comp and bloom_up.comp
+struct BloomConstants {
+  uint32_t src_size[2];
+  uint32_t dst_size[2];
+  float threshold;
+  uint32_t prefilter;
+};
+
+// Matches the TonemapConstants push constant block in tonemap.comp
+struct TonemapConstants {
+  uint32_t size[2];
+  float exposure;
+  float bloom_strength;
+};
+
+static uint32_t group_count(uint32_t size) {
+  return (size + post_group_size - 1) / post_group_size;
+}
+
+static void level_barrier(VkCommandBuffer cmd) {
+  VkMemoryBarrier barrier = {
+    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+    .srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+    .dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+  };
+
+  vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, nullptr, 0, nullptr);
+}
+
+PostProcess::PostProcess(VkDevice device, GpuAllocator& allocator, VkPipelineCache pipeline_cache, VkShaderModule bloom_down_shader, VkShaderModule bloom_up_shader, VkShaderModule tonemap_shader)
+  : m_device(device), m_allocator(allocator)
+{
+  // Bilinear: the bloom filters take their taps between texels
+  VkSamplerCreateInfo sampler_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter = VK_FILTER_LINEAR,
+    .minFilter = VK_FILTER_LINEAR,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+    .maxLod = VK_LOD_CLAMP_NONE,
+  };
+
+  if (vkCreateSampler(m_device, &sampler_info, nullptr, &m_sampler) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan sampler.");
+  }
+
+  VkDescriptorSetLayoutBinding bindings[] = {
+    {
+      .binding = 0,
+      .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+    {
+      .binding = 1,
+      .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+      .descriptorCount = 1,
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+    },
+  };
+
+  VkDescriptorSetLayoutCreateInfo bloom_set_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = 2,
+    .pBindings = bindings,
+  };
+
+  if (vkCreateDescriptorSetLayout(m_device, &bloom_set_layout_info, nullptr, &m_bloom_set_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
+
+  // The scene and the bloom chain, then the output
+  VkDescriptorSetLayoutBinding tonemap_bindings[] = { bindings[0], bindings[0], bindings[1] };
+  tonemap_bindings[1].binding = 1;
+  tonemap_bindings[2].binding = 2;
+
+  VkDescriptorSetLayoutCreateInfo tonemap_set_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = 3,
+    .pBindings = tonemap_bindings,
+  };
+
+  if (vkCreateDescriptorSetLayout(m_device, &tonemap_set_layout_info, nullptr, &m_tonemap_set_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
+
+  auto create_layout = [&](VkDescriptorSetLayout set_layout, uint32_t constants_size) {
+    VkPushConstantRange constants_range = {
+      .stageFlags = VK_SHADER_STAGE_COMPUTE_BIT,
+      .offset = 0,
+      .size = constants_size,
+    };
+
+    VkPipelineLayoutCreateInfo layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 1,
+      .pSetLayouts = &set_layout,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &constants_range,
+    };
+
+    VkPipelineLayout layout;
+    if (vkCreatePipelineLayout(m_device, &layout_info, nullptr, &layout) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan pipeline layout.");
+    }
+
+    return layout;
+  };
+
+  m_bloom_layout = create_layout(m_bloom_set_layout, sizeof(BloomConstants));
+  m_tonemap_layout = create_layout(m_tonemap_set_layout, sizeof(TonemapConstants));
+
+  auto create_pipeline = [&](VkShaderModule shader, VkPipelineLayout layout) {
+    VkComputePipelineCreateInfo pipeline_info = {
+      .sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+      .stage = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_COMPUTE_BIT,
+        .module = shader,
+        .pName = "main",
+      },
+      .layout = layout,
+    };
+
+    VkPipeline pipeline;
+    if (vkCreateComputePipelines(m_device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan compute pipeline.");
+    }
+
+    return pipeline;
+  };
+
+  m_bloom_down_pipeline = create_pipeline(bloom_down_shader, m_bloom_layout);
+  m_bloom_up_pipeline = create_pipeline(bloom_up_shader, m_bloom_layout);
+  m_tonemap_pipeline = create_pipeline(tonemap_shader, m_tonemap_layout);
+}
+
+PostProcess::~PostProcess() {
+  vkDestroyPipeline(m_device, m_tonemap_pipeline, nullptr);
+  vkDestroyPipeline(m_device, m_bloom_up_pipeline, nullptr);
+  vkDestroyPipeline(m_device, m_bloom_down_pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_tonemap_layout, nullptr);
+  vkDestroyPipelineLayout(m_device, m_bloom_layout, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_tonemap_set_layout, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_bloom_set_layout, nullptr);
+  vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+PostTargets PostProcess::create_targets(uint32_t width, uint32_t height, uint32_t frame_count, const std::vector<uint32_t>& queue_families) {
+  PostTargets targets = {
+    .width = width,
+    .height = height,
+    .bloom_width = std::max(width / 2, 1u),
+    .bloom_height = std::max(height / 2, 1u),
+  };
+
+  targets.bloom_levels = 1;
+  while (targets.bloom_levels < max_bloom_levels && (std::min(targets.bloom_width, targets.bloom_height) >> targets.bloom_levels) > 0) {
+    targets.bloom_levels++;
+  }
+
+  bool concurrent = queue_families.size() > 1;
+
+  auto create_image = [&](VkFormat format, uint32_t image_width, uint32_t image_height, uint32_t levels, VkImageUsageFlags usage) {
+    VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = format,
+      .extent = { image_width, image_height, 1 },
+      .mipLevels = levels,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = usage,
+      .sharingMode = concurrent ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+      .queueFamilyIndexCount = concurrent ? (uint32_t)queue_families.size() : 0,
+      .pQueueFamilyIndices = concurrent ? queue_families.data() : nullptr,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+
+    return m_allocator.create_image(image_info, GpuMemoryUsage::GpuOnly);
+  };
+
+  auto create_view = [&](VkImage image, VkFormat format, uint32_t level) {
+    VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = format,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = level,
+        .levelCount = 1,
+        .layerCount = 1,
+      },
+    };
+
+    VkImageView view;
+    if (vkCreateImageView(m_device, &view_info, nullptr, &view) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan image view.");
+    }
+
+    return view;
+  };
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(frame_count)) {
+    targets.hdr.push_back(create_image(hdr_format, width, height, 1, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT));
+    targets.hdr_views.push_back(create_view(targets.hdr.back().image, hdr_format, 0));
+    targets.ldr.push_back(create_image(ldr_format, width, height, 1, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT));
+    targets.ldr_views.push_back(create_view(targets.ldr.back().image, ldr_format, 0));
+  }
+
+  targets.bloom = create_image(hdr_format, targets.bloom_width, targets.bloom_height, targets.bloom_levels, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+  for (auto i : Range<uint32_t>(targets.bloom_levels)) {
+    targets.bloom_level_views.push_back(create_view(targets.bloom.image, hdr_format, i));
+  }
+
+  uint32_t bloom_set_count = frame_count + (targets.bloom_levels - 1) * 2;
+  uint32_t set_count = bloom_set_count + frame_count;
+
+  VkDescriptorPoolSize pool_sizes[] = {
+    { .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = bloom_set_count + frame_count * 2 },
+    { .type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .descriptorCount = set_count },
+  };
+
+  VkDescriptorPoolCreateInfo pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .maxSets = set_count,
+    .poolSizeCount = 2,
+    .pPoolSizes = pool_sizes,
+  };
+
+  if (vkCreateDescriptorPool(m_device, &pool_info, nullptr, &targets.descriptor_pool) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor pool.");
+  }
+
+  std::vector<VkDescriptorSetLayout> set_layouts(bloom_set_count, m_bloom_set_layout);
+  set_layouts.resize(set_count, m_tonemap_set_layout);
+
+  std::vector<VkDescriptorSet> sets(set_count);
+
+  VkDescriptorSetAllocateInfo set_alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = targets.descriptor_pool,
+    .descriptorSetCount = set_count,
+    .pSetLayouts = set_layouts.data(),
+  };
+
+  if (vkAllocateDescriptorSets(m_device, &set_alloc_info, sets.data()) != VK_SUCCESS) {
+    fatal_error("Failed to allocate Vulkan descriptor set.");
+  }
+
+  auto next = sets.begin();
+  targets.prefilter_sets.assign(next, next + frame_count);
+  next += frame_count;
+  targets.down_sets.assign(next, next + (targets.bloom_levels - 1));
+  next += targets.bloom_levels - 1;
+  targets.up_sets.assign(next, next + (targets.bloom_levels - 1));
+  next += targets.bloom_levels - 1;
+  targets.tonemap_sets.assign(next, sets.end());
+
+  // Image infos are referenced by the writes, so reserve up front
+  std::vector<VkDescriptorImageInfo> image_infos;
+  image_infos.reserve(set_count * 3);
+
+  std::vector<VkWriteDescriptorSet> writes;
+
+  auto write = [&](VkDescriptorSet set, uint32_t binding, VkImageView view, VkImageLayout layout, bool storage) {
+    image_infos.push_back(VkDescriptorImageInfo {
+      .sampler = storage ? nullptr : m_sampler,
+      .imageView = view,
+      .imageLayout = layout,
+    });
+
+    writes.push_back(VkWriteDescriptorSet {
+      .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+      .dstSet = set,
+      .dstBinding = binding,
+      .descriptorCount = 1,
+      .descriptorType = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+      .pImageInfo = &image_infos.back(),
+    });
+  };
+
+  // The bloom chain is written as storage, so it is sampled in GENERAL too
+  for (auto i : Range<uint32_t>(frame_count)) {
+    write(targets.prefilter_sets[i], 0, targets.hdr_views[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+    write(targets.prefilter_sets[i], 1, targets.bloom_level_views[0], VK_IMAGE_LAYOUT_GENERAL, true);
+
+    write(targets.tonemap_sets[i], 0, targets.hdr_views[i], VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false);
+    write(targets.tonemap_sets[i], 1, targets.bloom_level_views[0], VK_IMAGE_LAYOUT_GENERAL, false);
+    write(targets.tonemap_sets[i], 2, targets.ldr_views[i], VK_IMAGE_LAYOUT_GENERAL, true);
+  }
+
+  for (auto i : Range<uint32_t>(targets.bloom_levels - 1)) {
+    write(targets.down_sets[i], 0, targets.bloom_level_views[i], VK_IMAGE_LAYOUT_GENERAL, false);
+    write(targets.down_sets[i], 1, targets.bloom_level_views[i + 1], VK_IMAGE_LAYOUT_GENERAL, true);
+
+    write(targets.up_sets[i], 0, targets.bloom_level_views[i + 1], VK_IMAGE_LAYOUT_GENERAL, false);
+    write(targets.up_sets[i], 1, targets.bloom_level_views[i], VK_IMAGE_LAYOUT_GENERAL, true);
+  }
+
+  vkUpdateDescriptorSets(m_device, (uint32_t)writes.size(), writes.data(), 0, nullptr);
+
+  return targets;
+}
+
+void PostProcess::destroy_targets(const PostTargets& targets) {
+  vkDestroyDescriptorPool(m_device, targets.descriptor_pool, nullptr);
+
+  for (auto view : targets.bloom_level_views) {
+    vkDestroyImageView(m_device, view, nullptr);
+  }
+
+  m_allocator.destroy_image(targets.bloom);
+
+  for (auto i : Range<size_t>(targets.hdr.size())) {
+    vkDestroyImageView(m_device, targets.hdr_views[i], nullptr);
+    vkDestroyImageView(m_device, targets.ldr_views[i], nullptr);
+    m_allocator.destroy_image(targets.hdr[i]);
+    m_allocator.destroy_image(targets.ldr[i]);
+  }
+}
+
+// Downsamples to the smallest level, thresholding into the first, then adds
+// each level back onto the one above it, blurred
+void PostProcess::bloom(VkCommandBuffer cmd, const PostTargets& targets, uint32_t frame) {
+  auto level_size = [&](uint32_t level, uint32_t* size) {
+    size[0] = std::max(targets.bloom_width >> level, 1u);
+    size[1] = std::max(targets.bloom_height >> level, 1u);
+  };
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_bloom_down_pipeline);
+
+  for (auto i : Range<uint32_t>(targets.bloom_levels)) {
+    BloomConstants constants = {
+      .src_size = { targets.width, targets.height },
+      .threshold = bloom_threshold,
+      .prefilter = i == 0,
+    };
+
+    if (i) {
+      level_barrier(cmd);
+      level_size(i - 1, constants.src_size);
+    }
+
+    level_size(i, constants.dst_size);
+
+    VkDescriptorSet set = i ? targets.down_sets[i - 1] : targets.prefilter_sets[frame];
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_bloom_layout, 0, 1, &set, 0, nullptr);
+    vkCmdPushConstants(cmd, m_bloom_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(cmd, group_count(constants.dst_size[0]), group_count(constants.dst_size[1]), 1);
+  }
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_bloom_up_pipeline);
+
+  for (uint32_t i = targets.bloom_levels - 1; i-- > 0;) {
+    BloomConstants constants = {};
+    level_size(i + 1, constants.src_size);
+    level_size(i, constants.dst_size);
+
+    level_barrier(cmd);
+
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_bloom_layout, 0, 1, &targets.up_sets[i], 0, nullptr);
+    vkCmdPushConstants(cmd, m_bloom_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+    vkCmdDispatch(cmd, group_count(constants.dst_size[0]), group_count(constants.dst_size[1]), 1);
+  }
+}
+
+void PostProcess::tonemap(VkCommandBuffer cmd, const PostTargets& targets, uint32_t frame) {
+  TonemapConstants constants = {
+    .size = { targets.width, targets.height },
+    .exposure = exposure,
+    .bloom_strength = bloom_strength,
+  };
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_tonemap_pipeline);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, m_tonemap_layout, 0, 1, &targets.tonemap_sets[frame], 0, nullptr);
+  vkCmdPushConstants(cmd, m_tonemap_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+  vkCmdDispatch(cmd, group_count(targets.width), group_count(targets.height), 1);
+}
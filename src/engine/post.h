@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+
+// The scene renders into HDR images, which the render passes and pipelines
+// target, and is tonemapped into LDR ones in the backbuffer's format
+static constexpr VkFormat hdr_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+static constexpr VkFormat ldr_format = VK_FORMAT_R8G8B8A8_UNORM;
+
+// What the scene renders into and post-processing reads and writes, sized to
+// the render targets, so recreated and retired with them like the Hi-Z
+// pyramid. The HDR and LDR images are per frame in flight, so one frame can be
+// post-processed while the next renders; the bloom chain is shared, as
+// post-processing of successive frames runs in order on one queue.
+struct PostTargets {
+  std::vector<GpuImage> hdr; // Scene color, sampled by the bloom and tonemap passes
+  std::vector<VkImageView> hdr_views;
+  std::vector<GpuImage> ldr; // Tonemapped, copied to the backbuffer
+  std::vector<VkImageView> ldr_views;
+  GpuImage bloom;            // Half resolution mip chain, downsampled then summed back up
+  std::vector<VkImageView> bloom_level_views;
+  VkDescriptorPool descriptor_pool;
+  std::vector<VkDescriptorSet> prefilter_sets; // Per frame: that frame's HDR image into bloom level 0
+  std::vector<VkDescriptorSet> down_sets;      // down_sets[i] writes level i + 1 from level i
+  std::vector<VkDescriptorSet> up_sets;        // up_sets[i] adds level i + 1 onto level i
+  std::vector<VkDescriptorSet> tonemap_sets;   // Per frame
+  uint32_t width;
+  uint32_t height;
+  uint32_t bloom_width;
+  uint32_t bloom_height;
+  uint32_t bloom_levels;
+};
+
+// Bloom and tonemapping in compute, so they can run on an async compute queue
+// while the graphics queue renders the next frame. When bloom() is recorded
+// the frame's HDR image must be in SHADER_READ_ONLY_OPTIMAL and the bloom
+// chain in GENERAL; tonemap() also needs the LDR image in GENERAL. The render
+// graph sees to those, and only the barriers between bloom levels are
+// recorded here.
+class PostProcess {
+public:
+  PostProcess(VkDevice device, GpuAllocator& allocator, VkPipelineCache pipeline_cache, VkShaderModule bloom_down_shader, VkShaderModule bloom_up_shader, VkShaderModule tonemap_shader);
+  ~PostProcess();
+
+  // 'queue_families' share the images concurrently when there is more than one
+  PostTargets create_targets(uint32_t width, uint32_t height, uint32_t frame_count, const std::vector<uint32_t>& queue_families);
+  void destroy_targets(const PostTargets& targets);
+
+  void bloom(VkCommandBuffer cmd, const PostTargets& targets, uint32_t frame);
+  void tonemap(VkCommandBuffer cmd, const PostTargets& targets, uint32_t frame);
+
+private:
+  VkDevice m_device;
+  GpuAllocator& m_allocator;
+  VkSampler m_sampler;
+  VkDescriptorSetLayout m_bloom_set_layout;
+  VkDescriptorSetLayout m_tonemap_set_layout;
+  VkPipelineLayout m_bloom_layout;
+  VkPipelineLayout m_tonemap_layout;
+  VkPipeline m_bloom_down_pipeline;
+  VkPipeline m_bloom_up_pipeline;
+  VkPipeline m_tonemap_pipeline;
+};
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <format>
+
+#include "profiler.h"
+#include "base.h"
+
+static const char* stat_names[PIPELINE_STAT_COUNT] = {
+  "ia_vertices",
+  "ia_primitives",
+  "vs_invocations",
+  "clip_primitives",
+  "fs_invocations",
+  "cs_invocations",
+};
+
+// Bit order matches PipelineStat, which is the order results are written in
+static constexpr VkQueryPipelineStatisticFlags measured_statistics =
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+  VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+GpuProfiler::GpuProfiler(VkDevice device, const VkPhysicalDeviceProperties& props, uint32_t timestamp_valid_bits, bool pipeline_statistics, uint32_t frame_count)
+  : m_device(device), m_timestamp_period(props.limits.timestampPeriod)
+{
+  m_timestamp_mask = timestamp_valid_bits >= 64 ? ~0ull : (1ull << timestamp_valid_bits) - 1;
+  m_slots.resize(frame_count);
+
+  if (timestamp_valid_bits) {
+    VkQueryPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_TIMESTAMP,
+      .queryCount = frame_count * MAX_SCOPES * 2,
+    };
+
+    if (vkCreateQueryPool(m_device, &pool_info, nullptr, &m_timestamp_pool) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan timestamp query pool.");
+    }
+  }
+
+  if (pipeline_statistics) {
+    m_statistics_flags = measured_statistics;
+
+    VkQueryPoolCreateInfo pool_info = {
+      .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+      .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+      .queryCount = frame_count * MAX_SCOPES,
+      .pipelineStatistics = m_statistics_flags,
+    };
+
+    if (vkCreateQueryPool(m_device, &pool_info, nullptr, &m_statistics_pool) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan pipeline statistics query pool.");
+    }
+  }
+}
+
+GpuProfiler::~GpuProfiler() {
+  if (m_csv) {
+    fclose(m_csv);
+  }
+
+  if (m_timestamp_pool) {
+    vkDestroyQueryPool(m_device, m_timestamp_pool, nullptr);
+  }
+
+  if (m_statistics_pool) {
+    vkDestroyQueryPool(m_device, m_statistics_pool, nullptr);
+  }
+}
+
+bool GpuProfiler::open_csv(const char* path) {
+  if (m_csv) {
+    fclose(m_csv);
+  }
+
+  m_csv = fopen(path, "w");
+  if (!m_csv) {
+    return false;
+  }
+
+  fputs("frame,scope,depth,cpu_ms,gpu_ms", m_csv);
+  for (const char* name : stat_names) {
+    fputs(std::format(",{}", name).c_str(), m_csv);
+  }
+  fputs("\n", m_csv);
+
+  return true;
+}
+
+void GpuProfiler::begin_frame(VkCommandBuffer cmd, uint32_t frame_index) {
+  read_back(frame_index);
+
+  m_frame_index = frame_index;
+  m_depth = 0;
+
+  FrameSlot& slot = m_slots[frame_index];
+  slot.scopes.clear();
+  slot.stats_count = 0;
+  slot.frame_number = m_frame_number++;
+  slot.pending = true;
+
+  if (m_timestamp_pool) {
+    vkCmdResetQueryPool(cmd, m_timestamp_pool, frame_index * MAX_SCOPES * 2, MAX_SCOPES * 2);
+  }
+
+  if (m_statistics_pool) {
+    vkCmdResetQueryPool(cmd, m_statistics_pool, frame_index * MAX_SCOPES, MAX_SCOPES);
+  }
+
+  begin_scope(cmd, "frame");
+}
+
+void GpuProfiler::end_frame(VkCommandBuffer cmd) {
+  end_scope(cmd, 0);
+}
+
+uint32_t GpuProfiler::begin_scope(VkCommandBuffer cmd, const char* name) {
+  FrameSlot& slot = m_slots[m_frame_index];
+
+  if (slot.scopes.size() >= MAX_SCOPES) {
+    return ~0u;
+  }
+
+  uint32_t scope = (uint32_t)slot.scopes.size();
+  uint32_t query_base = m_frame_index * MAX_SCOPES;
+
+  // Statistics queries of one type can't nest, so only passes directly under
+  // the frame get one
+  uint32_t stats_query = ~0u;
+  if (m_statistics_pool && m_depth == 1) {
+    stats_query = slot.stats_count++;
+    vkCmdBeginQuery(cmd, m_statistics_pool, query_base + stats_query, 0);
+  }
+
+  if (m_timestamp_pool) {
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_pool, query_base * 2 + scope * 2);
+  }
+
+  slot.scopes.push_back(Scope {
+    .name = name,
+    .depth = m_depth,
+    .stats_query = stats_query,
+    .cpu_begin = std::chrono::steady_clock::now(),
+  });
+
+  m_depth++;
+  return scope;
+}
+
+void GpuProfiler::end_scope(VkCommandBuffer cmd, uint32_t scope) {
+  if (scope == ~0u) {
+    return;
+  }
+
+  FrameSlot& slot = m_slots[m_frame_index];
+  Scope& s = slot.scopes[scope];
+  uint32_t query_base = m_frame_index * MAX_SCOPES;
+
+  if (m_timestamp_pool) {
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_pool, query_base * 2 + scope * 2 + 1);
+  }
+
+  if (s.stats_query != ~0u) {
+    vkCmdEndQuery(cmd, m_statistics_pool, query_base + s.stats_query);
+  }
+
+  s.cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - s.cpu_begin).count();
+  m_depth--;
+}
+
+void GpuProfiler::read_back(uint32_t frame_index) {
+  FrameSlot& slot = m_slots[frame_index];
+
+  if (!slot.pending) {
+    return;
+  }
+
+  slot.pending = false;
+
+  uint32_t scope_count = (uint32_t)slot.scopes.size();
+  std::vector<uint64_t>& timestamps = m_timestamps;
+  std::vector<uint64_t>& stats = m_stats;
+  timestamps.resize(scope_count * 2);
+  stats.resize(slot.stats_count * PIPELINE_STAT_COUNT);
+
+  // The frame fence has signalled, so no wait flag: a not-ready result would
+  // mean the frame was never submitted, and is dropped
+  if (m_timestamp_pool && scope_count) {
+    VkResult result = vkGetQueryPoolResults(m_device, m_timestamp_pool, frame_index * MAX_SCOPES * 2, scope_count * 2,
+      timestamps.size() * sizeof(uint64_t), timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result != VK_SUCCESS) {
+      return;
+    }
+  }
+
+  if (m_statistics_pool && slot.stats_count) {
+    VkResult result = vkGetQueryPoolResults(m_device, m_statistics_pool, frame_index * MAX_SCOPES, slot.stats_count,
+      stats.size() * sizeof(uint64_t), stats.data(), PIPELINE_STAT_COUNT * sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+
+    if (result != VK_SUCCESS) {
+      return;
+    }
+  }
+
+  m_results.clear();
+
+  for (auto i : Range<uint32_t>(scope_count)) {
+    const Scope& scope = slot.scopes[i];
+
+    ProfileResult result = {
+      .name = scope.name,
+      .depth = scope.depth,
+      .cpu_ms = scope.cpu_ms,
+      .gpu_ms = 0.0,
+    };
+
+    if (m_timestamp_pool) {
+      uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & m_timestamp_mask;
+      result.gpu_ms = (double)ticks * m_timestamp_period / 1e6;
+    }
+
+    if (scope.stats_query != ~0u) {
+      memcpy(result.stats, &stats[scope.stats_query * PIPELINE_STAT_COUNT], sizeof(result.stats));
+    }
+
+    m_results.push_back(result);
+  }
+
+  if (m_csv) {
+    for (auto& result : m_results) {
+      std::string row = std::format("{},{},{},{:.4f},{:.4f}", slot.frame_number, result.name, result.depth, result.cpu_ms, result.gpu_ms);
+      for (uint64_t stat : result.stats) {
+        row += std::format(",{}", stat);
+      }
+      row += "\n";
+      fputs(row.c_str(), m_csv);
+    }
+  }
+
+  if (m_print_interval) {
+    for (auto& result : m_results) {
+      auto it = std::find_if(m_averages.begin(), m_averages.end(), [&](const Average& a) { return !strcmp(a.name, result.name) && a.depth == result.depth; });
+
+      if (it == m_averages.end()) {
+        m_averages.push_back(Average { result.name, result.depth, 0.0, 0.0 });
+        it = m_averages.end() - 1;
+      }
+
+      it->cpu_ms += result.cpu_ms;
+      it->gpu_ms += result.gpu_ms;
+    }
+
+    if (++m_interval_frames >= m_print_interval) {
+      print_averages();
+    }
+  }
+}
+
+void GpuProfiler::print_averages() {
+  std::cout << std::format("Profile, average of {} frames:", m_interval_frames) << std::endl;
+
+  for (auto& average : m_averages) {
+    std::string label = std::string(average.depth * 2, ' ') + average.name;
+    std::cout << std::format("  {:<24} cpu {:8.3f} ms  gpu {:8.3f} ms", label, average.cpu_ms / m_interval_frames, average.gpu_ms / m_interval_frames) << std::endl;
+  }
+
+  m_averages.clear();
+  m_interval_frames = 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+enum class PipelineStat {
+  InputAssemblyVertices,
+  InputAssemblyPrimitives,
+  VertexShaderInvocations,
+  ClippingPrimitives,
+  FragmentShaderInvocations,
+  ComputeShaderInvocations,
+  Count
+};
+
+static constexpr uint32_t PIPELINE_STAT_COUNT = (uint32_t)PipelineStat::Count;
+
+struct ProfileResult {
+  const char* name;
+  uint32_t depth;   // 0 is the whole frame
+  double cpu_ms;    // Time spent recording the scope
+  double gpu_ms;    // Zero when the queue has no timestamp support
+  uint64_t stats[PIPELINE_STAT_COUNT]; // Only filled for passes directly under the frame
+};
+
+// Per-frame timestamp and pipeline statistics queries around named scopes.
+// Every frame in flight has its own range of queries, read back in
+// begin_frame() once that frame's fence has signalled, so the CPU never waits
+// on the GPU for results.
+class GpuProfiler {
+public:
+  static constexpr uint32_t MAX_SCOPES = 64;
+
+  GpuProfiler(VkDevice device, const VkPhysicalDeviceProperties& props, uint32_t timestamp_valid_bits, bool pipeline_statistics, uint32_t frame_count);
+  ~GpuProfiler();
+
+  // Call once the frame's fence has been waited on; opens the frame scope
+  void begin_frame(VkCommandBuffer cmd, uint32_t frame_index);
+  void end_frame(VkCommandBuffer cmd);
+
+  // 'name' must outlive the profiler (normally a string literal). Scopes nest,
+  // and one directly under the frame must not cross a render pass boundary.
+  uint32_t begin_scope(VkCommandBuffer cmd, const char* name);
+  void end_scope(VkCommandBuffer cmd, uint32_t scope);
+
+  // Scopes of the most recently completed frame, in begin order
+  const std::vector<ProfileResult>& results() const { return m_results; }
+
+  // Prints averages every 'frames' frames; 0 turns it off
+  void set_print_interval(uint32_t frames) { m_print_interval = frames; }
+  // Appends one row per scope per completed frame
+  bool open_csv(const char* path);
+
+  // Secondary command buffers recorded inside a measured pass must inherit these
+  VkQueryPipelineStatisticFlags statistics_flags() const { return m_statistics_flags; }
+
+private:
+  struct Scope {
+    const char* name;
+    uint32_t depth;
+    uint32_t stats_query; // ~0u when the scope has no statistics query
+    std::chrono::steady_clock::time_point cpu_begin;
+    double cpu_ms;
+  };
+
+  struct FrameSlot {
+    std::vector<Scope> scopes;
+    uint32_t stats_count;
+    uint64_t frame_number;
+    bool pending;
+  };
+
+  struct Average {
+    const char* name;
+    uint32_t depth;
+    double cpu_ms;
+    double gpu_ms;
+  };
+
+  void read_back(uint32_t frame_index);
+  void print_averages();
+
+private:
+  VkDevice m_device;
+  double m_timestamp_period;
+  uint64_t m_timestamp_mask;
+  VkQueryPipelineStatisticFlags m_statistics_flags = 0;
+  VkQueryPool m_timestamp_pool = nullptr;
+  VkQueryPool m_statistics_pool = nullptr;
+  std::vector<FrameSlot> m_slots;
+  uint32_t m_frame_index = 0;
+  uint32_t m_depth = 0;
+  uint64_t m_frame_number = 0;
+  std::vector<ProfileResult> m_results;
+  std::vector<uint64_t> m_timestamps; // Read back query results, kept to reuse their storage
+  std::vector<uint64_t> m_stats;
+
+  uint32_t m_print_interval = 0;
+  uint32_t m_interval_frames = 0;
+  std::vector<Average> m_averages;
+  FILE* m_csv = nullptr;
+};
+
+// Opens a profiler scope for the lifetime of the object
+class ProfileScope {
+public:
+  ProfileScope(GpuProfiler& profiler, VkCommandBuffer cmd, const char* name)
+    : m_profiler(profiler), m_cmd(cmd), m_scope(profiler.begin_scope(cmd, name))
+  {
+  }
+
+  ~ProfileScope() {
+    m_profiler.end_scope(m_cmd, m_scope);
+  }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  GpuProfiler& m_profiler;
+  VkCommandBuffer m_cmd;
+  uint32_t m_scope;
+};
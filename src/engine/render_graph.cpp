@@ -0,0 +1,595 @@
+#include <algorithm>
+
+#include "render_graph.h"
+#include "base.h"
+
+static constexpr VkAccessFlags2 write_access_mask =
+  VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+struct UsageInfo {
+  VkPipelineStageFlags2 stages;
+  VkAccessFlags2 access;
+  VkImageLayout layout;
+  bool write;
+};
+
+// Only stage and access bits that also exist in the original flags, so the
+// vkCmdPipelineBarrier fallback can use them as they are. 'general' images are
+// written as storage somewhere in the graph and stay in GENERAL to be read.
+static UsageInfo usage_info(RgUsage usage, VkImageAspectFlags aspect, bool general) {
+  bool depth = aspect & VK_IMAGE_ASPECT_DEPTH_BIT;
+  VkImageLayout read_layout = general ? VK_IMAGE_LAYOUT_GENERAL : depth ? VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  switch (usage) {
+    case RgUsage::ColorAttachment:
+      return { VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, true };
+    case RgUsage::DepthAttachment:
+      return { VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, true };
+    case RgUsage::ComputeRead:
+      return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, read_layout, false };
+    case RgUsage::ComputeStorage:
+      return { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT | VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL, true };
+    case RgUsage::FragmentRead:
+      return { VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, read_layout, false };
+    case RgUsage::TaskRead:
+      return { VK_PIPELINE_STAGE_2_TASK_SHADER_BIT_EXT, VK_ACCESS_2_SHADER_READ_BIT, read_layout, false };
+    case RgUsage::TransferSrc:
+      return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, false };
+    case RgUsage::TransferDst:
+      return { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, true };
+  }
+
+  return {};
+}
+
+static VkImageAspectFlags format_aspect(VkFormat format) {
+  switch (format) {
+    case VK_FORMAT_D16_UNORM:
+    case VK_FORMAT_D32_SFLOAT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT;
+    case VK_FORMAT_D24_UNORM_S8_UINT:
+    case VK_FORMAT_D32_SFLOAT_S8_UINT:
+      return VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+    default:
+      return VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+}
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+RenderGraph::RenderGraph(VkDevice device, GpuAllocator& allocator, PFN_vkCmdPipelineBarrier2 cmd_pipeline_barrier2)
+  : m_device(device), m_allocator(allocator), m_cmd_pipeline_barrier2(cmd_pipeline_barrier2)
+{
+}
+
+RenderGraph::~RenderGraph() {
+  destroy(reset());
+}
+
+RenderGraph::Retired RenderGraph::reset() {
+  Retired retired = {
+    .memory = m_memory,
+  };
+
+  for (auto& image : m_images) {
+    if (image.transient && image.image) {
+      retired.images.push_back(image.image);
+      retired.views.push_back(image.view);
+    }
+  }
+
+  m_images.clear();
+  m_passes.clear();
+  m_alive.clear();
+  m_memory.reset();
+  m_first_frame = {};
+  m_steady_frame = {};
+  m_executed = false;
+
+  return retired;
+}
+
+void RenderGraph::destroy(const Retired& retired) {
+  for (auto view : retired.views) {
+    vkDestroyImageView(m_device, view, nullptr);
+  }
+
+  for (auto image : retired.images) {
+    vkDestroyImage(m_device, image, nullptr);
+  }
+
+  if (retired.memory) {
+    m_allocator.free(*retired.memory);
+  }
+}
+
+RgImage RenderGraph::create_image(const char* name, const RgImageDesc& desc) {
+  m_images.push_back(Image {
+    .name = name,
+    .transient = true,
+    .desc = desc,
+    .aspect = format_aspect(desc.format),
+  });
+
+  return (RgImage)m_images.size() - 1;
+}
+
+RgImage RenderGraph::import_image(const char* name, const RgImport& import) {
+  m_images.push_back(Image {
+    .name = name,
+    .transient = false,
+    .import = import,
+    .aspect = import.aspect,
+  });
+
+  return (RgImage)m_images.size() - 1;
+}
+
+void RenderGraph::add_pass(const char* name, std::vector<RgUse> uses, std::function<void(VkCommandBuffer)> record, bool side_effects) {
+  m_passes.push_back(Pass {
+    .name = name,
+    .uses = std::move(uses),
+    .record = std::move(record),
+    .side_effects = side_effects,
+  });
+}
+
+void RenderGraph::bind_image(RgImage image, VkImage vk_image, VkImageView view) {
+  m_images[image].image = vk_image;
+  m_images[image].view = view;
+}
+
+// Walks back from the outputs: a pass survives if it has side effects or
+// writes something a surviving pass (or the frame's output) uses. Every use
+// keeps earlier writers alive, since a write may only partly overwrite.
+void RenderGraph::cull_passes() {
+  std::vector<bool> needed(m_images.size());
+
+  for (auto i : Range<size_t>(m_images.size())) {
+    needed[i] = !m_images[i].transient && m_images[i].import.final;
+  }
+
+  for (size_t i = m_passes.size(); i-- > 0;) {
+    Pass& pass = m_passes[i];
+    pass.alive = pass.side_effects;
+
+    for (auto& use : pass.uses) {
+      if (usage_info(use.usage, m_images[use.image].aspect, false).write && needed[use.image]) {
+        pass.alive = true;
+      }
+    }
+
+    if (pass.alive) {
+      for (auto& use : pass.uses) {
+        needed[use.image] = true;
+      }
+    }
+  }
+
+  m_alive.clear();
+  for (auto i : Range<uint32_t>((uint32_t)m_passes.size())) {
+    if (m_passes[i].alive) {
+      m_alive.push_back(i);
+    }
+  }
+}
+
+// Transients are placed largest first at the lowest offset that doesn't
+// overlap the memory of any transient whose lifetime overlaps theirs
+void RenderGraph::allocate_transients() {
+  std::vector<RgImage> placed;
+  VkDeviceSize total_size = 0;
+  VkDeviceSize alignment = 1;
+  uint32_t type_bits = ~0u;
+
+  std::vector<RgImage> order;
+
+  for (auto i : Range<RgImage>((RgImage)m_images.size())) {
+    Image& image = m_images[i];
+    if (!image.transient || image.first_pass > image.last_pass) {
+      continue;
+    }
+
+    VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = image.desc.format,
+      .extent = { image.desc.width, image.desc.height, 1 },
+      .mipLevels = image.desc.mip_levels,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = image.desc.usage,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+
+    if (vkCreateImage(m_device, &image_info, nullptr, &image.image) != VK_SUCCESS) {
+      fatal_error("Failed to create transient image '{}'.", image.name);
+    }
+
+    vkGetImageMemoryRequirements(m_device, image.image, &image.requirements);
+    order.push_back(i);
+  }
+
+  std::sort(order.begin(), order.end(), [&](RgImage a, RgImage b) {
+    return m_images[a].requirements.size > m_images[b].requirements.size;
+  });
+
+  for (RgImage i : order) {
+    Image& image = m_images[i];
+    VkDeviceSize offset = 0;
+
+    for (bool moved = true; moved;) {
+      moved = false;
+
+      for (RgImage j : placed) {
+        const Image& other = m_images[j];
+        bool lifetimes_overlap = image.first_pass <= other.last_pass && other.first_pass <= image.last_pass;
+        bool memory_overlaps = offset < other.offset + other.requirements.size && other.offset < offset + image.requirements.size;
+
+        if (lifetimes_overlap && memory_overlaps) {
+          offset = align_up(other.offset + other.requirements.size, image.requirements.alignment);
+          moved = true;
+        }
+      }
+    }
+
+    image.offset = offset;
+    placed.push_back(i);
+
+    total_size = std::max(total_size, offset + image.requirements.size);
+    alignment = std::max(alignment, image.requirements.alignment);
+    type_bits &= image.requirements.memoryTypeBits;
+  }
+
+  if (placed.empty()) {
+    return;
+  }
+
+  if (!type_bits) {
+    fatal_error("Transient images have no memory type in common.");
+  }
+
+  VkMemoryRequirements requirements = {
+    .size = total_size,
+    .alignment = alignment,
+    .memoryTypeBits = type_bits,
+  };
+
+  m_memory = m_allocator.allocate(requirements, GpuMemoryUsage::GpuOnly, GpuResourceKind::Image);
+  if (!m_memory) {
+    fatal_error("Out of GPU memory allocating {} bytes of transient images.", total_size);
+  }
+
+  for (RgImage i : placed) {
+    Image& image = m_images[i];
+    vkBindImageMemory(m_device, image.image, m_memory->memory, m_memory->offset + image.offset);
+
+    VkImageViewCreateInfo view_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+      .image = image.image,
+      .viewType = VK_IMAGE_VIEW_TYPE_2D,
+      .format = image.desc.format,
+      .subresourceRange = {
+        // Views of depth/stencil images are for sampling depth
+        .aspectMask = image.aspect & VK_IMAGE_ASPECT_DEPTH_BIT ? (VkImageAspectFlags)VK_IMAGE_ASPECT_DEPTH_BIT : image.aspect,
+        .levelCount = image.desc.mip_levels,
+        .layerCount = 1,
+      },
+    };
+
+    if (vkCreateImageView(m_device, &view_info, nullptr, &image.view) != VK_SUCCESS) {
+      fatal_error("Failed to create view of transient image '{}'.", image.name);
+    }
+  }
+}
+
+RenderGraph::Schedule RenderGraph::schedule(const std::vector<Track>& start, std::vector<Track>* end) const {
+  std::vector<Track> tracks = start;
+  std::vector<bool> general(m_images.size());
+
+  for (auto i : Range<size_t>(m_images.size())) {
+    general[i] = !m_images[i].transient && m_images[i].import.general;
+  }
+
+  for (auto& pass : m_passes) {
+    for (auto& use : pass.uses) {
+      general[use.image] = general[use.image] || use.usage == RgUsage::ComputeStorage;
+    }
+  }
+
+  Schedule schedule;
+  schedule.before_pass.resize(m_alive.size());
+
+  for (auto k : Range<size_t>(m_alive.size())) {
+    const Pass& pass = m_passes[m_alive[k]];
+
+    // A pass may use an image several ways, as long as they share a layout
+    std::vector<std::pair<RgImage, UsageInfo>> uses;
+
+    for (auto& use : pass.uses) {
+      UsageInfo info = usage_info(use.usage, m_images[use.image].aspect, general[use.image]);
+      auto it = std::find_if(uses.begin(), uses.end(), [&](auto& u) { return u.first == use.image; });
+
+      if (it == uses.end()) {
+        uses.emplace_back(use.image, info);
+        continue;
+      }
+
+      if (it->second.layout != info.layout) {
+        fatal_error("Pass '{}' uses image '{}' in two layouts.", pass.name, m_images[use.image].name);
+      }
+
+      it->second.stages |= info.stages;
+      it->second.access |= info.access;
+      it->second.write = it->second.write || info.write;
+    }
+
+    for (auto& [image, u] : uses) {
+      Track& t = tracks[image];
+      bool layout_change = t.layout != u.layout;
+
+      if (layout_change || u.write) {
+        // Writes and transitions wait for earlier readers as well as writers
+        VkPipelineStageFlags2 src_stages = t.write_stages | t.read_stages;
+
+        if (layout_change || src_stages) {
+          schedule.before_pass[k].push_back(Barrier { image, src_stages, t.write_access, u.stages, u.access, t.layout, u.layout });
+        }
+
+        // A transition counts as a write that is already visible to this
+        // pass; what this pass writes is visible to nothing yet
+        t = Track {
+          .layout = u.layout,
+          .write_stages = u.stages,
+          .write_access = u.access & write_access_mask,
+          .read_stages = u.write ? 0 : u.stages,
+          .visible_stages = u.write ? 0 : u.stages,
+          .visible_access = u.write ? 0 : u.access,
+        };
+      }
+      else {
+        bool visible = !(u.stages & ~t.visible_stages) && !(u.access & ~t.visible_access);
+
+        if (t.write_stages && !visible) {
+          schedule.before_pass[k].push_back(Barrier { image, t.write_stages, t.write_access, u.stages, u.access, t.layout, u.layout });
+          t.visible_stages |= u.stages;
+          t.visible_access |= u.access;
+        }
+
+        t.read_stages |= u.stages;
+      }
+    }
+  }
+
+  for (auto i : Range<RgImage>((RgImage)m_images.size())) {
+    const Image& image = m_images[i];
+    if (image.transient || !image.import.final) {
+      continue;
+    }
+
+    Track& t = tracks[i];
+    const RgState& final = *image.import.final;
+
+    if (t.layout != final.layout) {
+      schedule.after_last.push_back(Barrier { i, t.write_stages | t.read_stages, t.write_access, final.stages, final.access, t.layout, final.layout });
+    }
+
+    t = Track {
+      .layout = final.layout,
+      .write_stages = final.stages,
+      .write_access = final.access & write_access_mask,
+    };
+  }
+
+  if (end) {
+    *end = std::move(tracks);
+  }
+
+  return schedule;
+}
+
+RenderGraphStats RenderGraph::compile() {
+  cull_passes();
+
+  for (auto& image : m_images) {
+    image.first_pass = UINT32_MAX;
+    image.last_pass = 0;
+  }
+
+  for (auto k : Range<uint32_t>((uint32_t)m_alive.size())) {
+    for (auto& use : m_passes[m_alive[k]].uses) {
+      Image& image = m_images[use.image];
+      image.first_pass = std::min(image.first_pass, k);
+      image.last_pass = std::max(image.last_pass, k);
+    }
+  }
+
+  allocate_transients();
+
+  // What each transient's last pass leaves in flight; a transient's first use
+  // waits for that from everything sharing its memory, itself included (the
+  // previous frame's use)
+  std::vector<Track> start(m_images.size());
+  std::vector<VkPipelineStageFlags2> last_stages(m_images.size());
+  std::vector<VkAccessFlags2> last_access(m_images.size());
+
+  for (auto i : Range<RgImage>((RgImage)m_images.size())) {
+    const Image& image = m_images[i];
+    if (!image.transient || image.first_pass > image.last_pass) {
+      continue;
+    }
+
+    for (auto& use : m_passes[m_alive[image.last_pass]].uses) {
+      if (use.image == i) {
+        UsageInfo info = usage_info(use.usage, image.aspect, false);
+        last_stages[i] |= info.stages;
+        last_access[i] |= info.access & write_access_mask;
+      }
+    }
+  }
+
+  for (auto i : Range<RgImage>((RgImage)m_images.size())) {
+    const Image& image = m_images[i];
+
+    if (!image.transient) {
+      start[i] = Track {
+        .layout = image.import.initial.layout,
+        .write_stages = image.import.initial.stages,
+        .write_access = image.import.initial.access,
+      };
+      continue;
+    }
+
+    start[i] = Track { .layout = VK_IMAGE_LAYOUT_UNDEFINED };
+
+    if (image.first_pass > image.last_pass) {
+      continue;
+    }
+
+    for (auto j : Range<RgImage>((RgImage)m_images.size())) {
+      const Image& other = m_images[j];
+      if (!other.transient || other.first_pass > other.last_pass) {
+        continue;
+      }
+
+      if (image.offset < other.offset + other.requirements.size && other.offset < image.offset + image.requirements.size) {
+        start[i].write_stages |= last_stages[j];
+        start[i].write_access |= last_access[j];
+      }
+    }
+  }
+
+  std::vector<Track> end;
+  m_first_frame = schedule(start, &end);
+
+  bool persistent = false;
+  for (auto i : Range<size_t>(m_images.size())) {
+    if (!m_images[i].transient && m_images[i].import.persistent) {
+      start[i] = end[i];
+      persistent = true;
+    }
+  }
+
+  m_steady_frame = persistent ? schedule(start, nullptr) : m_first_frame;
+  m_executed = false;
+
+  RenderGraphStats stats = {
+    .passes = (uint32_t)m_alive.size(),
+    .culled_passes = (uint32_t)(m_passes.size() - m_alive.size()),
+    .transient_bytes = m_memory ? m_memory->size : 0,
+  };
+
+  for (auto& batch : m_steady_frame.before_pass) {
+    stats.barriers += (uint32_t)batch.size();
+    stats.barrier_batches += batch.empty() ? 0 : 1;
+  }
+
+  stats.barriers += (uint32_t)m_steady_frame.after_last.size();
+  stats.barrier_batches += m_steady_frame.after_last.empty() ? 0 : 1;
+
+  for (auto& image : m_images) {
+    if (image.transient && image.image) {
+      stats.transient_images++;
+      stats.transient_bytes_unaliased += image.requirements.size;
+    }
+  }
+
+  return stats;
+}
+
+void RenderGraph::record_barriers(VkCommandBuffer cmd, Arena& arena, const std::vector<Barrier>& barriers) {
+  auto range = [&](RgImage image) {
+    return VkImageSubresourceRange {
+      .aspectMask = m_images[image].aspect,
+      .levelCount = VK_REMAINING_MIP_LEVELS,
+      .layerCount = VK_REMAINING_ARRAY_LAYERS,
+    };
+  };
+
+  if (m_cmd_pipeline_barrier2) {
+    ArenaVector<VkImageMemoryBarrier2> image_barriers(arena);
+    image_barriers.reserve(barriers.size());
+
+    for (auto& b : barriers) {
+      image_barriers.push_back(VkImageMemoryBarrier2 {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = b.src_stages,
+        .srcAccessMask = b.src_access,
+        .dstStageMask = b.dst_stages,
+        .dstAccessMask = b.dst_access,
+        .oldLayout = b.old_layout,
+        .newLayout = b.new_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = m_images[b.image].image,
+        .subresourceRange = range(b.image),
+      });
+    }
+
+    VkDependencyInfo dependency_info = {
+      .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+      .imageMemoryBarrierCount = (uint32_t)image_barriers.size(),
+      .pImageMemoryBarriers = image_barriers.data(),
+    };
+
+    m_cmd_pipeline_barrier2(cmd, &dependency_info);
+    return;
+  }
+
+  // One call for the whole batch, with the union of the stages
+  VkPipelineStageFlags src_stages = 0;
+  VkPipelineStageFlags dst_stages = 0;
+  ArenaVector<VkImageMemoryBarrier> image_barriers(arena);
+  image_barriers.reserve(barriers.size());
+
+  for (auto& b : barriers) {
+    src_stages |= (VkPipelineStageFlags)b.src_stages;
+    dst_stages |= (VkPipelineStageFlags)b.dst_stages;
+
+    image_barriers.push_back(VkImageMemoryBarrier {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = (VkAccessFlags)b.src_access,
+      .dstAccessMask = (VkAccessFlags)b.dst_access,
+      .oldLayout = b.old_layout,
+      .newLayout = b.new_layout,
+      .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+      .image = m_images[b.image].image,
+      .subresourceRange = range(b.image),
+    });
+  }
+
+  vkCmdPipelineBarrier(cmd,
+    src_stages ? src_stages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+    dst_stages ? dst_stages : (VkPipelineStageFlags)VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+    0, 0, nullptr, 0, nullptr, (uint32_t)image_barriers.size(), image_barriers.data());
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd, Arena& arena, GpuProfiler* profiler) {
+  const Schedule& schedule = m_executed ? m_steady_frame : m_first_frame;
+
+  for (auto k : Range<size_t>(m_alive.size())) {
+    const Pass& pass = m_passes[m_alive[k]];
+
+    if (!schedule.before_pass[k].empty()) {
+      record_barriers(cmd, arena, schedule.before_pass[k]);
+    }
+
+    uint32_t scope = profiler ? profiler->begin_scope(cmd, pass.name) : 0;
+    pass.record(cmd);
+
+    if (profiler) {
+      profiler->end_scope(cmd, scope);
+    }
+  }
+
+  if (!schedule.after_last.empty()) {
+    record_barriers(cmd, arena, schedule.after_last);
+  }
+
+  m_executed = true;
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+#include "profiler.h"
+#include "arena.h"
+
+// Handle to an image declared in a RenderGraph; only valid until reset()
+using RgImage = uint32_t;
+
+// How a pass uses an image. Each maps to the stages, access and layout the
+// barriers are computed from.
+enum class RgUsage {
+  ColorAttachment, // Read and written as a color attachment
+  DepthAttachment, // Depth tested and written
+  ComputeRead,     // Sampled by compute; depth images are read in DEPTH_STENCIL_READ_ONLY_OPTIMAL,
+                   // images written as storage anywhere in the graph in GENERAL
+  ComputeStorage,  // Storage image read and written by compute, in GENERAL
+  FragmentRead,    // Sampled by fragment shaders
+  TaskRead,        // Sampled by task shaders; needs VK_EXT_mesh_shader
+  TransferSrc,
+  TransferDst,
+};
+
+struct RgUse {
+  RgImage image;
+  RgUsage usage;
+};
+
+// Synchronization state of an image outside the graph
+struct RgState {
+  VkPipelineStageFlags2 stages;
+  VkAccessFlags2 access;
+  VkImageLayout layout;
+};
+
+// Allocated by the graph from one shared block of memory, aliased with other
+// transients whose lifetimes don't overlap. Contents never survive the frame.
+struct RgImageDesc {
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mip_levels = 1;
+  VkImageUsageFlags usage;
+};
+
+// An image owned elsewhere. 'initial' is its state when the frame starts; a
+// persistent image starts each later frame where the previous one left it.
+// Images with a 'final' state are graph outputs and are transitioned to it
+// after the last pass. 'general' images are read in GENERAL even when this
+// graph never writes them as storage, to match descriptors written that way.
+struct RgImport {
+  VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+  RgState initial;
+  std::optional<RgState> final;
+  bool persistent = false;
+  bool general = false;
+};
+
+struct RenderGraphStats {
+  uint32_t passes;
+  uint32_t culled_passes;
+  uint32_t barriers;        // Image barriers per frame
+  uint32_t barrier_batches; // Pipeline barrier calls per frame
+  uint32_t transient_images;
+  VkDeviceSize transient_bytes;           // Memory allocated for transients
+  VkDeviceSize transient_bytes_unaliased; // What they would take on their own
+};
+
+// A frame described as passes that declare the images they read and write.
+// compile() drops passes whose results nothing uses, places transient images
+// in shared memory wherever their lifetimes allow, and works out every image
+// barrier up front, merged into one call before each pass that needs any.
+// execute() then only records barriers and calls the passes.
+//
+// Passes run in declaration order. Buffers are not tracked: passes that write
+// them (or have other effects the graph can't see) must be marked as having
+// side effects, and order their own buffer accesses.
+//
+// Built once and executed every frame; imported images are rebound with
+// bind_image() before each execute().
+class RenderGraph {
+public:
+  // Transient images and memory released by reset(); in-flight frames may still use them
+  struct Retired {
+    std::vector<VkImage> images;
+    std::vector<VkImageView> views;
+    std::optional<GpuAllocation> memory;
+  };
+
+  // Without vkCmdPipelineBarrier2 (synchronization2), barriers are recorded
+  // with vkCmdPipelineBarrier instead
+  RenderGraph(VkDevice device, GpuAllocator& allocator, PFN_vkCmdPipelineBarrier2 cmd_pipeline_barrier2);
+  ~RenderGraph();
+
+  Retired reset();
+  void destroy(const Retired& retired);
+
+  // 'name' must outlive the graph (normally a string literal)
+  RgImage create_image(const char* name, const RgImageDesc& desc);
+  RgImage import_image(const char* name, const RgImport& import);
+  void add_pass(const char* name, std::vector<RgUse> uses, std::function<void(VkCommandBuffer)> record, bool side_effects = false);
+
+  RenderGraphStats compile();
+
+  void bind_image(RgImage image, VkImage vk_image, VkImageView view = nullptr);
+  VkImage image(RgImage image) const { return m_images[image].image; }
+  VkImageView view(RgImage image) const { return m_images[image].view; }
+
+  // Each pass gets a profiler scope named after it when 'profiler' is set.
+  // Barrier structs are built in 'arena', which must outlive the recording.
+  void execute(VkCommandBuffer cmd, Arena& arena, GpuProfiler* profiler = nullptr);
+
+private:
+  struct Image {
+    const char* name;
+    bool transient;
+    RgImageDesc desc;
+    RgImport import;
+    VkImageAspectFlags aspect;
+    VkImage image;
+    VkImageView view;
+    VkDeviceSize offset;
+    VkMemoryRequirements requirements;
+    uint32_t first_pass; // Lifetime in alive passes; first_pass > last_pass if unused
+    uint32_t last_pass;
+  };
+
+  struct Pass {
+    const char* name;
+    std::vector<RgUse> uses;
+    std::function<void(VkCommandBuffer)> record;
+    bool side_effects;
+    bool alive;
+  };
+
+  struct Barrier {
+    RgImage image;
+    VkPipelineStageFlags2 src_stages;
+    VkAccessFlags2 src_access;
+    VkPipelineStageFlags2 dst_stages;
+    VkAccessFlags2 dst_access;
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+  };
+
+  // Barriers recorded before each alive pass, then before the frame ends
+  struct Schedule {
+    std::vector<std::vector<Barrier>> before_pass;
+    std::vector<Barrier> after_last;
+  };
+
+  struct Track {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 write_stages;
+    VkAccessFlags2 write_access;
+    VkPipelineStageFlags2 read_stages;
+    VkPipelineStageFlags2 visible_stages; // Where the last write is already visible
+    VkAccessFlags2 visible_access;
+  };
+
+  void cull_passes();
+  void allocate_transients();
+  Schedule schedule(const std::vector<Track>& start, std::vector<Track>* end) const;
+  void record_barriers(VkCommandBuffer cmd, Arena& arena, const std::vector<Barrier>& barriers);
+
+private:
+  VkDevice m_device;
+  GpuAllocator& m_allocator;
+  PFN_vkCmdPipelineBarrier2 m_cmd_pipeline_barrier2;
+
+  std::vector<Image> m_images;
+  std::vector<Pass> m_passes;
+  std::vector<uint32_t> m_alive; // Indices of passes that survived culling
+  std::optional<GpuAllocation> m_memory;
+
+  Schedule m_first_frame;
+  Schedule m_steady_frame; // Persistent imports start from where the last frame left them
+  bool m_executed = false;
+};
@@ -1,9 +1,14 @@
 #include <utility>
+#include <algorithm>
 #include <iostream>
 #include <format>
 #include <functional>
 #include <optional>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <thread>
 
 #include "renderer.h"
 #include "base.h"
@@ -12,24 +17,147 @@ VkSurfaceKHR create_vulkan_surface(VkInstance instance, platform::WindowHandle w
 std::vector<const char*> get_vulkan_instance_extensions();
 VkInstanceCreateFlags get_vulkan_instance_flags();
 
-static constexpr VkFormat swapchain_format = VK_FORMAT_R8G8B8A8_UNORM;
+static constexpr VkFormat swapchain_format = ldr_format; // Tonemapped images are copied in as they are
+static constexpr VkFormat depth_format = VK_FORMAT_D32_SFLOAT;
+static constexpr const char* pipeline_cache_path = "pipeline_cache.bin";
+static constexpr VkDeviceSize upload_ring_frame_size = 4 * 1024 * 1024;
+static constexpr VkDeviceSize staging_size = 64 * 1024 * 1024;
+static constexpr VkDeviceSize upload_frame_budget = 16 * 1024 * 1024;
+static constexpr VkDeviceSize texture_budget = 256 * 1024 * 1024;
+
+// Matches the FrameUniforms block in triangle.vert (std140)
+struct FrameUniforms {
+  float time;
+  float aspect;
+  float camera[2];
+  float zoom;
+  float padding[3];
+};
+
+// Matches the DrawConstants push constant block in triangle.vert
+struct DrawConstants {
+  float offset[2];
+  float scale;
+  float padding;
+};
+
+// The scene is a square grid of triangles filling [-1, 1]
+static uint32_t grid_columns(uint32_t count) {
+  uint32_t columns = 1;
+  while (columns * columns < count) {
+    columns++;
+  }
+
+  return columns;
+}
+
+static DrawConstants grid_draw(uint32_t index, uint32_t columns) {
+  float cell = 2.0f / (float)columns;
+
+  return DrawConstants {
+    .offset = { -1.0f + cell * ((float)(index % columns) + 0.5f), -1.0f + cell * ((float)(index / columns) + 0.5f) },
+    .scale = columns > 1 ? cell : 1.0f,
+  };
+}
+
+// The depth of the grid's cells and occluders, the only entities drawn
+static constexpr uint32_t scene_instance_depth = 2;
+
+// The grid as a hierarchy: a root holding a group per row, whose children are
+// its cells, and a group of 'occluders' oversized triangles on a coarser grid
+// in front, for occlusion culling to hide the grid behind. Created breadth
+// first, so the instances are the grid in order, then the occluders.
+static std::vector<SceneRow> build_scene(TransformStore& transforms, uint32_t count, uint32_t occluders) {
+  uint32_t columns = grid_columns(count);
+  uint32_t occluder_columns = grid_columns(occluders);
+  uint32_t row_count = (count + columns - 1) / columns;
+
+  transforms.clear();
+  transforms.reserve(2 + row_count + count + occluders);
+
+  EntityId root = transforms.create(no_parent, Transform2D { .scale = 1.0f }, 0.0f, 0.0f);
+  std::vector<SceneRow> rows;
+
+  for (auto row : Range<uint32_t>(row_count)) {
+    float y = grid_draw(row * columns, columns).offset[1];
+    rows.push_back(SceneRow { transforms.create(root, Transform2D { .y = y, .scale = 1.0f }, 0.0f, 0.0f), y });
+  }
+
+  EntityId occluder_group = transforms.create(root, Transform2D { .scale = 1.0f }, 0.0f, 0.0f);
+
+  // The triangle's corners are sqrt(0.5) * scale from its center at most
+  for (auto i : Range<uint32_t>(count)) {
+    DrawConstants draw = grid_draw(i, columns);
+    transforms.create(rows[i / columns].entity, Transform2D { .x = draw.offset[0], .scale = draw.scale }, 0.71f, 0.5f);
+  }
 
-template<typename... Args>
-void fatal_error(const std::format_string<Args...>& fmt, Args&&... args) {
-  std::string s = std::format(fmt, std::forward<Args>(args)...);
-  platform::message_box(s.c_str(), "Error");
-  platform::exit_program(1);
+  for (auto i : Range<uint32_t>(occluders)) {
+    DrawConstants draw = grid_draw(i, occluder_columns);
+    transforms.create(occluder_group, Transform2D { .x = draw.offset[0], .y = draw.offset[1], .scale = draw.scale * 1.6f }, 0.71f, 0.1f);
+  }
+
+  return rows;
 }
 
-template<typename T, typename I, typename R>
-std::vector<T> vk_enumerate(I instance, R(*func)(I, uint32_t*, T*)) {
-  uint32_t count = 0;
-  func(instance, &count, nullptr);
+// HDR color and depth, both kept in attachment layouts; the render graph records
+// every transition and dependency around the pass. A pass that loads continues
+// from an earlier one, and only a clearing pass keeps its depth, since the
+// Hi-Z build may read it.
+static VkRenderPass create_render_pass(VkDevice device, bool load) {
+  VkAttachmentDescription attachments[] = {
+    {
+      .format = hdr_format,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+    },
+    {
+      .format = depth_format,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = load ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+      .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+      .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+      .initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      .finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+    },
+  };
+
+  VkAttachmentReference color_attachment_ref = {
+    .attachment = 0,
+    .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+  };
+
+  VkAttachmentReference depth_attachment_ref = {
+    .attachment = 1,
+    .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+  };
+
+  VkSubpassDescription subpass = {
+    .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+    .colorAttachmentCount = 1,
+    .pColorAttachments = &color_attachment_ref,
+    .pDepthStencilAttachment = &depth_attachment_ref,
+  };
+
+  VkRenderPassCreateInfo render_pass_info = {
+    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+    .attachmentCount = 2,
+    .pAttachments = attachments,
+    .subpassCount = 1,
+    .pSubpasses = &subpass,
+  };
 
-  std::vector<T> v(count);
-  func(instance, &count, v.data());
+  VkRenderPass render_pass;
+  if (vkCreateRenderPass(device, &render_pass_info, nullptr, &render_pass) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan render pass.");
+  }
 
-  return v;
+  return render_pass;
 }
 
 VKAPI_ATTR VkBool32 VKAPI_CALL vulkan_debug_callback(
@@ -43,14 +171,35 @@ VKAPI_ATTR VkBool32 VKAPI_CALL vulkan_debug_callback(
     return VK_FALSE;
 }
 
-Renderer::Renderer(platform::WindowHandle window) {
+Renderer::Renderer(platform::WindowHandle window, const FramePacing& pacing)
+  : Renderer(window, platform::get_window_size(window), pacing)
+{
+}
+
+Renderer::Renderer(uint32_t width, uint32_t height, const FramePacing& pacing)
+  : Renderer(nullptr, { width, height }, pacing)
+{
+}
+
+Renderer::Renderer(platform::WindowHandle window, std::pair<uint32_t, uint32_t> size, const FramePacing& pacing)
+  : m_headless(window == nullptr), m_pacing(pacing), m_start_time(std::chrono::steady_clock::now())
+{
+  if (!m_pacing.frames_in_flight || m_pacing.frames_in_flight > MAX_FRAMES_IN_FLIGHT) {
+    fatal_error("Frames in flight must be between 1 and {}.", MAX_FRAMES_IN_FLIGHT);
+  }
+
+  m_frames_in_flight = m_pacing.frames_in_flight;
+
+  m_jobs = std::make_unique<JobSystem>();
+  m_frame_arenas = std::make_unique<FrameArenas>(*m_jobs, m_frames_in_flight);
+
   VkApplicationInfo app_info = {
     .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
     .pApplicationName = "Vro",
     .applicationVersion = VK_MAKE_VERSION(1, 0, 0),
     .pEngineName = "Vro Engine",
     .engineVersion = VK_MAKE_VERSION(1, 0, 0),
-    .apiVersion = VK_API_VERSION_1_0
+    .apiVersion = VK_API_VERSION_1_2
   };
 
   std::vector<const char*> validation_layers = {
@@ -60,18 +209,20 @@ Renderer::Renderer(platform::WindowHandle window) {
   };
 
   std::vector<const char*> extensions = {
-    "VK_KHR_surface",
 #if _DEBUG
     "VK_EXT_debug_utils",
 #endif
   };
 
-  auto platform_extensions = get_vulkan_instance_extensions();
-  extensions.insert(extensions.end(), platform_extensions.begin(), platform_extensions.end());
+  if (!m_headless) {
+    auto platform_extensions = get_vulkan_instance_extensions();
+    extensions.push_back("VK_KHR_surface");
+    extensions.insert(extensions.end(), platform_extensions.begin(), platform_extensions.end());
+  }
 
   VkInstanceCreateInfo instance_info = {
     .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
-    .flags = get_vulkan_instance_flags(),
+    .flags = m_headless ? 0 : get_vulkan_instance_flags(),
     .pApplicationInfo = &app_info,
     .enabledLayerCount = (uint32_t)validation_layers.size(),
     .ppEnabledLayerNames = validation_layers.data(),
@@ -93,14 +244,15 @@ Renderer::Renderer(platform::WindowHandle window) {
   
   auto vkCreateDebugUtilsMessengerEXT = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(m_instance, "vkCreateDebugUtilsMessengerEXT");
   assert(vkCreateDebugUtilsMessengerEXT);
-  VkDebugUtilsMessengerEXT debug_messenger;
-  vkCreateDebugUtilsMessengerEXT(m_instance, &debug_messenger_info, nullptr, &debug_messenger);
+  vkCreateDebugUtilsMessengerEXT(m_instance, &debug_messenger_info, nullptr, &m_debug_messenger);
 #endif
 
-  m_surface = create_vulkan_surface(m_instance, window);
-  
-  if (!m_surface) {
-    fatal_error("Failed to create Vulkan surface.");
+  if (!m_headless) {
+    m_surface = create_vulkan_surface(m_instance, window);
+    
+    if (!m_surface) {
+      fatal_error("Failed to create Vulkan surface.");
+    }
   }
 
   std::vector<VkPhysicalDevice> devices = vk_enumerate(m_instance, vkEnumeratePhysicalDevices);
@@ -108,50 +260,334 @@ Renderer::Renderer(platform::WindowHandle window) {
     fatal_error("Failed to find Vulkan device.");
   }
 
-  m_physical_device = devices[0];
+  // A graphics family that can also present to the surface, if any
+  auto find_graphics_queue = [&](VkPhysicalDevice device) -> std::optional<uint32_t> {
+    std::vector<VkQueueFamilyProperties> families = vk_enumerate(device, vkGetPhysicalDeviceQueueFamilyProperties);
+
+    for (uint32_t i = 0; i < families.size(); ++i) {
+      VkBool32 present_support = m_headless;
+      if (!m_headless) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &present_support);
+      }
+
+      if (families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT && present_support) {
+        return i;
+      }
+    }
+
+    return std::nullopt;
+  };
+
+  // Everything below relies on Vulkan 1.2 and its timeline semaphores, so the
+  // first device that has those and a queue to draw with is used
+  auto is_suitable = [&](VkPhysicalDevice device) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device, &props);
+
+    if (props.apiVersion < VK_API_VERSION_1_2) {
+      return false;
+    }
+
+    VkPhysicalDeviceVulkan12Features vulkan12_features = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    };
+
+    VkPhysicalDeviceFeatures2 features2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &vulkan12_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(device, &features2);
+    return vulkan12_features.timelineSemaphore && find_graphics_queue(device).has_value();
+  };
+
+  m_physical_device = nullptr;
+
+  for (VkPhysicalDevice device : devices) {
+    if (is_suitable(device)) {
+      m_physical_device = device;
+      break;
+    }
+  }
+
+  if (!m_physical_device) {
+    fatal_error("No Vulkan device supports Vulkan 1.2 with timeline semaphores and a graphics queue{}.", m_headless ? "" : " that can present to the window");
+  }
+
+  vkGetPhysicalDeviceProperties(m_physical_device, &m_physical_device_props);
 
   std::vector<VkQueueFamilyProperties> queue_props = vk_enumerate(m_physical_device, vkGetPhysicalDeviceQueueFamilyProperties);
+  uint32_t queue_id = *find_graphics_queue(m_physical_device);
 
-  uint32_t queue_id = 0xffffffff;
+  // A transfer-only family usually maps to the DMA engines, which copy without
+  // taking time from the graphics queue
+  uint32_t transfer_queue_id = queue_id;
 
   for (uint32_t i = 0; i < queue_props.size(); ++i) {
     auto flags = queue_props[i].queueFlags;
 
-    VkBool32 present_support = false;
-    vkGetPhysicalDeviceSurfaceSupportKHR(m_physical_device, i, m_surface, &present_support);
-
-    if (
-      flags & VK_QUEUE_GRAPHICS_BIT && 
-      present_support
-    ) {
-      queue_id = i;
+    if (flags & VK_QUEUE_TRANSFER_BIT && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      transfer_queue_id = i;
       break;
     }
   }
 
-  if (queue_id == 0xffffffff) {
-    fatal_error("Failed to find a Vulkan queue family");
+  // A compute-only family runs alongside graphics, taking the post-processing
+  // of one frame while the next renders
+  std::optional<uint32_t> compute_queue_id;
+
+  for (uint32_t i = 0; i < queue_props.size(); ++i) {
+    auto flags = queue_props[i].queueFlags;
+
+    if (flags & VK_QUEUE_COMPUTE_BIT && !(flags & VK_QUEUE_GRAPHICS_BIT)) {
+      compute_queue_id = i;
+      break;
+    }
   }
 
   float queue_priority = 1.0f;
 
-  VkDeviceQueueCreateInfo queue_info = {
-    .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-    .queueFamilyIndex = queue_id,
-    .queueCount = 1,
-    .pQueuePriorities = &queue_priority
+  std::vector<VkDeviceQueueCreateInfo> queue_infos = {
+    {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = queue_id,
+      .queueCount = 1,
+      .pQueuePriorities = &queue_priority
+    },
+  };
+
+  if (transfer_queue_id != queue_id) {
+    queue_infos.push_back({
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = transfer_queue_id,
+      .queueCount = 1,
+      .pQueuePriorities = &queue_priority
+    });
+  }
+
+  if (compute_queue_id) {
+    queue_infos.push_back({
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = *compute_queue_id,
+      .queueCount = 1,
+      .pQueuePriorities = &queue_priority
+    });
+  }
+
+  VkPhysicalDeviceVulkan12Features supported_vulkan12_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+  };
+
+  VkPhysicalDeviceFeatures2 supported_features2 = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+    .pNext = &supported_vulkan12_features,
+  };
+
+  vkGetPhysicalDeviceFeatures2(m_physical_device, &supported_features2);
+  const VkPhysicalDeviceFeatures& supported_features = supported_features2.features;
+
+  // Pipeline statistics are only measured when secondaries can inherit the query
+  bool pipeline_statistics = supported_features.pipelineStatisticsQuery && supported_features.inheritedQueries;
+
+  // The bindless heap needs runtime-sized, partially bound arrays that can be
+  // written while earlier frames are still using other slots. Without them the
+  // heap only hands out handles, and the CPU-recorded path is all there is.
+  const VkPhysicalDeviceVulkan12Features& v12 = supported_vulkan12_features;
+  m_bindless_supported = v12.descriptorIndexing && v12.runtimeDescriptorArray && v12.descriptorBindingPartiallyBound &&
+    v12.descriptorBindingUpdateUnusedWhilePending && v12.descriptorBindingStorageBufferUpdateAfterBind &&
+    v12.descriptorBindingSampledImageUpdateAfterBind && v12.shaderSampledImageArrayNonUniformIndexing;
+
+  // GPU-driven draws pass the instance id through firstInstance and read
+  // instances and meshes through the bindless heap; the draw count and
+  // multi-draw are optional
+  m_gpu_driven_supported = supported_features.drawIndirectFirstInstance && m_bindless_supported;
+  bool multi_draw_indirect = supported_features.multiDrawIndirect;
+  bool draw_indirect_count = supported_vulkan12_features.drawIndirectCount;
+
+  // Block compressed textures of a family the device lacks are rejected at load
+  bool bc_textures = supported_features.textureCompressionBC;
+  bool astc_textures = supported_features.textureCompressionASTC_LDR;
+
+  VkPhysicalDeviceFeatures device_features = {
+    .multiDrawIndirect = multi_draw_indirect,
+    .drawIndirectFirstInstance = m_gpu_driven_supported,
+    .textureCompressionASTC_LDR = astc_textures,
+    .textureCompressionBC = bc_textures,
+    .pipelineStatisticsQuery = pipeline_statistics,
+    .inheritedQueries = pipeline_statistics,
+  };
+
+  VkPhysicalDeviceVulkan12Features vulkan12_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+    .drawIndirectCount = draw_indirect_count,
+    .descriptorIndexing = m_bindless_supported,
+    .shaderSampledImageArrayNonUniformIndexing = m_bindless_supported,
+    .descriptorBindingSampledImageUpdateAfterBind = m_bindless_supported,
+    .descriptorBindingStorageBufferUpdateAfterBind = m_bindless_supported,
+    .descriptorBindingUpdateUnusedWhilePending = m_bindless_supported,
+    .descriptorBindingPartiallyBound = m_bindless_supported,
+    .runtimeDescriptorArray = m_bindless_supported,
+    .timelineSemaphore = VK_TRUE,
+  };
+
+  std::vector<const char*> device_extensions;
+  void* device_features_chain = &vulkan12_features;
+
+  if (!m_headless) {
+    device_extensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
+
+  // Present waits tell us when a frame actually reached the display, for
+  // latency measurement and low latency pacing
+  VkPhysicalDevicePresentWaitFeaturesKHR present_wait_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR,
+  };
+
+  VkPhysicalDevicePresentIdFeaturesKHR present_id_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR,
+    .pNext = &present_wait_features,
+  };
+
+  bool present_wait = false;
+
+  if (!m_headless && supports_device_extension(VK_KHR_PRESENT_ID_EXTENSION_NAME) && supports_device_extension(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &present_id_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &features2);
+    present_wait = present_id_features.presentId && present_wait_features.presentWait;
+  }
+
+  if (present_wait) {
+    device_extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    device_extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+    present_wait_features.pNext = device_features_chain;
+    device_features_chain = &present_id_features;
+  }
+
+  // Lets the render graph record barriers with the finer stages and access of
+  // synchronization2; it falls back to vkCmdPipelineBarrier without it
+  VkPhysicalDeviceSynchronization2Features synchronization2_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES,
+  };
+
+  bool synchronization2 = false;
+
+  if (supports_device_extension(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &synchronization2_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &features2);
+    synchronization2 = synchronization2_features.synchronization2;
+  }
+
+  if (synchronization2) {
+    device_extensions.push_back(VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+
+    synchronization2_features.pNext = device_features_chain;
+    device_features_chain = &synchronization2_features;
+  }
+
+  // Dynamic rendering records passes straight into image views, so resizes
+  // don't recreate framebuffers and pipelines don't depend on render passes
+  VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES,
+  };
+
+  m_dynamic_rendering_supported = false;
+
+  if (supports_device_extension(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &dynamic_rendering_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &features2);
+    m_dynamic_rendering_supported = dynamic_rendering_features.dynamicRendering;
+  }
+
+  if (m_dynamic_rendering_supported) {
+    device_extensions.push_back(VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME);
+
+    dynamic_rendering_features.pNext = device_features_chain;
+    device_features_chain = &dynamic_rendering_features;
+  }
+
+  // Graphics pipeline libraries let shaders compile once into parts that are
+  // linked into pipelines, quickly at first and optimized later
+  VkPhysicalDeviceGraphicsPipelineLibraryFeaturesEXT graphics_pipeline_library_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_GRAPHICS_PIPELINE_LIBRARY_FEATURES_EXT,
   };
 
-  VkPhysicalDeviceFeatures device_features = {};
+  m_graphics_pipeline_library = false;
+
+  if (supports_device_extension(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME) && supports_device_extension(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &graphics_pipeline_library_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &features2);
+    m_graphics_pipeline_library = graphics_pipeline_library_features.graphicsPipelineLibrary;
+  }
+
+  if (m_graphics_pipeline_library) {
+    device_extensions.push_back(VK_KHR_PIPELINE_LIBRARY_EXTENSION_NAME);
+    device_extensions.push_back(VK_EXT_GRAPHICS_PIPELINE_LIBRARY_EXTENSION_NAME);
+
+    graphics_pipeline_library_features.pNext = device_features_chain;
+    device_features_chain = &graphics_pipeline_library_features;
+  }
 
-  std::vector<const char*> device_extensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME
+  // Mesh shaders let task shaders cull meshlets and launch only the survivors;
+  // without them meshlets are culled by a compute pass into indexed draws
+  VkPhysicalDeviceMeshShaderFeaturesEXT mesh_shader_features = {
+    .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
   };
 
+  m_mesh_shader_supported = false;
+
+  // Only GPU-driven, with meshlets read through the bindless heap
+  if (m_gpu_driven_supported && supports_device_extension(VK_EXT_MESH_SHADER_EXTENSION_NAME)) {
+    VkPhysicalDeviceFeatures2 features2 = {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+      .pNext = &mesh_shader_features,
+    };
+
+    vkGetPhysicalDeviceFeatures2(m_physical_device, &features2);
+    m_mesh_shader_supported = mesh_shader_features.taskShader && mesh_shader_features.meshShader;
+  }
+
+  if (m_mesh_shader_supported) {
+    device_extensions.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+
+    // Only the shader stages: the multiview and shading rate variants need
+    // features of their own
+    mesh_shader_features = VkPhysicalDeviceMeshShaderFeaturesEXT {
+      .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MESH_SHADER_FEATURES_EXT,
+      .pNext = device_features_chain,
+      .taskShader = VK_TRUE,
+      .meshShader = VK_TRUE,
+    };
+
+    device_features_chain = &mesh_shader_features;
+  }
+
+  bool memory_budget_ext = supports_device_extension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  if (memory_budget_ext) {
+    device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+  }
+
   VkDeviceCreateInfo device_info = {
     .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-    .queueCreateInfoCount = 1,
-    .pQueueCreateInfos = &queue_info,
+    .pNext = device_features_chain,
+    .queueCreateInfoCount = (uint32_t)queue_infos.size(),
+    .pQueueCreateInfos = queue_infos.data(),
     .enabledExtensionCount = (uint32_t)device_extensions.size(),
     .ppEnabledExtensionNames = device_extensions.data(),
     .pEnabledFeatures = &device_features,
@@ -161,9 +597,56 @@ Renderer::Renderer(platform::WindowHandle window) {
     fatal_error("Failed to create Vulkan device.");
   }
 
+  m_queue_family = queue_id;
   vkGetDeviceQueue(m_device, queue_id, 0, &m_queue);
+  vkGetDeviceQueue(m_device, transfer_queue_id, 0, &m_transfer_queue);
+
+  if (compute_queue_id) {
+    m_compute_queue_family = *compute_queue_id;
+    vkGetDeviceQueue(m_device, m_compute_queue_family, 0, &m_compute_queue);
+  }
+
+  m_gpu_allocator = std::make_unique<GpuAllocator>(m_physical_device, m_device, memory_budget_ext);
+
+  VkDeviceSize upload_alignment = std::max(
+    m_physical_device_props.limits.minUniformBufferOffsetAlignment,
+    m_physical_device_props.limits.minStorageBufferOffsetAlignment
+  );
+
+  m_upload_ring = std::make_unique<UploadRing>(*m_gpu_allocator, m_frames_in_flight, upload_ring_frame_size, upload_alignment);
+  m_uploader = std::make_unique<Uploader>(m_device, *m_gpu_allocator, m_transfer_queue, transfer_queue_id, queue_id, staging_size, upload_frame_budget);
+
+  m_profiler = std::make_unique<GpuProfiler>(m_device, m_physical_device_props, queue_props[queue_id].timestampValidBits, pipeline_statistics, m_frames_in_flight);
+  m_bindless = std::make_unique<BindlessHeap>(m_device, m_bindless_supported);
+
+  auto cmd_pipeline_barrier2 = synchronization2 ? (PFN_vkCmdPipelineBarrier2)vkGetDeviceProcAddr(m_device, "vkCmdPipelineBarrier2KHR") : nullptr;
+  m_graph = std::make_unique<RenderGraph>(m_device, *m_gpu_allocator, cmd_pipeline_barrier2);
+  m_post_graph = std::make_unique<RenderGraph>(m_device, *m_gpu_allocator, cmd_pipeline_barrier2);
+  m_present_graph = std::make_unique<RenderGraph>(m_device, *m_gpu_allocator, cmd_pipeline_barrier2);
+
+  std::cout << std::format("Uploads: {}", m_uploader->dedicated_queue() ? std::format("dedicated transfer queue (family {})", transfer_queue_id) : "graphics queue") << std::endl;
+  std::cout << std::format("Barriers: {}", cmd_pipeline_barrier2 ? "synchronization2" : "legacy") << std::endl;
+  std::cout << std::format("Async compute: {}", m_compute_queue ? std::format("compute queue (family {})", m_compute_queue_family) : "unsupported") << std::endl;
 
-  for (auto i : Range<size_t>(FRAMES_IN_FLIGHT)) {
+  if (m_dynamic_rendering_supported) {
+    m_cmd_begin_rendering = (PFN_vkCmdBeginRendering)vkGetDeviceProcAddr(m_device, "vkCmdBeginRenderingKHR");
+    m_cmd_end_rendering = (PFN_vkCmdEndRendering)vkGetDeviceProcAddr(m_device, "vkCmdEndRenderingKHR");
+  }
+
+  m_dynamic_rendering = m_dynamic_rendering_supported;
+
+  PFN_vkCmdDrawMeshTasksIndirectEXT draw_mesh_tasks_indirect = nullptr;
+  PFN_vkCmdDrawMeshTasksIndirectCountEXT draw_mesh_tasks_indirect_count = nullptr;
+
+  if (m_mesh_shader_supported) {
+    draw_mesh_tasks_indirect = (PFN_vkCmdDrawMeshTasksIndirectEXT)vkGetDeviceProcAddr(m_device, "vkCmdDrawMeshTasksIndirectEXT");
+    draw_mesh_tasks_indirect_count = (PFN_vkCmdDrawMeshTasksIndirectCountEXT)vkGetDeviceProcAddr(m_device, "vkCmdDrawMeshTasksIndirectCountEXT");
+  }
+
+  // Task and mesh shaders read the frame's uniforms and sample the Hi-Z pyramid too
+  VkShaderStageFlags mesh_stages = m_mesh_shader_supported ? VK_SHADER_STAGE_TASK_BIT_EXT | VK_SHADER_STAGE_MESH_BIT_EXT : 0;
+
+  for (auto i : Range<size_t>(m_frames_in_flight)) {
     VkFenceCreateInfo fence_info = {
       .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
       .flags = VK_FENCE_CREATE_SIGNALED_BIT
@@ -172,148 +655,204 @@ Renderer::Renderer(platform::WindowHandle window) {
     vkCreateFence(m_device, &fence_info, nullptr, &m_fences[i]);
   }
 
-  for (auto i : Range<size_t>(FRAMES_IN_FLIGHT)) {
+  for (auto i : Range<size_t>(m_frames_in_flight)) {
+    VkSemaphoreCreateInfo semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    };
+
+    vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_acquire_semaphores[i]);
+  }
+
+  for (VkSemaphore* timeline : { &m_graphics_timeline, &m_compute_timeline }) {
+    VkSemaphoreTypeCreateInfo type_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+      .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+      .initialValue = 0,
+    };
+
     VkSemaphoreCreateInfo semaphore_info = {
       .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+      .pNext = &type_info,
     };
 
-    vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_semaphores[i]);
+    if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, timeline) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan timeline semaphore.");
+    }
   }
 
+  load_pipeline_cache();
+
   m_triangle_vs = load_shader("shaders/triangle.vert.spv");
   m_triangle_fs = load_shader("shaders/triangle.frag.spv");
 
-  std::vector<VkPipelineShaderStageCreateInfo> shader_stages = {
-    make_shader_stage(VK_SHADER_STAGE_VERTEX_BIT, m_triangle_vs),
-    make_shader_stage(VK_SHADER_STAGE_FRAGMENT_BIT, m_triangle_fs),
+  // Per-frame data comes from the upload ring through a dynamic offset, so one
+  // descriptor set serves every frame and every sub-allocation
+  VkDescriptorSetLayoutBinding frame_binding = {
+    .binding = 0,
+    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+    .descriptorCount = 1,
+    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT | mesh_stages,
   };
 
-  std::vector<VkDynamicState> dynamic_states = {
-    VK_DYNAMIC_STATE_VIEWPORT,
-    VK_DYNAMIC_STATE_SCISSOR
+  VkDescriptorSetLayoutCreateInfo set_layout_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+    .bindingCount = 1,
+    .pBindings = &frame_binding,
   };
 
-  VkPipelineDynamicStateCreateInfo dynamic_state_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
-    .dynamicStateCount = (uint32_t)dynamic_states.size(),
-    .pDynamicStates = dynamic_states.data()
-  };
+  if (vkCreateDescriptorSetLayout(m_device, &set_layout_info, nullptr, &m_frame_set_layout) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor set layout.");
+  }
 
-  VkPipelineVertexInputStateCreateInfo vertex_input_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+  VkDescriptorPoolSize pool_size = {
+    .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+    .descriptorCount = 1,
   };
 
-  VkPipelineInputAssemblyStateCreateInfo input_assembly_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-    .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+  VkDescriptorPoolCreateInfo descriptor_pool_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+    .maxSets = 1,
+    .poolSizeCount = 1,
+    .pPoolSizes = &pool_size,
   };
 
-  VkPipelineViewportStateCreateInfo viewport_state_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-    .viewportCount = 1,
-    .scissorCount = 1
-  };
+  if (vkCreateDescriptorPool(m_device, &descriptor_pool_info, nullptr, &m_descriptor_pool) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan descriptor pool.");
+  }
 
-  VkPipelineRasterizationStateCreateInfo rast_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
-    .cullMode = VK_CULL_MODE_BACK_BIT,
-    .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
-    .lineWidth = 1.0f,
+  VkDescriptorSetAllocateInfo set_alloc_info = {
+    .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+    .descriptorPool = m_descriptor_pool,
+    .descriptorSetCount = 1,
+    .pSetLayouts = &m_frame_set_layout,
   };
 
-  VkPipelineMultisampleStateCreateInfo multisampling = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-    .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
-    .sampleShadingEnable = VK_FALSE,
-    .minSampleShading = 1.0f
+  if (vkAllocateDescriptorSets(m_device, &set_alloc_info, &m_frame_set) != VK_SUCCESS) {
+    fatal_error("Failed to allocate Vulkan descriptor set.");
+  }
+
+  VkDescriptorBufferInfo frame_buffer_info = {
+    .buffer = m_upload_ring->buffer(),
+    .offset = 0,
+    .range = sizeof(FrameUniforms),
   };
 
-  VkPipelineColorBlendAttachmentState blend_attachment = {
-    .blendEnable = VK_FALSE,
-    .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+  VkWriteDescriptorSet frame_write = {
+    .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+    .dstSet = m_frame_set,
+    .dstBinding = 0,
+    .descriptorCount = 1,
+    .descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC,
+    .pBufferInfo = &frame_buffer_info,
   };
 
-  VkPipelineColorBlendStateCreateInfo blend_state_info = {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-    .logicOpEnable = VK_FALSE,
-    .attachmentCount = 1,
-    .pAttachments = &blend_attachment,
+  vkUpdateDescriptorSets(m_device, 1, &frame_write, 0, nullptr);
+
+  VkPushConstantRange draw_constants_range = {
+    .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+    .offset = 0,
+    .size = sizeof(DrawConstants),
   };
 
   VkPipelineLayoutCreateInfo pipeline_layout_info = {
     .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+    .setLayoutCount = 1,
+    .pSetLayouts = &m_frame_set_layout,
+    .pushConstantRangeCount = 1,
+    .pPushConstantRanges = &draw_constants_range,
   };
 
   if (vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &m_pipeline_layout) != VK_SUCCESS) {
     fatal_error("Failed to create Vulkan pipeline layout.");
   }
 
-  VkAttachmentDescription color_attachment = {
-    .format = swapchain_format,
-    .samples = VK_SAMPLE_COUNT_1_BIT,
-    .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
-    .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
-    .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
-    .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-    .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
-  };
+  // These index the bindless heap, which needs descriptor indexing enabled
+  if (m_gpu_driven_supported) {
+    m_instanced_vs = load_shader("shaders/instanced.vert.spv");
+    m_cull_cs = load_shader("shaders/cull.comp.spv");
+    m_meshlet_cull_cs = load_shader("shaders/meshlet_cull.comp.spv");
+  }
 
-  VkAttachmentReference color_attachment_ref = {
-    .attachment = 0,
-    .layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-  };
+  m_hiz_cs = load_shader("shaders/hiz.comp.spv");
+  m_bloom_down_cs = load_shader("shaders/bloom_down.comp.spv");
+  m_bloom_up_cs = load_shader("shaders/bloom_up.comp.spv");
+  m_tonemap_cs = load_shader("shaders/tonemap.comp.spv");
 
-  VkSubpassDescription subpass = {
-    .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-    .colorAttachmentCount = 1,
-    .pColorAttachments = &color_attachment_ref,
-  };
+  // Modules using the mesh shader capability are only valid with the extension
+  if (m_mesh_shader_supported) {
+    m_meshlet_ts = load_shader("shaders/meshlet.task.spv");
+    m_meshlet_ms = load_shader("shaders/meshlet.mesh.spv");
+  }
 
-  VkSubpassDependency subpass_dependency = {
-    .srcSubpass = VK_SUBPASS_EXTERNAL,
-    .dstSubpass = 0,
-    .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-    .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-    .srcAccessMask = 0,
-    .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-  };
-  
-  VkRenderPassCreateInfo render_pass_info = {
-    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
-    .attachmentCount = 1,
-    .pAttachments = &color_attachment,
-    .subpassCount = 1,
-    .pSubpasses = &subpass,
-    .dependencyCount = 1,
-    .pDependencies = &subpass_dependency
-  };
+  m_hiz = std::make_unique<HiZBuilder>(m_device, *m_gpu_allocator, m_pipeline_cache, m_hiz_cs, VK_SHADER_STAGE_COMPUTE_BIT | (mesh_stages & VK_SHADER_STAGE_TASK_BIT_EXT));
+  m_post = std::make_unique<PostProcess>(m_device, *m_gpu_allocator, m_pipeline_cache, m_bloom_down_cs, m_bloom_up_cs, m_tonemap_cs);
+  m_mesh_loader = std::make_unique<MeshLoader>(*m_gpu_allocator, *m_uploader, *m_bindless);
+  m_textures = std::make_unique<TextureStreamer>(m_device, *m_gpu_allocator, *m_uploader, *m_bindless, texture_budget, bc_textures, astc_textures);
+  // Everything GPU-driven binds the heap, so none of it exists without one
+  if (m_gpu_driven_supported) {
+    m_gpu_scene = std::make_unique<GpuScene>(m_device, *m_gpu_allocator, *m_uploader, *m_bindless, m_pipeline_cache, m_cull_cs, m_meshlet_cull_cs, m_hiz->cull_set_layout(), m_frames_in_flight, draw_indirect_count, multi_draw_indirect,
+      draw_mesh_tasks_indirect, draw_mesh_tasks_indirect_count);
+
+    // The best path the device has; it only applies once a mesh is set
+    if (!m_gpu_scene->set_meshlet_path(MeshletPath::MeshShader)) {
+      m_gpu_scene->set_meshlet_path(MeshletPath::Compute);
+    }
 
-  if (vkCreateRenderPass(m_device, &render_pass_info, nullptr, &m_render_pass) != VK_SUCCESS) {
-    fatal_error("Failed to create Vulkan render pass.");
+    VkDescriptorSetLayout instanced_set_layouts[] = { m_frame_set_layout, m_bindless->set_layout() };
+
+    VkPushConstantRange instanced_constants_range = {
+      .stageFlags = VK_SHADER_STAGE_VERTEX_BIT,
+      .offset = 0,
+      .size = sizeof(InstancedConstants),
+    };
+
+    VkPipelineLayoutCreateInfo instanced_layout_info = {
+      .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+      .setLayoutCount = 2,
+      .pSetLayouts = instanced_set_layouts,
+      .pushConstantRangeCount = 1,
+      .pPushConstantRanges = &instanced_constants_range,
+    };
+
+    if (vkCreatePipelineLayout(m_device, &instanced_layout_info, nullptr, &m_instanced_layout) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan pipeline layout.");
+    }
+
+    if (m_mesh_shader_supported) {
+      VkDescriptorSetLayout meshlet_set_layouts[] = { m_frame_set_layout, m_bindless->set_layout(), m_hiz->cull_set_layout() };
+
+      VkPushConstantRange meshlet_constants_range = {
+        .stageFlags = mesh_stages,
+        .offset = 0,
+        .size = sizeof(MeshletConstants),
+      };
+
+      VkPipelineLayoutCreateInfo meshlet_layout_info = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        .setLayoutCount = 3,
+        .pSetLayouts = meshlet_set_layouts,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges = &meshlet_constants_range,
+      };
+
+      if (vkCreatePipelineLayout(m_device, &meshlet_layout_info, nullptr, &m_meshlet_layout) != VK_SUCCESS) {
+        fatal_error("Failed to create Vulkan pipeline layout.");
+      }
+    }
   }
 
-  VkGraphicsPipelineCreateInfo pipeline_info = {
-    .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-    .stageCount = (uint32_t)shader_stages.size(),
-    .pStages = shader_stages.data(),
-    .pVertexInputState = &vertex_input_info,
-    .pInputAssemblyState = &input_assembly_info,
-    .pViewportState = &viewport_state_info,
-    .pRasterizationState = &rast_info,
-    .pMultisampleState = &multisampling,
-    .pColorBlendState = &blend_state_info,
-    .pDynamicState = &dynamic_state_info,
-    .layout = m_pipeline_layout,
-    .renderPass = m_render_pass,
-    .subpass = 0
-  };
+  create_pipelines();
+
+  std::cout << std::format("Indirect draws: {}", !m_gpu_driven_supported ? "unsupported" : draw_indirect_count ? "draw count" : multi_draw_indirect ? "multi-draw" : "one call per instance") << std::endl;
+  std::cout << std::format("Meshlets: {}", m_mesh_shader_supported ? "task and mesh shaders" : m_gpu_driven_supported && draw_indirect_count ? "compute culling" : "unsupported") << std::endl;
+  std::cout << std::format("Bindless: {}", m_bindless_supported ? "descriptor indexing" : "unsupported, CPU-recorded draws only") << std::endl;
 
-  if (vkCreateGraphicsPipelines(m_device, nullptr, 1, &pipeline_info, nullptr, &m_pipeline) != VK_SUCCESS) {
-    fatal_error("Failed to create Vulkan graphics pipeline.");
+  if (!m_headless) {
+    m_swapchain = std::make_unique<Swapchain>(m_physical_device, m_device, m_surface, swapchain_format, present_wait);
   }
 
-  auto [window_w, window_h] = platform::get_window_size(window);
+  // Targets are built by the first present()
+  auto [window_w, window_h] = size;
   resize(window_w, window_h);
 
   VkCommandPoolCreateInfo command_pool_info = {
@@ -326,7 +865,7 @@ Renderer::Renderer(platform::WindowHandle window) {
     fatal_error("Failed to create Vulkan command pool.");
   }
 
-  for (auto i : Range<size_t>(FRAMES_IN_FLIGHT)) {
+  for (auto i : Range<size_t>(m_frames_in_flight)) {
     VkCommandBufferAllocateInfo cmd_buf_info = {
       .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
       .commandPool = m_command_pool,
@@ -336,103 +875,887 @@ Renderer::Renderer(platform::WindowHandle window) {
     if (vkAllocateCommandBuffers(m_device, &cmd_buf_info, &m_command_buffers[i]) != VK_SUCCESS) {
       fatal_error("Failed to create Vulkan command buffer.");
     }
-  }
-}
 
-void Renderer::resize(uint32_t width, uint32_t height) {
-  m_swapchain_width = width;
-  m_swapchain_height = height;
+    if (vkAllocateCommandBuffers(m_device, &cmd_buf_info, &m_present_command_buffers[i]) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan command buffer.");
+    }
+  }
 
-  vkDeviceWaitIdle(m_device);
+  if (m_compute_queue) {
+    VkCommandPoolCreateInfo compute_pool_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+      .flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+      .queueFamilyIndex = m_compute_queue_family,
+    };
 
-  if (m_swapchain_image_views.size()) {
-    for (auto view : m_swapchain_image_views) {
-      vkDestroyImageView(m_device, view, nullptr);
+    if (vkCreateCommandPool(m_device, &compute_pool_info, nullptr, &m_compute_command_pool) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan command pool.");
     }
 
-    for (auto fb : m_swapchain_framebuffers) {
-      vkDestroyFramebuffer(m_device, fb, nullptr);
+    VkCommandBufferAllocateInfo compute_cmd_buf_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = m_compute_command_pool,
+      .commandBufferCount = m_frames_in_flight,
+    };
+
+    if (vkAllocateCommandBuffers(m_device, &compute_cmd_buf_info, m_compute_command_buffers) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan command buffer.");
     }
   }
+}
 
-  VkExtent2D image_extent = {
-    .width = width,
-    .height = height
-  };
+Renderer::~Renderer() {
+  vkDeviceWaitIdle(m_device);
 
-  VkSwapchainCreateInfoKHR swapchain_info = {
-    .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
-    .surface = m_surface,
-    .minImageCount = 2,
-    .imageFormat = swapchain_format,
-    .imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR,
-    .imageExtent = image_extent,
-    .imageArrayLayers = 1,
-    .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-    .preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR,
-    .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
-    .presentMode = VK_PRESENT_MODE_FIFO_KHR,
-    .clipped = VK_TRUE,
-    .oldSwapchain = m_swapchain
-  };
+  // Lets compiles in progress finish into the cache before it is saved
+  destroy_pipelines();
+  save_pipeline_cache();
+
+  retire_targets();
+  retire_graph();
+  set_mesh(nullptr);
+  m_completed_frames = m_submitted_frames;
+  flush_deferred();
+  m_swapchain.reset();
 
-  if(vkCreateSwapchainKHR(m_device, &swapchain_info, nullptr, &m_swapchain) != VK_SUCCESS) {
-    fatal_error("Failed to create Vulkan swapchain.");
+  for (auto i : Range<size_t>(m_frames_in_flight)) {
+    vkDestroyFence(m_device, m_fences[i], nullptr);
+    vkDestroySemaphore(m_device, m_acquire_semaphores[i], nullptr);
   }
 
-  if (swapchain_info.oldSwapchain) {
-    vkDestroySwapchainKHR(m_device, swapchain_info.oldSwapchain, nullptr);
+  vkDestroySemaphore(m_device, m_graphics_timeline, nullptr);
+  vkDestroySemaphore(m_device, m_compute_timeline, nullptr);
+
+  m_recorder.reset();
+  m_graph.reset();
+  m_post_graph.reset();
+  m_present_graph.reset();
+  m_gpu_scene.reset();
+  m_mesh_loader.reset();
+  m_textures.reset();
+  m_hiz.reset();
+  m_post.reset();
+  m_bindless.reset();
+  vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+  if (m_compute_command_pool) {
+    vkDestroyCommandPool(m_device, m_compute_command_pool, nullptr);
+  }
+  vkDestroyPipelineLayout(m_device, m_instanced_layout, nullptr);
+  vkDestroyShaderModule(m_device, m_instanced_vs, nullptr);
+  vkDestroyShaderModule(m_device, m_cull_cs, nullptr);
+  vkDestroyShaderModule(m_device, m_meshlet_cull_cs, nullptr);
+  if (m_mesh_shader_supported) {
+    vkDestroyPipelineLayout(m_device, m_meshlet_layout, nullptr);
+    vkDestroyShaderModule(m_device, m_meshlet_ts, nullptr);
+    vkDestroyShaderModule(m_device, m_meshlet_ms, nullptr);
+  }
+  vkDestroyShaderModule(m_device, m_hiz_cs, nullptr);
+  vkDestroyShaderModule(m_device, m_bloom_down_cs, nullptr);
+  vkDestroyShaderModule(m_device, m_bloom_up_cs, nullptr);
+  vkDestroyShaderModule(m_device, m_tonemap_cs, nullptr);
+  vkDestroyPipelineCache(m_device, m_pipeline_cache, nullptr);
+  if (m_render_pass) {
+    vkDestroyRenderPass(m_device, m_render_pass, nullptr);
+    vkDestroyRenderPass(m_device, m_render_pass_load, nullptr);
+  }
+  vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+  vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_frame_set_layout, nullptr);
+  vkDestroyShaderModule(m_device, m_triangle_vs, nullptr);
+  vkDestroyShaderModule(m_device, m_triangle_fs, nullptr);
+  m_profiler.reset();
+  m_uploader.reset();
+  m_upload_ring.reset();
+  m_gpu_allocator.reset();
+  vkDestroyDevice(m_device, nullptr);
+
+  if (m_surface) {
+    vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
   }
 
-  uint32_t image_count = 0;
-  vkGetSwapchainImagesKHR(m_device, m_swapchain, &image_count, nullptr);
+#if _DEBUG
+  auto vkDestroyDebugUtilsMessengerEXT = (PFN_vkDestroyDebugUtilsMessengerEXT) vkGetInstanceProcAddr(m_instance, "vkDestroyDebugUtilsMessengerEXT");
+  vkDestroyDebugUtilsMessengerEXT(m_instance, m_debug_messenger, nullptr);
+#endif
 
-  m_swapchain_images.resize(image_count);
-  m_swapchain_image_views.resize(image_count);
-  m_swapchain_framebuffers.resize(image_count);
+  vkDestroyInstance(m_instance, nullptr);
+}
 
-  vkGetSwapchainImagesKHR(m_device, m_swapchain, &image_count, m_swapchain_images.data());
+void Renderer::wait_idle() {
+  vkDeviceWaitIdle(m_device);
+}
 
-  for (auto i : Range<uint32_t>(image_count)) {
-    VkImageSubresourceRange subresource = {
-      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-      .levelCount = 1,
-      .layerCount = 1
-    };
+void Renderer::print_memory_stats() {
+  m_gpu_allocator->print_stats();
 
-    VkImageViewCreateInfo view_info = {
-      .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
-      .image = m_swapchain_images[i],
-      .viewType = VK_IMAGE_VIEW_TYPE_2D,
-      .format = swapchain_info.imageFormat,
-      .subresourceRange = subresource
-    };
+  UploadStats upload_stats = m_uploader->stats();
+  std::cout << std::format("Uploads: {:.1f} MB total, {:.1f} MB/s, {} pending", upload_stats.total_bytes / (1024.0 * 1024.0), upload_stats.bytes_per_second / (1024.0 * 1024.0), upload_stats.pending_requests) << std::endl;
 
-    if (vkCreateImageView(m_device, &view_info, nullptr, &m_swapchain_image_views[i]) != VK_SUCCESS) {
-      fatal_error("Failed to create Vulkan swapchain image view.");
-    }
+  TextureStats texture_stats = m_textures->stats();
+  std::cout << std::format("Textures: {} resident in {:.1f} of {:.1f} MB ({:.1f} MB wanted), {} streaming, {:.1f} ms average stream-in, {} evictions",
+    texture_stats.textures, texture_stats.resident_bytes / (1024.0 * 1024.0), texture_stats.budget_bytes / (1024.0 * 1024.0), texture_stats.wanted_bytes / (1024.0 * 1024.0),
+    texture_stats.streaming, texture_stats.average_stream_in_ms, texture_stats.evictions) << std::endl;
+}
 
-    VkFramebufferCreateInfo framebuffer_info = {
-      .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO, 
-      .renderPass = m_render_pass,
-      .attachmentCount = 1,
-      .pAttachments = &m_swapchain_image_views[i],
-      .width = width,
-      .height = height,
-      .layers = 1
-    };
+void Renderer::set_draw_count(uint32_t count) {
+  m_instances_dirty |= m_gpu_driven && count != m_draw_count;
+  m_draw_count = count;
+}
 
-    if (vkCreateFramebuffer(m_device, &framebuffer_info, nullptr, &m_swapchain_framebuffers[i]) != VK_SUCCESS) {
-      fatal_error("Failed to create Vulkan framebuffer.");
-    }
+bool Renderer::set_gpu_driven(bool enabled) {
+  if (enabled && !m_gpu_driven_supported) {
+    return false;
   }
+
+  m_instances_dirty |= enabled != m_gpu_driven;
+  m_graph_dirty |= enabled != m_gpu_driven;
+  m_gpu_driven = enabled;
+  return true;
+}
+
+bool Renderer::set_dynamic_rendering(bool enabled) {
+  if (enabled && !m_dynamic_rendering_supported) {
+    return false;
+  }
+
+  if (enabled != m_dynamic_rendering) {
+    vkDeviceWaitIdle(m_device);
+
+    destroy_pipelines();
+    m_dynamic_rendering = enabled;
+    create_pipelines();
+
+    m_graph_dirty = true;
+  }
+
+  return true;
+}
+
+bool Renderer::set_async_compute(bool enabled) {
+  if (enabled && !m_compute_queue) {
+    return false;
+  }
+
+  // A frame tonemapped on the compute queue and not yet presented is dropped
+  // rather than presented out of turn
+  if (enabled != m_async_compute) {
+    m_post_pending.reset();
+  }
+
+  m_async_compute = enabled;
+  return true;
+}
+
+void Renderer::set_occlusion_culling(bool enabled) {
+  m_graph_dirty |= enabled != m_occlusion_culling;
+  m_occlusion_culling = enabled;
+}
+
+bool Renderer::set_mesh(const char* path) {
+  std::optional<GpuMesh> mesh;
+
+  // Meshes are only drawn GPU-driven
+  if (!m_gpu_scene) {
+    return false;
+  }
+
+  if (path) {
+    mesh = m_mesh_loader->load(path);
+    if (!mesh) {
+      return false;
+    }
+  }
+
+  if (m_mesh) {
+    defer_destroy([this, retired = *m_mesh]() {
+      m_mesh_loader->destroy(retired);
+    });
+  }
+
+  m_mesh = std::move(mesh);
+  m_gpu_scene->set_mesh(m_mesh ? &*m_mesh : nullptr);
+  return true;
+}
+
+void Renderer::set_scene_animation(bool enabled) {
+  // Put the rows back where they started
+  m_instances_dirty |= m_gpu_driven && m_scene_animation && !enabled;
+  m_scene_animation = enabled;
+}
+
+void Renderer::set_occluder_count(uint32_t count) {
+  m_instances_dirty |= m_gpu_driven && count != m_occluder_count;
+  m_occluder_count = count;
+}
+
+void Renderer::set_camera(float x, float y, float zoom) {
+  m_camera[0] = x;
+  m_camera[1] = y;
+  m_zoom = zoom;
+}
+
+void Renderer::set_record_slices(uint32_t count) {
+  vkDeviceWaitIdle(m_device);
+
+  m_recorder.reset();
+
+  if (count) {
+    m_recorder = std::make_unique<ParallelRecorder>(m_device, m_queue_family, *m_jobs, count, m_frames_in_flight);
+  }
+}
+
+void Renderer::resize(uint32_t width, uint32_t height) {
+  m_requested_width = width;
+  m_requested_height = height;
+  m_targets_dirty = true;
+}
+
+// Returns false while there is nothing to render to (minimized window)
+bool Renderer::recreate_targets() {
+  auto start = std::chrono::steady_clock::now();
+  uint32_t width = m_requested_width;
+  uint32_t height = m_requested_height;
+
+  if (m_headless) {
+    if (!width || !height) {
+      return false;
+    }
+
+    retire_targets();
+    create_offscreen_images(width, height);
+  }
+  else {
+    // The old swapchain is passed as oldSwapchain and stays alive until the
+    // frames that presented from it have completed
+    std::optional<Swapchain::Retired> retired = m_swapchain->recreate(width, height, m_pacing.present_mode, m_pacing.image_count);
+    if (!retired) {
+      return false;
+    }
+
+    retire_targets();
+
+    defer_destroy([this, retired = std::move(*retired)]() {
+      m_swapchain->destroy(retired);
+    });
+
+    m_swapchain_images = m_swapchain->images();
+    m_last_present_id = 0;
+
+    // Present ids of the old swapchain can't be waited on through the new one
+    for (auto i : Range<uint32_t>(m_pending_latency_count)) {
+      m_pending_latency[(m_pending_latency_head + i) % max_pending_latency].presented = false;
+    }
+    width = m_swapchain->extent().width;
+    height = m_swapchain->extent().height;
+  }
+
+  m_swapchain_width = width;
+  m_swapchain_height = height;
+  m_targets_dirty = false;
+  m_graph_dirty = true;
+
+  m_rebuild_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  return true;
+}
+
+// Hands the current offscreen images to the deferred destroy list instead of
+// waiting for the device to go idle
+void Renderer::retire_targets() {
+  std::vector<VkImage> images = std::move(m_swapchain_images);
+  std::vector<GpuAllocation> allocations = std::move(m_offscreen_allocations);
+
+  m_swapchain_images.clear();
+  m_offscreen_allocations.clear();
+
+  defer_destroy([this, images = std::move(images), allocations = std::move(allocations)]() {
+    // Swapchain images belong to the swapchain; only offscreen ones have allocations
+    for (auto i : Range<size_t>(allocations.size())) {
+      m_gpu_allocator->destroy_image(GpuImage { images[i], allocations[i] });
+    }
+  });
+}
+
+void Renderer::build_graph() {
+  auto start = std::chrono::steady_clock::now();
+  retire_graph();
+
+  bool occlusion = m_gpu_driven && m_occlusion_culling;
+  VkImageLayout present_layout = m_headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  // The frame's HDR image was last read by its post-processing a few frames
+  // ago, which wait_for_frame() has waited for. It is left ready for compute,
+  // on whichever queue post-processing runs.
+  m_hdr = m_graph->import_image("hdr", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+    .final = RgState { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+  });
+
+  m_depth = m_graph->create_image("depth", RgImageDesc {
+    .format = depth_format,
+    .width = m_swapchain_width,
+    .height = m_swapchain_height,
+    .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+  });
+
+  // Culling always binds the pyramid, even when only the late phase samples
+  // it. Each frame's early phase uses what the last frame built, and its
+  // descriptors are written for GENERAL.
+  RgImage hiz = 0;
+
+  if (m_gpu_driven) {
+    hiz = m_graph->import_image("hi-z", RgImport {
+      .initial = { VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+      .persistent = true,
+      .general = true,
+    });
+
+    m_graph->add_pass(occlusion ? "early cull" : "cull", { { hiz, RgUsage::ComputeRead } }, [this, occlusion](VkCommandBuffer cmd) {
+      m_gpu_scene->cull(cmd, m_frame_index, m_cull_view, occlusion ? CullPhase::Early : CullPhase::All);
+    }, true);
+  }
+
+  std::vector<RgUse> attachments = { { m_hdr, RgUsage::ColorAttachment }, { m_depth, RgUsage::DepthAttachment } };
+
+  m_graph->add_pass(occlusion ? "early pass" : "main pass", attachments, [this, occlusion](VkCommandBuffer cmd) {
+    auto record_start = std::chrono::steady_clock::now();
+
+    if (m_gpu_driven) {
+      begin_rendering(cmd, false, false);
+      record_indirect_draws(cmd, m_frame_offset, occlusion ? CullPhase::Early : CullPhase::All);
+    }
+    else if (m_recorder) {
+      begin_rendering(cmd, false, true);
+
+      VkFormat color_format = hdr_format;
+
+      VkCommandBufferInheritanceRenderingInfo rendering_inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &color_format,
+        .depthAttachmentFormat = depth_format,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+      };
+
+      VkCommandBufferInheritanceInfo inheritance = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = m_dynamic_rendering ? &rendering_inheritance : nullptr,
+        .renderPass = m_dynamic_rendering ? nullptr : m_render_pass,
+        .subpass = 0,
+        .framebuffer = m_dynamic_rendering ? nullptr : m_framebuffers[m_frame_index],
+        .pipelineStatistics = m_profiler->statistics_flags(),
+      };
+
+      const std::vector<VkCommandBuffer>& secondaries = m_recorder->record(m_frame_index, inheritance, m_draw_count, [&](VkCommandBuffer secondary, Range<uint32_t> draws) {
+        record_draws(secondary, draws, m_frame_offset);
+      });
+
+      vkCmdExecuteCommands(cmd, (uint32_t)secondaries.size(), secondaries.data());
+    }
+    else {
+      begin_rendering(cmd, false, false);
+      record_draws(cmd, Range<uint32_t>(m_draw_count), m_frame_offset);
+    }
+
+    m_record_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record_start).count();
+
+    end_rendering(cmd);
+  });
+
+  // Two-phase occlusion culling: the early pass draws last frame's visible set,
+  // and the late pass draws whatever else passes the occlusion test against
+  // the pyramid built from its depth
+  if (occlusion) {
+    m_graph->add_pass("hi-z build", { { m_depth, RgUsage::ComputeRead }, { hiz, RgUsage::ComputeStorage } }, [this](VkCommandBuffer cmd) {
+      m_hiz->build(cmd, m_hiz_pyramid);
+    });
+
+    m_graph->add_pass("late cull", { { hiz, RgUsage::ComputeRead } }, [this](VkCommandBuffer cmd) {
+      m_gpu_scene->cull(cmd, m_frame_index, m_cull_view, CullPhase::Late);
+    }, true);
+
+    // Task shaders test meshlets against the pyramid too
+    std::vector<RgUse> late_uses = attachments;
+    if (m_mesh_shader_supported) {
+      late_uses.push_back({ hiz, RgUsage::TaskRead });
+    }
+
+    m_graph->add_pass("late pass", late_uses, [this](VkCommandBuffer cmd) {
+      begin_rendering(cmd, true, false);
+      record_indirect_draws(cmd, m_frame_offset, CullPhase::Late);
+      end_rendering(cmd);
+    });
+  }
+
+  // The scene's barrier left the HDR image in this state; a compute queue
+  // waits for it through the graphics timeline. The bloom chain is rebuilt
+  // from scratch, once the last frame's post-processing (earlier on the same
+  // queue, or waited for at the switch between queues) is done with it.
+  m_post_hdr = m_post_graph->import_image("hdr", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+  });
+
+  RgImage bloom = m_post_graph->import_image("bloom", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED },
+  });
+
+  m_post_ldr = m_post_graph->import_image("ldr", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+    .final = RgState { VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+  });
+
+  m_post_graph->add_pass("bloom", { { m_post_hdr, RgUsage::ComputeRead }, { bloom, RgUsage::ComputeStorage } }, [this](VkCommandBuffer cmd) {
+    m_post->bloom(cmd, m_post_targets, m_frame_index);
+  });
+
+  m_post_graph->add_pass("tonemap", { { m_post_hdr, RgUsage::ComputeRead }, { bloom, RgUsage::ComputeRead }, { m_post_ldr, RgUsage::ComputeStorage } }, [this](VkCommandBuffer cmd) {
+    m_post->tonemap(cmd, m_post_targets, m_frame_index);
+  });
+
+  // Post-processing's barrier (or the compute timeline) makes the LDR image
+  // ready to copy from. The acquire semaphore is waited on at transfer, so the
+  // backbuffer's transition out of UNDEFINED waits there too.
+  m_present_ldr = m_present_graph->import_image("ldr", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_NONE, 0, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+  });
+
+  m_backbuffer = m_present_graph->import_image("backbuffer", RgImport {
+    .initial = { VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED },
+    .final = RgState { VK_PIPELINE_STAGE_2_NONE, 0, present_layout },
+  });
+
+  m_present_graph->add_pass("present copy", { { m_present_ldr, RgUsage::TransferSrc }, { m_backbuffer, RgUsage::TransferDst } }, [this](VkCommandBuffer cmd) {
+    VkImageCopy region = {
+      .srcSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1 },
+      .dstSubresource = { .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT, .layerCount = 1 },
+      .extent = { m_swapchain_width, m_swapchain_height, 1 },
+    };
+
+    vkCmdCopyImage(cmd, m_present_graph->image(m_present_ldr), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_present_graph->image(m_backbuffer), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+  });
+
+  RenderGraphStats stats = m_graph->compile();
+
+  for (RenderGraph* graph : { m_post_graph.get(), m_present_graph.get() }) {
+    RenderGraphStats graph_stats = graph->compile();
+    stats.passes += graph_stats.passes;
+    stats.culled_passes += graph_stats.culled_passes;
+    stats.barriers += graph_stats.barriers;
+    stats.barrier_batches += graph_stats.barrier_batches;
+  }
+
+  // Resizes only change the transient sizes
+  bool changed = stats.passes != m_graph_stats.passes || stats.culled_passes != m_graph_stats.culled_passes ||
+    stats.barriers != m_graph_stats.barriers || stats.barrier_batches != m_graph_stats.barrier_batches;
+  m_graph_stats = stats;
+
+  if (changed) {
+    std::cout << std::format("Render graph: {} passes ({} culled), {} barriers in {} batches, {:.1f} MB transient ({:.1f} MB unaliased)",
+      stats.passes, stats.culled_passes, stats.barriers, stats.barrier_batches,
+      stats.transient_bytes / (1024.0 * 1024.0), stats.transient_bytes_unaliased / (1024.0 * 1024.0)) << std::endl;
+  }
+
+  if (m_gpu_driven) {
+    m_hiz_pyramid = m_hiz->create_pyramid(m_graph->view(m_depth), m_swapchain_width, m_swapchain_height);
+    m_graph->bind_image(hiz, m_hiz_pyramid.image.image, m_hiz_pyramid.view);
+  }
+
+  // Shared with the compute queue, so nothing needs an ownership transfer
+  std::vector<uint32_t> queue_families = { m_queue_family };
+  if (m_compute_queue) {
+    queue_families.push_back(m_compute_queue_family);
+  }
+
+  m_post_targets = m_post->create_targets(m_swapchain_width, m_swapchain_height, m_frames_in_flight, queue_families);
+  m_post_graph->bind_image(bloom, m_post_targets.bloom.image);
+
+  // Dynamic rendering uses the views directly
+  uint32_t framebuffer_count = m_dynamic_rendering ? 0 : m_frames_in_flight;
+  m_framebuffers.resize(framebuffer_count);
+
+  for (auto i : Range<uint32_t>(framebuffer_count)) {
+    VkImageView framebuffer_attachments[] = { m_post_targets.hdr_views[i], m_graph->view(m_depth) };
+
+    VkFramebufferCreateInfo framebuffer_info = {
+      .sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+      .renderPass = m_render_pass,
+      .attachmentCount = 2,
+      .pAttachments = framebuffer_attachments,
+      .width = m_swapchain_width,
+      .height = m_swapchain_height,
+      .layers = 1
+    };
+
+    if (vkCreateFramebuffer(m_device, &framebuffer_info, nullptr, &m_framebuffers[i]) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan framebuffer.");
+    }
+  }
+
+  m_graph_dirty = false;
+  m_rebuild_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Framebuffers, the Hi-Z pyramid, post-processing targets and the graph's
+// transient images may still be in use by frames in flight
+void Renderer::retire_graph() {
+  RenderGraph::Retired graph = m_graph->reset();
+  RenderGraph::Retired post_graph = m_post_graph->reset();
+  RenderGraph::Retired present_graph = m_present_graph->reset();
+  std::vector<VkFramebuffer> framebuffers = std::move(m_framebuffers);
+  HiZPyramid hiz_pyramid = std::exchange(m_hiz_pyramid, HiZPyramid {});
+  PostTargets post_targets = std::exchange(m_post_targets, PostTargets {});
+
+  // Its tonemapped image goes with the old targets
+  m_post_pending.reset();
+
+  m_framebuffers.clear();
+
+  defer_destroy([this, graph = std::move(graph), post_graph = std::move(post_graph), present_graph = std::move(present_graph), framebuffers = std::move(framebuffers),
+    hiz_pyramid = std::move(hiz_pyramid), post_targets = std::move(post_targets)]() {
+    for (auto fb : framebuffers) {
+      vkDestroyFramebuffer(m_device, fb, nullptr);
+    }
+
+    if (hiz_pyramid.view) {
+      m_hiz->destroy_pyramid(hiz_pyramid);
+    }
+
+    if (post_targets.descriptor_pool) {
+      m_post->destroy_targets(post_targets);
+    }
+
+    m_graph->destroy(graph);
+    m_post_graph->destroy(post_graph);
+    m_present_graph->destroy(present_graph);
+  });
+}
+
+// A pass that loads continues from an earlier one; only a clearing pass keeps
+// depth, as in create_render_pass()
+void Renderer::begin_rendering(VkCommandBuffer cmd, bool load, bool secondaries) {
+  VkClearValue clear_values[2] = {};
+  clear_values[0].color = {{0.012f, 0.012f, 0.012f, 1.0f}}; // Linear; about the old 0.1 once tonemapped
+  clear_values[1].depthStencil = { .depth = 1.0f };
+
+  VkRect2D render_area = {
+    .extent = { m_swapchain_width, m_swapchain_height }
+  };
+
+  if (m_dynamic_rendering) {
+    VkRenderingAttachmentInfo color_attachment = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+      .imageView = m_post_targets.hdr_views[m_frame_index],
+      .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+      .loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+      .clearValue = clear_values[0],
+    };
+
+    VkRenderingAttachmentInfo depth_attachment = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+      .imageView = m_graph->view(m_depth),
+      .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+      .loadOp = load ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
+      .storeOp = load ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE,
+      .clearValue = clear_values[1],
+    };
+
+    VkRenderingInfo rendering_info = {
+      .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+      .flags = secondaries ? (VkRenderingFlags)VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT : 0,
+      .renderArea = render_area,
+      .layerCount = 1,
+      .colorAttachmentCount = 1,
+      .pColorAttachments = &color_attachment,
+      .pDepthAttachment = &depth_attachment,
+    };
+
+    m_cmd_begin_rendering(cmd, &rendering_info);
+    return;
+  }
+
+  VkRenderPassBeginInfo render_pass_begin_info = {
+    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+    .renderPass = load ? m_render_pass_load : m_render_pass,
+    .framebuffer = m_framebuffers[m_frame_index],
+    .renderArea = render_area,
+    .clearValueCount = 2,
+    .pClearValues = clear_values
+  };
+
+  vkCmdBeginRenderPass(cmd, &render_pass_begin_info, secondaries ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
+}
+
+void Renderer::end_rendering(VkCommandBuffer cmd) {
+  if (m_dynamic_rendering) {
+    m_cmd_end_rendering(cmd);
+  }
+  else {
+    vkCmdEndRenderPass(cmd);
+  }
+}
+
+void Renderer::set_present_mode(PresentMode mode) {
+  if (mode != m_pacing.present_mode) {
+    m_pacing.present_mode = mode;
+    m_targets_dirty = !m_headless;
+  }
+}
+
+void Renderer::set_swapchain_image_count(uint32_t count) {
+  if (count != m_pacing.image_count) {
+    m_pacing.image_count = count;
+    m_targets_dirty = !m_headless;
+  }
+}
+
+PresentMode Renderer::present_mode() const {
+  return m_swapchain ? m_swapchain->present_mode() : PresentMode::Fifo;
+}
+
+// Completes pending latency samples in submission order, without blocking
+void Renderer::poll_latency() {
+  while (m_pending_latency_count) {
+    PendingLatency& pending = m_pending_latency[m_pending_latency_head];
+    bool done;
+
+    if (pending.presented) {
+      done = m_swapchain->wait_for_present(pending.serial, 0);
+    }
+    else {
+      done = m_completed_frames >= pending.serial ||
+        (m_frame_serials[pending.slot] == pending.serial && vkGetFenceStatus(m_device, m_fences[pending.slot]) == VK_SUCCESS);
+    }
+
+    if (!done) {
+      break;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.input_time).count();
+
+    m_latency_min_ms = m_latency_samples ? std::min(m_latency_min_ms, ms) : ms;
+    m_latency_max_ms = m_latency_samples ? std::max(m_latency_max_ms, ms) : ms;
+    m_latency_total_ms += ms;
+    m_latency_samples++;
+
+    m_pending_latency_head = (m_pending_latency_head + 1) % max_pending_latency;
+    m_pending_latency_count--;
+  }
+}
+
+LatencyStats Renderer::latency_stats() const {
+  return LatencyStats {
+    .samples = m_latency_samples,
+    .avg_ms = m_latency_samples ? m_latency_total_ms / m_latency_samples : 0.0,
+    .min_ms = m_latency_min_ms,
+    .max_ms = m_latency_max_ms,
+    .to_display = m_swapchain && m_swapchain->supports_present_wait(),
+  };
+}
+
+void Renderer::reset_latency_stats() {
+  m_latency_samples = 0;
+  m_latency_total_ms = 0.0;
+  m_latency_min_ms = 0.0;
+  m_latency_max_ms = 0.0;
+}
+
+void Renderer::defer_destroy(std::function<void()> destroy) {
+  m_deferred_destroys.emplace_back(m_submitted_frames, std::move(destroy));
+}
+
+void Renderer::flush_deferred() {
+  auto it = std::remove_if(m_deferred_destroys.begin(), m_deferred_destroys.end(), [&](auto& entry) {
+    if (entry.first > m_completed_frames) {
+      return false;
+    }
+
+    entry.second();
+    return true;
+  });
+
+  m_deferred_destroys.erase(it, m_deferred_destroys.end());
+}
+
+void Renderer::create_offscreen_images(uint32_t width, uint32_t height) {
+  m_swapchain_images.resize(m_frames_in_flight);
+  m_offscreen_allocations.resize(m_frames_in_flight);
+
+  for (auto i : Range<size_t>(m_frames_in_flight)) {
+    VkImageCreateInfo image_info = {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+      .imageType = VK_IMAGE_TYPE_2D,
+      .format = swapchain_format,
+      .extent = { width, height, 1 },
+      .mipLevels = 1,
+      .arrayLayers = 1,
+      .samples = VK_SAMPLE_COUNT_1_BIT,
+      .tiling = VK_IMAGE_TILING_OPTIMAL,
+      .usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+      .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+      .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED
+    };
+
+    GpuImage image = m_gpu_allocator->create_image(image_info, GpuMemoryUsage::GpuOnly);
+    m_swapchain_images[i] = image.image;
+    m_offscreen_allocations[i] = image.allocation;
+  }
+}
+
+bool Renderer::supports_device_extension(const char* name) {
+  if (m_available_device_extensions.empty()) {
+    uint32_t count = 0;
+    vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &count, nullptr);
+
+    m_available_device_extensions.resize(count);
+    vkEnumerateDeviceExtensionProperties(m_physical_device, nullptr, &count, m_available_device_extensions.data());
+  }
+
+  for (auto& extension : m_available_device_extensions) {
+    if (!strcmp(extension.extensionName, name)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Renderer::wait_for_frame() {
+  poll_latency();
+
+  if (m_pacing.low_latency && m_submitted_frames) {
+    // Let everything already submitted drain, so the frame about to start is
+    // the only one queued when it reaches the GPU
+    uint32_t previous = (m_frame_index + m_frames_in_flight - 1) % m_frames_in_flight;
+    vkWaitForFences(m_device, 1, &m_fences[previous], true, UINT64_MAX);
+
+    // Bounded so a window that stops being displayed can't hang the loop
+    if (m_last_present_id) {
+      constexpr uint64_t present_timeout_ns = 100'000'000;
+      m_swapchain->wait_for_present(m_last_present_id, present_timeout_ns);
+    }
+  }
+
+  vkWaitForFences(m_device, 1, &m_fences[m_frame_index], true, UINT64_MAX);
+
+  // Its post-processing may still be running on the compute queue
+  if (m_compute_serials[m_frame_index]) {
+    VkSemaphoreWaitInfo wait_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+      .semaphoreCount = 1,
+      .pSemaphores = &m_compute_timeline,
+      .pValues = &m_compute_serials[m_frame_index],
+    };
+
+    vkWaitSemaphores(m_device, &wait_info, UINT64_MAX);
+  }
+
+  m_completed_frames = std::max(m_completed_frames, m_frame_serials[m_frame_index]);
+  m_frame_arenas->begin_frame(m_frame_index);
+  flush_deferred();
+  poll_latency();
+
+  m_input_time = std::chrono::steady_clock::now();
+  m_frame_started = true;
 }
 
 void Renderer::present() {
+  if (!m_frame_started) {
+    wait_for_frame();
+  }
+
+  m_frame_started = false;
+  m_rebuild_ms = 0.0;
+
   VkCommandBuffer cmd_buf = m_command_buffers[m_frame_index];
-  vkWaitForFences(m_device, 1, &m_fences[m_frame_index], true, UINT64_MAX);
+
+  if (m_targets_dirty && !recreate_targets()) {
+    return;
+  }
+
+  // Before acquiring, as rebuilding drops a frame waiting to be presented
+  if (m_graph_dirty) {
+    build_graph();
+  }
+
+  // With async compute, the frame presented is the one before this, so there
+  // is nothing to present until one has been post-processed
+  bool presenting = !m_async_compute || m_post_pending;
+
+  uint32_t image_index = m_frame_index; // Headless copies into the offscreen image for this frame
+  if (!m_headless && presenting) {
+    VkResult result = m_swapchain->acquire(m_acquire_semaphores[m_frame_index], &image_index);
+
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+      // Nothing was signalled, so the fence and semaphore are still usable
+      if (!recreate_targets()) {
+        return;
+      }
+
+      build_graph();
+      presenting = !m_async_compute;
+      result = presenting ? m_swapchain->acquire(m_acquire_semaphores[m_frame_index], &image_index) : VK_SUCCESS;
+    }
+
+    if (result == VK_SUBOPTIMAL_KHR) {
+      m_targets_dirty = true;
+    }
+    else if (result != VK_SUCCESS) {
+      return;
+    }
+  }
+
+  // Only reset once this frame is certain to be submitted
   vkResetFences(m_device, 1, &m_fences[m_frame_index]);
 
+  update_pipelines();
+
+  if (m_instances_dirty && m_gpu_scene) {
+    // Instance and draw buffers of the old scene stay alive for in-flight frames
+    std::vector<GpuInstance> instances;
+
+    if (m_gpu_driven) {
+      m_scene_rows = build_scene(m_transforms, m_draw_count, m_occluder_count);
+      instances.resize(m_draw_count + m_occluder_count);
+      m_transforms.update(*m_jobs, instances.data(), m_transforms.level(scene_instance_depth).lower);
+    }
+
+    GpuScene::Retired retired = m_gpu_scene->set_instances(instances);
+    defer_destroy([this, retired = std::move(retired)]() {
+      m_gpu_scene->destroy(retired);
+    });
+
+    m_instances_dirty = false;
+  }
+
+  m_transform_ms = 0.0;
+
+  // This frame's fence has signalled, so its staging is free to overwrite
+  if (m_scene_animation && m_gpu_driven) {
+    if (GpuInstance* instances = m_gpu_scene->write_instances(m_frame_index)) {
+      auto start = std::chrono::steady_clock::now();
+      float time = std::chrono::duration<float>(start - m_start_time).count();
+
+      for (auto i : Range<uint32_t>((uint32_t)m_scene_rows.size())) {
+        const SceneRow& row = m_scene_rows[i];
+        m_transforms.set_local(row.entity, Transform2D { .y = row.y, .rotation = 0.05f * std::sin(2.0f * time + 0.3f * (float)i), .scale = 1.0f });
+      }
+
+      m_transforms.update(*m_jobs, instances, m_transforms.level(scene_instance_depth).lower);
+      m_transform_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+
+  // Swapped out levels stay alive for in-flight frames
+  for (auto& retired : m_textures->update()) {
+    defer_destroy([this, retired]() {
+      m_textures->destroy(retired);
+    });
+  }
+
+  m_gpu_allocator->update_budget();
+  m_upload_ring->begin_frame(m_frame_index);
+  m_uploader->submit();
+
   VkCommandBufferBeginInfo cmd_begin_info = {
     .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
   };
@@ -442,35 +1765,258 @@ void Renderer::present() {
     fatal_error("Failed to begin Vulkan command buffer.");
   }
 
-  uint32_t image_index;
-  vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, m_semaphores[m_frame_index], nullptr, &image_index);
+  m_profiler->begin_frame(cmd_buf, m_frame_index);
 
-  VkExtent2D render_extent = {
-    .width = m_swapchain_width,
-    .height = m_swapchain_height
+  uint64_t upload_wait_value;
+  {
+    ProfileScope scope(*m_profiler, cmd_buf, "upload acquire");
+    upload_wait_value = m_uploader->record_acquires(cmd_buf);
+  }
+
+  FrameUniforms frame_uniforms = {
+    .time = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_start_time).count(),
+    .aspect = (float)m_swapchain_width / (float)m_swapchain_height,
+    .camera = { m_camera[0], m_camera[1] },
+    .zoom = m_zoom,
   };
 
-  VkRect2D render_area = {
-    .extent = render_extent
+  UploadSlice frame_slice = m_upload_ring->push(frame_uniforms);
+
+  m_frame_offset = (uint32_t)frame_slice.offset;
+  m_cull_view = CullView {
+    .camera = { m_camera[0], m_camera[1] },
+    .zoom = m_zoom,
+    .aspect = frame_uniforms.aspect,
+    .time = frame_uniforms.time,
+    .hiz_set = m_hiz_pyramid.cull_set,
+    .hiz_size = { m_hiz_pyramid.width, m_hiz_pyramid.height },
+    .hiz_levels = m_hiz_pyramid.levels,
+    .viewport_height = m_swapchain_height,
+    .lod_threshold = m_lod_threshold,
   };
 
-  VkClearValue clear_color = {
-    {0.1f, 0.1f, 0.1f, 1.0f}
+  Arena& arena = m_frame_arenas->local();
+  uint64_t serial = m_submitted_frames + 1;
+
+  m_graph->bind_image(m_hdr, m_post_targets.hdr[m_frame_index].image, m_post_targets.hdr_views[m_frame_index]);
+  m_graph->execute(cmd_buf, arena, m_profiler.get());
+
+  m_post_graph->bind_image(m_post_hdr, m_post_targets.hdr[m_frame_index].image);
+  m_post_graph->bind_image(m_post_ldr, m_post_targets.ldr[m_frame_index].image);
+
+  if (!m_async_compute) {
+    m_post_graph->execute(cmd_buf, arena, m_profiler.get());
+  }
+
+  m_profiler->end_frame(cmd_buf);
+
+  if(vkEndCommandBuffer(cmd_buf) != VK_SUCCESS) {
+    fatal_error("Failed to end Vulkan command buffer.");
+  }
+
+  // The scene (and in sync mode its post-processing) in one batch, and the
+  // copy into the backbuffer in another, so only the copy waits on acquire.
+  // With async compute the copy is of the frame before, once the compute
+  // queue is done with it, and goes first, so the scene's timeline signal
+  // covers it too.
+  struct Batch {
+    ArenaVector<VkSemaphore> wait_semaphores;
+    ArenaVector<VkPipelineStageFlags> wait_stages;
+    ArenaVector<uint64_t> wait_values; // Ignored for binary semaphores
+    ArenaVector<VkSemaphore> signal_semaphores;
+    ArenaVector<uint64_t> signal_values;
+    VkCommandBuffer cmd;
+
+    Batch(Arena& arena, VkCommandBuffer cmd)
+      : wait_semaphores(arena), wait_stages(arena), wait_values(arena), signal_semaphores(arena), signal_values(arena), cmd(cmd)
+    {
+    }
+
+    void wait(VkSemaphore semaphore, VkPipelineStageFlags stages, uint64_t value) {
+      wait_semaphores.push_back(semaphore);
+      wait_stages.push_back(stages);
+      wait_values.push_back(value);
+    }
+
+    void signal(VkSemaphore semaphore, uint64_t value) {
+      signal_semaphores.push_back(semaphore);
+      signal_values.push_back(value);
+    }
   };
 
-  VkRenderPassBeginInfo render_pass_begin_info = {
-    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-    .renderPass = m_render_pass,
-    .framebuffer = m_swapchain_framebuffers[image_index],
-    .renderArea = render_area,
-    .clearValueCount = 1,
-    .pClearValues = &clear_color
+  ArenaVector<Batch> batches(arena);
+  batches.reserve(2);
+
+  std::optional<uint32_t> presented_slot = m_async_compute ? m_post_pending : std::optional<uint32_t>(m_frame_index);
+
+  if (presented_slot && m_async_compute) {
+    Batch& copy = batches.emplace_back(arena, m_present_command_buffers[m_frame_index]);
+    copy.wait(m_compute_timeline, VK_PIPELINE_STAGE_TRANSFER_BIT, m_compute_serials[*presented_slot]);
+  }
+
+  Batch& scene = batches.emplace_back(arena, cmd_buf);
+
+  if (upload_wait_value) {
+    scene.wait(m_uploader->timeline(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, upload_wait_value);
+  }
+
+  if (m_async_compute) {
+    scene.signal(m_graphics_timeline, serial);
+  }
+  else if (m_last_compute_serial) {
+    // The bloom chain may still be in use by the compute queue, from before async compute was turned off
+    scene.wait(m_compute_timeline, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, m_last_compute_serial);
+  }
+
+  if (presented_slot && !m_async_compute) {
+    batches.emplace_back(arena, m_present_command_buffers[m_frame_index]);
+  }
+
+  if (presented_slot) {
+    Batch& copy = m_async_compute ? batches.front() : batches.back();
+
+    if (!m_headless) {
+      copy.wait(m_acquire_semaphores[m_frame_index], VK_PIPELINE_STAGE_TRANSFER_BIT, 0);
+      copy.signal(m_swapchain->present_semaphore(image_index), 0);
+    }
+
+    record_present_copy(copy.cmd, arena, *presented_slot, image_index);
+  }
+
+  ArenaVector<VkTimelineSemaphoreSubmitInfo> timeline_infos(arena);
+  ArenaVector<VkSubmitInfo> submit_infos(arena);
+  timeline_infos.reserve(batches.size());
+  submit_infos.reserve(batches.size());
+
+  for (auto& batch : batches) {
+    timeline_infos.push_back(VkTimelineSemaphoreSubmitInfo {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .waitSemaphoreValueCount = (uint32_t)batch.wait_values.size(),
+      .pWaitSemaphoreValues = batch.wait_values.data(),
+      .signalSemaphoreValueCount = (uint32_t)batch.signal_values.size(),
+      .pSignalSemaphoreValues = batch.signal_values.data(),
+    });
+
+    submit_infos.push_back(VkSubmitInfo {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &timeline_infos.back(),
+      .waitSemaphoreCount = (uint32_t)batch.wait_semaphores.size(),
+      .pWaitSemaphores = batch.wait_semaphores.data(),
+      .pWaitDstStageMask = batch.wait_stages.data(),
+      .commandBufferCount = 1,
+      .pCommandBuffers = &batch.cmd,
+      .signalSemaphoreCount = (uint32_t)batch.signal_semaphores.size(),
+      .pSignalSemaphores = batch.signal_semaphores.data(),
+    });
+  }
+
+  vkQueueSubmit(m_queue, (uint32_t)submit_infos.size(), submit_infos.data(), m_fences[m_frame_index]);
+  m_frame_serials[m_frame_index] = ++m_submitted_frames;
+  m_compute_serials[m_frame_index] = 0;
+
+  // Post-processing starts once the scene is drawn, while the graphics queue
+  // moves on to the next frame
+  if (m_async_compute) {
+    VkCommandBuffer compute_cmd = m_compute_command_buffers[m_frame_index];
+
+    vkResetCommandBuffer(compute_cmd, 0);
+    if (vkBeginCommandBuffer(compute_cmd, &cmd_begin_info) != VK_SUCCESS) {
+      fatal_error("Failed to begin Vulkan command buffer.");
+    }
+
+    m_post_graph->execute(compute_cmd, arena);
+
+    if (vkEndCommandBuffer(compute_cmd) != VK_SUCCESS) {
+      fatal_error("Failed to end Vulkan command buffer.");
+    }
+
+    VkPipelineStageFlags compute_wait_stage = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+
+    VkTimelineSemaphoreSubmitInfo compute_timeline_info = {
+      .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+      .waitSemaphoreValueCount = 1,
+      .pWaitSemaphoreValues = &serial,
+      .signalSemaphoreValueCount = 1,
+      .pSignalSemaphoreValues = &serial,
+    };
+
+    VkSubmitInfo compute_submit_info = {
+      .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+      .pNext = &compute_timeline_info,
+      .waitSemaphoreCount = 1,
+      .pWaitSemaphores = &m_graphics_timeline,
+      .pWaitDstStageMask = &compute_wait_stage,
+      .commandBufferCount = 1,
+      .pCommandBuffers = &compute_cmd,
+      .signalSemaphoreCount = 1,
+      .pSignalSemaphores = &m_compute_timeline,
+    };
+
+    vkQueueSubmit(m_compute_queue, 1, &compute_submit_info, nullptr);
+    m_compute_serials[m_frame_index] = serial;
+    m_last_compute_serial = serial;
+  }
+
+  if (presented_slot) {
+    // Input for the frame presented was sampled a frame earlier in async compute mode
+    PendingLatency latency = {
+      .serial = m_submitted_frames,
+      .slot = m_frame_index,
+      .presented = false,
+      .input_time = m_async_compute ? m_post_input_time : m_input_time,
+    };
+
+    if (!m_headless) {
+      // The frame serial doubles as the present id, which only has to increase
+      VkResult result = m_swapchain->present(m_queue, image_index, m_submitted_frames);
+
+      if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        m_targets_dirty = true;
+      }
+
+      if ((result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR) && m_swapchain->supports_present_wait()) {
+        m_last_present_id = m_submitted_frames;
+        latency.presented = true;
+      }
+    }
+
+    if (m_pending_latency_count == max_pending_latency) {
+      m_pending_latency_head = (m_pending_latency_head + 1) % max_pending_latency;
+      m_pending_latency_count--;
+    }
+
+    m_pending_latency[(m_pending_latency_head + m_pending_latency_count) % max_pending_latency] = latency;
+    m_pending_latency_count++;
+  }
+
+  if (m_async_compute) {
+    m_post_pending = m_frame_index;
+    m_post_input_time = m_input_time;
+  }
+
+  m_frame_index = (m_frame_index + 1) % m_frames_in_flight;
+}
+
+void Renderer::record_present_copy(VkCommandBuffer cmd, Arena& arena, uint32_t slot, uint32_t image_index) {
+  VkCommandBufferBeginInfo cmd_begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
   };
 
-  vkCmdBeginRenderPass(cmd_buf, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+  vkResetCommandBuffer(cmd, 0);
+  if (vkBeginCommandBuffer(cmd, &cmd_begin_info) != VK_SUCCESS) {
+    fatal_error("Failed to begin Vulkan command buffer.");
+  }
 
-  vkCmdBindPipeline(cmd_buf, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline); 
+  m_present_graph->bind_image(m_present_ldr, m_post_targets.ldr[slot].image);
+  m_present_graph->bind_image(m_backbuffer, m_swapchain_images[image_index]);
+  m_present_graph->execute(cmd, arena);
 
+  if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+    fatal_error("Failed to end Vulkan command buffer.");
+  }
+}
+
+void Renderer::set_viewport(VkCommandBuffer cmd) {
   VkViewport viewport = {
     .width = (float)m_swapchain_width,
     .height = (float)m_swapchain_height,
@@ -479,49 +2025,177 @@ void Renderer::present() {
   };
 
   VkRect2D scissor = {
-    .extent = render_extent
+    .extent = { m_swapchain_width, m_swapchain_height }
   };
 
-  vkCmdSetViewport(cmd_buf, 0, 1, &viewport);
-  vkCmdSetScissor(cmd_buf, 0, 1, &scissor);
+  vkCmdSetViewport(cmd, 0, 1, &viewport);
+  vkCmdSetScissor(cmd, 0, 1, &scissor);
+}
 
-  vkCmdDraw(cmd_buf, 3, 1, 0, 0);
+// Secondary buffers inherit no state, so every slice binds everything it uses
+void Renderer::record_draws(VkCommandBuffer cmd, Range<uint32_t> draws, uint32_t frame_offset) {
+  VkPipeline pipeline = m_pipelines->get(m_pipeline);
+  if (!pipeline) {
+    return;
+  }
 
-  vkCmdEndRenderPass(cmd_buf);
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  set_viewport(cmd);
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_frame_set, 1, &frame_offset);
 
-  if(vkEndCommandBuffer(cmd_buf) != VK_SUCCESS) {
-    fatal_error("Failed to end Vulkan command buffer.");
+  uint32_t columns = grid_columns(m_draw_count);
+
+  for (auto i : draws) {
+    DrawConstants constants = grid_draw(i, columns);
+    vkCmdPushConstants(cmd, m_pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(constants), &constants);
+    vkCmdDraw(cmd, 3, 1, 0, 0);
   }
+}
 
-  VkPipelineStageFlags wait_stages[] = {
-    VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT
-  };
-  
-  VkSubmitInfo submit_info = {
-    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-    .waitSemaphoreCount = 1,
-    .pWaitSemaphores = &m_semaphores[m_frame_index],
-    .pWaitDstStageMask = wait_stages,
-    .commandBufferCount = 1,
-    .pCommandBuffers = &cmd_buf,
+void Renderer::record_indirect_draws(VkCommandBuffer cmd, uint32_t frame_offset, CullPhase phase) {
+  bool mesh_shaders = m_gpu_scene->uses_mesh_shaders();
+  VkPipeline pipeline = m_pipelines->get(mesh_shaders ? m_meshlet_pipeline : m_instanced_pipeline);
+  VkPipelineLayout layout = mesh_shaders ? m_meshlet_layout : m_instanced_layout;
+
+  if (!pipeline) {
+    return;
+  }
+
+  vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  set_viewport(cmd);
+
+  VkDescriptorSet sets[] = { m_frame_set, m_bindless->set() };
+  vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, sets, 1, &frame_offset);
+  m_gpu_scene->draw(cmd, layout, m_cull_view, phase);
+}
+
+// The pipelines compile in the background; draws are skipped until they are
+// ready. With dynamic rendering they are created against attachment formats;
+// otherwise against m_render_pass, which (like m_render_pass_load, compatible
+// with it) is only created then.
+void Renderer::create_pipelines() {
+  if (!m_dynamic_rendering && !m_render_pass) {
+    m_render_pass = create_render_pass(m_device, false);
+    m_render_pass_load = create_render_pass(m_device, true);
+  }
+
+  PipelineTargets targets = {
+    .render_pass = m_dynamic_rendering ? nullptr : m_render_pass,
+    .color_format = hdr_format,
+    .depth_format = depth_format,
   };
 
-  vkQueueSubmit(m_queue, 1, &submit_info, m_fences[m_frame_index]);
+  // Left mostly to the job system, which records every frame
+  uint32_t compile_threads = std::clamp(std::thread::hardware_concurrency() / 4, 1u, 4u);
+
+  m_pipeline_start = std::chrono::steady_clock::now();
+  m_pipelines_reported = false;
+  m_pipelines = std::make_unique<PipelineManager>(m_device, m_pipeline_cache, targets, m_graphics_pipeline_library, compile_threads);
+
+  m_pipeline = m_pipelines->request(GraphicsPipelineDesc {
+    .vertex_shader = m_triangle_vs,
+    .fragment_shader = m_triangle_fs,
+    .layout = m_pipeline_layout,
+  });
+
+  // GPU-driven path: instances are fetched from the bindless heap
+  if (m_gpu_driven_supported) {
+    m_instanced_pipeline = m_pipelines->request(GraphicsPipelineDesc {
+      .vertex_shader = m_instanced_vs,
+      .fragment_shader = m_triangle_fs,
+      .layout = m_instanced_layout,
+    });
+  }
+
+  // Meshlets culled in task shaders, with the same vertices and winding
+  if (m_mesh_shader_supported) {
+    m_meshlet_pipeline = m_pipelines->request(GraphicsPipelineDesc {
+      .vertex_shader = nullptr,
+      .fragment_shader = m_triangle_fs,
+      .layout = m_meshlet_layout,
+      .task_shader = m_meshlet_ts,
+      .mesh_shader = m_meshlet_ms,
+    });
+  }
+}
+
+void Renderer::destroy_pipelines() {
+  m_pipelines.reset();
+}
+
+void Renderer::wait_for_pipelines() {
+  m_pipelines->wait();
+  update_pipelines();
+}
 
-  VkPresentInfoKHR present_info = {
-    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-    .swapchainCount = 1,
-    .pSwapchains = &m_swapchain,
-    .pImageIndices = &image_index,
+// Publishes finished compiles and reports once every pipeline is final
+void Renderer::update_pipelines() {
+  for (VkPipeline pipeline : m_pipelines->update()) {
+    defer_destroy([device = m_device, pipeline] { vkDestroyPipeline(device, pipeline, nullptr); });
+  }
+
+  if (!m_pipelines_reported && pipelines_ready()) {
+    double pipeline_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_pipeline_start).count();
+    std::cout << std::format("Pipeline creation: {:.3f} ms to ready ({} cache, {}, {})", pipeline_ms, m_pipeline_cache_warm ? "warm" : "cold",
+      m_dynamic_rendering ? "dynamic rendering" : "render passes", m_graphics_pipeline_library ? "libraries" : "monolithic") << std::endl;
+    m_pipelines_reported = true;
+  }
+}
+
+void Renderer::load_pipeline_cache() {
+  std::optional<MappedFile> data = map_binary(pipeline_cache_path);
+
+  // Only seed the cache with data written by this exact device and driver; the
+  // driver would reject (or worse, trust) anything else.
+  m_pipeline_cache_warm = false;
+
+  if (data && data->size() >= sizeof(VkPipelineCacheHeaderVersionOne)) {
+    VkPipelineCacheHeaderVersionOne header;
+    memcpy(&header, data->data(), sizeof(header));
+
+    m_pipeline_cache_warm =
+      header.headerSize >= sizeof(VkPipelineCacheHeaderVersionOne) && header.headerSize <= data->size() &&
+      header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+      header.vendorID == m_physical_device_props.vendorID &&
+      header.deviceID == m_physical_device_props.deviceID &&
+      memcmp(header.pipelineCacheUUID, m_physical_device_props.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+
+    if (!m_pipeline_cache_warm) {
+      std::cout << std::format("Discarding stale pipeline cache '{}'", pipeline_cache_path) << std::endl;
+    }
+  }
+
+  VkPipelineCacheCreateInfo cache_info = {
+    .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+    .initialDataSize = m_pipeline_cache_warm ? data->size() : 0,
+    .pInitialData = m_pipeline_cache_warm ? data->data() : nullptr,
   };
 
-  vkQueuePresentKHR(m_queue, &present_info);
+  if (vkCreatePipelineCache(m_device, &cache_info, nullptr, &m_pipeline_cache) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan pipeline cache.");
+  }
+}
+
+void Renderer::save_pipeline_cache() {
+  size_t size = 0;
+  if (vkGetPipelineCacheData(m_device, m_pipeline_cache, &size, nullptr) != VK_SUCCESS) {
+    return;
+  }
 
-  m_frame_index = (m_frame_index + 1) % FRAMES_IN_FLIGHT;
+  std::vector<uint8_t> data(size);
+  if (vkGetPipelineCacheData(m_device, m_pipeline_cache, &size, data.data()) != VK_SUCCESS) {
+    return;
+  }
+
+  data.resize(size);
+
+  if (!save_binary(pipeline_cache_path, data.data(), data.size())) {
+    std::cerr << std::format("Failed to write pipeline cache '{}'", pipeline_cache_path) << std::endl;
+  }
 }
 
 VkShaderModule Renderer::load_shader(const char* path) {
-  std::optional<std::vector<uint8_t>> shader_code = load_binary(path);
+  std::optional<MappedFile> shader_code = map_binary(path);
 
   if (!shader_code) {
     fatal_error("Missing shader at '{}'", path);
@@ -530,7 +2204,7 @@ VkShaderModule Renderer::load_shader(const char* path) {
   VkShaderModuleCreateInfo module_info = {
     .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
     .codeSize = shader_code->size(),
-    .pCode = (uint32_t*)shader_code->data(),
+    .pCode = (const uint32_t*)shader_code->data(),
   };
 
   VkShaderModule module;
@@ -540,12 +2214,3 @@ VkShaderModule Renderer::load_shader(const char* path) {
 
   return module;
 }
-
-VkPipelineShaderStageCreateInfo Renderer::make_shader_stage(VkShaderStageFlagBits stage, VkShaderModule module) {
-  return VkPipelineShaderStageCreateInfo {
-    .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-    .stage = stage,
-    .module = module,
-    .pName = "main"
-  };
-}
\ No newline at end of file
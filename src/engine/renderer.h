@@ -1,42 +1,337 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <vector>
 #include <vulkan/vulkan.h>
 
 #include "platform/platform.h"
+#include "gpu_memory.h"
+#include "upload_ring.h"
+#include "uploader.h"
+#include "parallel_recorder.h"
+#include "jobs.h"
+#include "arena.h"
+#include "profiler.h"
+#include "swapchain.h"
+#include "gpu_scene.h"
+#include "mesh.h"
+#include "textures.h"
+#include "transforms.h"
+#include "hiz.h"
+#include "post.h"
+#include "bindless.h"
+#include "render_graph.h"
+#include "pipeline_manager.h"
 
-static constexpr uint32_t FRAMES_IN_FLIGHT = 2;
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+struct FramePacing {
+  PresentMode present_mode = PresentMode::Fifo;
+  uint32_t image_count = 0;      // Swapchain images; 0 picks one for the present mode
+  uint32_t frames_in_flight = 2; // 1 to MAX_FRAMES_IN_FLIGHT, fixed once the renderer exists
+  // Starts each frame only once the previous one has finished on the GPU (and
+  // been displayed, where present waits are supported), so input sampled after
+  // wait_for_frame() is not queued behind older frames. Costs throughput.
+  bool low_latency = false;
+};
+
+// Time from the end of wait_for_frame() (where input should be sampled) until
+// the frame was displayed, or finished on the GPU when present waits are
+// unavailable. Completion is noticed at the start of a later frame, so samples
+// can be late by up to one frame unless low latency mode waits on them.
+struct LatencyStats {
+  uint32_t samples;
+  double avg_ms;
+  double min_ms;
+  double max_ms;
+  bool to_display; // False when measured to GPU completion
+};
+
+// A row of the GPU-driven grid, swayed about its center when animated
+struct SceneRow {
+  EntityId entity;
+  float y;
+};
 
 class Renderer {
 public:
-  Renderer(platform::WindowHandle window);
+  Renderer(platform::WindowHandle window, const FramePacing& pacing = {});
+  Renderer(uint32_t width, uint32_t height, const FramePacing& pacing = {}); // Headless: renders into offscreen images, no surface or swapchain
+  ~Renderer();
+  // Takes effect at the next present(); never stalls the device
   void resize(uint32_t width, uint32_t height);
+  // Blocks until the next frame may start. Sample input after this returns;
+  // present() calls it itself if it wasn't called for the frame.
+  void wait_for_frame();
   void present();
 
+  // Present mode and image count changes recreate the swapchain at the next present()
+  void set_present_mode(PresentMode mode);
+  void set_swapchain_image_count(uint32_t count);
+  void set_low_latency(bool enabled) { m_pacing.low_latency = enabled; }
+  const FramePacing& pacing() const { return m_pacing; }
+  // What the surface actually gave us; always FIFO when headless
+  PresentMode present_mode() const;
+
+  LatencyStats latency_stats() const;
+  void reset_latency_stats();
+  void wait_idle();
+  void print_memory_stats();
+
+  // The scene is a grid of 'count' triangles, one draw call each
+  void set_draw_count(uint32_t count);
+  // Splits draw recording into 'count' secondary buffers recorded as jobs; 0 records inline
+  void set_record_slices(uint32_t count);
+  // Draws the grid as instances culled by a compute pass and drawn indirectly.
+  // Returns false (and keeps CPU draws) when the device can't.
+  bool set_gpu_driven(bool enabled);
+  // Draws last frame's visible instances first, builds a Hi-Z pyramid from
+  // their depth and draws whatever else passes an occlusion test against it.
+  // Only affects the GPU-driven path.
+  void set_occlusion_culling(bool enabled);
+  // Adds 'count' large triangles in front of the GPU-driven grid, for
+  // occlusion culling to hide it behind
+  void set_occluder_count(uint32_t count);
+  // Sways the rows of the GPU-driven grid, updating every instance's world
+  // transform on the job threads each frame; off by default
+  void set_scene_animation(bool enabled);
+  // CPU time the last present() spent updating transforms; 0 when not animated
+  double transform_time_ms() const { return m_transform_ms; }
+  // GPU culling results of the most recently completed frame
+  CullStats cull_stats() const { return m_gpu_scene ? m_gpu_scene->stats() : CullStats {}; }
+  uint32_t visible_instances() const { CullStats stats = cull_stats(); return stats.early_draws + stats.late_draws; }
+  // Draws the GPU-driven instances as a cooked mesh (see mesh_format.h)
+  // instead of triangles; null goes back to triangles. Returns false, keeping
+  // the current mesh, when the file can't be loaded.
+  bool set_mesh(const char* path);
+  // Each instance of the mesh is drawn at the coarsest LOD whose error is at
+  // most 'pixels' on screen; 0 always draws the finest
+  void set_lod_threshold(float pixels) { m_lod_threshold = pixels; }
+  // Culls the mesh's meshlets on the GPU too (see MeshletPath); by default
+  // with mesh shaders where supported, else in compute. Returns false, keeping
+  // the current path, when the device can't.
+  bool set_meshlet_path(MeshletPath path) { return m_gpu_scene && m_gpu_scene->set_meshlet_path(path); }
+  MeshletPath meshlet_path() const { return m_gpu_scene ? m_gpu_scene->meshlet_path() : MeshletPath::None; }
+  // Pans and zooms the view of the grid, which spans [-1, 1] at zoom 1
+  void set_camera(float x, float y, float zoom);
+  // CPU time spent recording draws in the last present()
+  double record_time_ms() const { return m_record_ms; }
+  // Records passes with VK_KHR_dynamic_rendering instead of render pass and
+  // framebuffer objects; on by default where supported. Recreates the graphics
+  // pipelines, so it waits for the device. Returns false when unsupported.
+  bool set_dynamic_rendering(bool enabled);
+  bool dynamic_rendering() const { return m_dynamic_rendering; }
+  // Runs bloom and tonemapping on a compute-only queue, overlapped with the
+  // next frame's rendering on the graphics queue. Frames are displayed one
+  // present() later than without it. Off by default; returns false when the
+  // device has no separate compute family.
+  bool set_async_compute(bool enabled);
+  bool async_compute() const { return m_async_compute; }
+  // CPU time the last present() spent recreating targets and the render graph
+  // (as after a resize); 0 when nothing was rebuilt
+  double rebuild_time_ms() const { return m_rebuild_ms; }
+  // Pipelines compile in the background from construction (and after
+  // set_dynamic_rendering()); until then frames are presented without draws.
+  // Stays false while fast-linked placeholders are still being optimized.
+  bool pipelines_ready() const { return m_pipelines->pending() == 0; }
+  // For measurements that need every draw: blocks until pipelines_ready()
+  void wait_for_pipelines();
+
+  VkPhysicalDevice physical_device() const { return m_physical_device; }
+  GpuAllocator& gpu_allocator() { return *m_gpu_allocator; }
+  Uploader& uploader() { return *m_uploader; }
+  JobSystem& jobs() { return *m_jobs; }
+  // Scratch for CPU data built while recording a frame, reset once its fence has signalled
+  FrameArenas& frame_arenas() { return *m_frame_arenas; }
+  GpuProfiler& profiler() { return *m_profiler; }
+  BindlessHeap& bindless() { return *m_bindless; }
+  TextureStreamer& textures() { return *m_textures; }
+
 private:
+  Renderer(platform::WindowHandle window, std::pair<uint32_t, uint32_t> size, const FramePacing& pacing);
+  bool recreate_targets();
+  void retire_targets();
+  // Declares the frame's passes for the current mode and targets, and creates
+  // what depends on the graph's images (framebuffers, Hi-Z pyramid,
+  // post-processing targets)
+  void build_graph();
+  void retire_graph();
+  void create_pipelines();
+  void destroy_pipelines();
+  void update_pipelines();
+  // Into the frame's HDR image and depth, through whichever path is enabled
+  void begin_rendering(VkCommandBuffer cmd, bool load, bool secondaries);
+  void end_rendering(VkCommandBuffer cmd);
+  void create_offscreen_images(uint32_t width, uint32_t height);
+  // Copies frame 'slot''s tonemapped image into the backbuffer
+  void record_present_copy(VkCommandBuffer cmd, Arena& arena, uint32_t slot, uint32_t image_index);
+  bool supports_device_extension(const char* name);
+  void load_pipeline_cache();
+  void save_pipeline_cache();
   VkShaderModule load_shader(const char* path);
-  VkPipelineShaderStageCreateInfo make_shader_stage(VkShaderStageFlagBits stage, VkShaderModule module);
+  void record_draws(VkCommandBuffer cmd, Range<uint32_t> draws, uint32_t frame_offset);
+  void record_indirect_draws(VkCommandBuffer cmd, uint32_t frame_offset, CullPhase phase);
+  void set_viewport(VkCommandBuffer cmd);
+  // Runs 'destroy' once every frame submitted so far has completed
+  void defer_destroy(std::function<void()> destroy);
+  void flush_deferred();
+  void poll_latency();
 
 private:
+  bool m_headless;
+  FramePacing m_pacing;
+  uint32_t m_frames_in_flight;
+  std::unique_ptr<JobSystem> m_jobs;
+  std::unique_ptr<FrameArenas> m_frame_arenas;
+  std::chrono::steady_clock::time_point m_start_time;
   VkInstance m_instance;
+#if _DEBUG
+  VkDebugUtilsMessengerEXT m_debug_messenger;
+#endif
   VkPhysicalDevice m_physical_device;
+  VkPhysicalDeviceProperties m_physical_device_props;
+  std::vector<VkExtensionProperties> m_available_device_extensions;
   VkDevice m_device;
+  uint32_t m_queue_family;
   VkQueue m_queue;
-  VkSurfaceKHR m_surface;
-  VkSwapchainKHR m_swapchain = nullptr;
-  uint32_t m_swapchain_width;
-  uint32_t m_swapchain_height;
-  std::vector<VkImage> m_swapchain_images;
-  std::vector<VkImageView> m_swapchain_image_views;
-  std::vector<VkFramebuffer> m_swapchain_framebuffers;
-  VkFence m_fences[FRAMES_IN_FLIGHT] = {};
+  VkQueue m_transfer_queue; // Same as m_queue when there is no transfer-only family
+  uint32_t m_compute_queue_family = 0;
+  VkQueue m_compute_queue = nullptr; // Only with a compute family apart from graphics
+  std::unique_ptr<GpuAllocator> m_gpu_allocator;
+  std::unique_ptr<UploadRing> m_upload_ring;
+  std::unique_ptr<Uploader> m_uploader;
+  std::unique_ptr<GpuProfiler> m_profiler;
+  std::unique_ptr<BindlessHeap> m_bindless;
+  VkSurfaceKHR m_surface = nullptr;
+  std::unique_ptr<Swapchain> m_swapchain;
+  uint32_t m_swapchain_width = 0;
+  uint32_t m_swapchain_height = 0;
+  uint32_t m_requested_width = 0;
+  uint32_t m_requested_height = 0;
+  bool m_targets_dirty = true;
+  std::vector<VkImage> m_swapchain_images; // Offscreen images when headless, one per frame in flight
+  std::vector<GpuAllocation> m_offscreen_allocations;
+  std::vector<VkFramebuffer> m_framebuffers; // Per frame in flight, over its HDR image
+  // The scene into HDR, then bloom and tonemapping into LDR, then the copy to
+  // the backbuffer. Separate graphs, as each may be submitted to its own queue.
+  std::unique_ptr<RenderGraph> m_graph;
+  std::unique_ptr<RenderGraph> m_post_graph;
+  std::unique_ptr<RenderGraph> m_present_graph;
+  bool m_graph_dirty = true;
+  RgImage m_hdr = 0;
+  RgImage m_depth = 0;
+  RgImage m_post_hdr = 0;
+  RgImage m_post_ldr = 0;
+  RgImage m_present_ldr = 0;
+  RgImage m_backbuffer = 0;
+  RenderGraphStats m_graph_stats = {}; // Of the last build, to only report changes
+  HiZPyramid m_hiz_pyramid = {};
+  PostTargets m_post_targets = {};
+  VkFence m_fences[MAX_FRAMES_IN_FLIGHT] = {};
   VkShaderModule m_triangle_vs;
   VkShaderModule m_triangle_fs;
+  VkDescriptorSetLayout m_frame_set_layout;
+  VkDescriptorPool m_descriptor_pool;
+  VkDescriptorSet m_frame_set;
   VkPipelineLayout m_pipeline_layout;
-  VkRenderPass m_render_pass;
-  VkPipeline m_pipeline;
+  bool m_dynamic_rendering_supported;
+  bool m_dynamic_rendering;
+  PFN_vkCmdBeginRendering m_cmd_begin_rendering = nullptr;
+  PFN_vkCmdEndRendering m_cmd_end_rendering = nullptr;
+  VkRenderPass m_render_pass = nullptr;      // Clears; only created for the render pass path
+  VkRenderPass m_render_pass_load = nullptr; // Continues from an earlier pass
+  bool m_graphics_pipeline_library;
+  std::unique_ptr<PipelineManager> m_pipelines;
+  std::chrono::steady_clock::time_point m_pipeline_start;
+  bool m_pipelines_reported = false;
+  PipelineHandle m_pipeline;
+  bool m_bindless_supported;
+  bool m_gpu_driven_supported;
+  bool m_gpu_driven = false;
+  bool m_instances_dirty = false;
+  std::unique_ptr<GpuScene> m_gpu_scene;
+  std::unique_ptr<MeshLoader> m_mesh_loader;
+  std::optional<GpuMesh> m_mesh;
+  std::unique_ptr<TextureStreamer> m_textures;
+  float m_lod_threshold = 1.0f;
+  VkShaderModule m_instanced_vs = nullptr;
+  VkShaderModule m_cull_cs = nullptr;
+  VkShaderModule m_meshlet_cull_cs = nullptr;
+  VkShaderModule m_hiz_cs;
+  VkShaderModule m_bloom_down_cs;
+  VkShaderModule m_bloom_up_cs;
+  VkShaderModule m_tonemap_cs;
+  std::unique_ptr<PostProcess> m_post;
+  bool m_mesh_shader_supported;
+  VkShaderModule m_meshlet_ts = nullptr;
+  VkShaderModule m_meshlet_ms = nullptr;
+  VkPipelineLayout m_meshlet_layout = nullptr;
+  PipelineHandle m_meshlet_pipeline = 0;
+  std::unique_ptr<HiZBuilder> m_hiz;
+  bool m_occlusion_culling = false;
+  uint32_t m_occluder_count = 0;
+  TransformStore m_transforms; // The GPU-driven grid's hierarchy
+  std::vector<SceneRow> m_scene_rows;
+  bool m_scene_animation = false;
+  double m_transform_ms = 0.0;
+  VkPipelineLayout m_instanced_layout = nullptr;
+  PipelineHandle m_instanced_pipeline = 0;
+  float m_camera[2] = {};
+  float m_zoom = 1.0f;
+  VkPipelineCache m_pipeline_cache;
+  bool m_pipeline_cache_warm;
   VkCommandPool m_command_pool;
-  VkSemaphore m_semaphores[FRAMES_IN_FLIGHT] = {};
-  VkCommandBuffer m_command_buffers[FRAMES_IN_FLIGHT] = {};
+  VkSemaphore m_acquire_semaphores[MAX_FRAMES_IN_FLIGHT] = {};
+  VkCommandBuffer m_command_buffers[MAX_FRAMES_IN_FLIGHT] = {};
+  VkCommandBuffer m_present_command_buffers[MAX_FRAMES_IN_FLIGHT] = {};
+  VkCommandPool m_compute_command_pool = nullptr;
+  VkCommandBuffer m_compute_command_buffers[MAX_FRAMES_IN_FLIGHT] = {};
+  // Signalled with the frame serial by the scene's submission, and by its
+  // post-processing on the compute queue, in async compute mode
+  VkSemaphore m_graphics_timeline;
+  VkSemaphore m_compute_timeline;
+  bool m_async_compute = false;
+  uint64_t m_compute_serials[MAX_FRAMES_IN_FLIGHT] = {}; // Compute timeline value each slot's post-processing signals; 0 for none
+  uint64_t m_last_compute_serial = 0;
+  // A frame post-processed on the compute queue and not yet presented
+  std::optional<uint32_t> m_post_pending;
+  std::chrono::steady_clock::time_point m_post_input_time;
   uint32_t m_frame_index = 0;
+  bool m_frame_started = false;
+  uint64_t m_submitted_frames = 0;
+  uint64_t m_completed_frames = 0;
+  uint64_t m_frame_serials[MAX_FRAMES_IN_FLIGHT] = {}; // Value of m_submitted_frames when each slot was last submitted
+  uint64_t m_last_present_id = 0; // 0 when nothing was presented to the current swapchain
+  std::vector<std::pair<uint64_t, std::function<void()>>> m_deferred_destroys;
+  uint32_t m_draw_count = 1;
+  std::unique_ptr<ParallelRecorder> m_recorder;
+  double m_record_ms = 0.0;
+  double m_rebuild_ms = 0.0;
+
+  // Per-frame state the graph's passes read when executed
+  uint32_t m_frame_offset = 0;
+  CullView m_cull_view = {};
+
+  struct PendingLatency {
+    uint64_t serial;
+    uint32_t slot;
+    bool presented; // Presented with a present id that can be waited on
+    std::chrono::steady_clock::time_point input_time;
+  };
+
+  std::chrono::steady_clock::time_point m_input_time;
+  // Ring of samples waiting on their frame, oldest at the head. Frames in
+  // flight and queued presents keep it to a few entries; should it fill up
+  // anyway, the oldest sample is dropped.
+  static constexpr uint32_t max_pending_latency = 16;
+  PendingLatency m_pending_latency[max_pending_latency] = {};
+  uint32_t m_pending_latency_head = 0;
+  uint32_t m_pending_latency_count = 0;
+  uint32_t m_latency_samples = 0;
+  double m_latency_total_ms = 0.0;
+  double m_latency_min_ms = 0.0;
+  double m_latency_max_ms = 0.0;
 };
@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <iostream>
+#include <format>
+
+#include "swapchain.h"
+#include "base.h"
+
+const char* present_mode_name(PresentMode mode) {
+  switch (mode) {
+    case PresentMode::Fifo: return "fifo";
+    case PresentMode::Mailbox: return "mailbox";
+    case PresentMode::Immediate: return "immediate";
+  }
+
+  return "unknown";
+}
+
+static VkPresentModeKHR to_vk_present_mode(PresentMode mode) {
+  switch (mode) {
+    case PresentMode::Fifo: return VK_PRESENT_MODE_FIFO_KHR;
+    case PresentMode::Mailbox: return VK_PRESENT_MODE_MAILBOX_KHR;
+    case PresentMode::Immediate: return VK_PRESENT_MODE_IMMEDIATE_KHR;
+  }
+
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+// Immediate falls back to mailbox (still no waiting on vblank), and both fall
+// back to FIFO, which every surface supports
+static PresentMode choose_present_mode(const std::vector<VkPresentModeKHR>& supported, PresentMode requested) {
+  auto is_supported = [&](PresentMode mode) {
+    return std::find(supported.begin(), supported.end(), to_vk_present_mode(mode)) != supported.end();
+  };
+
+  if (requested == PresentMode::Immediate && !is_supported(PresentMode::Immediate)) {
+    requested = PresentMode::Mailbox;
+  }
+
+  if (requested == PresentMode::Mailbox && !is_supported(PresentMode::Mailbox)) {
+    requested = PresentMode::Fifo;
+  }
+
+  return requested;
+}
+
+Swapchain::Swapchain(VkPhysicalDevice physical_device, VkDevice device, VkSurfaceKHR surface, VkFormat format, bool present_wait)
+  : m_physical_device(physical_device), m_device(device), m_surface(surface), m_format(format)
+{
+  if (present_wait) {
+    m_vkWaitForPresentKHR = (PFN_vkWaitForPresentKHR)vkGetDeviceProcAddr(m_device, "vkWaitForPresentKHR");
+  }
+}
+
+Swapchain::~Swapchain() {
+  destroy(Retired { m_swapchain, m_present_semaphores });
+}
+
+std::optional<Swapchain::Retired> Swapchain::recreate(uint32_t width, uint32_t height, PresentMode mode, uint32_t image_count) {
+  VkSurfaceCapabilitiesKHR caps;
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(m_physical_device, m_surface, &caps);
+
+  VkExtent2D extent = caps.currentExtent;
+
+  // 0xffffffff means the surface size follows the swapchain
+  if (extent.width == 0xffffffff) {
+    extent.width = std::clamp(width, caps.minImageExtent.width, caps.maxImageExtent.width);
+    extent.height = std::clamp(height, caps.minImageExtent.height, caps.maxImageExtent.height);
+  }
+
+  if (!extent.width || !extent.height) {
+    return std::nullopt;
+  }
+
+  uint32_t present_mode_count = 0;
+  vkGetPhysicalDeviceSurfacePresentModesKHR(m_physical_device, m_surface, &present_mode_count, nullptr);
+  std::vector<VkPresentModeKHR> present_modes(present_mode_count);
+  vkGetPhysicalDeviceSurfacePresentModesKHR(m_physical_device, m_surface, &present_mode_count, present_modes.data());
+
+  PresentMode chosen_mode = choose_present_mode(present_modes, mode);
+
+  if (chosen_mode != mode) {
+    std::cout << std::format("Present mode {} is not supported, using {}", present_mode_name(mode), present_mode_name(chosen_mode)) << std::endl;
+  }
+
+  // Mailbox needs a third image to have one to render into while one is
+  // displayed and another waits for vblank
+  if (!image_count) {
+    image_count = chosen_mode == PresentMode::Mailbox ? 3 : 2;
+  }
+
+  image_count = std::max(image_count, caps.minImageCount);
+  if (caps.maxImageCount) {
+    image_count = std::min(image_count, caps.maxImageCount);
+  }
+
+  // Frames are tonemapped elsewhere and copied in
+  if (!(caps.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+    fatal_error("Swapchain images can't be copied to.");
+  }
+
+  VkSwapchainCreateInfoKHR swapchain_info = {
+    .sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
+    .surface = m_surface,
+    .minImageCount = image_count,
+    .imageFormat = m_format,
+    .imageColorSpace = VK_COLORSPACE_SRGB_NONLINEAR_KHR,
+    .imageExtent = extent,
+    .imageArrayLayers = 1,
+    .imageUsage = VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    .preTransform = caps.currentTransform,
+    .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
+    .presentMode = to_vk_present_mode(chosen_mode),
+    .clipped = VK_TRUE,
+    .oldSwapchain = m_swapchain
+  };
+
+  VkSwapchainKHR swapchain;
+  if (vkCreateSwapchainKHR(m_device, &swapchain_info, nullptr, &swapchain) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan swapchain.");
+  }
+
+  Retired retired = { m_swapchain, std::move(m_present_semaphores) };
+
+  m_swapchain = swapchain;
+  m_extent = extent;
+  m_present_mode = chosen_mode;
+
+  uint32_t count = 0;
+  vkGetSwapchainImagesKHR(m_device, m_swapchain, &count, nullptr);
+  m_images.resize(count);
+  vkGetSwapchainImagesKHR(m_device, m_swapchain, &count, m_images.data());
+
+  m_present_semaphores.assign(m_images.size(), nullptr);
+
+  for (auto& semaphore : m_present_semaphores) {
+    VkSemaphoreCreateInfo semaphore_info = {
+      .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    };
+
+    vkCreateSemaphore(m_device, &semaphore_info, nullptr, &semaphore);
+  }
+
+  return retired;
+}
+
+void Swapchain::destroy(const Retired& retired) {
+  for (auto semaphore : retired.present_semaphores) {
+    vkDestroySemaphore(m_device, semaphore, nullptr);
+  }
+
+  if (retired.swapchain) {
+    vkDestroySwapchainKHR(m_device, retired.swapchain, nullptr);
+  }
+}
+
+VkResult Swapchain::acquire(VkSemaphore semaphore, uint32_t* image_index) {
+  if (!m_swapchain) {
+    return VK_ERROR_OUT_OF_DATE_KHR;
+  }
+
+  return vkAcquireNextImageKHR(m_device, m_swapchain, UINT64_MAX, semaphore, nullptr, image_index);
+}
+
+VkResult Swapchain::present(VkQueue queue, uint32_t image_index, uint64_t present_id) {
+  VkPresentIdKHR present_id_info = {
+    .sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR,
+    .swapchainCount = 1,
+    .pPresentIds = &present_id,
+  };
+
+  VkPresentInfoKHR present_info = {
+    .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+    .pNext = supports_present_wait() ? &present_id_info : nullptr,
+    .waitSemaphoreCount = 1,
+    .pWaitSemaphores = &m_present_semaphores[image_index],
+    .swapchainCount = 1,
+    .pSwapchains = &m_swapchain,
+    .pImageIndices = &image_index,
+  };
+
+  return vkQueuePresentKHR(queue, &present_info);
+}
+
+bool Swapchain::wait_for_present(uint64_t present_id, uint64_t timeout) {
+  if (!m_vkWaitForPresentKHR || !m_swapchain) {
+    return true;
+  }
+
+  // Out of date and similar errors mean the present will never be observed
+  return m_vkWaitForPresentKHR(m_device, m_swapchain, present_id, timeout) != VK_TIMEOUT;
+}
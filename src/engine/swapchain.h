@@ -0,0 +1,65 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+enum class PresentMode {
+  Fifo,      // Waits for vblank and queues frames; always supported
+  Mailbox,   // Waits for vblank, but a new frame replaces the queued one
+  Immediate, // Presents straight away and may tear
+};
+
+const char* present_mode_name(PresentMode mode);
+
+// Owns the VkSwapchainKHR, its images and one present semaphore per image. A
+// semaphore waited on by vkQueuePresentKHR can only be reused once its image
+// has been acquired again, which is why these are per image and the acquire
+// semaphores (protected by the frame fences) are per frame in flight.
+class Swapchain {
+public:
+  // What a recreation leaves behind; frames still in flight may use it
+  struct Retired {
+    VkSwapchainKHR swapchain;
+    std::vector<VkSemaphore> present_semaphores;
+  };
+
+  // 'present_wait' means VK_KHR_present_id and VK_KHR_present_wait are enabled
+  Swapchain(VkPhysicalDevice physical_device, VkDevice device, VkSurfaceKHR surface, VkFormat format, bool present_wait);
+  ~Swapchain();
+
+  // Builds a swapchain for the surface's current extent, or for width x height
+  // when the surface leaves the choice to us. Returns nullopt while the surface
+  // has no area (minimized); the current swapchain is then left alone. An
+  // unsupported mode falls back towards FIFO, and an image count of 0 picks
+  // one that suits the mode.
+  std::optional<Retired> recreate(uint32_t width, uint32_t height, PresentMode mode, uint32_t image_count);
+  void destroy(const Retired& retired);
+
+  VkResult acquire(VkSemaphore semaphore, uint32_t* image_index);
+  // Waits on the image's present semaphore. 'present_id' must increase with
+  // every present and is only used when present waits are enabled.
+  VkResult present(VkQueue queue, uint32_t image_index, uint64_t present_id);
+
+  bool supports_present_wait() const { return m_vkWaitForPresentKHR != nullptr; }
+  // True once the present with this id has reached the display (or was
+  // skipped); a 0 timeout polls
+  bool wait_for_present(uint64_t present_id, uint64_t timeout);
+
+  const std::vector<VkImage>& images() const { return m_images; }
+  VkExtent2D extent() const { return m_extent; }
+  PresentMode present_mode() const { return m_present_mode; }
+  VkSemaphore present_semaphore(uint32_t image_index) const { return m_present_semaphores[image_index]; }
+
+private:
+  VkPhysicalDevice m_physical_device;
+  VkDevice m_device;
+  VkSurfaceKHR m_surface;
+  VkFormat m_format;
+  VkSwapchainKHR m_swapchain = nullptr;
+  VkExtent2D m_extent = {};
+  PresentMode m_present_mode = PresentMode::Fifo;
+  PFN_vkWaitForPresentKHR m_vkWaitForPresentKHR = nullptr;
+  std::vector<VkImage> m_images;
+  std::vector<VkSemaphore> m_present_semaphores;
+};
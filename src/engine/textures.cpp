@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <iostream>
+
+#include "textures.h"
+#include "base.h"
+
+// Most stream-ins queued per update, so a camera cut doesn't queue every
+// texture's finest levels ahead of the frame's other uploads
+static constexpr uint32_t max_stream_ins_per_update = 8;
+
+TextureStreamer::TextureStreamer(VkDevice device, GpuAllocator& allocator, Uploader& uploader, BindlessHeap& bindless, VkDeviceSize budget, bool bc_formats, bool astc_formats)
+  : m_device(device), m_allocator(allocator), m_uploader(uploader), m_bindless(bindless), m_budget(budget), m_bc_formats(bc_formats), m_astc_formats(astc_formats)
+{
+  VkSamplerCreateInfo sampler_info = {
+    .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+    .magFilter = VK_FILTER_LINEAR,
+    .minFilter = VK_FILTER_LINEAR,
+    .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
+    .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
+    .maxLod = VK_LOD_CLAMP_NONE,
+  };
+
+  if (vkCreateSampler(m_device, &sampler_info, nullptr, &m_sampler) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan sampler.");
+  }
+
+  m_sampler_handle = m_bindless.add_sampler(m_sampler);
+}
+
+TextureStreamer::~TextureStreamer() {
+  std::vector<Retired> retired;
+
+  for (auto& texture : m_textures) {
+    retire(texture.resident, retired);
+    retire(texture.pending, retired);
+
+    if (texture.handle.valid()) {
+      m_bindless.remove(texture.handle);
+      retired.push_back(Retired { .handle = texture.handle });
+    }
+  }
+
+  for (auto& r : retired) {
+    destroy(r);
+  }
+
+  m_bindless.remove(m_sampler_handle);
+  m_bindless.release(m_sampler_handle);
+  vkDestroySampler(m_device, m_sampler, nullptr);
+}
+
+std::optional<TextureId> TextureStreamer::load(const char* path) {
+  std::optional<MappedFile> mapped = map_binary(path);
+  if (!mapped) {
+    std::cerr << std::format("Missing texture '{}'", path) << std::endl;
+    return std::nullopt;
+  }
+
+  auto file = std::make_shared<const MappedFile>(std::move(*mapped));
+
+  const char* error = nullptr;
+  std::optional<Ktx2Texture> ktx = parse_ktx2(file->data(), file->size(), &error);
+
+  if (!ktx) {
+    std::cerr << std::format("Invalid texture '{}': {}", path, error) << std::endl;
+    return std::nullopt;
+  }
+
+  if ((is_bc_format(ktx->format) && !m_bc_formats) || (is_astc_format(ktx->format) && !m_astc_formats)) {
+    std::cerr << std::format("Texture '{}' is in a format the device can't sample", path) << std::endl;
+    return std::nullopt;
+  }
+
+  TextureId id;
+  if (m_free_ids.size()) {
+    id = m_free_ids.back();
+    m_free_ids.pop_back();
+  }
+  else {
+    id = (TextureId)m_textures.size();
+    m_textures.emplace_back();
+  }
+
+  uint32_t level_count = (uint32_t)ktx->levels.size();
+  uint32_t tail_level = level_count - 1;
+
+  for (auto i : Range<uint32_t>(level_count)) {
+    if (std::max(ktx->levels[i].width, ktx->levels[i].height) <= tail_size) {
+      tail_level = i;
+      break;
+    }
+  }
+
+  Texture& texture = m_textures[id];
+  texture = Texture {
+    .file = std::move(file),
+    .ktx = std::move(*ktx),
+    .tail_level = tail_level,
+    .requested_level = ~0u,
+    .wanted_level = tail_level,
+    .live = true,
+  };
+
+  // The tail is resident whatever the budget says
+  texture.pending = begin_residency(texture, tail_level, false);
+  m_committed_bytes += residency_bytes(texture, tail_level);
+
+  return id;
+}
+
+void TextureStreamer::unload(TextureId id) {
+  assert(m_textures[id].live && "Texture already unloaded");
+  m_textures[id].unloading = true;
+}
+
+void TextureStreamer::request(TextureId id, float pixels) {
+  Texture& texture = m_textures[id];
+  uint32_t size = std::max(texture.ktx.width, texture.ktx.height);
+
+  // Level i is size >> i texels across
+  float ratio = (float)size / std::max(pixels, 1.0f);
+  uint32_t level = ratio > 1.0f ? (uint32_t)std::floor(std::log2(ratio)) : 0;
+
+  texture.requested_level = std::min({ texture.requested_level, level, texture.tail_level });
+}
+
+std::vector<TextureStreamer::Retired> TextureStreamer::update() {
+  std::vector<Retired> retired;
+  auto now = std::chrono::steady_clock::now();
+  m_update++;
+
+  for (auto id : Range<TextureId>((TextureId)m_textures.size())) {
+    Texture& texture = m_textures[id];
+    if (!texture.live) {
+      continue;
+    }
+
+    if (texture.pending && m_uploader.is_ready(texture.pending->ticket)) {
+      if (texture.pending->stream_in && texture.requested_at) {
+        double ms = std::chrono::duration<double, std::milli>(now - *texture.requested_at).count();
+        m_latency_total_ms += ms;
+        m_latency_max_ms = std::max(m_latency_max_ms, ms);
+        m_latency_count++;
+        m_stream_ins++;
+        texture.requested_at.reset();
+      }
+
+      // Frames in flight may still sample the old slot, so the new image gets a new one
+      retire(texture.resident, retired);
+      if (texture.handle.valid()) {
+        m_bindless.remove(texture.handle);
+        retired.back().handle = texture.handle;
+      }
+
+      texture.resident = std::move(texture.pending);
+      texture.pending.reset();
+      texture.handle = m_bindless.add_image(texture.resident->view);
+    }
+
+    if (texture.unloading && !texture.pending) {
+      m_committed_bytes -= residency_bytes(texture, target_level(texture));
+
+      retire(texture.resident, retired);
+      if (texture.handle.valid()) {
+        m_bindless.remove(texture.handle);
+        retired.back().handle = texture.handle;
+      }
+
+      texture = Texture {};
+      m_free_ids.push_back(id);
+      continue;
+    }
+
+    texture.wanted_level = std::min(texture.requested_level, texture.tail_level);
+    texture.requested_level = ~0u;
+
+    if (texture.wanted_level < texture.tail_level) {
+      texture.last_requested = m_update;
+    }
+
+    // Latency runs from the first request the texture can't yet satisfy
+    if (texture.wanted_level < target_level(texture)) {
+      if (!texture.requested_at) {
+        texture.requested_at = now;
+      }
+    }
+    else if (!texture.pending || !texture.pending->stream_in) {
+      texture.requested_at.reset();
+    }
+  }
+
+  // A lowered budget takes effect straight away
+  if (m_committed_bytes > m_budget) {
+    evict(m_committed_bytes - m_budget, nullptr);
+  }
+
+  // The textures missing the most detail go first
+  std::vector<TextureId> candidates;
+  for (auto id : Range<TextureId>((TextureId)m_textures.size())) {
+    const Texture& texture = m_textures[id];
+    if (texture.live && !texture.unloading && !texture.pending && texture.wanted_level < target_level(texture)) {
+      candidates.push_back(id);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [&](TextureId a, TextureId b) {
+    const Texture& ta = m_textures[a];
+    const Texture& tb = m_textures[b];
+    return target_level(ta) - ta.wanted_level > target_level(tb) - tb.wanted_level;
+  });
+
+  if (candidates.size() > max_stream_ins_per_update) {
+    candidates.resize(max_stream_ins_per_update);
+  }
+
+  for (auto id : candidates) {
+    Texture& texture = m_textures[id];
+    uint32_t current = target_level(texture);
+    VkDeviceSize current_bytes = residency_bytes(texture, current);
+
+    // The finest level at or below the one wanted that fits, once other
+    // textures' unwanted levels are evicted
+    uint32_t level = texture.wanted_level;
+
+    for (; level < current; level++) {
+      VkDeviceSize cost = residency_bytes(texture, level) - current_bytes;
+
+      if (m_committed_bytes + cost > m_budget) {
+        evict(m_committed_bytes + cost - m_budget, &texture);
+      }
+
+      if (m_committed_bytes + cost <= m_budget) {
+        break;
+      }
+    }
+
+    if (level != texture.wanted_level) {
+      m_denied++;
+    }
+
+    if (level == current) {
+      continue;
+    }
+
+    m_committed_bytes += residency_bytes(texture, level) - current_bytes;
+    texture.pending = begin_residency(texture, level, true);
+  }
+
+  return retired;
+}
+
+VkDeviceSize TextureStreamer::evict(VkDeviceSize bytes, const Texture* keep) {
+  std::vector<Texture*> candidates;
+
+  for (auto& texture : m_textures) {
+    if (texture.live && &texture != keep && !texture.pending && texture.wanted_level > target_level(texture)) {
+      candidates.push_back(&texture);
+    }
+  }
+
+  std::sort(candidates.begin(), candidates.end(), [](const Texture* a, const Texture* b) {
+    return a->last_requested < b->last_requested;
+  });
+
+  VkDeviceSize freed = 0;
+
+  for (Texture* texture : candidates) {
+    if (freed >= bytes) {
+      break;
+    }
+
+    // Down to what it still wants, at worst the tail
+    uint32_t level = texture->wanted_level;
+    freed += residency_bytes(*texture, target_level(*texture)) - residency_bytes(*texture, level);
+    m_committed_bytes -= residency_bytes(*texture, target_level(*texture)) - residency_bytes(*texture, level);
+    texture->pending = begin_residency(*texture, level, false);
+    m_evictions++;
+  }
+
+  return freed;
+}
+
+void TextureStreamer::destroy(const Retired& retired) {
+  if (retired.view) {
+    vkDestroyImageView(m_device, retired.view, nullptr);
+  }
+
+  if (retired.image.image) {
+    m_allocator.destroy_image(retired.image);
+  }
+
+  if (retired.handle.valid()) {
+    m_bindless.release(retired.handle);
+  }
+}
+
+uint32_t TextureStreamer::resident_level(TextureId id) const {
+  const Texture& texture = m_textures[id];
+  return texture.resident ? texture.resident->first_level : (uint32_t)texture.ktx.levels.size();
+}
+
+TextureStats TextureStreamer::stats() const {
+  TextureStats stats = {
+    .resident_bytes = m_committed_bytes,
+    .budget_bytes = m_budget,
+    .stream_ins = m_stream_ins,
+    .evictions = m_evictions,
+    .denied = m_denied,
+    .average_stream_in_ms = m_latency_count ? m_latency_total_ms / m_latency_count : 0.0,
+    .max_stream_in_ms = m_latency_max_ms,
+  };
+
+  for (auto& texture : m_textures) {
+    if (texture.live) {
+      stats.textures++;
+      stats.wanted_bytes += residency_bytes(texture, texture.wanted_level);
+      stats.streaming += texture.pending.has_value();
+    }
+  }
+
+  return stats;
+}
+
+void TextureStreamer::reset_stats() {
+  m_stream_ins = 0;
+  m_evictions = 0;
+  m_denied = 0;
+  m_latency_count = 0;
+  m_latency_total_ms = 0.0;
+  m_latency_max_ms = 0.0;
+}
+
+TextureStreamer::Residency TextureStreamer::begin_residency(Texture& texture, uint32_t first_level, bool stream_in) {
+  const Ktx2Level& first = texture.ktx.levels[first_level];
+  uint32_t level_count = (uint32_t)texture.ktx.levels.size() - first_level;
+
+  VkImageCreateInfo image_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+    .imageType = VK_IMAGE_TYPE_2D,
+    .format = texture.ktx.format,
+    .extent = { first.width, first.height, 1 },
+    .mipLevels = level_count,
+    .arrayLayers = 1,
+    .samples = VK_SAMPLE_COUNT_1_BIT,
+    .tiling = VK_IMAGE_TILING_OPTIMAL,
+    .usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+  };
+
+  Residency residency = {
+    .image = m_allocator.create_image(image_info, GpuMemoryUsage::GpuOnly),
+    .first_level = first_level,
+    .stream_in = stream_in,
+  };
+
+  VkImageViewCreateInfo view_info = {
+    .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+    .image = residency.image.image,
+    .viewType = VK_IMAGE_VIEW_TYPE_2D,
+    .format = texture.ktx.format,
+    .subresourceRange = {
+      .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+      .levelCount = level_count,
+      .layerCount = 1,
+    },
+  };
+
+  if (vkCreateImageView(m_device, &view_info, nullptr, &residency.view) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan image view.");
+  }
+
+  // Coarsest first, though the image is only swapped in once all have arrived
+  for (uint32_t i = level_count; i-- > 0;) {
+    const Ktx2Level& level = texture.ktx.levels[first_level + i];
+    residency.ticket = m_uploader.upload_image(residency.image.image, i, { level.width, level.height, 1 }, texture.file, level.offset, level.size);
+  }
+
+  return residency;
+}
+
+void TextureStreamer::retire(std::optional<Residency>& residency, std::vector<Retired>& retired) {
+  if (!residency) {
+    return;
+  }
+
+  retired.push_back(Retired {
+    .image = residency->image,
+    .view = residency->view,
+  });
+
+  residency.reset();
+}
+
+VkDeviceSize TextureStreamer::residency_bytes(const Texture& texture, uint32_t first_level) const {
+  VkDeviceSize bytes = 0;
+
+  for (uint32_t i = first_level; i < texture.ktx.levels.size(); i++) {
+    bytes += texture.ktx.levels[i].size;
+  }
+
+  return bytes;
+}
+
+uint32_t TextureStreamer::target_level(const Texture& texture) const {
+  return texture.pending ? texture.pending->first_level : texture.resident ? texture.resident->first_level : (uint32_t)texture.ktx.levels.size();
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+#include "uploader.h"
+#include "bindless.h"
+#include "ktx2.h"
+
+class MappedFile;
+
+// Index of a texture loaded by a TextureStreamer
+using TextureId = uint32_t;
+
+// Sizes are bytes of mip data; images' alignment padding is not counted
+struct TextureStats {
+  uint32_t textures;
+  VkDeviceSize resident_bytes; // The mips every texture has or is streaming in
+  VkDeviceSize wanted_bytes;   // The mips every texture was last asked for
+  VkDeviceSize budget_bytes;
+  uint32_t streaming;          // Textures with uploads in flight
+  uint64_t stream_ins;
+  uint64_t evictions;
+  uint64_t denied;             // Requests left coarser than asked for to stay within the budget
+  double average_stream_in_ms; // From a request for finer mips to their first use
+  double max_stream_in_ms;
+};
+
+// Streams the mips of KTX2 textures (see ktx2.h) into sampled images, within
+// a fixed budget. The coarse levels from 'tail_size' texels down are always
+// resident; finer ones are streamed in when requested, from feedback about
+// how large a texture is drawn on screen, and evicted least recently
+// requested first when the budget runs out.
+//
+// Files stay mapped and levels go from the mapping straight into staging
+// through the uploader. A texture's resident levels are one image, so a
+// change of residency uploads a new image from the file (the coarse levels
+// are a small part of it) and swaps it in once every level has arrived.
+// The old image stays sampled until then and alive until frames in flight are
+// done with it, so memory briefly exceeds the budget by the images being
+// swapped.
+class TextureStreamer {
+public:
+  // Images, views and heap slots that frames in flight may still sample
+  struct Retired {
+    GpuImage image;
+    VkImageView view;
+    BindlessHandle handle;
+  };
+
+  static constexpr uint32_t tail_size = 64;
+
+  // Formats of the block compression families the device lacks are rejected by load()
+  TextureStreamer(VkDevice device, GpuAllocator& allocator, Uploader& uploader, BindlessHeap& bindless, VkDeviceSize budget, bool bc_formats, bool astc_formats);
+  // The device must be idle
+  ~TextureStreamer();
+
+  // Maps the file and queues its tail. Returns nullopt, after printing why,
+  // for missing, malformed or unsupported files.
+  std::optional<TextureId> load(const char* path);
+  // The texture goes once its uploads have finished; update() retires it
+  void unload(TextureId id);
+
+  // Sampled image slot, invalid until the tail has arrived. Changes whenever
+  // levels stream in or out, so look it up every frame.
+  BindlessHandle handle(TextureId id) const { return m_textures[id].handle; }
+  // Trilinear and repeating
+  BindlessHandle sampler() const { return m_sampler_handle; }
+  // Feedback for the next update(): the texture is drawn about 'pixels'
+  // texels across. The finest level wanted is the smallest at least that size.
+  void request(TextureId id, float pixels);
+
+  // Once per frame, before the uploader submits: swaps in finished levels,
+  // applies the requests since the last update, evicts over budget and queues
+  // uploads. Returns what was swapped out or unloaded.
+  std::vector<Retired> update();
+  void destroy(const Retired& retired);
+
+  void set_budget(VkDeviceSize bytes) { m_budget = bytes; }
+  // Finest level frames sample, or the level count when nothing is resident yet
+  uint32_t resident_level(TextureId id) const;
+  uint32_t level_count(TextureId id) const { return (uint32_t)m_textures[id].ktx.levels.size(); }
+  TextureStats stats() const;
+  void reset_stats();
+
+private:
+  // One image holding levels first_level onwards
+  struct Residency {
+    GpuImage image;
+    VkImageView view;
+    uint32_t first_level;
+    UploadTicket ticket; // Of the last level
+    bool stream_in;      // Finer than what it replaces, rather than an eviction
+  };
+
+  struct Texture {
+    std::shared_ptr<const MappedFile> file;
+    Ktx2Texture ktx;
+    uint32_t tail_level;
+    std::optional<Residency> resident;
+    std::optional<Residency> pending;
+    BindlessHandle handle;
+    uint32_t requested_level; // Finest asked for since the last update; ~0 for none
+    uint32_t wanted_level;
+    uint64_t last_requested;  // Update that last wanted finer than the tail
+    std::optional<std::chrono::steady_clock::time_point> requested_at; // Still waiting for finer levels since
+    bool live;
+    bool unloading;
+  };
+
+  Residency begin_residency(Texture& texture, uint32_t first_level, bool stream_in);
+  void retire(std::optional<Residency>& residency, std::vector<Retired>& retired);
+  VkDeviceSize residency_bytes(const Texture& texture, uint32_t first_level) const;
+  // Level the texture is resident at once pending uploads finish
+  uint32_t target_level(const Texture& texture) const;
+  // Evicts levels nobody wants, least recently requested first, until 'bytes'
+  // are freed or nothing else can go. Returns the bytes freed.
+  VkDeviceSize evict(VkDeviceSize bytes, const Texture* keep);
+
+private:
+  VkDevice m_device;
+  GpuAllocator& m_allocator;
+  Uploader& m_uploader;
+  BindlessHeap& m_bindless;
+  VkDeviceSize m_budget;
+  bool m_bc_formats;
+  bool m_astc_formats;
+  VkSampler m_sampler;
+  BindlessHandle m_sampler_handle;
+
+  std::vector<Texture> m_textures;
+  std::vector<TextureId> m_free_ids;
+  VkDeviceSize m_committed_bytes = 0; // Sum of residency_bytes() at target_level()
+  uint64_t m_update = 0;
+
+  uint64_t m_stream_ins = 0;
+  uint64_t m_evictions = 0;
+  uint64_t m_denied = 0;
+  uint64_t m_latency_count = 0;
+  double m_latency_total_ms = 0.0;
+  double m_latency_max_ms = 0.0;
+};
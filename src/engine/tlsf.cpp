@@ -0,0 +1,254 @@
+#include <bit>
+#include <cassert>
+
+#include "tlsf.h"
+#include "base.h"
+
+TlsfAllocator::TlsfAllocator(uint64_t size)
+  : m_capacity(size)
+{
+  for (auto fl : Range<uint32_t>(FL_COUNT)) {
+    for (auto sl : Range<uint32_t>(SL_COUNT)) {
+      m_heads[fl][sl] = INVALID_NODE;
+    }
+  }
+
+  m_first_node = new_node();
+  m_nodes[m_first_node] = {
+    .offset = 0,
+    .size = size,
+    .alignment = 1,
+    .prev_phys = INVALID_NODE,
+    .next_phys = INVALID_NODE,
+    .prev_free = INVALID_NODE,
+    .next_free = INVALID_NODE,
+    .used = false
+  };
+
+  insert_free(m_first_node);
+}
+
+void TlsfAllocator::mapping(uint64_t size, uint32_t* fl, uint32_t* sl) {
+  if (size < SL_COUNT) {
+    *fl = 0;
+    *sl = (uint32_t)size;
+  }
+  else {
+    uint32_t msb = 63 - std::countl_zero(size);
+    *fl = msb - SL_BITS + 1;
+    *sl = (uint32_t)(size >> (msb - SL_BITS)) & (SL_COUNT - 1);
+  }
+}
+
+uint32_t TlsfAllocator::find_free(uint64_t size) {
+  // Round up to the next list boundary so every block in the chosen list fits
+  if (size >= SL_COUNT) {
+    uint32_t msb = 63 - std::countl_zero(size);
+    uint64_t round = (1ull << (msb - SL_BITS)) - 1;
+    if (size + round < size) {
+      return INVALID_NODE;
+    }
+    size += round;
+  }
+
+  uint32_t fl, sl;
+  mapping(size, &fl, &sl);
+
+  if (fl >= FL_COUNT) {
+    return INVALID_NODE;
+  }
+
+  uint32_t sl_map = m_sl_bitmap[fl] & (~0u << sl);
+
+  if (!sl_map) {
+    uint64_t fl_map = fl + 1 < 64 ? m_fl_bitmap & (~0ull << (fl + 1)) : 0;
+    if (!fl_map) {
+      return INVALID_NODE;
+    }
+
+    fl = std::countr_zero(fl_map);
+    sl_map = m_sl_bitmap[fl];
+  }
+
+  sl = std::countr_zero(sl_map);
+  return m_heads[fl][sl];
+}
+
+uint32_t TlsfAllocator::new_node() {
+  if (m_unused_nodes.size()) {
+    uint32_t node = m_unused_nodes.back();
+    m_unused_nodes.pop_back();
+    return node;
+  }
+
+  m_nodes.emplace_back();
+  return (uint32_t)m_nodes.size() - 1;
+}
+
+void TlsfAllocator::insert_free(uint32_t node) {
+  Node& n = m_nodes[node];
+
+  uint32_t fl, sl;
+  mapping(n.size, &fl, &sl);
+
+  n.used = false;
+  n.prev_free = INVALID_NODE;
+  n.next_free = m_heads[fl][sl];
+
+  if (n.next_free != INVALID_NODE) {
+    m_nodes[n.next_free].prev_free = node;
+  }
+
+  m_heads[fl][sl] = node;
+  m_fl_bitmap |= 1ull << fl;
+  m_sl_bitmap[fl] |= 1u << sl;
+}
+
+void TlsfAllocator::remove_free(uint32_t node) {
+  Node& n = m_nodes[node];
+
+  uint32_t fl, sl;
+  mapping(n.size, &fl, &sl);
+
+  if (n.prev_free != INVALID_NODE) {
+    m_nodes[n.prev_free].next_free = n.next_free;
+  }
+  else {
+    m_heads[fl][sl] = n.next_free;
+  }
+
+  if (n.next_free != INVALID_NODE) {
+    m_nodes[n.next_free].prev_free = n.prev_free;
+  }
+
+  if (m_heads[fl][sl] == INVALID_NODE) {
+    m_sl_bitmap[fl] &= ~(1u << sl);
+    if (!m_sl_bitmap[fl]) {
+      m_fl_bitmap &= ~(1ull << fl);
+    }
+  }
+}
+
+// Shrinks 'node' to 'size' and returns a new free-standing node for the remainder
+uint32_t TlsfAllocator::split(uint32_t node, uint64_t size) {
+  uint32_t rest = new_node();
+
+  Node& n = m_nodes[node];
+  Node& r = m_nodes[rest];
+
+  r = {
+    .offset = n.offset + size,
+    .size = n.size - size,
+    .alignment = 1,
+    .prev_phys = node,
+    .next_phys = n.next_phys,
+    .prev_free = INVALID_NODE,
+    .next_free = INVALID_NODE,
+    .used = false
+  };
+
+  if (n.next_phys != INVALID_NODE) {
+    m_nodes[n.next_phys].prev_phys = rest;
+  }
+
+  n.next_phys = rest;
+  n.size = size;
+
+  return rest;
+}
+
+std::optional<TlsfAllocator::Allocation> TlsfAllocator::allocate(uint64_t size, uint64_t alignment) {
+  assert(size && std::has_single_bit(alignment));
+
+  uint32_t node = find_free(size + alignment - 1);
+  if (node == INVALID_NODE) {
+    return std::nullopt;
+  }
+
+  remove_free(node);
+
+  // Front padding becomes its own free block
+  uint64_t padding = ((m_nodes[node].offset + alignment - 1) & ~(alignment - 1)) - m_nodes[node].offset;
+  if (padding) {
+    uint32_t front = node;
+    node = split(front, padding);
+    insert_free(front);
+  }
+
+  if (m_nodes[node].size > size) {
+    insert_free(split(node, size));
+  }
+
+  Node& n = m_nodes[node];
+  n.used = true;
+  n.alignment = alignment;
+
+  m_used += n.size;
+  m_allocation_count++;
+
+  return Allocation { n.offset, n.size, node };
+}
+
+void TlsfAllocator::free(uint32_t node) {
+  assert(m_nodes[node].used);
+
+  m_used -= m_nodes[node].size;
+  m_allocation_count--;
+
+  uint32_t prev = m_nodes[node].prev_phys;
+  if (prev != INVALID_NODE && !m_nodes[prev].used) {
+    remove_free(prev);
+
+    m_nodes[prev].size += m_nodes[node].size;
+    m_nodes[prev].next_phys = m_nodes[node].next_phys;
+    if (m_nodes[node].next_phys != INVALID_NODE) {
+      m_nodes[m_nodes[node].next_phys].prev_phys = prev;
+    }
+
+    m_unused_nodes.push_back(node);
+    node = prev;
+  }
+
+  uint32_t next = m_nodes[node].next_phys;
+  if (next != INVALID_NODE && !m_nodes[next].used) {
+    remove_free(next);
+
+    m_nodes[node].size += m_nodes[next].size;
+    m_nodes[node].next_phys = m_nodes[next].next_phys;
+    if (m_nodes[next].next_phys != INVALID_NODE) {
+      m_nodes[m_nodes[next].next_phys].prev_phys = node;
+    }
+
+    m_unused_nodes.push_back(next);
+  }
+
+  insert_free(node);
+}
+
+std::vector<TlsfAllocator::Allocation> TlsfAllocator::allocations() const {
+  std::vector<Allocation> result;
+
+  for (uint32_t node = m_first_node; node != INVALID_NODE; node = m_nodes[node].next_phys) {
+    if (m_nodes[node].used) {
+      result.push_back({ m_nodes[node].offset, m_nodes[node].size, node });
+    }
+  }
+
+  return result;
+}
+
+uint64_t TlsfAllocator::largest_free() const {
+  if (!m_fl_bitmap) {
+    return 0;
+  }
+
+  uint32_t fl = 63 - std::countl_zero(m_fl_bitmap);
+  uint32_t sl = 31 - std::countl_zero(m_sl_bitmap[fl]);
+
+  uint64_t largest = 0;
+  for (uint32_t node = m_heads[fl][sl]; node != INVALID_NODE; node = m_nodes[node].next_free) {
+    largest = m_nodes[node].size > largest ? m_nodes[node].size : largest;
+  }
+
+  return largest;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Two-level segregated fit allocator over an abstract range of offsets. It never
+// touches the memory it manages, so it can carve up VkDeviceMemory blocks.
+// Allocation and free are O(1): a two-level bitmap finds a free list whose
+// blocks are all large enough, and neighbouring free blocks merge on free.
+class TlsfAllocator {
+public:
+  static constexpr uint32_t INVALID_NODE = 0xffffffff;
+
+  struct Allocation {
+    uint64_t offset;
+    uint64_t size;
+    uint32_t node;
+  };
+
+  TlsfAllocator(uint64_t size);
+
+  std::optional<Allocation> allocate(uint64_t size, uint64_t alignment);
+  void free(uint32_t node);
+
+  // Live allocations in address order (used by defragmentation)
+  std::vector<Allocation> allocations() const;
+  uint64_t alignment_of(uint32_t node) const { return m_nodes[node].alignment; }
+
+  uint64_t capacity() const { return m_capacity; }
+  uint64_t used() const { return m_used; }
+  uint32_t allocation_count() const { return m_allocation_count; }
+  uint64_t largest_free() const;
+
+private:
+  static constexpr uint32_t SL_BITS = 5;
+  static constexpr uint32_t SL_COUNT = 1 << SL_BITS;
+  static constexpr uint32_t FL_COUNT = 64 - SL_BITS + 1;
+
+  struct Node {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t alignment;
+    uint32_t prev_phys;
+    uint32_t next_phys;
+    uint32_t prev_free;
+    uint32_t next_free;
+    bool used;
+  };
+
+  static void mapping(uint64_t size, uint32_t* fl, uint32_t* sl);
+  uint32_t find_free(uint64_t size);
+  uint32_t new_node();
+  void insert_free(uint32_t node);
+  void remove_free(uint32_t node);
+  uint32_t split(uint32_t node, uint64_t size);
+
+private:
+  uint64_t m_capacity;
+  uint64_t m_used = 0;
+  uint32_t m_allocation_count = 0;
+  uint64_t m_fl_bitmap = 0;
+  uint32_t m_sl_bitmap[FL_COUNT] = {};
+  uint32_t m_heads[FL_COUNT][SL_COUNT];
+  uint32_t m_first_node;
+  std::vector<Node> m_nodes;
+  std::vector<uint32_t> m_unused_nodes;
+};
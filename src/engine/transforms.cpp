@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#include "transforms.h"
+#include "jobs.h"
+#include "base.h"
+
+// Slots per piece of a level handed to a job; a multiple of every lane width
+static constexpr uint32_t block_size = 64;
+// Blocks per job, so small levels aren't split into jobs that cost more than they do
+static constexpr uint32_t blocks_per_job = 32;
+
+namespace {
+  struct ScalarLanes {
+    static constexpr uint32_t width = 1;
+    float v;
+
+    static ScalarLanes load(const float* p) { return { *p }; }
+    static ScalarLanes gather(const float* base, const uint32_t* index) { return { base[*index] }; }
+    static ScalarLanes set1(float x) { return { x }; }
+    void store(float* p) const { *p = v; }
+    static void fence() {}
+
+    friend ScalarLanes operator+(ScalarLanes a, ScalarLanes b) { return { a.v + b.v }; }
+    friend ScalarLanes operator-(ScalarLanes a, ScalarLanes b) { return { a.v - b.v }; }
+    friend ScalarLanes operator*(ScalarLanes a, ScalarLanes b) { return { a.v * b.v }; }
+    friend ScalarLanes sqrt(ScalarLanes a) { return { std::sqrt(a.v) }; }
+
+    static void store_instances(GpuInstance* out, ScalarLanes x, ScalarLanes y, ScalarLanes scale, ScalarLanes radius, ScalarLanes depth) {
+      *out = GpuInstance {
+        .offset = { x.v, y.v },
+        .scale = scale.v,
+        .radius = radius.v,
+        .depth = depth.v,
+      };
+    }
+  };
+
+#if defined(__AVX2__)
+  struct SimdLanes {
+    static constexpr uint32_t width = 8;
+    __m256 v;
+
+    static SimdLanes load(const float* p) { return { _mm256_loadu_ps(p) }; }
+    static SimdLanes gather(const float* base, const uint32_t* index) { return { _mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i*)index), 4) }; }
+    static SimdLanes set1(float x) { return { _mm256_set1_ps(x) }; }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+    static void fence() { _mm_sfence(); }
+
+    friend SimdLanes operator+(SimdLanes a, SimdLanes b) { return { _mm256_add_ps(a.v, b.v) }; }
+    friend SimdLanes operator-(SimdLanes a, SimdLanes b) { return { _mm256_sub_ps(a.v, b.v) }; }
+    friend SimdLanes operator*(SimdLanes a, SimdLanes b) { return { _mm256_mul_ps(a.v, b.v) }; }
+    friend SimdLanes sqrt(SimdLanes a) { return { _mm256_sqrt_ps(a.v) }; }
+
+    // An 8x8 transpose of the instance fields (the last three are padding),
+    // leaving each row a whole GpuInstance. Aligned rows are streamed past
+    // the cache: instances are only written, often to write-combined memory.
+    static void store_instances(GpuInstance* out, SimdLanes x, SimdLanes y, SimdLanes scale, SimdLanes radius, SimdLanes depth) {
+      __m256 zero = _mm256_setzero_ps();
+
+      __m256 t0 = _mm256_unpacklo_ps(x.v, y.v);
+      __m256 t1 = _mm256_unpackhi_ps(x.v, y.v);
+      __m256 t2 = _mm256_unpacklo_ps(scale.v, radius.v);
+      __m256 t3 = _mm256_unpackhi_ps(scale.v, radius.v);
+      __m256 t4 = _mm256_unpacklo_ps(depth.v, zero);
+      __m256 t5 = _mm256_unpackhi_ps(depth.v, zero);
+
+      __m256 u0 = _mm256_shuffle_ps(t0, t2, 0x44);
+      __m256 u1 = _mm256_shuffle_ps(t0, t2, 0xee);
+      __m256 u2 = _mm256_shuffle_ps(t1, t3, 0x44);
+      __m256 u3 = _mm256_shuffle_ps(t1, t3, 0xee);
+      __m256 u4 = _mm256_shuffle_ps(t4, zero, 0x44);
+      __m256 u5 = _mm256_shuffle_ps(t4, zero, 0xee);
+      __m256 u6 = _mm256_shuffle_ps(t5, zero, 0x44);
+      __m256 u7 = _mm256_shuffle_ps(t5, zero, 0xee);
+
+      __m256 rows[] = {
+        _mm256_permute2f128_ps(u0, u4, 0x20), _mm256_permute2f128_ps(u1, u5, 0x20),
+        _mm256_permute2f128_ps(u2, u6, 0x20), _mm256_permute2f128_ps(u3, u7, 0x20),
+        _mm256_permute2f128_ps(u0, u4, 0x31), _mm256_permute2f128_ps(u1, u5, 0x31),
+        _mm256_permute2f128_ps(u2, u6, 0x31), _mm256_permute2f128_ps(u3, u7, 0x31),
+      };
+
+      float* p = (float*)out;
+
+      if ((uintptr_t)p % 32 == 0) {
+        for (auto i : Range<uint32_t>(8)) {
+          _mm256_stream_ps(p + i * 8, rows[i]);
+        }
+      }
+      else {
+        for (auto i : Range<uint32_t>(8)) {
+          _mm256_storeu_ps(p + i * 8, rows[i]);
+        }
+      }
+    }
+  };
+#elif defined(__SSE2__) || defined(_M_X64)
+  struct SimdLanes {
+    static constexpr uint32_t width = 4;
+    __m128 v;
+
+    static SimdLanes load(const float* p) { return { _mm_loadu_ps(p) }; }
+    // No gather before AVX2, though siblings mostly load the same parent
+    static SimdLanes gather(const float* base, const uint32_t* index) { return { _mm_set_ps(base[index[3]], base[index[2]], base[index[1]], base[index[0]]) }; }
+    static SimdLanes set1(float x) { return { _mm_set1_ps(x) }; }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+    static void fence() { _mm_sfence(); }
+
+    friend SimdLanes operator+(SimdLanes a, SimdLanes b) { return { _mm_add_ps(a.v, b.v) }; }
+    friend SimdLanes operator-(SimdLanes a, SimdLanes b) { return { _mm_sub_ps(a.v, b.v) }; }
+    friend SimdLanes operator*(SimdLanes a, SimdLanes b) { return { _mm_mul_ps(a.v, b.v) }; }
+    friend SimdLanes sqrt(SimdLanes a) { return { _mm_sqrt_ps(a.v) }; }
+
+    // Two 4x4 transposes: the first half of each GpuInstance, then depth and
+    // padding. Streamed past the cache when aligned, as with AVX2.
+    static void store_instances(GpuInstance* out, SimdLanes x, SimdLanes y, SimdLanes scale, SimdLanes radius, SimdLanes depth) {
+      __m128 a0 = x.v, a1 = y.v, a2 = scale.v, a3 = radius.v;
+      __m128 b0 = depth.v, b1 = _mm_setzero_ps(), b2 = _mm_setzero_ps(), b3 = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+      __m128 rows[] = { a0, b0, a1, b1, a2, b2, a3, b3 };
+      float* p = (float*)out;
+
+      if ((uintptr_t)p % 16 == 0) {
+        for (auto i : Range<uint32_t>(8)) {
+          _mm_stream_ps(p + i * 4, rows[i]);
+        }
+      }
+      else {
+        for (auto i : Range<uint32_t>(8)) {
+          _mm_storeu_ps(p + i * 4, rows[i]);
+        }
+      }
+    }
+  };
+#else
+  using SimdLanes = ScalarLanes;
+#endif
+}
+
+// World transforms of slots [begin, end) in steps of L::width, and their
+// instances when Write, returning where the last whole step ended. Roots take
+// their local transform.
+template<typename L, bool Root, bool Write>
+static uint32_t update_lanes(TransformStore::Arrays& a, uint32_t begin, uint32_t end, GpuInstance* instances, uint32_t first_instance) {
+  uint32_t i = begin;
+
+  for (; i + L::width <= end; i += L::width) {
+    L lx = L::load(&a.local_x[i]);
+    L ly = L::load(&a.local_y[i]);
+    L lc = L::load(&a.local_c[i]);
+    L ls = L::load(&a.local_s[i]);
+
+    L wx = lx, wy = ly, wc = lc, ws = ls;
+
+    if constexpr (!Root) {
+      const uint32_t* parents = &a.parent[i];
+      L px = L::gather(a.world_x.data(), parents);
+      L py = L::gather(a.world_y.data(), parents);
+      L pc = L::gather(a.world_c.data(), parents);
+      L ps = L::gather(a.world_s.data(), parents);
+
+      wx = px + pc * lx - ps * ly;
+      wy = py + ps * lx + pc * ly;
+      wc = pc * lc - ps * ls;
+      ws = pc * ls + ps * lc;
+    }
+
+    wx.store(&a.world_x[i]);
+    wy.store(&a.world_y[i]);
+    wc.store(&a.world_c[i]);
+    ws.store(&a.world_s[i]);
+
+    if constexpr (Write) {
+      L scale = sqrt(wc * wc + ws * ws);
+      L::store_instances(&instances[i - first_instance], wx, wy, scale, L::load(&a.radius[i]) * scale, L::load(&a.depth[i]));
+    }
+  }
+
+  // Streamed stores are ordered before the job reports itself done
+  if constexpr (Write) {
+    L::fence();
+  }
+
+  return i;
+}
+
+// SIMD steps while whole ones fit, then scalar
+template<bool Root, bool Write>
+static void update_steps(TransformStore::Arrays& a, uint32_t begin, uint32_t end, GpuInstance* instances, uint32_t first_instance, bool simd) {
+  if (simd) {
+    begin = update_lanes<SimdLanes, Root, Write>(a, begin, end, instances, first_instance);
+  }
+
+  update_lanes<ScalarLanes, Root, Write>(a, begin, end, instances, first_instance);
+}
+
+template<bool Root>
+static void update_range(TransformStore::Arrays& a, uint32_t begin, uint32_t end, GpuInstance* instances, uint32_t first_instance, bool simd) {
+  uint32_t split = std::clamp(first_instance, begin, end);
+
+  if (begin < split) {
+    update_steps<Root, false>(a, begin, split, instances, first_instance, simd);
+  }
+
+  if (split < end) {
+    update_steps<Root, true>(a, split, end, instances, first_instance, simd);
+  }
+}
+
+EntityId TransformStore::create(EntityId parent, const Transform2D& local, float radius, float depth) {
+  EntityId entity = (EntityId)m_slots.size();
+  uint32_t slot = entity;
+  uint32_t level = parent == no_parent ? 0 : m_depths[parent] + 1;
+  uint32_t parent_slot = parent == no_parent ? 0 : m_slots[parent];
+
+  // Stays sorted when appended after its level's last entity and that
+  // entity's parent, which building the tree breadth first always is
+  if (m_sorted && slot) {
+    uint32_t last_level = level_count() - 1;
+    m_sorted = level == last_level + 1 || (level == last_level && (!level || parent_slot >= m_arrays.parent[slot - 1]));
+  }
+
+  if (m_sorted) {
+    if (level == level_count()) {
+      m_levels.push_back(slot + 1);
+    }
+    else {
+      m_levels.back() = slot + 1;
+    }
+  }
+
+  m_slots.push_back(slot);
+  m_entities.push_back(entity);
+  m_depths.push_back(level);
+
+  m_arrays.parent.push_back(parent_slot);
+  m_arrays.local_x.push_back(0.0f);
+  m_arrays.local_y.push_back(0.0f);
+  m_arrays.local_c.push_back(1.0f);
+  m_arrays.local_s.push_back(0.0f);
+  m_arrays.radius.push_back(radius);
+  m_arrays.depth.push_back(depth);
+  m_arrays.world_x.push_back(0.0f);
+  m_arrays.world_y.push_back(0.0f);
+  m_arrays.world_c.push_back(1.0f);
+  m_arrays.world_s.push_back(0.0f);
+
+  set_local(entity, local);
+
+  return entity;
+}
+
+void TransformStore::set_local(EntityId entity, const Transform2D& local) {
+  uint32_t slot = m_slots[entity];
+
+  m_arrays.local_x[slot] = local.x;
+  m_arrays.local_y[slot] = local.y;
+  m_arrays.local_c[slot] = local.scale * std::cos(local.rotation);
+  m_arrays.local_s[slot] = local.scale * std::sin(local.rotation);
+}
+
+void TransformStore::clear() {
+  m_arrays = {};
+  m_slots.clear();
+  m_entities.clear();
+  m_depths.clear();
+  m_levels = { 0 };
+  m_sorted = true;
+}
+
+void TransformStore::reserve(uint32_t count) {
+  for (auto* array : { &m_arrays.local_x, &m_arrays.local_y, &m_arrays.local_c, &m_arrays.local_s, &m_arrays.radius, &m_arrays.depth,
+    &m_arrays.world_x, &m_arrays.world_y, &m_arrays.world_c, &m_arrays.world_s }) {
+    array->reserve(count);
+  }
+
+  m_arrays.parent.reserve(count);
+  m_slots.reserve(count);
+  m_entities.reserve(count);
+  m_depths.reserve(count);
+}
+
+void TransformStore::update(JobSystem& jobs, GpuInstance* instances, uint32_t first_instance, bool simd) {
+  if (!m_sorted) {
+    sort();
+  }
+
+  for (auto level : Range<uint32_t>(level_count())) {
+    uint32_t begin = m_levels[level];
+    uint32_t end = m_levels[level + 1];
+    uint32_t blocks = (end - begin + block_size - 1) / block_size;
+
+    // Siblings are contiguous, so a block mostly gathers the same few parents
+    jobs.parallel_for(Range<uint32_t>(blocks), blocks_per_job, [&](Range<uint32_t> range) {
+      uint32_t first = begin + range.lower * block_size;
+      uint32_t last = std::min(begin + range.upper * block_size, end);
+
+      if (level) {
+        update_range<false>(m_arrays, first, last, instances, first_instance, simd);
+      }
+      else {
+        update_range<true>(m_arrays, first, last, instances, first_instance, simd);
+      }
+    });
+  }
+}
+
+Transform2D TransformStore::world(uint32_t slot) const {
+  return Transform2D {
+    .x = m_arrays.world_x[slot],
+    .y = m_arrays.world_y[slot],
+    .rotation = std::atan2(m_arrays.world_s[slot], m_arrays.world_c[slot]),
+    .scale = std::hypot(m_arrays.world_c[slot], m_arrays.world_s[slot]),
+  };
+}
+
+uint32_t TransformStore::simd_width() {
+  return SimdLanes::width;
+}
+
+void TransformStore::sort() {
+  uint32_t count = size();
+  uint32_t levels = *std::max_element(m_depths.begin(), m_depths.end()) + 1;
+
+  // Entities by depth, each level ordered by its parents' new slots, which
+  // the level above has already been given
+  std::vector<std::vector<EntityId>> by_level(levels);
+  for (auto entity : Range<EntityId>(count)) {
+    by_level[m_depths[entity]].push_back(entity);
+  }
+
+  std::vector<uint32_t> new_slots(count);
+  std::vector<EntityId> order;
+  order.reserve(count);
+
+  m_levels.clear();
+
+  for (auto level : Range<uint32_t>(levels)) {
+    std::vector<EntityId>& entities = by_level[level];
+
+    if (level) {
+      std::stable_sort(entities.begin(), entities.end(), [&](EntityId a, EntityId b) {
+        return new_slots[m_entities[m_arrays.parent[m_slots[a]]]] < new_slots[m_entities[m_arrays.parent[m_slots[b]]]];
+      });
+    }
+
+    m_levels.push_back((uint32_t)order.size());
+
+    for (EntityId entity : entities) {
+      new_slots[entity] = (uint32_t)order.size();
+      order.push_back(entity);
+    }
+  }
+
+  m_levels.push_back(count);
+
+  auto permute = [&](auto& array) {
+    std::remove_reference_t<decltype(array)> sorted(count);
+    for (auto i : Range<uint32_t>(count)) {
+      sorted[i] = array[m_slots[order[i]]];
+    }
+
+    array = std::move(sorted);
+  };
+
+  permute(m_arrays.parent);
+  permute(m_arrays.local_x);
+  permute(m_arrays.local_y);
+  permute(m_arrays.local_c);
+  permute(m_arrays.local_s);
+  permute(m_arrays.radius);
+  permute(m_arrays.depth);
+  permute(m_arrays.world_x);
+  permute(m_arrays.world_y);
+  permute(m_arrays.world_c);
+  permute(m_arrays.world_s);
+
+  // Parents still hold old slots; map them through their entities
+  for (auto i : Range<uint32_t>(count)) {
+    if (m_depths[order[i]]) {
+      m_arrays.parent[i] = new_slots[m_entities[m_arrays.parent[i]]];
+    }
+  }
+
+  m_slots = new_slots;
+  m_entities = order;
+  m_sorted = true;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "gpu_scene.h"
+#include "base.h"
+
+class JobSystem;
+
+using EntityId = uint32_t;
+
+static constexpr EntityId no_parent = ~0u;
+
+// A 2D similarity transform: scaled, rotated (radians, counter-clockwise),
+// then translated
+struct Transform2D {
+  float x;
+  float y;
+  float rotation;
+  float scale;
+};
+
+// Entities with a transform relative to their parent, a bounding circle and
+// a depth, stored structure-of-arrays. update() computes world transforms
+// and writes each entity's GpuInstance.
+//
+// Transforms are kept as a translation plus the complex number
+// scale * (cos, sin), so composing two is a complex multiply and a multiply-add,
+// with no trigonometry per update. Entities are sorted by depth, then by
+// parent, so each level only reads the level above it and siblings sit
+// together. A level is split across job threads, and each thread's range is
+// processed in AVX2 (8-wide) or SSE (4-wide) lanes, whichever the build
+// targets, with a scalar tail.
+class TransformStore {
+public:
+  // Parents must already exist; reordering waits for the next update()
+  EntityId create(EntityId parent, const Transform2D& local, float radius, float depth);
+  void set_local(EntityId entity, const Transform2D& local);
+  void clear();
+  void reserve(uint32_t count);
+
+  // Writes a GpuInstance for each slot from 'first_instance' on, in slot
+  // order, the first to instances[0]; earlier slots (groups that aren't drawn
+  // themselves) only get world transforms. The destination may be mapped GPU
+  // memory: it is only written. 'simd' off runs the scalar kernel, for comparison.
+  void update(JobSystem& jobs, GpuInstance* instances, uint32_t first_instance = 0, bool simd = true);
+
+  uint32_t size() const { return (uint32_t)m_slots.size(); }
+  // Where update() writes the entity's instance; changes when entities are created
+  uint32_t slot(EntityId entity) const { return m_slots[entity]; }
+  uint32_t level_count() const { return (uint32_t)m_levels.size() - 1; }
+  // Slots of the entities at a depth, as of the last update() or while sorted
+  Range<uint32_t> level(uint32_t depth) const { return Range<uint32_t>(m_levels[depth], m_levels[depth + 1]); }
+  // World transform as of the last update(), by slot
+  Transform2D world(uint32_t slot) const;
+  // Lanes per SIMD step in this build
+  static uint32_t simd_width();
+
+  // Per slot, in depth then parent order. Parents are slots; roots have none.
+  struct Arrays {
+    std::vector<uint32_t> parent;
+    std::vector<float> local_x;
+    std::vector<float> local_y;
+    std::vector<float> local_c; // scale * cos(rotation)
+    std::vector<float> local_s; // scale * sin(rotation)
+    std::vector<float> radius;
+    std::vector<float> depth;
+    std::vector<float> world_x;
+    std::vector<float> world_y;
+    std::vector<float> world_c;
+    std::vector<float> world_s;
+  };
+
+private:
+  // Sorts the arrays once entities have been created since the last update
+  void sort();
+
+private:
+  Arrays m_arrays;
+  std::vector<uint32_t> m_slots;           // By entity
+  std::vector<uint32_t> m_entities;        // By slot
+  std::vector<uint32_t> m_depths;          // By entity; 0 for roots
+  std::vector<uint32_t> m_levels = { 0 };  // First slot of each depth, then the entity count
+  bool m_sorted = true;
+};
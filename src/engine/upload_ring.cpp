@@ -0,0 +1,58 @@
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+#include "upload_ring.h"
+#include "base.h"
+
+UploadRing::UploadRing(GpuAllocator& allocator, uint32_t frame_count, VkDeviceSize frame_size, VkDeviceSize min_alignment)
+  : m_allocator(allocator), m_frame_size((frame_size + min_alignment - 1) & ~(min_alignment - 1)), m_min_alignment(min_alignment)
+{
+  assert(std::has_single_bit(min_alignment));
+
+  VkBufferUsageFlags usage =
+    VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+    VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  m_buffer = m_allocator.create_buffer(m_frame_size * frame_count, usage, GpuMemoryUsage::Upload);
+
+  if (!m_buffer.allocation.mapped) {
+    fatal_error("Upload ring memory is not host visible.");
+  }
+}
+
+UploadRing::~UploadRing() {
+  m_allocator.destroy_buffer(m_buffer);
+}
+
+void UploadRing::begin_frame(uint32_t frame_index) {
+  m_peak = std::max(m_peak, m_head.load(std::memory_order_relaxed));
+  m_region_begin = frame_index * m_frame_size;
+  m_head.store(0, std::memory_order_relaxed);
+}
+
+UploadSlice UploadRing::allocate(VkDeviceSize size, VkDeviceSize alignment) {
+  alignment = std::max(alignment, m_min_alignment);
+  assert(std::has_single_bit(alignment));
+
+  VkDeviceSize head = m_head.load(std::memory_order_relaxed);
+  VkDeviceSize offset;
+
+  do {
+    offset = (head + alignment - 1) & ~(alignment - 1);
+  } while (!m_head.compare_exchange_weak(head, offset + size, std::memory_order_relaxed));
+
+  if (offset + size > m_frame_size) {
+    fatal_error("Upload ring overflow: {} bytes requested with {} of {} bytes used this frame.", size, offset, m_frame_size);
+  }
+
+  return UploadSlice {
+    .data = m_buffer.allocation.mapped + m_region_begin + offset,
+    .buffer = m_buffer.buffer,
+    .offset = m_region_begin + offset,
+    .size = size,
+  };
+}
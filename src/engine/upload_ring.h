@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstring>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+
+struct UploadSlice {
+  uint8_t* data;
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  VkDeviceSize size;
+};
+
+// Persistently mapped host-visible buffer split into one region per frame in
+// flight. A region is only reused after begin_frame() for that frame index,
+// which the caller invokes once the frame's fence has signalled, so handing out
+// memory is a single atomic bump with no allocation, mapping or locking.
+class UploadRing {
+public:
+  UploadRing(GpuAllocator& allocator, uint32_t frame_count, VkDeviceSize frame_size, VkDeviceSize min_alignment);
+  ~UploadRing();
+
+  void begin_frame(uint32_t frame_index);
+  UploadSlice allocate(VkDeviceSize size, VkDeviceSize alignment = 0);
+
+  template<typename T>
+  UploadSlice push(const T& value) {
+    UploadSlice slice = allocate(sizeof(T));
+    memcpy(slice.data, &value, sizeof(T));
+    return slice;
+  }
+
+  VkBuffer buffer() const { return m_buffer.buffer; }
+  VkDeviceSize frame_size() const { return m_frame_size; }
+  VkDeviceSize peak_usage() const { return m_peak; }
+
+private:
+  GpuAllocator& m_allocator;
+  GpuBuffer m_buffer;
+  VkDeviceSize m_frame_size;
+  VkDeviceSize m_min_alignment;
+  VkDeviceSize m_region_begin = 0;
+  std::atomic<VkDeviceSize> m_head = 0; // Offset within the current region
+  VkDeviceSize m_peak = 0;
+};
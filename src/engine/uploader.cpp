@@ -0,0 +1,441 @@
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include "uploader.h"
+#include "base.h"
+
+// Offsets into the staging buffer satisfy the 4 byte copy rule and every
+// block-compressed texel size
+static constexpr VkDeviceSize staging_alignment = 16;
+
+Uploader::Uploader(VkDevice device, GpuAllocator& allocator, VkQueue queue, uint32_t queue_family, uint32_t graphics_family, VkDeviceSize staging_size, VkDeviceSize frame_budget)
+  : m_device(device), m_allocator(allocator), m_queue(queue), m_queue_family(queue_family), m_graphics_family(graphics_family), m_frame_budget(frame_budget), m_window_start(std::chrono::steady_clock::now())
+{
+  VkCommandPoolCreateInfo command_pool_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+    .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT | VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+    .queueFamilyIndex = queue_family,
+  };
+
+  if (vkCreateCommandPool(m_device, &command_pool_info, nullptr, &m_command_pool) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan upload command pool.");
+  }
+
+  VkSemaphoreTypeCreateInfo timeline_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+    .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+    .initialValue = 0,
+  };
+
+  VkSemaphoreCreateInfo semaphore_info = {
+    .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+    .pNext = &timeline_info,
+  };
+
+  if (vkCreateSemaphore(m_device, &semaphore_info, nullptr, &m_timeline) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan timeline semaphore.");
+  }
+
+  // The staging buffer is bound over a linear pool used as a ring: each batch
+  // records its mark and releases everything before it once the batch retires
+  VkBufferCreateInfo buffer_info = {
+    .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+    .size = staging_size,
+    .usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+    .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+  };
+
+  if (vkCreateBuffer(m_device, &buffer_info, nullptr, &m_staging_buffer) != VK_SUCCESS) {
+    fatal_error("Failed to create Vulkan staging buffer.");
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(m_device, m_staging_buffer, &requirements);
+
+  m_staging = std::make_unique<GpuLinearPool>(m_allocator, requirements.size, requirements.memoryTypeBits, GpuMemoryUsage::Upload, GpuResourceKind::Buffer);
+
+  if (!m_staging->block().mapped) {
+    fatal_error("Staging memory is not host visible.");
+  }
+
+  vkBindBufferMemory(m_device, m_staging_buffer, m_staging->block().memory, m_staging->block().offset);
+}
+
+Uploader::~Uploader() {
+  // The owner waits for the device to go idle before tearing the uploader down
+  vkDestroyBuffer(m_device, m_staging_buffer, nullptr);
+  m_staging.reset();
+  vkDestroySemaphore(m_device, m_timeline, nullptr);
+  vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+}
+
+UploadTicket Uploader::upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, std::vector<uint8_t> data) {
+  return enqueue(Request {
+    .buffer = dst,
+    .dst_offset = dst_offset,
+    .data = std::move(data),
+  });
+}
+
+UploadTicket Uploader::upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  return upload_buffer(dst, dst_offset, std::vector<uint8_t>(bytes, bytes + size));
+}
+
+UploadTicket Uploader::upload_image(VkImage dst, uint32_t mip_level, VkExtent3D extent, std::vector<uint8_t> data) {
+  return enqueue(Request {
+    .image = dst,
+    .mip_level = mip_level,
+    .extent = extent,
+    .data = std::move(data),
+  });
+}
+
+UploadTicket Uploader::upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, std::shared_ptr<const MappedFile> file, size_t offset, size_t size) {
+  assert(offset + size <= file->size() && "Upload runs past the end of the file");
+
+  const uint8_t* bytes = file->data() + offset;
+  return enqueue(Request {
+    .buffer = dst,
+    .dst_offset = dst_offset,
+    .file = std::move(file),
+    .bytes = bytes,
+    .size = size,
+  });
+}
+
+UploadTicket Uploader::upload_image(VkImage dst, uint32_t mip_level, VkExtent3D extent, std::shared_ptr<const MappedFile> file, size_t offset, size_t size) {
+  assert(offset + size <= file->size() && "Upload runs past the end of the file");
+
+  const uint8_t* bytes = file->data() + offset;
+  return enqueue(Request {
+    .image = dst,
+    .mip_level = mip_level,
+    .extent = extent,
+    .file = std::move(file),
+    .bytes = bytes,
+    .size = size,
+  });
+}
+
+UploadTicket Uploader::enqueue(Request request) {
+  if (!request.file) {
+    request.size = request.data.size();
+  }
+
+  // Image levels are copied in one piece, so they must fit the staging ring
+  if (request.image && request.size > m_staging->capacity() / 2) {
+    fatal_error("Image upload of {} bytes does not fit the {} byte staging buffer.", request.size, m_staging->capacity());
+  }
+
+  std::lock_guard lock(m_mutex);
+
+  request.ticket = m_next_ticket++;
+  request.copied = 0;
+
+  m_requests.push_back(std::move(request));
+
+  // Deque elements never move, so this stays valid while the request is queued
+  Request& queued = m_requests.back();
+  if (!queued.file) {
+    queued.bytes = queued.data.data();
+  }
+
+  return queued.ticket;
+}
+
+void Uploader::finish_request(const Request& request, Batch& batch) {
+  batch.last_ticket = request.ticket;
+
+  // With a dedicated family these are the release half of the ownership
+  // transfer; record_acquires() replays them on the graphics queue
+  uint32_t src_family = dedicated_queue() ? m_queue_family : VK_QUEUE_FAMILY_IGNORED;
+  uint32_t dst_family = dedicated_queue() ? m_graphics_family : VK_QUEUE_FAMILY_IGNORED;
+
+  if (request.image) {
+    batch.image_barriers.push_back(VkImageMemoryBarrier {
+      .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_SHADER_READ_BIT,
+      .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+      .newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+      .srcQueueFamilyIndex = src_family,
+      .dstQueueFamilyIndex = dst_family,
+      .image = request.image,
+      .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .baseMipLevel = request.mip_level,
+        .levelCount = 1,
+        .layerCount = 1,
+      },
+    });
+  }
+  else if (request.buffer && request.size) {
+    batch.buffer_barriers.push_back(VkBufferMemoryBarrier {
+      .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+      .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+      .dstAccessMask = VK_ACCESS_MEMORY_READ_BIT,
+      .srcQueueFamilyIndex = src_family,
+      .dstQueueFamilyIndex = dst_family,
+      .buffer = request.buffer,
+      .offset = request.dst_offset,
+      .size = request.size,
+    });
+  }
+}
+
+void Uploader::submit() {
+  std::lock_guard lock(m_mutex);
+
+  if (m_requests.empty()) {
+    return;
+  }
+
+  VkCommandBuffer cmd;
+
+  if (m_free_command_buffers.size()) {
+    cmd = m_free_command_buffers.back();
+    m_free_command_buffers.pop_back();
+  }
+  else {
+    VkCommandBufferAllocateInfo cmd_buf_info = {
+      .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+      .commandPool = m_command_pool,
+      .commandBufferCount = 1
+    };
+
+    if (vkAllocateCommandBuffers(m_device, &cmd_buf_info, &cmd) != VK_SUCCESS) {
+      fatal_error("Failed to create Vulkan upload command buffer.");
+    }
+  }
+
+  VkCommandBufferBeginInfo cmd_begin_info = {
+    .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+    .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+  };
+
+  vkResetCommandBuffer(cmd, 0);
+  if (vkBeginCommandBuffer(cmd, &cmd_begin_info) != VK_SUCCESS) {
+    fatal_error("Failed to begin Vulkan upload command buffer.");
+  }
+
+  Batch batch = {
+    .cmd = cmd,
+    .last_ticket = m_submitted_ticket,
+    .bytes = 0,
+  };
+
+  VkDeviceSize budget = m_frame_budget;
+  VkDeviceSize max_chunk = m_staging->capacity() / 4;
+  bool recorded = false;
+
+  while (m_requests.size() && budget) {
+    Request& request = m_requests.front();
+    VkDeviceSize remaining = request.size - request.copied;
+
+    // Buffers are split into chunks, image levels go in whole. A level larger
+    // than the budget still goes out, but in a batch of its own.
+    VkDeviceSize chunk = request.image ? remaining : std::min({ remaining, budget, max_chunk });
+    if (request.image && chunk > budget && batch.bytes) {
+      break;
+    }
+
+    if (chunk) {
+      std::optional<GpuAllocation> staging = m_staging->allocate(chunk, staging_alignment);
+      if (!staging) {
+        break; // Staging ring is full until earlier batches retire
+      }
+
+      memcpy(staging->mapped, request.bytes + request.copied, chunk);
+      VkDeviceSize staging_offset = staging->offset - m_staging->block().offset;
+
+      if (request.image) {
+        VkImageMemoryBarrier to_transfer = {
+          .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+          .srcAccessMask = 0,
+          .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+          .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+          .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+          .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+          .image = request.image,
+          .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = request.mip_level,
+            .levelCount = 1,
+            .layerCount = 1,
+          },
+        };
+
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &to_transfer);
+
+        VkBufferImageCopy region = {
+          .bufferOffset = staging_offset,
+          .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = request.mip_level,
+            .layerCount = 1,
+          },
+          .imageExtent = request.extent,
+        };
+
+        vkCmdCopyBufferToImage(cmd, m_staging_buffer, request.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+      }
+      else {
+        VkBufferCopy region = {
+          .srcOffset = staging_offset,
+          .dstOffset = request.dst_offset + request.copied,
+          .size = chunk,
+        };
+
+        vkCmdCopyBuffer(cmd, m_staging_buffer, request.buffer, 1, &region);
+      }
+
+      request.copied += chunk;
+      batch.bytes += chunk;
+      budget -= std::min(chunk, budget);
+      recorded = true;
+    }
+
+    if (request.copied == request.size) {
+      finish_request(request, batch);
+      m_requests.pop_front();
+      recorded = true;
+    }
+  }
+
+  if (batch.buffer_barriers.size() || batch.image_barriers.size()) {
+    // Release to the graphics family, or make the writes visible when the
+    // uploads share the graphics queue
+    VkPipelineStageFlags dst_stage = dedicated_queue() ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+
+    // The release half carries no destination access; the acquire half carries
+    // no source access. Both are recorded from the batch's own barriers.
+    if (dedicated_queue()) {
+      for (auto& barrier : batch.buffer_barriers) {
+        barrier.dstAccessMask = 0;
+      }
+      for (auto& barrier : batch.image_barriers) {
+        barrier.dstAccessMask = 0;
+      }
+    }
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0,
+      0, nullptr,
+      (uint32_t)batch.buffer_barriers.size(), batch.buffer_barriers.data(),
+      (uint32_t)batch.image_barriers.size(), batch.image_barriers.data());
+
+    if (dedicated_queue()) {
+      for (auto& barrier : batch.buffer_barriers) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+      }
+      for (auto& barrier : batch.image_barriers) {
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+      }
+    }
+  }
+
+  if (vkEndCommandBuffer(cmd) != VK_SUCCESS) {
+    fatal_error("Failed to end Vulkan upload command buffer.");
+  }
+
+  if (!recorded) {
+    m_free_command_buffers.push_back(cmd);
+    return;
+  }
+
+  batch.value = ++m_timeline_value;
+  batch.staging_mark = m_staging->mark();
+  m_submitted_ticket = batch.last_ticket;
+
+  VkTimelineSemaphoreSubmitInfo timeline_info = {
+    .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+    .signalSemaphoreValueCount = 1,
+    .pSignalSemaphoreValues = &batch.value,
+  };
+
+  VkSubmitInfo submit_info = {
+    .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+    .pNext = &timeline_info,
+    .commandBufferCount = 1,
+    .pCommandBuffers = &cmd,
+    .signalSemaphoreCount = 1,
+    .pSignalSemaphores = &m_timeline,
+  };
+
+  if (vkQueueSubmit(m_queue, 1, &submit_info, nullptr) != VK_SUCCESS) {
+    fatal_error("Failed to submit Vulkan upload batch.");
+  }
+
+  m_in_flight.push_back(std::move(batch));
+}
+
+uint64_t Uploader::record_acquires(VkCommandBuffer cmd) {
+  std::lock_guard lock(m_mutex);
+
+  if (m_in_flight.empty()) {
+    return 0;
+  }
+
+  uint64_t completed = 0;
+  vkGetSemaphoreCounterValue(m_device, m_timeline, &completed);
+
+  uint64_t wait_value = 0;
+  std::vector<VkBufferMemoryBarrier>& buffer_barriers = m_acquire_buffer_barriers;
+  std::vector<VkImageMemoryBarrier>& image_barriers = m_acquire_image_barriers;
+  buffer_barriers.clear();
+  image_barriers.clear();
+
+  // Only batches that have already finished are picked up, so the wait added to
+  // the graphics submit is satisfied immediately and never stalls the frame
+  while (m_in_flight.size() && m_in_flight.front().value <= completed) {
+    Batch& batch = m_in_flight.front();
+
+    buffer_barriers.insert(buffer_barriers.end(), batch.buffer_barriers.begin(), batch.buffer_barriers.end());
+    image_barriers.insert(image_barriers.end(), batch.image_barriers.begin(), batch.image_barriers.end());
+
+    wait_value = batch.value;
+    m_ready_ticket = batch.last_ticket;
+    m_staging->release_until(batch.staging_mark);
+    m_total_bytes += batch.bytes;
+    m_window_bytes += batch.bytes;
+    m_free_command_buffers.push_back(batch.cmd);
+
+    m_in_flight.pop_front();
+  }
+
+  if (!dedicated_queue()) {
+    return 0; // Same queue; submission order and the batch's own barrier suffice
+  }
+
+  if (buffer_barriers.size() || image_barriers.size()) {
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+      0, nullptr,
+      (uint32_t)buffer_barriers.size(), buffer_barriers.data(),
+      (uint32_t)image_barriers.size(), image_barriers.data());
+  }
+
+  return wait_value;
+}
+
+UploadStats Uploader::stats() {
+  std::lock_guard lock(m_mutex);
+
+  auto now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - m_window_start).count();
+
+  if (elapsed >= 1.0) {
+    m_bytes_per_second = (double)m_window_bytes / elapsed;
+    m_window_bytes = 0;
+    m_window_start = now;
+  }
+
+  return UploadStats {
+    .total_bytes = m_total_bytes,
+    .bytes_per_second = m_bytes_per_second,
+    .pending_requests = m_requests.size(),
+  };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <vulkan/vulkan.h>
+
+#include "gpu_memory.h"
+
+class MappedFile;
+
+// Monotonic per-request id. A resource may be used by the graphics queue once
+// is_ready() returns true for the ticket of its last upload.
+using UploadTicket = uint64_t;
+
+struct UploadStats {
+  uint64_t total_bytes;
+  double bytes_per_second;
+  size_t pending_requests;
+};
+
+// Streams buffer and image data to the GPU through a staging ring, preferably on
+// a transfer-only queue so copies overlap rendering. Each submit() sends at most
+// a frame's budget of bytes, signalling a timeline semaphore. The graphics queue
+// picks up finished batches in record_acquires() (queue family ownership
+// acquire), so it never waits on copies that are still in flight.
+//
+// With no dedicated transfer family the uploader submits to the graphics queue
+// itself, and no ownership transfer is needed.
+class Uploader {
+public:
+  Uploader(VkDevice device, GpuAllocator& allocator, VkQueue queue, uint32_t queue_family, uint32_t graphics_family, VkDeviceSize staging_size, VkDeviceSize frame_budget);
+  ~Uploader();
+
+  UploadTicket upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, std::vector<uint8_t> data);
+  UploadTicket upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, const void* data, VkDeviceSize size);
+  // Whole mip level; the image ends up in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+  UploadTicket upload_image(VkImage dst, uint32_t mip_level, VkExtent3D extent, std::vector<uint8_t> data);
+  // Copy 'size' bytes at 'offset' in a mapped file straight into staging, with
+  // no copy on the heap. The file stays mapped until they have been copied.
+  UploadTicket upload_buffer(VkBuffer dst, VkDeviceSize dst_offset, std::shared_ptr<const MappedFile> file, size_t offset, size_t size);
+  UploadTicket upload_image(VkImage dst, uint32_t mip_level, VkExtent3D extent, std::shared_ptr<const MappedFile> file, size_t offset, size_t size);
+
+  // Records and submits pending copies, up to the per-frame byte budget
+  void submit();
+  // Records acquire barriers for completed batches into a graphics command buffer.
+  // Returns the timeline value that submission must wait on, or 0 for none.
+  uint64_t record_acquires(VkCommandBuffer cmd);
+
+  bool is_ready(UploadTicket ticket) const { return ticket <= m_ready_ticket; }
+  bool dedicated_queue() const { return m_queue_family != m_graphics_family; }
+  VkSemaphore timeline() const { return m_timeline; }
+  UploadStats stats();
+
+private:
+  struct Request {
+    UploadTicket ticket;
+    VkBuffer buffer;
+    VkDeviceSize dst_offset;
+    VkImage image;
+    uint32_t mip_level;
+    VkExtent3D extent;
+    std::vector<uint8_t> data;
+    std::shared_ptr<const MappedFile> file; // Source instead of 'data' when set
+    const uint8_t* bytes;                   // Into 'data' or 'file'
+    VkDeviceSize size;
+    VkDeviceSize copied;
+  };
+
+  struct Batch {
+    VkCommandBuffer cmd;
+    uint64_t value;
+    uint64_t staging_mark;
+    UploadTicket last_ticket;
+    VkDeviceSize bytes;
+    std::vector<VkBufferMemoryBarrier> buffer_barriers;
+    std::vector<VkImageMemoryBarrier> image_barriers;
+  };
+
+  UploadTicket enqueue(Request request);
+  void finish_request(const Request& request, Batch& batch);
+
+private:
+  VkDevice m_device;
+  GpuAllocator& m_allocator;
+  VkQueue m_queue;
+  uint32_t m_queue_family;
+  uint32_t m_graphics_family;
+  VkDeviceSize m_frame_budget;
+  VkCommandPool m_command_pool;
+  std::vector<VkCommandBuffer> m_free_command_buffers;
+  VkSemaphore m_timeline;
+  uint64_t m_timeline_value = 0;
+  VkBuffer m_staging_buffer;
+  std::unique_ptr<GpuLinearPool> m_staging;
+  std::deque<Request> m_requests;
+  std::deque<Batch> m_in_flight;
+  // Reused by record_acquires() so picking up batches does not allocate once warm
+  std::vector<VkBufferMemoryBarrier> m_acquire_buffer_barriers;
+  std::vector<VkImageMemoryBarrier> m_acquire_image_barriers;
+  UploadTicket m_next_ticket = 1;
+  UploadTicket m_submitted_ticket = 0;
+  UploadTicket m_ready_ticket = 0;
+  uint64_t m_total_bytes = 0;
+  uint64_t m_window_bytes = 0;
+  double m_bytes_per_second = 0.0;
+  std::chrono::steady_clock::time_point m_window_start;
+  std::mutex m_mutex;
+};
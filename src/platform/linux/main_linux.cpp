@@ -0,0 +1,249 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+#include "engine/renderer.h"
+#include "engine/base.h"
+#include "bench/bench.h"
+
+using Clock = std::chrono::steady_clock;
+
+struct Benchmark {
+  const char* name;
+  int(*run)(const BenchOptions& options);
+};
+
+static const Benchmark benchmarks[] = {
+  { "record", bench_record },
+  { "jobs", bench_jobs },
+  { "latency", bench_latency },
+  { "indirect", bench_indirect },
+  { "occlusion", bench_occlusion },
+  { "graph", bench_graph },
+  { "resize", bench_resize },
+  { "startup", bench_startup },
+  { "assets", bench_assets },
+  { "mesh", bench_mesh },
+  { "lod", bench_lod },
+  { "meshlets", bench_meshlets },
+  { "textures", bench_textures },
+  { "frame_allocs", bench_frame_allocs },
+  { "transforms", bench_transforms },
+  { "async_compute", bench_async_compute },
+  { "defrag", bench_defrag },
+  { "frame_packets", bench_frame_packets },
+};
+
+int main(int argc, char** argv) {
+  uint32_t width = 1920;
+  uint32_t height = 1080;
+  uint32_t frame_count = 1000;
+  uint32_t warmup_count = 16;
+  uint32_t upload_mb = 0;
+  uint32_t draw_count = 0; // 0 leaves the choice to the benchmark
+  uint32_t record_slices = 0;
+  const char* bench_name = nullptr;
+  uint32_t profile_interval = 0;
+  const char* profile_csv = nullptr;
+  const char* mesh_path = nullptr;
+  uint32_t lod_threshold = 1; // Pixels
+  uint32_t meshlet_path = ~0u; // Left to the renderer
+  FramePacing pacing = {};
+
+  // Parse command line: --width W --height H --frames N --warmup N --upload-mb N
+  // --draws N --slices N --bench NAME --profile N --profile-csv PATH
+  // --frames-in-flight N --low-latency 0|1 --mesh PATH --lod-threshold N
+  // --meshlets 0|1|2 (none, compute, mesh shaders)
+  for (int i = 1; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for '%s'\n", argv[i]);
+      return 1;
+    }
+
+    uint32_t value = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+
+    if (!strcmp(argv[i], "--bench")) {
+      bench_name = argv[i + 1];
+    }
+    else if (!strcmp(argv[i], "--profile-csv")) {
+      profile_csv = argv[i + 1];
+    }
+    else if (!strcmp(argv[i], "--mesh")) {
+      mesh_path = argv[i + 1];
+    }
+    else if (!strcmp(argv[i], "--width")) {
+      width = value;
+    }
+    else if (!strcmp(argv[i], "--height")) {
+      height = value;
+    }
+    else if (!strcmp(argv[i], "--frames")) {
+      frame_count = value;
+    }
+    else if (!strcmp(argv[i], "--warmup")) {
+      warmup_count = value;
+    }
+    else if (!strcmp(argv[i], "--upload-mb")) {
+      upload_mb = value;
+    }
+    else if (!strcmp(argv[i], "--draws")) {
+      draw_count = value;
+    }
+    else if (!strcmp(argv[i], "--slices")) {
+      record_slices = value;
+    }
+    else if (!strcmp(argv[i], "--profile")) {
+      profile_interval = value;
+    }
+    else if (!strcmp(argv[i], "--frames-in-flight")) {
+      pacing.frames_in_flight = value;
+    }
+    else if (!strcmp(argv[i], "--low-latency")) {
+      pacing.low_latency = value != 0;
+    }
+    else if (!strcmp(argv[i], "--lod-threshold")) {
+      lod_threshold = value;
+    }
+    else if (!strcmp(argv[i], "--meshlets")) {
+      meshlet_path = value;
+    }
+    else {
+      fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (!width || !height || !frame_count) {
+    fprintf(stderr, "Width, height and frame count must be non-zero\n");
+    return 1;
+  }
+
+  if (!pacing.frames_in_flight || pacing.frames_in_flight > MAX_FRAMES_IN_FLIGHT) {
+    fprintf(stderr, "Frames in flight must be between 1 and %u\n", MAX_FRAMES_IN_FLIGHT);
+    return 1;
+  }
+
+  if (bench_name) {
+    BenchOptions options = {
+      .width = width,
+      .height = height,
+      .frames = frame_count,
+      .warmup = warmup_count,
+      .draws = draw_count,
+    };
+
+    for (auto& benchmark : benchmarks) {
+      if (!strcmp(benchmark.name, bench_name)) {
+        return benchmark.run(options);
+      }
+    }
+
+    fprintf(stderr, "Unknown benchmark '%s'\n", bench_name);
+    return 1;
+  }
+
+  // Create the renderer with no window, targeting offscreen images
+  Renderer r(width, height, pacing);
+  r.set_draw_count(draw_count ? draw_count : 1);
+  r.set_record_slices(record_slices);
+  r.profiler().set_print_interval(profile_interval);
+
+  if (profile_csv && !r.profiler().open_csv(profile_csv)) {
+    fprintf(stderr, "Failed to open '%s'\n", profile_csv);
+    return 1;
+  }
+
+  // Meshes are only drawn by the GPU-driven path
+  if (mesh_path && (!r.set_gpu_driven(true) || !r.set_mesh(mesh_path))) {
+    fprintf(stderr, "Failed to draw '%s'\n", mesh_path);
+    return 1;
+  }
+
+  r.set_lod_threshold((float)lod_threshold);
+
+  if (meshlet_path != ~0u && (meshlet_path > (uint32_t)MeshletPath::MeshShader || !r.set_meshlet_path((MeshletPath)meshlet_path))) {
+    fprintf(stderr, "Meshlet path %u is not supported\n", meshlet_path);
+    return 1;
+  }
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(warmup_count)) {
+    r.present();
+  }
+
+  r.wait_idle();
+  r.reset_latency_stats();
+
+  // Optionally stream data to the GPU during the timed frames, in 1MB pieces, to
+  // measure upload throughput and its effect on frame times
+  GpuBuffer upload_target = {};
+  UploadTicket last_ticket = 0;
+
+  if (upload_mb) {
+    VkDeviceSize chunk_size = 1024 * 1024;
+    upload_target = r.gpu_allocator().create_buffer(upload_mb * chunk_size, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, GpuMemoryUsage::GpuOnly);
+
+    std::vector<uint8_t> chunk(chunk_size);
+    for (auto i : Range<size_t>(chunk.size())) {
+      chunk[i] = (uint8_t)i;
+    }
+
+    for (auto i : Range<uint32_t>(upload_mb)) {
+      last_ticket = r.uploader().upload_buffer(upload_target.buffer, i * chunk_size, chunk);
+    }
+  }
+
+  uint32_t upload_ready_frame = 0;
+
+  // Per-frame times include the wait on the frame fence, so once the pipeline
+  // is full they track GPU throughput rather than just CPU submission cost.
+  double min_ms = 1e9;
+  double max_ms = 0.0;
+
+  auto start = Clock::now();
+
+  for ([[maybe_unused]] auto i : Range<uint32_t>(frame_count)) {
+    auto frame_start = Clock::now();
+    r.present();
+    double ms = std::chrono::duration<double, std::milli>(Clock::now() - frame_start).count();
+
+    min_ms = std::min(min_ms, ms);
+    max_ms = std::max(max_ms, ms);
+
+    if (upload_mb && !upload_ready_frame && r.uploader().is_ready(last_ticket)) {
+      upload_ready_frame = i + 1;
+    }
+  }
+
+  r.wait_idle();
+
+  double total_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  double avg_ms = total_ms / frame_count;
+
+  printf("%ux%u, %u frames\n", width, height, frame_count);
+  printf("frame time: avg %.3f ms, min %.3f ms, max %.3f ms\n", avg_ms, min_ms, max_ms);
+  printf("throughput: %.1f frames/s\n", 1000.0 / avg_ms);
+
+  LatencyStats latency = r.latency_stats();
+  printf("input to GPU complete: avg %.3f ms, min %.3f ms, max %.3f ms (%u frames in flight%s)\n",
+    latency.avg_ms, latency.min_ms, latency.max_ms, pacing.frames_in_flight, pacing.low_latency ? ", low latency" : "");
+
+  if (upload_mb) {
+    if (upload_ready_frame) {
+      printf("upload: %u MB ready after %u frames\n", upload_mb, upload_ready_frame);
+    }
+    else {
+      printf("upload: %u MB not finished within %u frames\n", upload_mb, frame_count);
+    }
+  }
+
+  r.print_memory_stats();
+
+  if (upload_target.buffer) {
+    r.gpu_allocator().destroy_buffer(upload_target);
+  }
+
+  return 0;
+}
@@ -0,0 +1,78 @@
+#include <vulkan/vulkan.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "platform/platform.h"
+
+// Headless backend: there is no window system, so surfaces are never created
+// and the renderer is expected to run in offscreen mode.
+namespace platform {
+  std::pair<uint32_t, uint32_t> get_window_size(WindowHandle) {
+    return { 0, 0 };
+  }
+
+  void exit_program(int code) {
+    exit(code);
+  }
+
+  void message_box(const char* title, const char* message) {
+    fprintf(stderr, "%s: %s\n", title, message);
+  }
+
+  std::optional<FileMapping> map_file(const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return std::nullopt;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return std::nullopt;
+    }
+
+    FileMapping mapping = { nullptr, (size_t)st.st_size };
+
+    // The mapping keeps the file referenced once the descriptor is closed
+    if (mapping.size) {
+      void* data = mmap(nullptr, mapping.size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        return std::nullopt;
+      }
+
+      mapping.data = data;
+    }
+
+    close(fd);
+    return mapping;
+  }
+
+  void unmap_file(const FileMapping& mapping) {
+    if (mapping.data) {
+      munmap((void*)mapping.data, mapping.size);
+    }
+  }
+
+  bool replace_file(const char* from, const char* to) {
+    return rename(from, to) == 0;
+  }
+};
+
+VkSurfaceKHR create_vulkan_surface(VkInstance, platform::WindowHandle) {
+  return nullptr;
+}
+
+std::vector<const char*> get_vulkan_instance_extensions() {
+  return {};
+}
+
+VkInstanceCreateFlags get_vulkan_instance_flags() {
+  return (VkInstanceCreateFlags)0;
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <optional>
 #include <utility>
 
 namespace platform {
@@ -9,4 +12,16 @@ namespace platform {
   void exit_program(int code);
   void message_box(const char* title, const char* message);
 
+  // Read-only view of a whole file. Empty files map to a null view.
+  struct FileMapping {
+    const void* data;
+    size_t size;
+  };
+
+  std::optional<FileMapping> map_file(const char* path);
+  void unmap_file(const FileMapping& mapping);
+
+  // Moves 'from' over 'to' in one step, so 'to' is never missing
+  bool replace_file(const char* from, const char* to);
+
 };
\ No newline at end of file
@@ -1,14 +1,35 @@
 #include <windows.h>
 
+#include <chrono>
+#include <format>
 #include <iostream>
 #include <optional>
+#include <thread>
 #include <vector>
 
 #include "engine/renderer.h"
+#include "engine/frame_packets.h"
+
+struct Extent {
+  uint32_t width;
+  uint32_t height;
+};
+
+static constexpr uint32_t resize_queue_size = 64;
+
+// Everything the render thread needs from one step of the main thread. Keys
+// pressed while the render thread is busy wait for the next packet.
+struct FramePacket {
+  bool quit;
+  std::vector<WPARAM> keys;
+};
 
 struct Events { // Reset every time events are polled
   bool closed;
-  std::optional<std::pair<uint32_t, uint32_t>> resize;
+  std::vector<WPARAM> keys;
+  // Straight to the render thread, so it keeps up while a drag holds the
+  // main thread in the modal size loop
+  SpscQueue<Extent, resize_queue_size>* resizes;
 };
 
 // Window event callback
@@ -25,13 +46,93 @@ static LRESULT CALLBACK window_proc(HWND window, UINT msg, WPARAM w_param, LPARA
       events.closed = true;
       break;
     case WM_SIZE:
-      events.resize = { LOWORD(l_param), HIWORD(l_param) };
+      // Dropped when full; the render thread then asks the window instead
+      events.resizes->push({ LOWORD(l_param), HIWORD(l_param) });
+      break;
+    case WM_KEYDOWN:
+      events.keys.push_back(w_param);
       break;
   }
 
   return result;
 }
 
+// Owns the renderer, which only this thread touches. Applies the latest
+// resize, waits for the GPU, then takes the next packet if there is one, so
+// input is sampled as late as pacing allows without either thread waiting on
+// the other.
+static void render_main(HWND window, FramePackets<FramePacket>& packets, SpscQueue<Extent, resize_queue_size>& resizes, HANDLE packet_released) {
+  Renderer r(window);
+
+  auto report_start = std::chrono::steady_clock::now();
+  bool minimized = false;
+
+  while (true) {
+    std::optional<Extent> resize;
+    uint32_t resize_count = 0;
+
+    while (std::optional<Extent> extent = resizes.pop()) {
+      resize = *extent;
+      resize_count++;
+    }
+
+    if (resize) {
+      // Only the last size matters, unless later ones were dropped
+      auto [w, h] = resize_count >= resize_queue_size ? platform::get_window_size(window) : std::pair(resize->width, resize->height);
+      minimized = w == 0 || h == 0;
+
+      if (!minimized) {
+        r.resize(w, h);
+      }
+    }
+
+    if (!minimized) {
+      r.wait_for_frame();
+    }
+
+    // None while the main thread is stalled, e.g. in the modal size loop; the
+    // frame is rendered anyway so resizes are still applied and shown
+    if (const FramePacket* packet = packets.try_acquire()) {
+      if (packet->quit) {
+        break;
+      }
+
+      // 1/2/3 pick FIFO/mailbox/immediate, L toggles low latency pacing, C async compute
+      for (WPARAM key : packet->keys) {
+        switch (key) {
+          case '1': r.set_present_mode(PresentMode::Fifo); break;
+          case '2': r.set_present_mode(PresentMode::Mailbox); break;
+          case '3': r.set_present_mode(PresentMode::Immediate); break;
+          case 'L': r.set_low_latency(!r.pacing().low_latency); break;
+          case 'C': r.set_async_compute(!r.async_compute()); break;
+        }
+      }
+
+      packets.release();
+      SetEvent(packet_released);
+    }
+
+    if (minimized) {
+      // Nothing to present into, so don't spin on packets
+      std::this_thread::sleep_for(std::chrono::milliseconds(16));
+      continue;
+    }
+
+    if (std::chrono::steady_clock::now() - report_start > std::chrono::seconds(2)) {
+      LatencyStats latency = r.latency_stats();
+      std::cout << std::format("{}{}: input to {} avg {:.2f} ms, min {:.2f} ms, max {:.2f} ms",
+        present_mode_name(r.present_mode()), r.pacing().low_latency ? " (low latency)" : "", latency.to_display ? "display" : "GPU complete",
+        latency.avg_ms, latency.min_ms, latency.max_ms) << std::endl;
+
+      r.reset_latency_stats();
+      report_start = std::chrono::steady_clock::now();
+    }
+
+    // Call renderer
+    r.present();
+  }
+}
+
 int main() {
   // Register the window class
   WNDCLASSA wc = {
@@ -43,42 +144,74 @@ int main() {
   RegisterClassA(&wc);
 
   // Create window
-  Events e = {};
+  SpscQueue<Extent, resize_queue_size> resizes;
+  Events e = { .resizes = &resizes };
   HWND window = CreateWindowA(wc.lpszClassName, "Vro", WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, CW_USEDEFAULT, nullptr, nullptr, wc.hInstance, nullptr);
-  
+
   // Set events pointer
   SetWindowLongPtrA(window, GWLP_USERDATA, (LONG_PTR)&e);
   ShowWindow(window, SW_MAXIMIZE);
 
-  // Create the renderer
-  Renderer r(window);
+  // Create the renderer on its own thread. This thread keeps pumping messages
+  // meanwhile, as surface and swapchain creation may send some to the window.
+  FramePackets<FramePacket> packets;
+  HANDLE packet_released = CreateEventA(nullptr, FALSE, FALSE, nullptr);
+  std::thread render_thread(render_main, window, std::ref(packets), std::ref(resizes), packet_released);
 
-  // Loop while open
-  while (true) {
-    e = {}; // Reset events and poll
+  auto poll = [&]() {
+    e.keys.clear(); // Reset events and poll
     MSG msg;
-    while (PeekMessageA(&msg, window, 0, 0, PM_REMOVE)) {
+    while (PeekMessageA(&msg, nullptr, 0, 0, PM_REMOVE)) {
       TranslateMessage(&msg);
       DispatchMessageA(&msg);
     }
+  };
+
+  std::vector<WPARAM> keys;
+
+  // Loop while open
+  while (true) {
+    // Sleeps until there are messages or the render thread frees a packet;
+    // never on the GPU
+    MsgWaitForMultipleObjects(1, &packet_released, FALSE, INFINITE, QS_ALLINPUT);
+    poll();
 
     if (e.closed) { // Check if window is closed
       break;
     }
 
-    if (e.resize) { // Handle resize callback -> resize renderer resources
-      auto [w, h] = *e.resize;
-
-      if (w == 0 || h == 0) {
-        continue;
-      }
+    keys.insert(keys.end(), e.keys.begin(), e.keys.end());
 
-      r.resize(w, h);
+    // Simulation for the next frame goes here, overlapping the render thread's
+    // recording and submission of the previous one
+    if (FramePacket* packet = packets.begin_write()) {
+      packet->quit = false;
+      packet->keys.swap(keys);
+      keys.clear();
+      packets.publish();
     }
+  }
 
-    // Call renderer
-    r.present();
+  // The render thread takes this packet next and stops. Messages are pumped
+  // until it has, as tearing down the swapchain may send some to the window.
+  FramePacket* packet;
+  while (!(packet = packets.begin_write())) {
+    MsgWaitForMultipleObjects(1, &packet_released, FALSE, INFINITE, QS_ALLINPUT);
+    poll();
   }
 
+  packet->quit = true;
+  packets.publish();
+
+  HANDLE thread = render_thread.native_handle();
+  while (MsgWaitForMultipleObjects(1, &thread, FALSE, INFINITE, QS_ALLINPUT) != WAIT_OBJECT_0) {
+    poll();
+  }
+
+  render_thread.join();
+
+  CloseHandle(packet_released);
+  DestroyWindow(window);
+
   return 0;
-}
\ No newline at end of file
+}
@@ -26,6 +26,52 @@ namespace platform {
   void message_box(const char* title, const char* message) {
     MessageBoxA(nullptr, message, title, 0);
   }
+
+  std::optional<FileMapping> map_file(const char* path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+      return std::nullopt;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+      CloseHandle(file);
+      return std::nullopt;
+    }
+
+    FileMapping mapping = { nullptr, (size_t)size.QuadPart };
+
+    // The view keeps the file and mapping objects alive once their handles are closed
+    if (mapping.size) {
+      HANDLE file_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+      void* data = file_mapping ? MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+
+      if (file_mapping) {
+        CloseHandle(file_mapping);
+      }
+
+      if (!data) {
+        CloseHandle(file);
+        return std::nullopt;
+      }
+
+      mapping.data = data;
+    }
+
+    CloseHandle(file);
+    return mapping;
+  }
+
+  void unmap_file(const FileMapping& mapping) {
+    if (mapping.data) {
+      UnmapViewOfFile(mapping.data);
+    }
+  }
+
+  bool replace_file(const char* from, const char* to) {
+    // rename() fails on Windows when the target exists
+    return MoveFileExA(from, to, MOVEFILE_REPLACE_EXISTING) != 0;
+  }
 };
 
 VkSurfaceKHR create_vulkan_surface(VkInstance instance, platform::WindowHandle window) {
@@ -0,0 +1,78 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(set = 0, binding = 0) uniform FrameUniforms {
+  float time;
+  float aspect;
+  vec2 camera;
+  float zoom;
+} frame;
+
+struct Instance {
+  vec2 offset;
+  float scale;
+  float radius;
+  float depth;
+  float padding[3]; // GpuInstance is 32 bytes
+};
+
+// Bindless heap, binding 0: every storage buffer
+layout(std430, set = 1, binding = 0) readonly buffer InstanceBuffers {
+  Instance instances[];
+} instance_buffers[];
+
+// MeshVertex: snorm16 positions in the unit sphere, unorm8 color
+struct Vertex {
+  uint position_xy;
+  uint position_z;
+  uint color;
+};
+
+layout(std430, set = 1, binding = 0) readonly buffer VertexBuffers {
+  Vertex vertices[];
+} vertex_buffers[];
+
+layout(push_constant) uniform InstancedConstants {
+  uint instance_buffer;
+  uint vertex_buffer; // ~0 for the built-in triangle
+} draw;
+
+vec2 positions[3] = vec2[](
+  vec2(0.0, -0.5),
+  vec2(-0.5, 0.5),
+  vec2(0.5, 0.5)
+);
+
+vec3 colors[3] = vec3[](
+  vec3(1.0, 0.0, 0.0),
+  vec3(0.0, 1.0, 0.0),
+  vec3(0.0, 0.0, 1.0)
+);
+
+layout(location = 0) out vec3 fragColor;
+
+void main() {
+  Instance instance = instance_buffers[draw.instance_buffer].instances[gl_InstanceIndex];
+
+  float c = cos(frame.time);
+  float s = sin(frame.time);
+  vec2 local;
+  vec3 color;
+
+  if (draw.vertex_buffer == ~0u) {
+    local = positions[gl_VertexIndex];
+    color = colors[gl_VertexIndex];
+  }
+  else {
+    // The unit sphere spans the triangle's extent
+    Vertex vertex = vertex_buffers[draw.vertex_buffer].vertices[gl_VertexIndex];
+    local = unpackSnorm2x16(vertex.position_xy) * 0.5;
+    color = unpackUnorm4x8(vertex.color).rgb;
+  }
+
+  vec2 p = mat2(c, s, -s, c) * local * instance.scale;
+
+  vec2 position = vec2(p.x / frame.aspect, p.y) + instance.offset - frame.camera;
+  gl_Position = vec4(position * frame.zoom, instance.depth, 1.0);
+  fragColor = color;
+}
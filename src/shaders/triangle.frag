@@ -3,7 +3,7 @@
 layout(location = 0) in vec3 fragColor;
 layout(location = 0) out vec4 outColor;
 
+// Linear HDR; tonemapping and gamma are applied in tonemap.comp
 void main() {
-  float gamma = 2.2f; 
-  outColor = vec4(pow(fragColor, 1.0f/gamma.xxx), 1.0);
-}
\ No newline at end of file
+  outColor = vec4(fragColor, 1.0);
+}
@@ -1,5 +1,17 @@
 #version 450
 
+layout(set = 0, binding = 0) uniform FrameUniforms {
+  float time;
+  float aspect;
+  vec2 camera;
+  float zoom;
+} frame;
+
+layout(push_constant) uniform DrawConstants {
+  vec2 offset;
+  float scale;
+} draw;
+
 vec2 positions[3] = vec2[](
   vec2(0.0, -0.5),
   vec2(-0.5, 0.5),
@@ -15,6 +27,11 @@ vec3 colors[3] = vec3[](
 layout(location = 0) out vec3 fragColor;
 
 void main() {
-  gl_Position = vec4(positions[gl_VertexIndex], 0.0, 1.0);
+  float c = cos(frame.time);
+  float s = sin(frame.time);
+  vec2 p = mat2(c, s, -s, c) * positions[gl_VertexIndex] * draw.scale;
+
+  vec2 position = vec2(p.x / frame.aspect, p.y) + draw.offset - frame.camera;
+  gl_Position = vec4(position * frame.zoom, 0.0, 1.0);
   fragColor = colors[gl_VertexIndex];
-}
\ No newline at end of file
+}
@@ -0,0 +1,791 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+
+#include "cook.h"
+#include "engine/base.h"
+
+// Modelled cache size for ordering; larger than real caches, so the order
+// keeps working on hardware that batches vertices differently
+static constexpr uint32_t optimizer_cache_size = 32;
+
+// Tom Forsyth's "Linear-speed vertex cache optimisation" scores: vertices of
+// the last triangle are fixed at 0.75 so it isn't simply repeated, others
+// fall off with their position in the cache, and vertices with few triangles
+// left get a boost so they are finished off rather than stranded.
+static float vertex_score(int32_t cache_position, uint32_t live_triangles) {
+  if (!live_triangles) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      score = 0.75f;
+    }
+    else {
+      score = powf(1.0f - (float)(cache_position - 3) / (optimizer_cache_size - 3), 1.5f);
+    }
+  }
+
+  return score + 2.0f / sqrtf((float)live_triangles);
+}
+
+static std::vector<uint32_t> optimize_vertex_cache(const std::vector<uint32_t>& indices, uint32_t vertex_count) {
+  uint32_t triangle_count = (uint32_t)indices.size() / 3;
+
+  // Triangles around each vertex; the first live[v] of a vertex's are unemitted
+  std::vector<uint32_t> live(vertex_count);
+  std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+  std::vector<uint32_t> adjacency(indices.size());
+
+  for (uint32_t v : indices) {
+    live[v]++;
+  }
+
+  for (auto v : Range<uint32_t>(vertex_count)) {
+    adjacency_offsets[v + 1] = adjacency_offsets[v] + live[v];
+  }
+
+  std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+
+  for (auto i : Range<size_t>(indices.size())) {
+    adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+  }
+
+  std::vector<int32_t> cache_positions(vertex_count, -1);
+  std::vector<float> scores(vertex_count);
+
+  for (auto v : Range<uint32_t>(vertex_count)) {
+    scores[v] = vertex_score(-1, live[v]);
+  }
+
+  auto triangle_score = [&](uint32_t t) {
+    return scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+  };
+
+  std::vector<bool> emitted(triangle_count);
+  std::vector<uint32_t> cache;
+  std::vector<uint32_t> next_cache;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+
+  uint32_t cursor = 0;
+  int64_t best = -1;
+
+  while (result.size() < indices.size()) {
+    // Nothing in the cache has triangles left: start again from the next
+    // unemitted triangle in the input order
+    if (best < 0) {
+      while (emitted[cursor]) {
+        cursor++;
+      }
+
+      best = cursor;
+    }
+
+    uint32_t t = (uint32_t)best;
+    const uint32_t* triangle = &indices[t * 3];
+
+    emitted[t] = true;
+    result.insert(result.end(), triangle, triangle + 3);
+
+    for (auto k : Range<uint32_t>(3)) {
+      uint32_t v = triangle[k];
+      uint32_t* begin = &adjacency[adjacency_offsets[v]];
+      uint32_t* end = begin + live[v];
+
+      std::swap(*std::find(begin, end, t), end[-1]);
+      live[v]--;
+    }
+
+    next_cache.assign(triangle, triangle + 3);
+    for (uint32_t v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        next_cache.push_back(v);
+      }
+    }
+
+    for (auto i : Range<size_t>(next_cache.size())) {
+      uint32_t v = next_cache[i];
+      cache_positions[v] = i < optimizer_cache_size ? (int32_t)i : -1;
+      scores[v] = vertex_score(cache_positions[v], live[v]);
+    }
+
+    // Only triangles touching the cache changed score, and the next one is
+    // taken from among them
+    best = -1;
+    float best_score = -1.0f;
+
+    for (auto i : Range<size_t>(std::min<size_t>(next_cache.size(), optimizer_cache_size))) {
+      uint32_t v = next_cache[i];
+
+      for (auto j : Range<uint32_t>(live[v])) {
+        uint32_t candidate = adjacency[adjacency_offsets[v] + j];
+        float score = triangle_score(candidate);
+
+        if (score > best_score) {
+          best_score = score;
+          best = candidate;
+        }
+      }
+    }
+
+    next_cache.resize(std::min<size_t>(next_cache.size(), optimizer_cache_size));
+    std::swap(cache, next_cache);
+  }
+
+  return result;
+}
+
+float average_cache_miss_ratio(const uint32_t* indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+  if (!index_count) {
+    return 0.0f;
+  }
+
+  // A vertex is cached if fewer than cache_size misses happened since its own
+  std::vector<uint32_t> timestamps(vertex_count, 0);
+  uint32_t time = cache_size + 1;
+  uint32_t misses = 0;
+
+  for (auto i : Range<size_t>(index_count)) {
+    uint32_t v = indices[i];
+
+    if (time - timestamps[v] > cache_size) {
+      timestamps[v] = time++;
+      misses++;
+    }
+  }
+
+  return (float)misses / (float)(index_count / 3);
+}
+
+static void triangle_normal(const float* a, const float* b, const float* c, double* n) {
+  double e0[3] = { (double)b[0] - a[0], (double)b[1] - a[1], (double)b[2] - a[2] };
+  double e1[3] = { (double)c[0] - a[0], (double)c[1] - a[1], (double)c[2] - a[2] };
+
+  n[0] = e0[1] * e1[2] - e0[2] * e1[1];
+  n[1] = e0[2] * e1[0] - e0[0] * e1[2];
+  n[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+// Greedily cuts triangles, in order, into runs that fit the meshlet limits,
+// listing each meshlet's vertices and its triangles' indices into that list.
+// 'markers' holds the meshlet each vertex was last listed for, 'locals' its
+// index there.
+static void build_meshlets(const uint32_t* indices, uint32_t index_count, uint32_t first_index, std::vector<uint32_t>& markers, std::vector<uint8_t>& locals, CookedMesh& mesh) {
+  MeshMeshlet meshlet = { .first_index = first_index, .first_vertex = (uint32_t)mesh.meshlet_vertices.size() };
+  uint32_t marker = (uint32_t)mesh.meshlets.size();
+
+  for (uint32_t i = 0; i < index_count; i += 3) {
+    const uint32_t* triangle = &indices[i];
+
+    uint32_t added = 0;
+
+    for (auto k : Range<uint32_t>(3)) {
+      bool repeated = (k > 0 && triangle[k] == triangle[0]) || (k > 1 && triangle[k] == triangle[1]);
+      added += markers[triangle[k]] != marker && !repeated;
+    }
+
+    if (meshlet.triangle_count == mesh_meshlet_max_triangles || meshlet.vertex_count + added > mesh_meshlet_max_vertices) {
+      mesh.meshlets.push_back(meshlet);
+      meshlet = { .first_index = first_index + i, .first_vertex = (uint32_t)mesh.meshlet_vertices.size() };
+      marker++;
+    }
+
+    for (auto k : Range<uint32_t>(3)) {
+      uint32_t v = triangle[k];
+
+      if (markers[v] != marker) {
+        markers[v] = marker;
+        locals[v] = (uint8_t)meshlet.vertex_count++;
+        mesh.meshlet_vertices.push_back(v);
+      }
+
+      mesh.meshlet_triangles.push_back(locals[v]);
+    }
+
+    meshlet.triangle_count++;
+  }
+
+  if (meshlet.triangle_count) {
+    mesh.meshlets.push_back(meshlet);
+  }
+}
+
+// A sphere around the box of the meshlet's vertices, and the narrowest cone
+// around the average of its triangles' normals that holds all of them
+static MeshMeshletBounds meshlet_bounds(const std::vector<float>& positions, const uint32_t* indices, const MeshMeshlet& meshlet) {
+  float box_min[3] = { INFINITY, INFINITY, INFINITY };
+  float box_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+  uint32_t index_count = meshlet.triangle_count * 3;
+
+  for (auto i : Range<uint32_t>(index_count)) {
+    const float* p = &positions[indices[i] * 3];
+
+    for (auto axis : Range<uint32_t>(3)) {
+      box_min[axis] = std::min(box_min[axis], p[axis]);
+      box_max[axis] = std::max(box_max[axis], p[axis]);
+    }
+  }
+
+  MeshMeshletBounds bounds = {};
+
+  for (auto axis : Range<uint32_t>(3)) {
+    bounds.center[axis] = (box_min[axis] + box_max[axis]) * 0.5f;
+  }
+
+  for (auto i : Range<uint32_t>(index_count)) {
+    const float* p = &positions[indices[i] * 3];
+    float dx = p[0] - bounds.center[0], dy = p[1] - bounds.center[1], dz = p[2] - bounds.center[2];
+    bounds.radius = std::max(bounds.radius, sqrtf(dx * dx + dy * dy + dz * dz));
+  }
+
+  // Positions are quantized to snorm16 afterwards
+  bounds.radius += 1.0f / 32767.0f;
+
+  std::vector<std::array<double, 3>> normals;
+  double axis[3] = {};
+
+  for (uint32_t i = 0; i < index_count; i += 3) {
+    double n[3];
+    triangle_normal(&positions[indices[i] * 3], &positions[indices[i + 1] * 3], &positions[indices[i + 2] * 3], n);
+
+    double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    // Slivers are never drawn, whichever way they face
+    if (length == 0.0) {
+      continue;
+    }
+
+    normals.push_back({ n[0] / length, n[1] / length, n[2] / length });
+
+    for (auto k : Range<uint32_t>(3)) {
+      axis[k] += normals.back()[k];
+    }
+  }
+
+  double axis_length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  bounds.cone_cutoff = 1.0f;
+
+  if (axis_length == 0.0) {
+    return bounds;
+  }
+
+  double min_dot = 1.0;
+
+  for (auto k : Range<uint32_t>(3)) {
+    axis[k] /= axis_length;
+    bounds.cone_axis[k] = (float)axis[k];
+  }
+
+  for (auto& n : normals) {
+    min_dot = std::min(min_dot, n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]);
+  }
+
+  // Normals within the cone's half angle a of the axis all face away from d
+  // once d is within 90 - a of it, where dot(d, axis) > cos(90 - a) = sin(a)
+  if (min_dot > 0.0) {
+    bounds.cone_cutoff = (float)std::min(sqrt(1.0 - min_dot * min_dot) + 1e-3, 1.0);
+  }
+
+  return bounds;
+}
+
+struct SimplifiedLod {
+  std::vector<uint32_t> indices;
+  float error;
+};
+
+// Garland and Heckbert's error quadric: the area weighted sum of squared
+// distances to a set of planes, as the upper triangle of a symmetric 4x4
+// matrix. Divided by the total area it is the mean squared distance.
+struct Quadric {
+  double a00, a01, a02, a11, a12, a22;
+  double b0, b1, b2;
+  double c;
+  double area;
+};
+
+static Quadric plane_quadric(const double* n, double d, double weight) {
+  return Quadric {
+    .a00 = weight * n[0] * n[0], .a01 = weight * n[0] * n[1], .a02 = weight * n[0] * n[2],
+    .a11 = weight * n[1] * n[1], .a12 = weight * n[1] * n[2], .a22 = weight * n[2] * n[2],
+    .b0 = weight * n[0] * d, .b1 = weight * n[1] * d, .b2 = weight * n[2] * d,
+    .c = weight * d * d,
+  };
+}
+
+static void add_quadric(Quadric& q, const Quadric& r) {
+  q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02;
+  q.a11 += r.a11; q.a12 += r.a12; q.a22 += r.a22;
+  q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+  q.c += r.c;
+  q.area += r.area;
+}
+
+static double evaluate_quadric(const Quadric& q, const float* p) {
+  double x = p[0], y = p[1], z = p[2];
+
+  double result = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z + 2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+    2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+  return std::max(result, 0.0);
+}
+
+// Open edges are kept in place by a plane through the edge, perpendicular to
+// its triangle, weighted well above the surface; UV seams, where vertices are
+// split, count as open and so don't crack apart
+static constexpr double border_weight = 10.0;
+
+// Don't collapse an edge if it turns any remaining triangle further than
+// this; cos 75 degrees
+static constexpr double max_normal_turn = 0.25;
+
+// Half-edge collapses: an edge's vertex moves onto the other end, so every LOD
+// indexes the finest LOD's vertices and they share one vertex buffer. The
+// cheapest collapses by quadric error go first. Each time the triangle count
+// halves a copy is kept as the next LOD, and collapsing carries on from it,
+// until 'lod_count' have been made or fewer than 'min_triangles' remain.
+static std::vector<SimplifiedLod> simplify(const std::vector<float>& positions, const std::vector<uint32_t>& indices, uint32_t lod_count, uint32_t min_triangles) {
+  uint32_t vertex_count = (uint32_t)positions.size() / 3;
+  uint32_t triangle_count = (uint32_t)indices.size() / 3;
+
+  std::vector<uint32_t> triangles = indices;
+  std::vector<bool> alive(triangle_count, true);
+  std::vector<std::vector<uint32_t>> vertex_triangles(vertex_count);
+  std::vector<Quadric> quadrics(vertex_count, Quadric {});
+
+  auto position = [&](uint32_t v) { return &positions[v * 3]; };
+
+  std::unordered_map<uint64_t, uint32_t> edge_uses;
+  auto edge_key = [](uint32_t a, uint32_t b) { return (uint64_t)std::min(a, b) << 32 | std::max(a, b); };
+
+  for (auto t : Range<uint32_t>(triangle_count)) {
+    const uint32_t* triangle = &triangles[t * 3];
+    double n[3];
+    triangle_normal(position(triangle[0]), position(triangle[1]), position(triangle[2]), n);
+
+    double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+    for (auto k : Range<uint32_t>(3)) {
+      vertex_triangles[triangle[k]].push_back(t);
+      edge_uses[edge_key(triangle[k], triangle[(k + 1) % 3])]++;
+    }
+
+    // Slivers with no area have no plane, and weigh nothing anyway
+    if (length == 0.0) {
+      continue;
+    }
+
+    double unit[3] = { n[0] / length, n[1] / length, n[2] / length };
+    const float* p = position(triangle[0]);
+
+    Quadric q = plane_quadric(unit, -(unit[0] * p[0] + unit[1] * p[1] + unit[2] * p[2]), length * 0.5);
+    q.area = length * 0.5;
+
+    for (auto k : Range<uint32_t>(3)) {
+      add_quadric(quadrics[triangle[k]], q);
+    }
+  }
+
+  for (auto t : Range<uint32_t>(triangle_count)) {
+    const uint32_t* triangle = &triangles[t * 3];
+    double n[3];
+    triangle_normal(position(triangle[0]), position(triangle[1]), position(triangle[2]), n);
+
+    for (auto k : Range<uint32_t>(3)) {
+      uint32_t a = triangle[k], b = triangle[(k + 1) % 3];
+      if (edge_uses[edge_key(a, b)] != 1) {
+        continue;
+      }
+
+      const float* pa = position(a);
+      const float* pb = position(b);
+      double edge[3] = { (double)pb[0] - pa[0], (double)pb[1] - pa[1], (double)pb[2] - pa[2] };
+
+      double plane[3] = { edge[1] * n[2] - edge[2] * n[1], edge[2] * n[0] - edge[0] * n[2], edge[0] * n[1] - edge[1] * n[0] };
+      double length = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+
+      if (length == 0.0) {
+        continue;
+      }
+
+      double unit[3] = { plane[0] / length, plane[1] / length, plane[2] / length };
+      double edge_length_sq = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+      Quadric q = plane_quadric(unit, -(unit[0] * pa[0] + unit[1] * pa[1] + unit[2] * pa[2]), edge_length_sq * border_weight);
+
+      add_quadric(quadrics[a], q);
+      add_quadric(quadrics[b], q);
+    }
+  }
+
+  // Entries go stale when either vertex is collapsed into; versions tell
+  struct Collapse {
+    float cost;
+    uint32_t from;
+    uint32_t to;
+    uint32_t from_version;
+    uint32_t to_version;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+  };
+
+  std::vector<uint32_t> versions(vertex_count);
+  std::vector<bool> removed(vertex_count);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+  auto push_edge = [&](uint32_t a, uint32_t b) {
+    Quadric q = quadrics[a];
+    add_quadric(q, quadrics[b]);
+
+    double area = std::max(q.area, 1e-12);
+
+    heap.push(Collapse { (float)(evaluate_quadric(q, position(b)) / area), a, b, versions[a], versions[b] });
+    heap.push(Collapse { (float)(evaluate_quadric(q, position(a)) / area), b, a, versions[b], versions[a] });
+  };
+
+  for (auto t : Range<uint32_t>(triangle_count)) {
+    for (auto k : Range<uint32_t>(3)) {
+      uint32_t a = triangles[t * 3 + k], b = triangles[t * 3 + (k + 1) % 3];
+
+      // Interior edges are in two triangles, in opposite directions
+      if (a < b || edge_uses[edge_key(a, b)] == 1) {
+        push_edge(a, b);
+      }
+    }
+  }
+
+  edge_uses = {};
+
+  // Moving 'from' onto 'to' must not fold any of its other triangles over
+  auto flips = [&](uint32_t from, uint32_t to) {
+    for (uint32_t t : vertex_triangles[from]) {
+      if (!alive[t]) {
+        continue;
+      }
+
+      const uint32_t* triangle = &triangles[t * 3];
+      if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+        continue;
+      }
+
+      const float* before[3] = { position(triangle[0]), position(triangle[1]), position(triangle[2]) };
+      const float* after[3] = { before[0], before[1], before[2] };
+
+      for (auto k : Range<uint32_t>(3)) {
+        if (triangle[k] == from) {
+          after[k] = position(to);
+        }
+      }
+
+      double n0[3], n1[3];
+      triangle_normal(before[0], before[1], before[2], n0);
+      triangle_normal(after[0], after[1], after[2], n1);
+
+      double length0 = sqrt(n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2]);
+      double length1 = sqrt(n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2]);
+
+      if (length0 > 0.0 && n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2] < max_normal_turn * length0 * length1) {
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  auto snapshot = [&](float error) {
+    SimplifiedLod lod = { .error = error };
+    std::vector<std::array<uint32_t, 3>> remaining;
+
+    for (auto t : Range<uint32_t>(triangle_count)) {
+      if (alive[t]) {
+        std::array<uint32_t, 3> triangle = { triangles[t * 3], triangles[t * 3 + 1], triangles[t * 3 + 2] };
+
+        // Rotated to start at the smallest index, keeping the winding, so
+        // triangles collapsed onto each other compare equal
+        std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+        remaining.push_back(triangle);
+      }
+    }
+
+    std::sort(remaining.begin(), remaining.end());
+    remaining.erase(std::unique(remaining.begin(), remaining.end()), remaining.end());
+
+    for (auto& triangle : remaining) {
+      lod.indices.insert(lod.indices.end(), triangle.begin(), triangle.end());
+    }
+
+    return lod;
+  };
+
+  std::vector<SimplifiedLod> lods;
+  std::vector<uint32_t> marks(vertex_count, UINT32_MAX);
+
+  uint32_t live = triangle_count;
+  uint32_t previous = triangle_count;
+  float max_error = 0.0f;
+
+  while (lods.size() < lod_count && previous >= min_triangles) {
+    uint32_t target = previous / 2;
+
+    while (live > target && !heap.empty()) {
+      Collapse collapse = heap.top();
+      heap.pop();
+
+      uint32_t from = collapse.from, to = collapse.to;
+
+      if (removed[from] || removed[to] || versions[from] != collapse.from_version || versions[to] != collapse.to_version) {
+        continue;
+      }
+
+      if (flips(from, to)) {
+        continue;
+      }
+
+      max_error = std::max(max_error, sqrtf(collapse.cost));
+
+      add_quadric(quadrics[to], quadrics[from]);
+      removed[from] = true;
+      versions[to]++;
+
+      for (uint32_t t : vertex_triangles[from]) {
+        if (!alive[t]) {
+          continue;
+        }
+
+        uint32_t* triangle = &triangles[t * 3];
+
+        if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+          alive[t] = false;
+          live--;
+          continue;
+        }
+
+        for (auto k : Range<uint32_t>(3)) {
+          if (triangle[k] == from) {
+            triangle[k] = to;
+          }
+        }
+
+        vertex_triangles[to].push_back(t);
+      }
+
+      vertex_triangles[from] = {};
+
+      auto& around = vertex_triangles[to];
+      around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return !alive[t]; }), around.end());
+
+      // Every edge out of 'to' now costs something else
+      for (uint32_t t : around) {
+        for (auto k : Range<uint32_t>(3)) {
+          uint32_t v = triangles[t * 3 + k];
+
+          if (v != to && marks[v] != to) {
+            marks[v] = to;
+            push_edge(to, v);
+          }
+        }
+      }
+
+      for (uint32_t t : around) {
+        for (auto k : Range<uint32_t>(3)) {
+          marks[triangles[t * 3 + k]] = UINT32_MAX;
+        }
+      }
+    }
+
+    if (live >= previous) {
+      break;
+    }
+
+    lods.push_back(snapshot(max_error));
+    previous = live;
+  }
+
+  return lods;
+}
+
+static uint32_t snorm16(float v) {
+  return (uint32_t)(uint16_t)(int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * 32767.0f);
+}
+
+CookedMesh cook_mesh(const SourceMesh& source, const CookOptions& options) {
+  CookedMesh mesh = {};
+  uint32_t source_vertex_count = (uint32_t)source.positions.size() / 3;
+
+  // Bounding sphere around the box center
+  float box_min[3] = { INFINITY, INFINITY, INFINITY };
+  float box_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+
+  for (uint32_t v : source.indices) {
+    for (auto axis : Range<uint32_t>(3)) {
+      box_min[axis] = std::min(box_min[axis], source.positions[v * 3 + axis]);
+      box_max[axis] = std::max(box_max[axis], source.positions[v * 3 + axis]);
+    }
+  }
+
+  float center[3] = {};
+  float radius = 0.0f;
+
+  if (source.indices.size()) {
+    for (auto axis : Range<uint32_t>(3)) {
+      center[axis] = (box_min[axis] + box_max[axis]) * 0.5f;
+    }
+
+    for (uint32_t v : source.indices) {
+      float dx = source.positions[v * 3] - center[0], dy = source.positions[v * 3 + 1] - center[1], dz = source.positions[v * 3 + 2] - center[2];
+      radius = std::max(radius, sqrtf(dx * dx + dy * dy + dz * dz));
+    }
+  }
+
+  float scale = radius > 0.0f ? 1.0f / radius : 1.0f;
+  std::vector<float> positions(source.positions.size());
+
+  for (auto i : Range<size_t>(positions.size())) {
+    positions[i] = (source.positions[i] - center[i % 3]) * scale;
+  }
+
+  SimplifiedLod finest = { .error = 0.0f };
+
+  for (size_t i = 0; i + 2 < source.indices.size(); i += 3) {
+    const uint32_t* triangle = &source.indices[i];
+    if (triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2]) {
+      finest.indices.insert(finest.indices.end(), triangle, triangle + 3);
+    }
+  }
+
+  std::vector<SimplifiedLod> chain;
+  uint32_t max_lods = std::max(options.max_lods, 1u);
+
+  if (max_lods > 1 && finest.indices.size() / 3 >= options.min_lod_triangles) {
+    chain = simplify(positions, finest.indices, max_lods - 1, options.min_lod_triangles);
+  }
+
+  chain.insert(chain.begin(), std::move(finest));
+
+  std::vector<uint32_t> markers(source_vertex_count, UINT32_MAX);
+  std::vector<uint8_t> locals(source_vertex_count);
+
+  for (auto& lod : chain) {
+    std::vector<uint32_t> ordered = optimize_vertex_cache(lod.indices, source_vertex_count);
+
+    MeshLod entry = {
+      .first_index = (uint32_t)mesh.indices.size(),
+      .index_count = (uint32_t)ordered.size(),
+      .first_meshlet = (uint32_t)mesh.meshlets.size(),
+      .error = lod.error,
+    };
+
+    build_meshlets(ordered.data(), (uint32_t)ordered.size(), entry.first_index, markers, locals, mesh);
+    entry.meshlet_count = (uint32_t)mesh.meshlets.size() - entry.first_meshlet;
+
+    mesh.indices.insert(mesh.indices.end(), ordered.begin(), ordered.end());
+    mesh.lods.push_back(entry);
+  }
+
+  for (auto& meshlet : mesh.meshlets) {
+    mesh.meshlet_bounds.push_back(meshlet_bounds(positions, &mesh.indices[meshlet.first_index], meshlet));
+  }
+
+  // Vertices in the order the finest LOD first uses them; coarser LODs only
+  // use a subset. Unreferenced vertices are dropped.
+  std::vector<uint32_t> remap(source_vertex_count, UINT32_MAX);
+
+  for (uint32_t& index : mesh.indices) {
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = (uint32_t)mesh.vertices.size();
+
+      const float* p = &positions[index * 3];
+      mesh.vertices.push_back(MeshVertex {
+        .position_xy = snorm16(p[0]) | snorm16(p[1]) << 16,
+        .position_z = snorm16(p[2]),
+        .color = source.colors[index],
+      });
+    }
+
+    index = remap[index];
+  }
+
+  for (uint32_t& vertex : mesh.meshlet_vertices) {
+    vertex = remap[vertex];
+  }
+
+  mesh.header = MeshFileHeader {
+    .magic = mesh_file_magic,
+    .version = mesh_file_version,
+    .vertex_count = (uint32_t)mesh.vertices.size(),
+    .index_count = (uint32_t)mesh.indices.size(),
+    .index_size = mesh.vertices.size() <= 65536 ? 2u : 4u,
+    .lod_count = (uint32_t)mesh.lods.size(),
+    .meshlet_count = (uint32_t)mesh.meshlets.size(),
+    .meshlet_vertex_count = (uint32_t)mesh.meshlet_vertices.size(),
+    .center = { center[0], center[1], center[2] },
+    .radius = radius,
+  };
+
+  return mesh;
+}
+
+bool write_cooked_mesh(const char* path, const CookedMesh& mesh) {
+  std::vector<uint16_t> short_indices;
+  const void* index_data = mesh.indices.data();
+
+  if (mesh.header.index_size == 2) {
+    short_indices.assign(mesh.indices.begin(), mesh.indices.end());
+    index_data = short_indices.data();
+  }
+
+  struct Payload {
+    MeshChunkType type;
+    const void* data;
+    uint64_t size;
+  };
+
+  Payload payloads[] = {
+    { MeshChunkType::Vertices, mesh.vertices.data(), mesh.vertices.size() * sizeof(MeshVertex) },
+    { MeshChunkType::Indices, index_data, (uint64_t)mesh.indices.size() * mesh.header.index_size },
+    { MeshChunkType::Lods, mesh.lods.data(), mesh.lods.size() * sizeof(MeshLod) },
+    { MeshChunkType::Meshlets, mesh.meshlets.data(), mesh.meshlets.size() * sizeof(MeshMeshlet) },
+    { MeshChunkType::MeshletBounds, mesh.meshlet_bounds.data(), mesh.meshlet_bounds.size() * sizeof(MeshMeshletBounds) },
+    { MeshChunkType::MeshletVertices, mesh.meshlet_vertices.data(), mesh.meshlet_vertices.size() * sizeof(uint32_t) },
+    { MeshChunkType::MeshletTriangles, mesh.meshlet_triangles.data(), mesh.meshlet_triangles.size() },
+  };
+
+  MeshFileHeader header = mesh.header;
+  header.chunk_count = (uint32_t)std::size(payloads);
+
+  auto align = [](uint64_t offset) { return (offset + mesh_chunk_alignment - 1) & ~(uint64_t)(mesh_chunk_alignment - 1); };
+
+  std::vector<MeshChunk> chunks;
+  uint64_t offset = align(sizeof(MeshFileHeader) + std::size(payloads) * sizeof(MeshChunk));
+
+  for (auto& payload : payloads) {
+    chunks.push_back(MeshChunk { .type = payload.type, .offset = offset, .size = payload.size });
+    offset = align(offset + payload.size);
+  }
+
+  std::vector<uint8_t> file(offset);
+  memcpy(file.data(), &header, sizeof(MeshFileHeader));
+  memcpy(file.data() + sizeof(MeshFileHeader), chunks.data(), chunks.size() * sizeof(MeshChunk));
+
+  for (auto i : Range<size_t>(chunks.size())) {
+    if (payloads[i].size) {
+      memcpy(file.data() + chunks[i].offset, payloads[i].data, payloads[i].size);
+    }
+  }
+
+  FILE* out = fopen(path, "wb");
+  if (!out) {
+    return false;
+  }
+
+  bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+  return fclose(out) == 0 && ok;
+}
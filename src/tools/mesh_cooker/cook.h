@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "engine/mesh_format.h"
+#include "obj.h"
+
+// Everything a cooked mesh file holds, with indices kept 32 bit until written
+struct CookedMesh {
+  MeshFileHeader header;
+  std::vector<MeshVertex> vertices;
+  std::vector<uint32_t> indices;
+  std::vector<MeshLod> lods;
+  std::vector<MeshMeshlet> meshlets;
+  std::vector<MeshMeshletBounds> meshlet_bounds;
+  std::vector<uint32_t> meshlet_vertices;
+  std::vector<uint8_t> meshlet_triangles;
+};
+
+struct CookOptions {
+  uint32_t max_lods = mesh_max_lods;
+  uint32_t min_lod_triangles = 64; // No coarser LOD is made once one has fewer
+};
+
+// Quantizes, builds the LOD chain, orders each LOD's triangles for the vertex
+// cache, cuts them into meshlets with bounds and normal cones and orders
+// vertices by first use
+CookedMesh cook_mesh(const SourceMesh& source, const CookOptions& options = {});
+bool write_cooked_mesh(const char* path, const CookedMesh& mesh);
+
+// Vertices transformed per triangle with a FIFO cache of 'cache_size' entries;
+// 3 is the worst possible and 0.5 is typical of a well ordered regular mesh
+float average_cache_miss_ratio(const uint32_t* indices, size_t index_count, uint32_t vertex_count, uint32_t cache_size = 16);
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "cook.h"
+#include "engine/base.h"
+
+// Usage: mesh_cooker INPUT.obj OUTPUT.vmesh [--lods N]
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s INPUT.obj OUTPUT.vmesh [--lods N]\n", argv[0]);
+    return 1;
+  }
+
+  const char* input = argv[1];
+  const char* output = argv[2];
+  CookOptions options = {};
+
+  for (int i = 3; i < argc; i += 2) {
+    if (i + 1 >= argc) {
+      fprintf(stderr, "Missing value for '%s'\n", argv[i]);
+      return 1;
+    }
+
+    if (!strcmp(argv[i], "--lods")) {
+      options.max_lods = (uint32_t)strtoul(argv[i + 1], nullptr, 10);
+    }
+    else {
+      fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  if (!options.max_lods || options.max_lods > mesh_max_lods) {
+    fprintf(stderr, "LOD count must be between 1 and %u\n", mesh_max_lods);
+    return 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+
+  std::optional<SourceMesh> source = load_obj(input);
+  if (!source) {
+    fprintf(stderr, "Failed to read '%s'\n", input);
+    return 1;
+  }
+
+  if (source->positions.empty() || source->indices.empty()) {
+    fprintf(stderr, "'%s' has no triangles to cook\n", input);
+    return 1;
+  }
+
+  uint32_t source_vertex_count = (uint32_t)source->positions.size() / 3;
+  float source_acmr = average_cache_miss_ratio(source->indices.data(), source->indices.size(), source_vertex_count);
+
+  CookedMesh mesh = cook_mesh(*source, options);
+
+  // The loader rejects empty meshes, and cooking drops degenerate triangles,
+  // which may be all of them
+  if (!mesh.header.vertex_count || !mesh.header.index_count) {
+    fprintf(stderr, "'%s' has no triangles to cook\n", input);
+    return 1;
+  }
+
+  if (!write_cooked_mesh(output, mesh)) {
+    fprintf(stderr, "Failed to write '%s'\n", output);
+    return 1;
+  }
+
+  double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  printf("%s: %u vertices, %zu triangles, cooked in %.1f ms\n", input, source_vertex_count, source->indices.size() / 3, ms);
+  printf("%5s %10s %10s %10s %10s\n", "lod", "triangles", "meshlets", "error", "ACMR");
+
+  for (auto i : Range<uint32_t>(mesh.header.lod_count)) {
+    const MeshLod& lod = mesh.lods[i];
+    float acmr = average_cache_miss_ratio(&mesh.indices[lod.first_index], lod.index_count, mesh.header.vertex_count);
+    printf("%5u %10u %10u %10.5f %10.3f\n", i, lod.index_count / 3, lod.meshlet_count, lod.error, acmr);
+  }
+
+  printf("Source ACMR %.3f; %u vertices, %u byte indices\n", source_acmr, mesh.header.vertex_count, mesh.header.index_size);
+  return 0;
+}
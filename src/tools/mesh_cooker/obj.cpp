@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include "obj.h"
+
+static const char* skip_spaces(const char* p, const char* end) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+
+  return p;
+}
+
+static const char* next_line(const char* p, const char* end) {
+  while (p < end && *p != '\n') {
+    p++;
+  }
+
+  return p < end ? p + 1 : end;
+}
+
+static uint32_t pack_color(float r, float g, float b) {
+  auto unorm = [](float v) { return (uint32_t)std::lround(std::clamp(v, 0.0f, 1.0f) * 255.0f); };
+  return unorm(r) | unorm(g) << 8 | unorm(b) << 16 | 255u << 24;
+}
+
+std::optional<SourceMesh> load_obj(const char* path) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    return std::nullopt;
+  }
+
+  fseek(file, 0, SEEK_END);
+  size_t len = ftell(file);
+  rewind(file);
+
+  // Terminated so strtof and strtol always stop inside the buffer
+  std::vector<char> text(len + 1);
+  size_t read = fread(text.data(), 1, len, file);
+  fclose(file);
+
+  if (read != len) {
+    return std::nullopt;
+  }
+
+  SourceMesh mesh;
+  std::vector<int64_t> polygon;
+
+  const char* end = text.data() + len;
+
+  for (const char* p = text.data(); p < end; p = next_line(p, end)) {
+    p = skip_spaces(p, end);
+
+    if (p + 1 < end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+      float values[6] = { 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f };
+      const char* q = p + 1;
+
+      for (auto& value : values) {
+        // strtof would skip the newline too
+        q = skip_spaces(q, end);
+        if (q == end || *q == '\n') {
+          break;
+        }
+
+        char* value_end;
+        float v = strtof(q, &value_end);
+
+        if (value_end == q) {
+          break;
+        }
+
+        value = v;
+        q = value_end;
+      }
+
+      mesh.positions.insert(mesh.positions.end(), values, values + 3);
+      mesh.colors.push_back(pack_color(values[3], values[4], values[5]));
+    }
+    else if (p + 1 < end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+      polygon.clear();
+      const char* q = skip_spaces(p + 1, end);
+
+      while (q < end && *q != '\n') {
+        char* index_end;
+        long index = strtol(q, &index_end, 10);
+
+        if (index_end == q) {
+          break;
+        }
+
+        // Negative indices count back from the last vertex so far
+        int64_t vertex_count = (int64_t)mesh.positions.size() / 3;
+        int64_t vertex = index < 0 ? vertex_count + index : index - 1;
+
+        if (vertex < 0 || vertex >= vertex_count) {
+          return std::nullopt;
+        }
+
+        polygon.push_back(vertex);
+
+        // Skip '/vt/vn'
+        q = index_end;
+        while (q < end && *q != ' ' && *q != '\t' && *q != '\r' && *q != '\n') {
+          q++;
+        }
+
+        q = skip_spaces(q, end);
+      }
+
+      for (size_t i = 2; i < polygon.size(); i++) {
+        mesh.indices.push_back((uint32_t)polygon[0]);
+        mesh.indices.push_back((uint32_t)polygon[i - 1]);
+        mesh.indices.push_back((uint32_t)polygon[i]);
+      }
+    }
+  }
+
+  return mesh;
+}
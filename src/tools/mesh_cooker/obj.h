@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Triangulated geometry as it comes out of a source file
+struct SourceMesh {
+  std::vector<float> positions; // xyz per vertex
+  std::vector<uint32_t> colors; // RGBA8 per vertex, white when the file has none
+  std::vector<uint32_t> indices;
+};
+
+// Wavefront OBJ: 'v x y z [r g b]' and 'f' lines, whose polygons are fanned
+// into triangles. Texture coordinates and normals are skipped. Returns nullopt
+// when the file can't be read or references vertices it doesn't have.
+std::optional<SourceMesh> load_obj(const char* path);